@@ -86,6 +86,10 @@ void MainScene::onActivate() {
   floor_node->setIsTerrain(true);
   cube_node->setIsTerrain(true);
 
+  // The terrain never changes, so its draws are recorded once and replayed every frame
+  floor_node->setStatic(true);
+  cube_node->setStatic(true);
+
   root_node->updateTransformation();
 }
 
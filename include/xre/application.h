@@ -20,7 +20,8 @@
 
 class Application {
 public:
-  Application(const char *application_name);
+  // The number of frames in flight trades latency for fewer stalls of the CPU on the GPU
+  Application(const char *application_name, uint32_t frames_in_flight = VulkanHandler::DEFAULT_FRAMES_IN_FLIGHT);
   ~Application();
 
   void run();
@@ -7,28 +7,33 @@
 #include <xre/utils.h>
 #include <xre/structs.h>
 #include <xre/vulkan_utils.h>
+#include <xre/memory_allocator.h>
 
 // Other includes
 #include <stb_image.h>
+#include <cassert>
 
 class Buffer {
 public:
-  Buffer(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize size, VkBufferUsageFlags buffer_usage_flags);
+  // Buffers are host visible by default, which is what we want for data which changes every frame. Static
+  // data should use VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT and be uploaded with the `UploadManager`.
+  Buffer(MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags buffer_usage_flags,
+         VkMemoryPropertyFlags memory_property_flags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
   void destroy();
   VkBuffer getBuffer();
   void loadData(std::vector<Vertex> input);
   void loadData(std::vector<uint16_t> input);
-  void loadData(ModelUniformBufferObject input, VkDeviceSize offset);
   void loadData(GlobalUniformBufferObject input);
   void loadData(stbi_uc *input);
+  void *mapPersistently();
 
 private:
   VkDevice m_device = nullptr;
   VkBuffer m_buffer = nullptr;
-  VkDeviceMemory m_device_memory = nullptr;
+  MemoryAllocator *m_allocator = nullptr;
+  MemoryAllocation m_allocation;
   VkDeviceSize m_size = 0u;
 
   void *map();
-  void unmap();
-};
\ No newline at end of file
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+// Scoped CPU timers, which are only compiled in if XRE_ENABLE_PROFILER is defined (see the option of the
+// same name in CMakeLists.txt). Without it, the macros expand to nothing, so the instrumentation can stay
+// in place without any cost.
+//
+// Usage:
+//   XRE_PROFILE_SCOPE("Update simulation"); // Times the rest of the enclosing block
+//   XRE_PROFILE_FUNCTION();                 // Same, named after the enclosing function
+//   XRE_PROFILE_THREAD("Worker");           // Names the calling thread in the trace
+//   XRE_PROFILE_WRITE_TRACE("trace.json");  // Dumps all recorded events as Chrome trace JSON
+//
+// The trace can be opened in chrome://tracing or https://ui.perfetto.dev.
+#ifdef XRE_ENABLE_PROFILER
+
+// Other includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Records the events of each thread into a buffer of its own, such that recording needs neither locks
+// nor atomics read-modify-write operations: the owning thread is the only writer, and publishes the
+// events by storing the new count with release semantics. Once a buffer is full, the oldest events are
+// overwritten. Traces should be written while the other threads are idle (e.g. on shutdown), as events
+// which are overwritten during the export might be inconsistent.
+class CpuProfiler {
+public:
+  struct Event {
+    const char *name; // Needs to outlive the profiler, e.g. a string literal
+    uint64_t start_ns;
+    uint64_t end_ns;
+  };
+
+  // Times the enclosing scope
+  class Scope {
+  public:
+    explicit Scope(const char *name) : m_name(name), m_start_ns(now()) {}
+    ~Scope() { record(m_name, m_start_ns, now()); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    const char *m_name;
+    uint64_t m_start_ns;
+  };
+
+  static uint64_t now();
+  static void record(const char *name, uint64_t start_ns, uint64_t end_ns);
+  static void setThreadName(const char *name);
+  static bool writeChromeTrace(const std::string &path);
+
+  // Number of events kept per thread
+  static constexpr uint32_t EVENTS_PER_THREAD = 1u << 16;
+
+private:
+  struct ThreadBuffer {
+    std::vector<Event> events = std::vector<Event>(EVENTS_PER_THREAD);
+    std::atomic<uint64_t> count = 0u; // Total number of recorded events, the buffer keeps the last ones
+    uint32_t thread_id = 0u;
+    std::string thread_name; // Copied, as the thread might be gone when the trace is written
+  };
+
+  static ThreadBuffer &threadBuffer();
+
+  // Buffers of all threads which recorded events. They're never freed, as the events of threads which
+  // already finished should still show up in the trace.
+  inline static std::mutex s_buffers_mutex;
+  inline static std::vector<ThreadBuffer *> s_buffers;
+  inline static const std::chrono::steady_clock::time_point s_start_time = std::chrono::steady_clock::now();
+};
+
+#define XRE_PROFILE_CONCAT_INNER(a, b) a##b
+#define XRE_PROFILE_CONCAT(a, b) XRE_PROFILE_CONCAT_INNER(a, b)
+#define XRE_PROFILE_SCOPE(name) CpuProfiler::Scope XRE_PROFILE_CONCAT(xre_profile_scope_, __LINE__)(name)
+#define XRE_PROFILE_FUNCTION() XRE_PROFILE_SCOPE(__func__)
+#define XRE_PROFILE_THREAD(name) CpuProfiler::setThreadName(name)
+#define XRE_PROFILE_WRITE_TRACE(path) CpuProfiler::writeChromeTrace(path)
+
+#else
+
+#define XRE_PROFILE_SCOPE(name)
+#define XRE_PROFILE_FUNCTION()
+#define XRE_PROFILE_THREAD(name)
+#define XRE_PROFILE_WRITE_TRACE(path)
+
+#endif
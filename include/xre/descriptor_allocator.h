@@ -0,0 +1,47 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+
+// Other includes
+#include <vector>
+#include <algorithm>
+
+// Allocates descriptor sets from a chain of pools. Once the current pool runs out, the next free pool is
+// used, and a new (larger) pool is only created if there is none left. Resetting the allocator resets all
+// pools at once and keeps them around for the next allocations, e.g. when a scene is torn down or a frame
+// slot is reused.
+class DescriptorAllocator {
+public:
+  DescriptorAllocator(VkDevice device, const char *name, const std::vector<VkDescriptorPoolSize> &set_sizes, uint32_t sets_per_pool);
+
+  void destroy();
+  VkDescriptorSet allocate(VkDescriptorSetLayout layout);
+  void reset();
+
+  DescriptorAllocatorStatistics getStatistics();
+
+  // Pools grow up to this number of sets, allocators which need more simply chain more pools of that size
+  static constexpr uint32_t MAX_SETS_PER_POOL = 4096;
+
+private:
+  VkDevice m_device = VK_NULL_HANDLE;
+
+  // Descriptors of each type needed by a single set, scaled by the number of sets of a pool
+  std::vector<VkDescriptorPoolSize> m_set_sizes;
+  uint32_t m_sets_per_pool = 0u;
+
+  VkDescriptorPool m_current_pool = VK_NULL_HANDLE;
+  std::vector<VkDescriptorPool> m_used_pools; // Full pools since the last reset
+  std::vector<VkDescriptorPool> m_free_pools; // Pools which were reset and can be reused
+
+  uint32_t m_allocated_sets = 0u; // Sets allocated since the last reset
+  DescriptorAllocatorStatistics m_statistics;
+
+  VkDescriptorPool acquirePool();
+  VkDescriptorPool createPool();
+};
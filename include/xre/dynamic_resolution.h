@@ -0,0 +1,53 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// Other includes
+#include <cstdint>
+
+// Picks the scale of the rendered resolution from the measured GPU time of the frames, such that heavy
+// scenes lose some sharpness instead of dropping frames. The (smoothed) GPU time is compared against the
+// frame budget: above the upper threshold the scale is lowered, below the lower threshold it is raised
+// again. The band in between keeps the scale stable, and each step needs the time to stay outside of
+// the band for a number of frames, such that a single spike doesn't change the resolution.
+class DynamicResolution {
+public:
+  DynamicResolution(float min_scale = MIN_SCALE, float max_scale = MAX_SCALE);
+
+  // Feed the GPU time of a frame along with the time available per frame (both in milliseconds)
+  void update(double gpu_time_ms, double frame_budget_ms);
+
+  float getScale() const;
+  VkExtent2D scaleExtent(VkExtent2D extent) const;
+
+  // Bounds of the scale (per axis)
+  static constexpr float MIN_SCALE = 0.6f;
+  static constexpr float MAX_SCALE = 1.0f;
+
+  // Change of the scale per step
+  static constexpr float SCALE_STEP = 0.05f;
+
+  // Fractions of the frame budget below which the scale is raised, and above which it is lowered
+  static constexpr double RAISE_THRESHOLD = 0.75;
+  static constexpr double LOWER_THRESHOLD = 0.9;
+
+  // Number of consecutive frames outside of the band before a step is taken. Lowering reacts faster,
+  // as a frame above the budget is dropped while one below it only wastes some headroom.
+  static constexpr uint32_t RAISE_FRAMES = 30;
+  static constexpr uint32_t LOWER_FRAMES = 5;
+
+  // Weight of the newest frame in the smoothed GPU time
+  static constexpr double SMOOTHING = 0.2;
+
+  // The scaled extents are rounded down to a multiple of this (but never below it)
+  static constexpr uint32_t EXTENT_ALIGNMENT = 8;
+
+private:
+  float m_min_scale;
+  float m_max_scale;
+  float m_scale;
+  double m_smoothed_gpu_time_ms = 0.0;
+  uint32_t m_frames_above = 0u;
+  uint32_t m_frames_below = 0u;
+};
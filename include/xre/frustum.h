@@ -0,0 +1,54 @@
+#pragma once
+
+// OpenXR includes
+#include <open_xr/openxr.h>
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/glm/gtx/quaternion.hpp>
+
+// XRe includes
+#include <xre/object_oriented_bounding_box.h>
+
+// Other includes
+#include <array>
+#include <limits>
+#include <algorithm>
+
+// Axis aligned box in world space, used for the cached bounds of scene graph subtrees
+struct AABB {
+  glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+  glm::vec3 max = glm::vec3(std::numeric_limits<float>::lowest());
+
+  bool isEmpty() const { return min.x > max.x; }
+
+  void extend(const glm::vec3 &point) {
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+  }
+
+  void extend(const AABB &other) {
+    if (!other.isEmpty()) {
+      extend(other.min);
+      extend(other.max);
+    }
+  }
+};
+
+// View frustum in world space, consisting of the side planes and the far plane. The near plane is left
+// out, as the side planes already reject everything behind the eye.
+class Frustum {
+public:
+  static Frustum fromView(const XrView &view, const glm::vec3 &current_origin, float far_clip);
+  static Frustum fromStereoViews(const XrView &left_view, const XrView &right_view, const glm::vec3 &current_origin, float far_clip);
+
+  bool intersects(const AABB &box) const;
+  bool intersects(OOBB box) const;
+
+private:
+  Frustum(const glm::vec3 &position, const glm::quat &orientation, const XrFovf &fov, float far_clip);
+
+  // Left, right, bottom, top and far plane, with the normals pointing inside
+  std::array<glm::vec4, 5> m_planes;
+};
@@ -20,6 +20,8 @@ inline glm::mat4 poseToMatrix(const XrPosef &pose, const glm::vec3 &current_orig
   return glm::inverse(translation * rotation);
 }
 
+// Projection for Vulkan clip space, i.e. depth ranges from 0 at the near to 1 at the far plane. The depth
+// submitted to the compositor relies on this mapping.
 inline glm::mat4 createProjectionMatrix(XrFovf fov, float near_clip, float far_clip) {
   const float left = glm::tan(fov.angleLeft);
   const float right = glm::tan(fov.angleRight);
@@ -32,8 +34,8 @@ inline glm::mat4 createProjectionMatrix(XrFovf fov, float near_clip, float far_c
   glm::mat4 projection_matrix;
   projection_matrix[0] = {2.0f / width, 0.0f, 0.0f, 0.0f};
   projection_matrix[1] = {0.0f, 2.0f / height, 0.0f, 0.0f};
-  projection_matrix[2] = {(right + left) / width, (up + down) / height, -(far_clip + near_clip) / (far_clip - near_clip), -1.0f};
-  projection_matrix[3] = {0.0f, 0.0f, -(far_clip * (near_clip + near_clip)) / (far_clip - near_clip), 0.0f};
+  projection_matrix[2] = {(right + left) / width, (up + down) / height, -far_clip / (far_clip - near_clip), -1.0f};
+  projection_matrix[3] = {0.0f, 0.0f, -(far_clip * near_clip) / (far_clip - near_clip), 0.0f};
   return projection_matrix;
 }
 
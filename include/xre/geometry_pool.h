@@ -0,0 +1,59 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+#include <xre/buffer.h>
+#include <xre/memory_allocator.h>
+#include <xre/upload_manager.h>
+
+// Other includes
+#include <vector>
+
+// Holds the geometry of many meshes in a few large, device local vertex and index buffers. A mesh
+// only gets a range within these buffers, which is drawn using `vertexOffset` and `firstIndex`. As
+// long as consecutive draws use the same page, the buffers don't need to be bound again. Freed ranges
+// are only handed out again once the frames which might still draw them are done.
+class GeometryPool {
+public:
+  GeometryPool(MemoryAllocator *allocator, UploadManager *upload_manager, uint32_t frame_count);
+
+  GeometryRange allocate(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices);
+  void free(const GeometryRange &range);
+  void beginFrame();
+  void destroy();
+
+  // Size of the vertex and index buffers of a page
+  static constexpr uint32_t PAGE_VERTEX_COUNT = 512u * 1024u;
+  static constexpr uint32_t PAGE_INDEX_COUNT = 2u * 1024u * 1024u;
+
+private:
+  // Unused range of the vertices or indices of a page
+  struct FreeBlock {
+    uint32_t offset;
+    uint32_t count;
+    uint64_t reusable_frame; // First frame in which no frame in flight can draw the block anymore
+  };
+
+  struct Page {
+    Buffer *vertex_buffer;
+    Buffer *index_buffer;
+    std::vector<FreeBlock> free_vertices; // Sorted by offset, adjacent blocks are merged
+    std::vector<FreeBlock> free_indices;
+  };
+
+  MemoryAllocator *m_allocator = nullptr;
+  UploadManager *m_upload_manager = nullptr;
+  std::vector<Page> m_pages;
+
+  uint32_t m_frame_count = 0u;
+  uint64_t m_frame = 0u; // Number of frames started so far
+
+  Page &createPage(uint32_t vertex_capacity, uint32_t index_capacity);
+  int32_t findBlock(const std::vector<FreeBlock> &blocks, uint32_t count);
+  uint32_t takeBlock(std::vector<FreeBlock> &blocks, int32_t block, uint32_t count);
+  void insertBlock(std::vector<FreeBlock> &blocks, uint32_t offset, uint32_t count);
+};
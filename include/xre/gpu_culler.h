@@ -0,0 +1,72 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+#include <xre/buffer.h>
+#include <xre/memory_allocator.h>
+#include <xre/object_oriented_bounding_box.h>
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+
+// Other includes
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+
+// GPU-driven path of the render queue. The objects and bounding boxes of the draws are stored in storage
+// buffers, and a compute pass culls them against the frusta of all views. The visible draws are written
+// as indirect commands, compacted per batch, such that each batch is drawn with a single
+// vkCmdDrawIndexedIndirectCount.
+class GpuCuller {
+public:
+  GpuCuller(VkDevice device, MemoryAllocator *allocator, VkPipelineCache pipeline_cache, const std::string &shader_path,
+            uint32_t frame_count);
+
+  void destroy();
+  void beginFrame(uint32_t frame_index, const std::vector<glm::mat4> &view_projections);
+  bool addDraw(const glm::mat4 &world, const glm::vec3 &color, uint32_t texture_index, const OOBB &bounds, const GeometryRange &geometry,
+               uint32_t batch, uint32_t first_command);
+  void dispatch(VkCommandBuffer command_buffer);
+  void drawBatch(VkCommandBuffer command_buffer, uint32_t batch, uint32_t first_command, uint32_t max_draw_count);
+
+  VkBuffer getObjectBuffer(uint32_t frame_index);
+
+  // Maximum number of draws and batches per frame, draws beyond that fall back to the CPU path
+  static constexpr uint32_t MAX_DRAWS = 16384u;
+  static constexpr uint32_t MAX_BATCHES = 1024u;
+
+private:
+  struct Frame {
+    Buffer *object_buffer;
+    GpuObjectData *objects;
+    Buffer *draw_buffer;
+    GpuDrawData *draws;
+    Buffer *frustum_buffer;
+    GpuCullFrustum *frustum;
+    Buffer *command_buffer; // Indirect draw commands written by the culling pass
+    Buffer *count_buffer;   // Number of visible draws per batch
+    VkDescriptorSet descriptor_set;
+  };
+
+  static constexpr uint32_t WORKGROUP_SIZE = 64u;
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  std::vector<Frame> m_frames;
+  uint32_t m_current_frame = 0u;
+  uint32_t m_draw_count = 0u;
+  uint32_t m_batch_count = 0u;
+
+  VkDescriptorSetLayout m_descriptor_set_layout = VK_NULL_HANDLE;
+  VkDescriptorPool m_descriptor_pool = VK_NULL_HANDLE;
+  VkPipelineLayout m_pipeline_layout = VK_NULL_HANDLE;
+  VkPipeline m_pipeline = VK_NULL_HANDLE;
+
+  void createPipeline(VkPipelineCache pipeline_cache, const std::string &shader_path);
+  void createFrame(Frame &frame, MemoryAllocator *allocator);
+};
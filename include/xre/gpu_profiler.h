@@ -0,0 +1,110 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+
+// Other includes
+#include <vector>
+#include <array>
+#include <map>
+#include <string>
+
+// Rolling averages of a profiler scope over the last GpuProfiler::ROLLING_WINDOW samples
+struct GpuScopeStatistics {
+  std::string name;
+  uint32_t samples = 0u;             // Number of samples in the window
+  double gpu_time_ms = 0.0;          // Average GPU time of the scope
+  double vertex_invocations = 0.0;   // Average vertex shader invocations (only with pipeline statistics)
+  double fragment_invocations = 0.0; // Average fragment shader invocations (only with pipeline statistics)
+};
+
+// Measures the GPU time of named scopes of the command buffers with timestamp queries, and optionally
+// the shader invocations with pipeline statistics queries. Each frame in flight has its own range of
+// queries, which is only read back once the slot is reused (i.e. after its fence was waited on), such
+// that the CPU never stalls on the results.
+//
+// Within a multiview render pass, every query uses one index per view, so each scope reserves that
+// many queries. Only one pipeline statistics query can be active at a time, so scopes asking for
+// statistics may not be nested.
+class GpuProfiler {
+public:
+  GpuProfiler(VkDevice device, uint32_t frame_count, double timestamp_period, uint64_t timestamp_mask, bool pipeline_statistics,
+              uint32_t view_count);
+
+  void destroy();
+
+  // Read the results of the frame which previously used the slot, and reset its queries. Needs to be
+  // recorded outside of a render pass, before any scope of the frame.
+  void beginFrame(VkCommandBuffer command_buffer, uint32_t frame_index);
+
+  // Scopes begun inside a render pass need to end in the same subpass. Returns the id to end the scope
+  // with, or NO_SCOPE if the frame ran out of scopes.
+  uint32_t beginScope(VkCommandBuffer command_buffer, const char *name, bool inside_render_pass = false,
+                      bool pipeline_statistics = false);
+  void endScope(VkCommandBuffer command_buffer, uint32_t scope);
+
+  // Scopes spanning multiple command buffers, which are recorded on other threads (e.g. the secondary
+  // command buffers of the parallel recording), are reserved up front on the thread recording the frame.
+  // Their timestamps are then written into the first and last command buffer, which only reads the
+  // profiler and can be done from any thread. These scopes can't have pipeline statistics, as a query
+  // can't span command buffers.
+  uint32_t reserveScope(const char *name, bool inside_render_pass = false);
+  void writeScopeTimestamp(VkCommandBuffer command_buffer, uint32_t scope, bool end);
+
+  std::vector<GpuScopeStatistics> getStatistics();
+
+  // GPU time (in milliseconds) of the outermost scopes of all frames read back since the last call,
+  // along with the number of these frames
+  double takeCompletedFrameTime(uint32_t &frame_count);
+
+  static constexpr uint32_t MAX_SCOPES_PER_FRAME = 32u;
+  static constexpr uint32_t ROLLING_WINDOW = 120u;
+  static constexpr uint32_t NO_SCOPE = UINT32_MAX;
+
+private:
+  struct Scope {
+    const char *name;
+    uint32_t depth;       // Number of scopes this one is nested in
+    uint32_t query_count; // Queries used per query, the view count inside a multiview render pass
+    bool pipeline_statistics;
+  };
+
+  struct Frame {
+    std::vector<Scope> scopes;
+    uint32_t open_scopes = 0u;
+    bool recorded = false;
+  };
+
+  struct Sample {
+    double gpu_time_ms;
+    uint64_t vertex_invocations;
+    uint64_t fragment_invocations;
+  };
+
+  struct RollingWindow {
+    std::array<Sample, ROLLING_WINDOW> samples;
+    uint32_t count = 0u;
+    uint32_t next = 0u;
+  };
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkQueryPool m_timestamp_pool = VK_NULL_HANDLE;
+  VkQueryPool m_statistics_pool = VK_NULL_HANDLE; // Only created with pipeline statistics
+  double m_timestamp_period;                      // Nanoseconds per timestamp tick
+  uint64_t m_timestamp_mask;                      // Valid bits of the timestamps
+  uint32_t m_view_count;
+
+  std::vector<Frame> m_frames;
+  uint32_t m_current_frame = 0u;
+
+  std::map<std::string, RollingWindow> m_windows;
+  double m_completed_frame_time_ms = 0.0;
+  uint32_t m_completed_frames = 0u;
+
+  void readResults(uint32_t frame_index);
+  uint32_t timestampQuery(uint32_t frame_index, uint32_t scope, bool end);
+  uint32_t statisticsQuery(uint32_t frame_index, uint32_t scope);
+};
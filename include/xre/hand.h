@@ -37,6 +37,10 @@ public:
 
 private:
   std::shared_ptr<SceneNode> m_hand_root_node;
+
+  // The joints are drawn as instances of a single cube. The joint nodes are not rendered, they only
+  // share a cube model to compute the interactions with the scene.
+  std::shared_ptr<InstancedModel> m_joint_instances;
   std::vector<std::shared_ptr<SceneNode>> m_joint_nodes;
 
   bool m_pinching = false;
@@ -0,0 +1,59 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+#include <xre/mesh.h>
+#include <xre/material.h>
+#include <xre/buffer.h>
+#include <xre/vulkan_handler.h>
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+
+// Other includes
+#include <vector>
+#include <memory>
+#include <cstring>
+
+// Draws many copies of a single mesh with a single instanced draw. Each instance has its own transform
+// (relative to the scene node of the model) and color. The instance data is copied into a persistently
+// mapped buffer with one region per frame in flight, so an instanced model must only be added to a
+// single scene node.
+class InstancedModel {
+public:
+  InstancedModel(Mesh mesh, std::shared_ptr<Material> material, uint32_t max_instances, std::shared_ptr<VulkanHandler> vulkan_handler);
+  ~InstancedModel();
+
+  // Add an instance and return its index
+  uint32_t addInstance(const glm::mat4 &transform, glm::vec3 color);
+  void setInstanceTransform(uint32_t index, const glm::mat4 &transform);
+  void setInstanceColor(uint32_t index, glm::vec3 color);
+  void clearInstances();
+  uint32_t getInstanceCount();
+
+  // Changes whenever the instances change, such that static subtrees know when to record their draws again
+  uint64_t getGeneration();
+
+private:
+  Mesh m_mesh;
+  std::shared_ptr<Material> m_material;
+  std::shared_ptr<VulkanHandler> m_vulkan_handler;
+
+  // Instance data, with the transforms relative to the scene node
+  std::vector<InstanceData> m_instances;
+  uint32_t m_max_instances;
+  uint64_t m_generation = 0u;
+
+  // Buffer holding the instance data of all frames in flight
+  Buffer *m_instance_buffer = nullptr;
+  uint8_t *m_mapped_instance_data = nullptr;
+
+  void render(RenderContext &ctx, glm::mat4 scene_node_transform);
+
+  // Scene Node can call render() directly
+  friend class SceneNode;
+};
@@ -10,28 +10,56 @@
 
 // Other includes
 #include <memory>
+#include <string>
+#include <filesystem>
 
 class Material {
 public:
-  Material(const std::string &vert_path, const std::string &frag_path, bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler);
+  Material(const std::string &vert_path, const std::string &frag_path, bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler,
+           const PipelineState &pipeline_state = PipelineState{});
   Material(const std::string &vert_path, const std::string &frag_path, std::shared_ptr<Texture> texture,
-           bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler);
+           bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler, const PipelineState &pipeline_state = PipelineState{});
+  ~Material();
 
-  void bind();
-  Buffer *getUniformBuffer();
+  // The destructor releases the pipeline references, so copies would release them twice
+  Material(const Material &) = delete;
+  Material &operator=(const Material &) = delete;
+
+  VkPipeline getGraphicsPipeline();
+  VkPipeline getIndirectGraphicsPipeline();
+  VkPipeline getInstancedGraphicsPipeline();
   VkDescriptorSet getDescriptorset();
+  uint32_t getTextureIndex();
+  bool isTranslucent();
 
 private:
   std::shared_ptr<VulkanHandler> m_vulkan_handler;
 
-  VkPipeline m_graphics_pipeline;
+  VkPipeline m_graphics_pipeline; // Shared with all other materials using the same shaders and state
+
+  // Variant of the pipeline used for GPU-driven draws, if the vertex shader has one
+  VkPipeline m_indirect_graphics_pipeline = VK_NULL_HANDLE;
+
+  // Variant of the pipeline used for instanced draws, only created once it's used
+  VkPipeline m_instanced_graphics_pipeline = VK_NULL_HANDLE;
 
-  // Uniform buffer
-  Buffer *m_uniform_buffer = nullptr;
+  // Needed to create the pipeline variants
+  std::string m_vert_path;
+  std::string m_frag_path;
+  PipelineState m_pipeline_state;
+
+  // Whether the material blends, either because it was asked to or because its texture has alpha. Its
+  // draws are then sorted back to front after the opaque ones.
+  bool m_translucent = false;
 
   // Descriptor set
   VkDescriptorSet m_descriptor_set = nullptr;
 
-  // Optional texture
+  // Optional texture, and its slot in the bindless texture array (if enabled)
   std::shared_ptr<Texture> m_texture = nullptr;
+  uint32_t m_texture_index = 0u;
+
+  void acquireIndirectGraphicsPipeline();
+  std::string getDirectVertexShaderPath();
+  std::string getVariantShaderPath(const std::string &path, const std::string &variant);
 };
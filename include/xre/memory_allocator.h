@@ -0,0 +1,135 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+#include <xre/vulkan_utils.h>
+
+// Other includes
+#include <vector>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <mutex>
+#include <cassert>
+#include <algorithm>
+#include <tuple>
+
+// How allocations are placed within a block of device memory
+enum class AllocationStrategy {
+  BUDDY, // General purpose, allocations can be freed in any order
+  LINEAR // Allocations are bumped, and the block is reused once all of its allocations are freed
+};
+
+// Which kind of resource an allocation is for. Buffers and (optimally tiled) images live in separate
+// heaps, such that we never have to respect bufferImageGranularity between neighbouring allocations.
+enum class AllocationKind { BUFFER, IMAGE };
+
+class MemoryBlock;
+
+// A sub-allocation of a block of device memory
+struct MemoryAllocation {
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkDeviceSize offset = 0u;
+  VkDeviceSize size = 0u;
+  uint32_t memory_type_index = 0u;
+  void *mapped_data = nullptr; // Pointer to the start of the allocation if the memory is host visible
+  MemoryBlock *block = nullptr;  // nullptr for dedicated allocations
+};
+
+// Sub-allocates device memory out of large blocks, such that we stay far below maxMemoryAllocationCount
+// and don't pay the cost of vkAllocateMemory for every single resource. Each combination of memory
+// type, resource kind and strategy has its own heap of blocks. Host visible blocks are mapped once
+// for their whole lifetime.
+class MemoryAllocator {
+public:
+  MemoryAllocator(VkDevice device, VkPhysicalDevice physical_device);
+
+  void destroy();
+
+  MemoryAllocation allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags memory_property_flags, AllocationKind kind,
+                            AllocationStrategy strategy = AllocationStrategy::BUDDY);
+  void free(MemoryAllocation &allocation);
+
+  // Whether any of the allowed memory types has the given properties
+  bool hasMemoryType(uint32_t memory_type_bits, VkMemoryPropertyFlags memory_property_flags);
+
+  std::vector<MemoryHeapStatistics> getStatistics();
+
+  VkDevice getDevice();
+  VkPhysicalDevice getPhysicalDevice();
+
+  // Size of the blocks we sub-allocate from (needs to be a power of two for the buddy strategy)
+  static constexpr VkDeviceSize BLOCK_SIZE = 64ull * 1024 * 1024;
+
+  // Allocations of at least this size get their own VkDeviceMemory
+  static constexpr VkDeviceSize DEDICATED_ALLOCATION_THRESHOLD = BLOCK_SIZE / 4;
+
+private:
+  struct HeapKey {
+    uint32_t memory_type_index;
+    AllocationKind kind;
+    AllocationStrategy strategy;
+
+    bool operator<(const HeapKey &other) const {
+      return std::tie(memory_type_index, kind, strategy) < std::tie(other.memory_type_index, other.kind, other.strategy);
+    }
+  };
+
+  struct Heap {
+    std::vector<MemoryBlock *> blocks;
+  };
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkPhysicalDevice m_physical_device = VK_NULL_HANDLE;
+  VkPhysicalDeviceMemoryProperties m_memory_properties{};
+
+  std::map<HeapKey, Heap> m_heaps;
+  std::mutex m_mutex;
+
+  // Dedicated allocations per memory type
+  std::map<uint32_t, MemoryHeapStatistics> m_dedicated_statistics;
+
+  VkDeviceMemory allocateDeviceMemory(VkDeviceSize size, uint32_t memory_type_index, void **mapped_data);
+};
+
+// A single VkDeviceMemory, which is split up using one of the allocation strategies
+class MemoryBlock {
+public:
+  MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void *mapped_data, AllocationStrategy strategy);
+
+  bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+  void free(VkDeviceSize offset);
+  bool isEmpty();
+
+  VkDeviceMemory getMemory();
+  void *getMappedData();
+  VkDeviceSize getSize();
+  VkDeviceSize getUsedSize();
+  uint32_t getAllocationCount();
+
+private:
+  // Smallest allocation of the buddy strategy
+  static constexpr VkDeviceSize MIN_BUDDY_SIZE = 256u;
+
+  VkDeviceMemory m_memory = VK_NULL_HANDLE;
+  VkDeviceSize m_size = 0u;
+  void *m_mapped_data = nullptr;
+  AllocationStrategy m_strategy;
+
+  // Offset of each live allocation, mapped to its size (linear) or its order (buddy)
+  std::unordered_map<VkDeviceSize, VkDeviceSize> m_allocations;
+  VkDeviceSize m_used_size = 0u;
+
+  // Linear strategy: next free offset
+  VkDeviceSize m_linear_offset = 0u;
+
+  // Buddy strategy: free offsets per order, where order `n` has a size of MIN_BUDDY_SIZE << n
+  std::vector<std::set<VkDeviceSize>> m_free_lists;
+
+  bool allocateBuddy(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+  bool allocateLinear(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset);
+};
@@ -17,6 +17,7 @@ public:
 private:
   void render(RenderContext &ctx);
 
-  // Only Model can call Mesh::render()
+  // Only Model and InstancedModel can call Mesh::render()
   friend class Model;
+  friend class InstancedModel;
 };
@@ -0,0 +1,45 @@
+#pragma once
+
+// XRe includes
+#include <xre/structs.h>
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+
+// Other includes
+#include <vector>
+#include <cstdint>
+
+// Simplifies meshes with quadric error metrics (Garland & Heckbert), used to generate the levels of
+// detail of the models. Vertices are welded by their position first, as the loaded meshes usually
+// don't share vertices between faces. Edges on the border of the mesh and vertices on seams (positions
+// shared by vertices with different normals or texture coordinates, i.e. hard edges and UV seams) are
+// kept in place, and collapses which would flip a triangle are rejected. Each corner keeps its own
+// normal and texture coordinate, so the seams survive the simplification.
+class MeshSimplifier {
+public:
+  // Simplify the mesh until it has at most `target_index_count` indices, or no edge can be collapsed
+  // anymore. Returns the largest error of the collapsed edges.
+  static float simplify(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices, size_t target_index_count,
+                        std::vector<Vertex> &out_vertices, std::vector<uint16_t> &out_indices);
+
+private:
+  // Symmetric 4x4 matrix summing the squared distances to a set of planes
+  struct Quadric {
+    double a[10] = {};
+
+    void addPlane(const glm::dvec4 &plane, double weight);
+    void add(const Quadric &other);
+    double evaluate(const glm::dvec3 &point) const;
+  };
+
+  struct Collapse {
+    double error;
+    uint32_t from; // Vertex which is removed
+    uint32_t to;   // Vertex which is kept and moved to the position
+    glm::vec3 position;
+  };
+
+  static bool flipsTriangle(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &triangles, uint32_t triangle,
+                            const Collapse &collapse);
+};
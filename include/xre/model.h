@@ -12,6 +12,9 @@
 #include <xre/geometry.h>
 #include <xre/color_utils.h>
 #include <xre/material.h>
+#include <xre/frustum.h>
+#include <xre/occlusion_culler.h>
+#include <xre/mesh_simplifier.h>
 
 class Model {
 public:
@@ -35,16 +38,36 @@ public:
   // should have a slightly different color applied
   void setInteractedState(bool interacted);
 
-private:
-  // Keep track of the global index of the model
-  inline static uint32_t s_model_index = 0;
+  // Changes whenever the color, the interaction state or the rendered bounding boxes change, such that
+  // static subtrees know when to record their draws again
+  uint64_t getGeneration();
+
+  // Levels of detail. Level 0 is the full detail, the following levels are simplified versions of
+  // the meshes (only generated for loaded models).
+  uint32_t getLodLevelCount();
+  uint32_t selectLodLevel(const LodViews &lod_views, const AABB &bounds, uint32_t current_level);
 
-  // The index of the current model itself
-  uint32_t m_model_index;
+  // Global bias for the level of detail selection, e.g. a bias of 1 uses one level coarser than
+  // usual. Can be raised if frames get too expensive.
+  static void setLodBias(float lod_bias);
+  static float getLodBias();
 
+  static constexpr bool GENERATE_LODS = true;
+  static constexpr uint32_t MAX_LOD_LEVELS = 4;           // Including the full detail level
+  static constexpr size_t LOD_MIN_TRIANGLES = 256;        // Meshes with fewer triangles are not simplified
+  static constexpr float LOD_TRIANGLE_RATIO = 0.5f;       // Triangles of a level compared to the previous one
+  static constexpr float LOD_FULL_DETAIL_PIXELS = 256.0f; // Projected size above which the full detail is used, halved per level
+  static constexpr float LOD_HYSTERESIS = 0.2f;           // Fraction of a level the size needs to pass a threshold by to switch
+
+private:
   // Vector holding all the meshes of this model
   std::vector<Mesh> m_meshes;
 
+  // Simplified meshes, level i + 1 is stored at index i. Each level has as many meshes as the model.
+  std::vector<std::vector<Mesh>> m_lod_meshes;
+
+  inline static float s_lod_bias = 0.0f;
+
   // Color of the model, which will be applied to all meshes
   glm::vec3 m_model_color;
 
@@ -52,12 +75,21 @@ private:
   glm::vec3 m_original_model_color;
 
   void loadObj(const char *model_path, std::shared_ptr<VulkanHandler> vulkan_handler);
-  void render(RenderContext &ctx, glm::mat4 scene_node_transform);
+  void render(RenderContext &ctx, glm::mat4 scene_node_transform, uint32_t lod_level);
+  std::vector<Mesh> generateLods(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices,
+                                 std::shared_ptr<VulkanHandler> vulkan_handler);
+  AABB computeBounds(const glm::mat4 &scene_node_transform);
+  void addOccluders(OcclusionCuller &occlusion_culler, const glm::mat4 &scene_node_transform);
+
+  // Meshes which passed the frustum culling in the current call to render()
+  std::vector<Mesh *> m_visible_meshes;
 
   bool m_render_bounding_boxes = false;
 
   bool m_interacted = false;
 
+  uint64_t m_generation = 0u;
+
   std::shared_ptr<Material> m_material;
 
   // Scene Node can call render() directly
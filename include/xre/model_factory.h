@@ -3,6 +3,7 @@
 // XRe includes
 #include <xre/mesh.h>
 #include <xre/model.h>
+#include <xre/instanced_model.h>
 #include <xre/vulkan_handler.h>
 
 // Other includes
@@ -89,6 +90,14 @@ inline std::shared_ptr<Model> createCube(glm::vec3 color, std::shared_ptr<Materi
   return std::make_shared<Model>(std::vector<Mesh>{cube_mesh}, color, material);
 }
 
+inline std::shared_ptr<InstancedModel> createInstancedCube(std::shared_ptr<Material> material, uint32_t max_instances,
+                                                          std::shared_ptr<VulkanHandler> vulkan_handler) {
+  auto [vertices, indices] = getCubeVerticesAndIndices();
+
+  Mesh cube_mesh = Mesh(vertices, indices, vulkan_handler);
+  return std::make_shared<InstancedModel>(cube_mesh, material, max_instances, vulkan_handler);
+}
+
 inline std::shared_ptr<Model> createPlane(float extent, std::shared_ptr<Material> material, glm::vec3 color,
                                           std::shared_ptr<VulkanHandler> vulkan_handler) {
   auto [vertices, indices] = getPlaneVerticesAndIndices(extent);
@@ -8,6 +8,7 @@
 
 // Other includes
 #include <vector>
+#include <array>
 #include <limits>
 #include <iostream>
 
@@ -19,7 +20,7 @@ public:
   bool intersects(OOBB &other);
   bool intersects(const glm::vec3 &line_start, const glm::vec3 &line_direction, float *out_distance);
   OOBB transformed(const glm::mat4 &model) const;
-  std::vector<glm::vec3> getCorners() const;
+  std::array<glm::vec3, 8> getCorners() const;
   std::vector<uint16_t> getLineIndices() const;
 
   glm::vec3 getCenter();
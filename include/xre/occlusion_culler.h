@@ -0,0 +1,83 @@
+#pragma once
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+
+// XRe includes
+#include <xre/frustum.h>
+#include <xre/object_oriented_bounding_box.h>
+
+// Other includes
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Software occlusion culling on the CPU. A small set of occluder meshes is rasterized (with SSE) into a
+// low resolution depth buffer per view, together with the farthest depth of each tile. Bounding boxes
+// are then tested against the tiles first, and only against the individual pixels where a tile is not
+// conclusive. As the culler does not depend on Vulkan, it can be run (and tested) without a GPU, and
+// the result only depends on its inputs.
+//
+// The depth buffers store 1/w, which can be interpolated linearly in screen space. Larger values are
+// closer to the eye, and empty pixels are 0, i.e. infinitely far away.
+class OcclusionCuller {
+public:
+  OcclusionCuller();
+  ~OcclusionCuller();
+
+  // Start collecting the occluders of a frame which is rendered with the given views. Waits for the
+  // rasterization of the previous frame to be done.
+  void beginFrame(const std::vector<glm::mat4> &view_projections);
+
+  // Add the triangles of an occluder mesh, the positions are transformed into world space right away
+  void addOccluder(const std::vector<glm::vec3> &positions, const std::vector<uint16_t> &indices, const glm::mat4 &world);
+
+  // Rasterize the occluders, either on the worker thread or on the calling thread
+  void rasterizeAsync();
+  void rasterize();
+
+  // Wait for the worker thread to finish rasterizing, needs to be called before testing
+  void wait();
+
+  // Whether a box (in world space) is hidden behind the occluders in all views
+  bool isOccluded(const OOBB &box) const;
+  bool isOccluded(const AABB &box) const;
+
+  static constexpr uint32_t WIDTH = 128;
+  static constexpr uint32_t HEIGHT = 128;
+  static constexpr uint32_t TILE_SIZE = 8;
+  static constexpr uint32_t TILES_X = WIDTH / TILE_SIZE;
+  static constexpr uint32_t TILES_Y = HEIGHT / TILE_SIZE;
+
+  // Triangles and boxes closer than this (in clip space w) are not rasterized or not culled respectively
+  static constexpr float NEAR_W = 0.01f;
+
+  // Boxes need to be this much (relatively) behind the occluders to be culled
+  static constexpr float DEPTH_BIAS = 1.0001f;
+
+private:
+  struct ViewBuffer {
+    glm::mat4 view_projection;
+    std::vector<float> depth;      // WIDTH x HEIGHT
+    std::vector<float> tile_depth; // Farthest (i.e. smallest) depth of each tile
+  };
+
+  std::vector<ViewBuffer> m_views;
+
+  // World space vertices of the occluders, three per triangle
+  std::vector<glm::vec3> m_triangles;
+
+  // Worker thread doing the rasterization, such that it can overlap other work of the frame
+  std::thread m_worker;
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  bool m_job_pending = false;
+  bool m_stop = false;
+
+  void workerLoop();
+  void rasterizeView(ViewBuffer &view);
+  void rasterizeTriangle(ViewBuffer &view, const glm::vec4 &v0, const glm::vec4 &v1, const glm::vec4 &v2);
+  bool isOccluded(const glm::vec3 *corners) const;
+  bool isOccludedInView(const ViewBuffer &view, const glm::vec3 *corners) const;
+};
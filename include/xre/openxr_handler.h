@@ -23,6 +23,10 @@
 #include <xre/hand.h>
 #include <xre/material.h>
 #include <xre/texture.h>
+#include <xre/frustum.h>
+#include <xre/occlusion_culler.h>
+#include <xre/dynamic_resolution.h>
+#include <xre/cpu_profiler.h>
 
 // Other includes
 #include <iostream>
@@ -32,20 +36,34 @@
 
 class OpenXrHandler {
 public:
-  OpenXrHandler(const char *application_name);
+  OpenXrHandler(const char *application_name, uint32_t frames_in_flight = VulkanHandler::DEFAULT_FRAMES_IN_FLIGHT);
   ~OpenXrHandler();
   VkExtent2D getEyeResolution(size_t eyeIndex) const;
+  VkExtent2D getRenderResolution(size_t eyeIndex) const;
   void pollOpenxrEvents(bool &loop_running, bool &xr_running);
   void renderFrame(std::function<void(RenderContext &)> draw_callback, std::function<void(XrTime)> update_simulation_callback);
-  void renderLayer(XrTime predicted_time, XrCompositionLayerProjection &layer_projection,
-                   std::function<void(RenderContext &)> draw_callback);
+  void renderLayer(XrCompositionLayerProjection &layer_projection, std::function<void(RenderContext &)> draw_callback);
 
   // Handlers
   std::shared_ptr<VulkanHandler> m_vulkan_handler;
 
 private:
   // Configs
+  static constexpr float NEAR_CLIP = 0.1f;
+  static constexpr float FAR_CLIP = 250.0f;
+
+  // Submit the depth of the views to the compositor (XR_KHR_composition_layer_depth) if the runtime
+  // supports it, such that it can use it for reprojection. Not available with MSAA.
+  static constexpr bool USE_DEPTH_LAYER = true;
+
+  // Scale the rendered part of the swapchain images with the measured GPU time, such that the frame
+  // budget is kept (see `DynamicResolution`). Needs timestamp support on the graphics queue.
+  static constexpr bool USE_DYNAMIC_RESOLUTION = true;
+
+  // File the CPU profiler scopes are written to on shutdown, if the profiler is compiled in
+  static constexpr const char *CPU_TRACE_FILE = "xre_cpu_trace.json";
   const char *m_application_name;
+  uint32_t m_frames_in_flight;
   XrFormFactor m_application_form_factor = XR_FORM_FACTOR_HEAD_MOUNTED_DISPLAY; // Using a HMD
   XrViewConfigurationType m_application_view_type =
       XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO; // The HMD has a stereo view, one display for each eye
@@ -68,8 +86,14 @@ private:
   std::vector<XrCompositionLayerProjectionView> m_projection_views;
   std::vector<XrSwapchain> m_swapchains;
   std::vector<std::vector<RenderTarget *>> m_render_targets;
+  std::vector<TransientAttachments *> m_transient_attachments; // Depth and MSAA color, shared by the images of a swapchain
+  bool m_depth_layer_enabled = false;                          // Whether the depth is rendered into depth swapchains
+  std::vector<XrSwapchain> m_depth_swapchains;
+  std::vector<std::vector<VkImageView>> m_depth_image_views;
+  std::vector<XrCompositionLayerDepthInfoKHR> m_depth_infos; // Chained onto the projection views
   XrSessionState m_openxr_session_state = XR_SESSION_STATE_UNKNOWN;
   uint32_t m_view_count = 0u;
+  bool m_multiview = false; // Whether all views are rendered at once into a single layered swapchain
   std::vector<glm::mat4> m_view_matrices;
   std::vector<glm::mat4> m_projection_matrices;
 
@@ -100,6 +124,14 @@ private:
   glm::vec3 m_headset_position = glm::zero<glm::vec3>();
   glm::vec3 m_current_origin = glm::zero<glm::vec3>();
 
+  // Occlusion culler (only created if enabled), and the origin its views were computed with
+  OcclusionCuller *m_occlusion_culler = nullptr;
+  glm::vec3 m_occlusion_origin = glm::zero<glm::vec3>();
+
+  // Scale of the rendered resolution, and the time available per frame (from the predicted display period)
+  DynamicResolution m_dynamic_resolution;
+  double m_frame_budget_ms = 0.0;
+
   // Material for controllers and hands
   std::shared_ptr<Material> m_interactions_material;
 
@@ -112,6 +144,10 @@ private:
   void pollOpenxrActions(XrTime predicted_time);
   void updateControllerStates(Controller *controller, XrTime predicted_time);
   void renderInteractions(RenderContext &ctx);
+  void locateViews(XrTime predicted_time);
+  void startOcclusionCulling();
+  uint32_t acquireSwapchainImage(XrSwapchain swapchain);
+  void releaseSwapchainImage(XrSwapchain swapchain);
   void updateHandTrackingStates(Hand *hand, XrTime predicted_time);
   void updateCurrentOriginForTeleport(glm::vec3 teleport_location);
   XrPath getXrPathFromString(std::string string);
@@ -0,0 +1,58 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+
+// Other includes
+#include <vector>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Records chunks of a render pass into secondary command buffers on a set of worker threads. Each thread
+// has a command pool per frame in flight, so the threads never share a pool, and all buffers of a frame
+// are freed at once by resetting its pools when the frame slot is reused.
+class ParallelRecorder {
+public:
+  ParallelRecorder(VkDevice device, uint32_t queue_family_index, uint32_t thread_count, uint32_t frame_count);
+  ~ParallelRecorder();
+
+  void beginFrame(uint32_t frame_index);
+  std::vector<VkCommandBuffer> record(uint32_t chunk_count, const VkCommandBufferInheritanceInfo &inheritance_info,
+                                      const std::function<void(uint32_t, VkCommandBuffer)> &record_chunk);
+
+  uint32_t getThreadCount();
+
+private:
+  struct Worker {
+    std::thread thread;
+    std::string name;
+    std::vector<VkCommandPool> command_pools;                  // One per frame in flight
+    std::vector<std::vector<VkCommandBuffer>> command_buffers; // Buffers allocated from each pool so far
+    uint32_t used_command_buffers = 0u;                        // Buffers used in the current frame
+  };
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  std::vector<Worker> m_workers;
+  uint32_t m_current_frame = 0u;
+
+  // Current job, only written by the calling thread while the workers are idle
+  uint32_t m_chunk_count = 0u;
+  const VkCommandBufferInheritanceInfo *m_inheritance_info = nullptr;
+  const std::function<void(uint32_t, VkCommandBuffer)> *m_record_chunk = nullptr;
+  std::vector<VkCommandBuffer> m_recorded_buffers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_condition;
+  uint64_t m_job = 0u;           // Incremented for each job, such that the workers notice new ones
+  uint32_t m_busy_workers = 0u; // Workers which didn't finish the current job yet
+  bool m_stop = false;
+
+  void workerLoop(uint32_t worker_index);
+  VkCommandBuffer acquireCommandBuffer(Worker &worker);
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+
+// Other includes
+#include <string>
+#include <vector>
+#include <fstream>
+#include <filesystem>
+#include <cstring>
+
+// Wraps a VkPipelineCache which is persisted on disk between runs of the application, such
+// that pipelines don't need to be fully recompiled by the driver on every start.
+class PipelineCache {
+public:
+  PipelineCache(VkDevice device, VkPhysicalDevice physical_device, const std::string &path);
+
+  void save();
+  void destroy();
+  VkPipelineCache getCache();
+
+  void recordPipelineCreation(const VkPipelineCreationFeedbackEXT &feedback);
+  void recordPipelineCreation();
+  PipelineCacheStatistics getStatistics();
+
+private:
+  // Header we prepend to the data we get from the driver. The driver validates its own data as
+  // well, but some drivers are known to crash on data of a different driver, so we make sure to
+  // only hand data back to the exact same device and driver version.
+  struct FileHeader {
+    uint32_t magic;
+    uint32_t header_version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+  };
+
+  static constexpr uint32_t FILE_MAGIC = 0x43505258; // "XRPC"
+  static constexpr uint32_t FILE_HEADER_VERSION = 1u;
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkPipelineCache m_pipeline_cache = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties m_device_properties{};
+  std::string m_path;
+
+  PipelineCacheStatistics m_statistics;
+
+  std::vector<char> loadValidatedData();
+  bool headerMatchesDevice(const FileHeader &header);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+
+// Other includes
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <cassert>
+
+// Deduplicates shader modules and graphics pipelines. Pipelines are keyed by their shader pair and
+// the fixed-function state, such that all materials which only differ in their texture or color
+// share the same pipeline. Entries are reference counted and stay cached when they are no longer
+// used, until `destroyUnused` is called.
+class PipelineRegistry {
+public:
+  using PipelineFactory = std::function<VkPipeline(VkShaderModule, VkShaderModule, const PipelineState &)>;
+
+  PipelineRegistry(VkDevice device, PipelineFactory pipeline_factory);
+
+  VkPipeline acquire(const std::string &vert_path, const std::string &frag_path, const PipelineState &state);
+  void release(VkPipeline pipeline);
+  void destroyUnused();
+  void destroy();
+
+  PipelineRegistryStatistics getStatistics();
+
+private:
+  struct PipelineKey {
+    std::string vert_path;
+    std::string frag_path;
+    PipelineState state;
+
+    bool operator==(const PipelineKey &other) const = default;
+  };
+
+  struct PipelineKeyHash {
+    size_t operator()(const PipelineKey &key) const;
+  };
+
+  struct PipelineEntry {
+    VkPipeline pipeline;
+    uint32_t reference_count;
+  };
+
+  struct ShaderModuleEntry {
+    VkShaderModule shader_module;
+    uint32_t reference_count; // Number of pipelines using this module
+  };
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  PipelineFactory m_pipeline_factory;
+
+  std::unordered_map<PipelineKey, PipelineEntry, PipelineKeyHash> m_pipelines;
+  std::unordered_map<std::string, ShaderModuleEntry> m_shader_modules;
+
+  PipelineRegistryStatistics m_statistics;
+
+  VkShaderModule acquireShaderModule(const std::string &path);
+  void releaseShaderModule(const std::string &path);
+};
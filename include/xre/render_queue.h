@@ -0,0 +1,110 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/structs.h>
+#include <xre/gpu_culler.h>
+#include <xre/gpu_profiler.h>
+#include <xre/parallel_recorder.h>
+#include <xre/object_oriented_bounding_box.h>
+
+// GLM includes
+#include <glm/glm/glm.hpp>
+
+// Other includes
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// Collects the draws of a frame while the scene graph is traversed, and records them afterwards sorted
+// by a 64-bit key. Draws sharing a pipeline, descriptor set or geometry buffers end up next to each other,
+// which allows skipping most of the binds.
+//
+// If a GPU culler is passed, draws with an indirect pipeline and a bounding box are culled on the GPU
+// instead, and each run of them sharing the same state is drawn with a single indirect count draw.
+//
+// With a parallel recorder, the sorted draws are split into chunks which are recorded into secondary
+// command buffers on its worker threads instead.
+//
+// Blended draws are drawn after the opaque draws of their pass, sorted back to front instead of by state.
+//
+// Layout of the key (most significant first):
+//   opaque:      4 bits pass | 0 | 11 bits pipeline | 16 bits descriptor set | 16 bits geometry buffers | 16 bits depth
+//   translucent: 4 bits pass | 1 | 16 bits inverted depth | 11 bits pipeline | 16 bits descriptor set | 16 bits geometry buffers
+class RenderQueue {
+public:
+  // Passes are drawn in this order, draws are only reordered within a pass
+  enum Pass : uint8_t { PASS_SCENE = 0, PASS_INTERACTIONS = 1 };
+  static constexpr const char *PASS_NAMES[] = {"Scene", "Interactions"};
+
+  void begin(const glm::mat4 &view_projection);
+  void setPass(Pass pass);
+  Pass getPass();
+  void push(const RenderContext &ctx, const GeometryRange &geometry, const OOBB *bounds);
+  void pushInstanced(const RenderContext &ctx, const GeometryRange &geometry, VkBuffer instance_buffer, VkDeviceSize instance_offset,
+                     uint32_t instance_count);
+  void cull(VkCommandBuffer command_buffer, GpuCuller *culler, uint32_t frame_index, const std::vector<glm::mat4> &view_projections);
+  void submit(RenderContext &ctx);
+  std::vector<VkCommandBuffer> submitParallel(const RenderContext &ctx, ParallelRecorder *recorder,
+                                              const VkCommandBufferInheritanceInfo &inheritance_info,
+                                              const std::function<void(VkCommandBuffer)> &begin_chunk);
+  size_t getDrawCount();
+
+  RenderQueueStatistics getStatistics();
+  RenderQueueStatistics getLastFrameStatistics();
+
+  // Distance up to which the depth part of the key is able to distinguish draws
+  static constexpr float MAX_SORT_DEPTH = 256.0f;
+
+  // Smallest number of draws worth a chunk of their own when recording in parallel
+  static constexpr uint32_t MIN_DRAWS_PER_CHUNK = 128;
+
+private:
+  struct DrawPacket {
+    uint64_t key;
+    VkPipeline pipeline;
+    VkPipeline indirect_pipeline;
+    VkDescriptorSet descriptor_set;
+    uint32_t uniform_offset;
+    GeometryRange geometry;
+
+    // Per-instance data of instanced draws, the buffer is null for regular draws
+    VkBuffer instance_buffer;
+    VkDeviceSize instance_offset;
+    uint32_t instance_count;
+
+    // Data for the GPU-driven path
+    bool has_bounds;
+    OOBB bounds;
+    glm::mat4 world_transform;
+    glm::vec3 color;
+    uint32_t texture_index;
+    int32_t batch;          // Batch the draw was added to, or -1 if it's drawn directly
+    uint32_t first_command; // First command of the batch
+    uint32_t batch_size;    // Number of draws in the batch
+  };
+
+  std::vector<DrawPacket> m_packets;
+  std::vector<uint32_t> m_sorted_packets; // Indices of the packets, sorted by key
+  GpuCuller *m_culler = nullptr;          // Culler used for the current frame, if any
+  Pass m_pass = PASS_SCENE;
+  glm::mat4 m_view_projection;
+
+  // Small ids for the handles of the current frame, such that they fit into the key
+  std::unordered_map<uint64_t, uint32_t> m_pipeline_ids;
+  std::unordered_map<uint64_t, uint32_t> m_descriptor_set_ids;
+  std::unordered_map<uint64_t, uint32_t> m_geometry_ids;
+
+  RenderQueueStatistics m_statistics;
+  RenderQueueStatistics m_last_frame_statistics;
+
+  void sort();
+  void record(RenderContext &ctx, size_t begin, size_t end, RenderQueueStatistics &frame_statistics) const;
+  std::vector<size_t> splitIntoChunks(uint32_t max_chunk_count) const;
+  bool sameBatch(const DrawPacket &a, const DrawPacket &b);
+  uint32_t lookupId(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t handle, uint32_t max_id);
+  void addStatistics(const RenderQueueStatistics &frame_statistics);
+  static void accumulateStatistics(RenderQueueStatistics &total, const RenderQueueStatistics &statistics);
+};
@@ -6,26 +6,26 @@
 // XRe includes
 #include <xre/utils.h>
 #include <xre/vulkan_utils.h>
+#include <xre/memory_allocator.h>
+#include <xre/transient_attachments.h>
 
 // Other includes
-#include <array>
+#include <vector>
 
 class RenderTarget final {
 public:
-  RenderTarget(VkDevice device, VkPhysicalDevice physical_device, VkImage image, VkExtent2D size, VkFormat format,
-               VkRenderPass render_pass);
+  RenderTarget(VkDevice device, VkImage image, VkExtent2D size, VkFormat format, VkRenderPass render_pass,
+               TransientAttachments *transient_attachments, uint32_t layer_count = 1u,
+               const std::vector<VkImageView> &depth_image_views = {});
 
   void destroy();
 
   VkImage getImage();
-  VkFramebuffer getFramebuffer();
+  VkFramebuffer getFramebuffer(uint32_t depth_image_id = 0u);
 
 private:
   VkDevice m_device = nullptr;
   VkImage m_color_image = nullptr;
-  VkImage m_depth_image = nullptr;
   VkImageView m_color_image_view = nullptr;
-  VkImageView m_depth_image_view = nullptr;
-  VkFramebuffer m_framebuffer = nullptr;
-  VkDeviceMemory m_depth_memory = nullptr;
+  std::vector<VkFramebuffer> m_framebuffers; // One per image of the depth swapchain (if any)
 };
\ No newline at end of file
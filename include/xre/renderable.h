@@ -20,6 +20,8 @@
 class Renderable {
 public:
   OOBB getObjectOrientedBoundingBox();
+  const std::vector<glm::vec3> &getVertexPositions();
+  const std::vector<uint16_t> &getIndices();
 
 protected:
   std::shared_ptr<VulkanHandler> m_vulkan_handler;
@@ -31,8 +33,9 @@ protected:
   // Protected as only subclasses may use it
   virtual void render(RenderContext &ctx);
   void renderBoundingBox(RenderContext &ctx);
+  void renderInstanced(RenderContext &ctx, VkBuffer instance_buffer, VkDeviceSize instance_offset, uint32_t instance_count);
 
-  // vertex and index buffers
+  // vertex and index buffers (only used if the geometry is not stored in the shared geometry pool)
   Buffer *m_vertex_buffer = nullptr;
   Buffer *m_index_buffer = nullptr;
 
@@ -41,6 +44,13 @@ protected:
   Buffer *m_bounding_box_vertex_buffer = nullptr;
   Buffer *m_bounding_box_index_buffer = nullptr;
 
+  // Where to find the geometry of the renderable and its bounding box when drawing
+  GeometryRange m_geometry{};
+  GeometryRange m_bounding_box_geometry{};
+
+  // Ranges allocated in the shared geometry pool, which are freed with the last copy of the renderable
+  std::vector<std::shared_ptr<GeometryRange>> m_pool_allocations;
+
   // Number of vertices and indices
   size_t m_vertex_count;
   size_t m_index_count;
@@ -49,7 +59,14 @@ protected:
   // The bounding box of this renderable
   OOBB m_bounding_box;
 
+  // Geometry kept on the CPU, such that the renderable can be used as an occluder (empty if occlusion
+  // culling is disabled)
+  std::vector<glm::vec3> m_vertex_positions;
+  std::vector<uint16_t> m_indices;
+
   void initialize(std::vector<Vertex> vertices, std::vector<uint16_t> indices, std::shared_ptr<VulkanHandler> vulkan_handler);
+  GeometryRange createGeometry(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices, Buffer *&vertex_buffer,
+                               Buffer *&index_buffer);
 
   // Scene Node can call render() directly
   friend class SceneNode;
@@ -38,6 +38,8 @@ public:
   std::unordered_set<SceneNode *> getGrabbableNodeInstances();
   void setNodeIsTerrain(SceneNode *node, bool is_terrain);
   std::unordered_set<SceneNode *> getTerrainNodeInstances();
+  void setNodeOccluder(SceneNode *node, bool occluder);
+  std::unordered_set<SceneNode *> getOccluderNodeInstances();
   void resetInteractionStates();
 
   std::unordered_set<Button *> getButtonInstances();
@@ -56,6 +58,10 @@ protected:
   // Set of all scene nodes belonging to this scene we marked as terrain (i.e. can teleport there)
   std::unordered_set<SceneNode *> m_terrain_scene_nodes;
 
+  // Set of all scene nodes belonging to this scene we marked as occluders (i.e. are rasterized for the
+  // occlusion culling)
+  std::unordered_set<SceneNode *> m_occluder_scene_nodes;
+
   // Set of all buttons in the scene
   std::unordered_set<Button *> m_button_instances;
 };
@@ -37,6 +37,7 @@ public:
   void resetInteractionStates();
   std::unordered_set<SceneNode *> getGrabbableNodeInstances();
   std::unordered_set<SceneNode *> getTerrainInstances();
+  std::unordered_set<SceneNode *> getOccluderInstances();
   std::unordered_set<Button *> getButtonInstances();
   void processButtonInteractions();
   void resetButtonInteractions();
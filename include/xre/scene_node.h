@@ -2,7 +2,10 @@
 
 // XRe includes
 #include <xre/model.h>
+#include <xre/instanced_model.h>
 #include <xre/renderable.h>
+#include <xre/frustum.h>
+#include <xre/occlusion_culler.h>
 
 // GLM includes
 #include <glm/glm/vec3.hpp>
@@ -22,6 +25,7 @@ class SceneNode {
 public:
   SceneNode();
   SceneNode(std::shared_ptr<Model> model);
+  SceneNode(std::shared_ptr<InstancedModel> instanced_model);
   ~SceneNode();
 
   void addChildNode(std::shared_ptr<SceneNode> child);
@@ -59,9 +63,28 @@ public:
   void setGrabbable(bool grabbable);
   void setIsTerrain(bool is_terrain);
 
+  // Occluders (e.g. walls) are rasterized by the occlusion culler, and hide the nodes behind them
+  void setOccluder(bool occluder);
+  void addOccluders(OcclusionCuller &occlusion_culler);
+
   void setActive(bool is_active);
   bool isActive();
 
+  // Nodes which are not placed in the world (e.g. text sticking to the HUD) need to disable the
+  // frustum culling, which also keeps their ancestors from being culled.
+  void setCullingEnabled(bool culling_enabled);
+
+  // The opaque draws of static subtrees (e.g. the venue geometry) are recorded once into cached command
+  // buffers, which are replayed every frame. Only the subtree as a whole is culled. The subtree is still
+  // visited every frame to track the interactions with its models and their levels of detail, and to draw
+  // its blended models, which have to be sorted with the rest of the frame. Changes of the transforms,
+  // children, activity, colors, interactions, instances and levels of detail within the subtree are
+  // detected automatically, other changes need to be reported with `invalidateStaticContent()`. Only the
+  // scene pass is cached, static subtrees drawn in other passes are drawn as usual.
+  void setStatic(bool is_static);
+  bool isStatic();
+  void invalidateStaticContent();
+
   // Check whether a node intersects with the model contained in another one
   bool intersects(std::shared_ptr<SceneNode> other);
 
@@ -87,6 +110,10 @@ private:
   // transformation)
   std::shared_ptr<Model> m_model = nullptr;
 
+  // Instanced model contained in this node (which might be null as well), whose instances are
+  // placed relative to the node
+  std::shared_ptr<InstancedModel> m_instanced_model = nullptr;
+
   // Position, scale and rotation of the SceneNode. These are all LOCAL,
   // i.e. in relation to the transform of the parent node!
   // Scale factors, initialize to use the scale of 1 for X, Y and Z
@@ -107,4 +134,34 @@ private:
 
   // Track whether the scene node is active or not
   bool m_is_active = true;
+
+  // World space bounds of the models in this node and all its children, used to reject whole
+  // subtrees during the frustum culling. The bounds are only recomputed in `updateTransformation()`
+  // if something in the subtree changed. Subtrees containing instanced models or nodes with
+  // disabled culling are unbounded, i.e. never culled.
+  AABB m_subtree_bounds;
+  AABB m_model_bounds; // Bounds of only the model of this node
+  bool m_subtree_bounded = true;
+  bool m_bounds_need_update = true;
+  bool m_subtree_bounds_changed = false;
+
+  // Whether the node may be culled
+  bool m_culling_enabled = true;
+
+  // Level of detail the model was rendered with in the last frame
+  uint32_t m_lod_level = 0u;
+
+  // Whether the draws of the subtree are cached, and the generation of its content, which changes whenever
+  // the cached command buffers are outdated. The generations are unique across all nodes, so a node
+  // created at the address of a deleted one can't reuse the buffers of the latter.
+  bool m_static = false;
+  uint64_t m_static_generation = 0u;
+  inline static uint64_t s_static_generations = 0u;
+
+  // Generations of the models the cached draws were recorded with
+  uint64_t m_model_generation = 0u;
+  uint64_t m_instanced_model_generation = 0u;
+
+  void invalidateBounds();
+  bool updateStaticSubtree(RenderContext &ctx);
 };
\ No newline at end of file
@@ -0,0 +1,59 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/structs.h>
+
+// Other includes
+#include <vector>
+#include <unordered_map>
+#include <functional>
+
+// Forward declarations
+class SceneNode;
+
+// Keeps the draws of static scene subtrees recorded in secondary command buffers, one per subtree and
+// frame slot, which are replayed every frame. The buffers only read the view projection from the global
+// uniform buffer, so they stay valid until the subtree changes (as tracked by its generation) or the
+// extent of the render target changes. Subtrees which are not drawn anymore are dropped once no frame
+// in flight can use their buffers. The buffers only hold opaque draws of the scene pass, and are executed
+// before all other draws of the frame.
+class StaticCommandCache {
+public:
+  StaticCommandCache(VkDevice device, uint32_t queue_family_index, uint32_t frame_count);
+  ~StaticCommandCache();
+
+  void beginFrame(uint32_t frame_index);
+  void addSubtree(SceneNode *node, uint64_t generation);
+  size_t getSubtreeCount();
+  std::vector<VkCommandBuffer> record(const VkCommandBufferInheritanceInfo &inheritance_info, VkExtent2D extent,
+                                      const std::function<void(SceneNode *, VkCommandBuffer)> &record_subtree);
+
+  StaticCommandCacheStatistics getStatistics();
+
+private:
+  struct Entry {
+    // Per frame slot, the buffer is null until it's recorded for the first time
+    std::vector<VkCommandBuffer> command_buffers;
+    std::vector<uint64_t> generations;
+    std::vector<VkExtent2D> extents;
+    uint64_t last_used_frame = 0u;
+  };
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  VkCommandPool m_command_pool = VK_NULL_HANDLE;
+  uint32_t m_frame_count = 0u;
+
+  std::unordered_map<SceneNode *, Entry> m_entries;
+  std::vector<std::pair<SceneNode *, uint64_t>> m_current_subtrees; // Subtrees drawn in the current frame
+  uint32_t m_current_frame = 0u;
+  uint64_t m_frame = 0u; // Number of frames started so far
+
+  StaticCommandCacheStatistics m_statistics;
+
+  void recordEntry(SceneNode *node, Entry &entry, const VkCommandBufferInheritanceInfo &inheritance_info,
+                   const std::function<void(SceneNode *, VkCommandBuffer)> &record_subtree);
+};
@@ -14,27 +14,216 @@
 #include <array>
 #include <optional>
 
-// Forward declaration of the buffer class
+// Forward declaration of the buffer classes
 class Buffer;
+class UniformArena;
+class RenderQueue;
+class Frustum;
+class OcclusionCuller;
+class GpuProfiler;
+class DescriptorAllocator;
+class StaticCommandCache;
 
 struct ModelUniformBufferObject {
   glm::mat4 world;
   glm::vec3 color;
+  uint32_t texture_index; // Slot of the texture in the bindless texture array, unused otherwise
 };
 
+// Per-draw data of the push constant path, matches the push constant block of the vertex shaders
+struct ModelPushConstants {
+  glm::mat4 world;
+  glm::vec3 color;
+  uint32_t texture_index;
+};
+
+// Per-object data of the GPU-driven path, read by the culling and vertex shaders (std430 layout)
+struct GpuObjectData {
+  glm::mat4 world;
+  glm::vec3 color;
+  uint32_t texture_index;
+};
+
+// Input of the culling shader, one per draw of the GPU-driven path (std430 layout)
+struct GpuDrawData {
+  glm::vec4 center;  // Center of the bounding box in model space
+  glm::vec4 extents; // Half extents along the axes of the bounding box
+  glm::vec4 axes[3];
+  uint32_t index_count;
+  uint32_t first_index;
+  int32_t vertex_offset;
+  uint32_t object;        // Index into the object buffer
+  uint32_t batch;         // Index into the count buffer
+  uint32_t first_command; // First command of the batch in the command buffer
+  uint32_t padding[2];
+};
+
+// Five planes (left, right, bottom, top, far) per view, used by the culling shader (std140 layout)
+struct GpuCullFrustum {
+  glm::vec4 planes[10];
+  uint32_t view_count;
+};
+
+// Holds one view projection matrix per eye, indexed by `gl_ViewIndex` in the shaders. The
+// vec3 members need to be aligned to 16 bytes to match the std140 layout.
 struct GlobalUniformBufferObject {
-  glm::mat4 view_projection;
-  glm::vec3 light_vector;
-  glm::vec3 light_color;
-  glm::vec3 ambient_color;
+  glm::mat4 view_projection[2];
+  alignas(16) glm::vec3 light_vector;
+  alignas(16) glm::vec3 light_color;
+  alignas(16) glm::vec3 ambient_color;
+};
+
+// Positions of the eyes a frame is rendered for, used to select the levels of detail of the models.
+// Both eyes are always included (even if they are rendered separately), such that they use the same levels.
+struct LodViews {
+  glm::vec3 positions[2];
+  uint32_t count;
+  float pixels_per_unit; // Projected size in pixels of one unit at a distance of one unit (largest of all views)
+};
+
+struct CullingStatistics {
+  uint64_t frames = 0u;        // Number of frames which were culled
+  uint64_t visited_nodes = 0u; // Scene nodes which were tested against the frustum
+  uint64_t culled_nodes = 0u;  // Scene nodes which were rejected together with their subtree
+  uint64_t culled_draws = 0u;  // Meshes of visible nodes which were rejected by their own bounding box
+  uint64_t occluded_nodes = 0u; // Scene nodes whose subtree is hidden behind the occluders
+  uint64_t occluded_draws = 0u; // Meshes hidden behind the occluders
 };
 
 struct RenderContext {
   VkCommandBuffer command_buffer;
-  Buffer *model_uniform_buffer;
+  UniformArena *uniform_arena; // Per-frame storage for the per-draw uniform data
   VkPipelineLayout pipeline_layout;
+  uint32_t frame_index; // Index of the frame in flight which is currently recorded
+  RenderQueue *render_queue; // Collects the draws, which are recorded sorted at the end of the frame
+  const Frustum *frustum;    // Frustum containing all views of the frame, might be null to disable culling
+  const OcclusionCuller *occlusion_culler; // Depth buffers of the occluders, might be null as well
+  const LodViews *lod_views; // Views used to select the levels of detail, might be null to always use full detail
+  CullingStatistics culling_statistics; // Counters of the current frame
+  GpuProfiler *gpu_profiler; // Measures the GPU time of the passes, might be null
+  DescriptorAllocator *descriptor_allocator; // Descriptor sets which are only used by the current frame
+  bool push_constants;       // Whether the per-draw data is pushed instead of stored in the uniform arena
+  StaticCommandCache *static_cache; // Collects the static subtrees which are drawn from cached buffers, might be null
+  bool static_recording; // Whether a static subtree is recorded into the cache, which only holds its opaque draws
+
+  // State of the model which is currently added to the render queue
+  VkPipeline pipeline;
+  VkPipeline indirect_pipeline; // Variant for the GPU-driven path, might be null
   VkDescriptorSet descriptor_set;
-  VkDeviceSize aligned_size;
+  uint32_t uniform_offset; // Dynamic offset of the uniform data in the arena, unused with push constants
+  glm::mat4 world_transform;
+  glm::vec3 color;
+  uint32_t texture_index; // Slot of the texture of the model in the bindless texture array
+  bool translucent;       // Whether the pipeline blends, i.e. the draws have to be sorted back to front
+
+  // Currently bound state while recording, used to skip redundant binds
+  VkPipeline bound_pipeline;
+  VkDescriptorSet bound_descriptor_set;
+  uint32_t bound_uniform_offset;
+  VkBuffer bound_vertex_buffer;
+  VkBuffer bound_index_buffer;
+};
+
+// Location of the geometry of a mesh, either in its own buffers or in a range of the shared
+// buffers of the `GeometryPool`.
+struct GeometryRange {
+  VkBuffer vertex_buffer;
+  VkBuffer index_buffer;
+  int32_t vertex_offset; // Added to each index, i.e. the first vertex of the mesh in the vertex buffer
+  uint32_t first_index;
+  uint32_t index_count;
+  uint32_t vertex_count; // Only needed to return the range to the pool
+};
+
+// Fixed-function state of a graphics pipeline, which is used (together with the shaders) to
+// deduplicate pipelines. The defaults match what most of our materials need.
+struct PipelineState {
+  VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  VkCullModeFlags cull_mode = VK_CULL_MODE_BACK_BIT;
+  bool depth_test = true;
+  bool depth_write = true;
+  bool blend = false; // Alpha blending, materials with a texture with alpha turn it on themselves
+  bool instanced = false; // Per-instance data (`InstanceData`) is read from vertex buffer binding 1
+
+  bool operator==(const PipelineState &other) const = default;
+};
+
+// Resources which are needed once per frame in flight, such that the CPU can already record
+// the next frame while the GPU is still rendering the previous ones.
+struct FrameData {
+  VkCommandPool command_pool;
+  VkCommandBuffer command_buffer;
+  VkFence fence;
+  Buffer *global_uniform_buffer;
+  VkDescriptorSet global_descriptor_set;
+  DescriptorAllocator *descriptor_allocator; // Transient descriptor sets, reset once the frame slot is reused
+};
+
+struct FrameStatistics {
+  uint64_t submitted_frames = 0u;   // Number of submitted command buffers
+  uint64_t fence_blocks = 0u;       // Number of times the CPU had to wait for the GPU to release a frame
+  double fence_block_time_ms = 0.0; // Total time the CPU spent blocked on fences
+};
+
+struct DescriptorAllocatorStatistics {
+  const char *name = "";
+  uint64_t allocations = 0u;   // Descriptor sets allocated in total
+  uint64_t resets = 0u;        // Number of times all sets were freed at once
+  uint64_t created_pools = 0u;
+  uint64_t pool_growths = 0u;  // Pools created because all previous ones were full, i.e. the first pool was too small
+  uint32_t peak_sets = 0u;     // Largest number of sets allocated between two resets
+  uint32_t pools = 0u;         // Pools currently owned by the allocator
+};
+
+struct StaticCommandCacheStatistics {
+  uint64_t frames = 0u;             // Frames which drew static subtrees
+  uint64_t replayed_subtrees = 0u;  // Subtree draws which reused a cached command buffer
+  uint64_t recorded_subtrees = 0u;  // Subtree draws which needed to record the buffer first
+  uint64_t evicted_subtrees = 0u;   // Subtrees dropped from the cache as they were not drawn anymore
+};
+
+struct PipelineCacheStatistics {
+  bool loaded_from_disk = false; // Whether valid cache data from a previous run was found
+  uint64_t hits = 0u;            // Pipelines which were found in the cache
+  uint64_t misses = 0u;          // Pipelines which had to be compiled by the driver
+  uint64_t unknown = 0u;         // Pipelines for which the driver did not report cache usage
+};
+
+struct RenderQueueStatistics {
+  uint64_t frames = 0u; // Number of recorded render queues
+  uint64_t draws = 0u;
+  uint64_t pipeline_binds = 0u;
+  uint64_t skipped_pipeline_binds = 0u; // Binds which were eliminated as the state was already bound
+  uint64_t descriptor_set_binds = 0u;
+  uint64_t skipped_descriptor_set_binds = 0u;
+  uint64_t vertex_buffer_binds = 0u;
+  uint64_t skipped_vertex_buffer_binds = 0u;
+  uint64_t index_buffer_binds = 0u;
+  uint64_t skipped_index_buffer_binds = 0u;
+  uint64_t indirect_draws = 0u;   // Draws which were culled on the GPU instead of being recorded directly
+  uint64_t indirect_batches = 0u; // Number of indirect count draws they were merged into
+  uint64_t instanced_draws = 0u;
+  uint64_t instances = 0u; // Instances drawn by the instanced draws
+  uint64_t push_constant_updates = 0u; // Per-draw data pushed with the direct draws
+  uint64_t parallel_chunks = 0u;       // Secondary command buffers recorded on the worker threads
+};
+
+struct PipelineRegistryStatistics {
+  uint64_t requests = 0u;          // Number of pipelines requested by materials
+  uint64_t created_pipelines = 0u; // Number of pipelines which actually had to be created
+  size_t cached_pipelines = 0u;    // Number of pipelines currently in the registry
+  size_t cached_shader_modules = 0u;
+};
+
+struct MemoryHeapStatistics {
+  uint32_t memory_type_index = 0u;
+  bool images = false;    // Whether the heap holds images (otherwise buffers)
+  bool linear = false;    // Whether the heap uses the linear strategy (otherwise buddy)
+  bool dedicated = false; // Whether these are dedicated allocations, which are not sub-allocated
+  uint32_t block_count = 0u;
+  uint32_t allocation_count = 0u;
+  VkDeviceSize block_bytes = 0u; // Memory allocated from the device
+  VkDeviceSize used_bytes = 0u;  // Memory handed out to resources (including buddy padding)
 };
 
 struct Vertex {
@@ -77,6 +266,48 @@ struct Vertex {
   bool operator==(const Vertex &other) const { return position == other.position && texture_coord == other.texture_coord; }
 };
 
+// Per-instance data of instanced draws, read as vertex attributes with the instance input rate
+struct InstanceData {
+  glm::mat4 world;
+  glm::vec3 color;
+  uint32_t texture_index; // Set by the instanced model from its material
+
+  static VkVertexInputBindingDescription getBindingDescription() {
+    VkVertexInputBindingDescription binding_description{};
+    binding_description.binding = 1;
+    binding_description.stride = sizeof(InstanceData);
+    binding_description.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+
+    return binding_description;
+  }
+
+  static std::array<VkVertexInputAttributeDescription, 6> getAttributeDescriptions() {
+    std::array<VkVertexInputAttributeDescription, 6> attribute_descriptions{};
+
+    // Bindings for the world matrix, which takes one location per column
+    for (uint32_t i = 0; i < 4; i++) {
+      attribute_descriptions[i].binding = 1;
+      attribute_descriptions[i].location = 3 + i;
+      attribute_descriptions[i].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+      attribute_descriptions[i].offset = offsetof(InstanceData, world) + i * sizeof(glm::vec4);
+    }
+
+    // Binding for color
+    attribute_descriptions[4].binding = 1;
+    attribute_descriptions[4].location = 7;
+    attribute_descriptions[4].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attribute_descriptions[4].offset = offsetof(InstanceData, color);
+
+    // Binding for the slot of the texture in the bindless texture array
+    attribute_descriptions[5].binding = 1;
+    attribute_descriptions[5].location = 8;
+    attribute_descriptions[5].format = VK_FORMAT_R32_UINT;
+    attribute_descriptions[5].offset = offsetof(InstanceData, texture_index);
+
+    return attribute_descriptions;
+  }
+};
+
 struct TextChar {
   float left;
   float right;
@@ -13,6 +13,10 @@
 #include <string>
 #include <memory>
 
+// Sampled color texture with a full mip chain. Images (e.g. PNG) are uploaded uncompressed and their mip
+// levels are generated on the GPU. If a block-compressed variant of the image exists next to it (e.g.
+// `Tiles012.bc7.ktx2` for `Tiles012.png`) and the device supports its format, the variant is loaded
+// instead, including its baked mip levels. KTX2 files can also be passed directly.
 class Texture {
 public:
   Texture(const std::string &path, std::shared_ptr<VulkanHandler> vulkan_handler);
@@ -20,14 +24,22 @@ public:
   VkImageView getTextureImageView();
   VkSampler getTextureSampler();
 
+  // Whether the texture has texels which are not fully opaque, i.e. its materials need to blend
+  bool hasAlpha();
+
 private:
   VkImage createTextureImage(const std::string &path);
-  void transitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout);
-  void copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height);
+  VkImage createCompressedTextureImage(const std::string &path);
+  VkImage createImage(uint32_t width, uint32_t height, VkImageUsageFlags usage);
+  std::string findCompressedVariant(const std::string &path);
   void createTextureImageView(VkImage image);
   void createTextureSampler();
 
+  MemoryAllocation m_texture_image_allocation;
   VkImageView m_texture_image_view;
   VkSampler m_texture_sampler;
+  VkFormat m_format = VK_FORMAT_R8G8B8A8_SRGB;
+  uint32_t m_mip_levels = 1u;
+  bool m_has_alpha = false;
   std::shared_ptr<VulkanHandler> m_vulkan_handler;
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/memory_allocator.h>
+
+// Attachments which only live within the render pass: the depth buffer and, with MSAA, the multisampled
+// color buffer which is resolved into the swapchain image at the end of the subpass. Their contents are
+// never stored, so they're created as transient attachments backed by lazily allocated memory (if the
+// device has it, e.g. tile based GPUs), and shared by all images of a swapchain. If the depth is submitted
+// to the compositor, it's rendered into a depth swapchain instead, and no transient depth is created.
+class TransientAttachments final {
+public:
+  TransientAttachments(MemoryAllocator *allocator, VkExtent2D size, VkFormat color_format, VkSampleCountFlagBits sample_count,
+                       bool transient_depth, uint32_t layer_count = 1u);
+
+  void destroy();
+
+  VkImageView getDepthImageView(); // Only available with a transient depth, otherwise null
+  VkImageView getColorImageView(); // Only available with MSAA, otherwise null
+  bool isLazilyAllocated();
+
+  static constexpr VkFormat DEPTH_FORMAT = VK_FORMAT_D32_SFLOAT;
+
+private:
+  struct Attachment {
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView image_view = VK_NULL_HANDLE;
+    MemoryAllocation allocation;
+  };
+
+  VkDevice m_device = nullptr;
+  MemoryAllocator *m_allocator = nullptr;
+  Attachment m_depth;
+  Attachment m_color;
+  bool m_lazily_allocated = false;
+
+  Attachment createAttachment(VkExtent2D size, VkFormat format, VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                              VkSampleCountFlagBits sample_count, uint32_t layer_count);
+  void destroyAttachment(Attachment &attachment);
+};
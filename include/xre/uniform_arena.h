@@ -0,0 +1,49 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/buffer.h>
+
+// Other includes
+#include <cstring>
+#include <cassert>
+#include <algorithm>
+#include <string>
+
+// Linear allocator for short-lived uniform data (e.g. the per-draw model data). The backing buffer
+// is mapped once and split into one region per frame in flight. Each draw bump-allocates an aligned
+// slot in the region of the current frame, and the region is reset when the frame slot is reused.
+class UniformArena {
+public:
+  UniformArena(MemoryAllocator *allocator, VkDeviceSize frame_region_size, uint32_t frame_count);
+
+  void destroy();
+  void beginFrame(uint32_t frame_index);
+
+  // Copy the given data into the current frame region and return the offset to use as dynamic offset
+  template <typename T> uint32_t push(const T &data) { return push(&data, sizeof(T)); }
+  uint32_t push(const void *data, VkDeviceSize size);
+
+  VkBuffer getBuffer();
+  VkDeviceSize getAlignment();
+  VkDeviceSize getFrameRegionSize();
+  VkDeviceSize getHighWatermark();
+
+private:
+  Buffer *m_buffer = nullptr;
+  uint8_t *m_mapped_data = nullptr;
+
+  VkDeviceSize m_alignment = 0u;
+  VkDeviceSize m_frame_region_size = 0u;
+  uint32_t m_frame_count = 0u;
+
+  // Start and current end of the region of the current frame
+  VkDeviceSize m_region_start = 0u;
+  VkDeviceSize m_region_offset = 0u;
+
+  // Largest number of bytes used within a single frame
+  VkDeviceSize m_high_watermark = 0u;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+// Vulkan includes
+#include <vulkan/vulkan.h>
+
+// XRe includes
+#include <xre/utils.h>
+#include <xre/buffer.h>
+
+// Other includes
+#include <deque>
+#include <algorithm>
+#include <vector>
+#include <cstring>
+#include <cassert>
+
+// Uploads data into device local buffers and images. The data is copied into a persistently mapped
+// staging ring, and the copies are recorded into a batch which is submitted as a whole (usually right
+// before the next frame is submitted). Completion of a batch is tracked by a timeline semaphore, such
+// that the frame can wait on the GPU instead of the CPU waiting for the queue to be idle.
+class UploadManager {
+public:
+  UploadManager(MemoryAllocator *allocator, VkQueue queue, uint32_t queue_family_index, VkDeviceSize staging_size);
+
+  void destroy();
+
+  void uploadBuffer(Buffer *destination, const void *data, VkDeviceSize size, VkDeviceSize destination_offset = 0u);
+  void uploadImage(VkImage destination, uint32_t width, uint32_t height, const void *data, VkDeviceSize size, uint32_t mip_levels = 1u);
+  void uploadImageLevels(VkImage destination, uint32_t width, uint32_t height, const void *data, VkDeviceSize size,
+                         const std::vector<VkDeviceSize> &level_offsets);
+
+  uint64_t flush();
+  uint64_t submit(VkCommandBuffer command_buffer);
+  void wait(uint64_t value);
+
+  VkSemaphore getTimelineSemaphore();
+  uint64_t getLastSubmittedValue();
+
+private:
+  // A submitted batch, which holds on to its resources until the GPU is done with it
+  struct Batch {
+    VkCommandBuffer command_buffer;
+    uint64_t timeline_value;
+    VkDeviceSize staging_end;          // Everything in the ring up to this offset is free once the batch is done
+    std::vector<Buffer *> own_buffers; // Staging buffers for uploads which did not fit into the ring
+  };
+
+  static constexpr VkDeviceSize STAGING_ALIGNMENT = 16u;
+
+  VkDevice m_device = VK_NULL_HANDLE;
+  MemoryAllocator *m_allocator = nullptr;
+  VkQueue m_queue = VK_NULL_HANDLE;
+  VkCommandPool m_command_pool = VK_NULL_HANDLE;
+  VkSemaphore m_timeline_semaphore = VK_NULL_HANDLE;
+  uint64_t m_last_submitted_value = 0u;
+
+  // Staging ring. Allocations happen at the head, and the tail moves forward as batches complete.
+  Buffer *m_staging_buffer = nullptr;
+  uint8_t *m_staging_data = nullptr;
+  VkDeviceSize m_staging_size = 0u;
+  VkDeviceSize m_head = 0u;
+  VkDeviceSize m_tail = 0u;
+  bool m_ring_empty = true;
+
+  // Batch which is currently being recorded, and batches the GPU might still work on
+  VkCommandBuffer m_command_buffer = VK_NULL_HANDLE;
+  std::vector<Buffer *> m_own_buffers;
+  std::deque<Batch> m_pending_batches;
+
+  VkCommandBuffer getCommandBuffer();
+  VkBuffer stage(const void *data, VkDeviceSize size, VkDeviceSize &offset);
+  bool allocateStaging(VkDeviceSize size, VkDeviceSize &offset);
+  void generateMipmaps(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels);
+  void reclaimCompletedBatches();
+};
@@ -14,7 +14,22 @@
 // XRe includes
 #include <xre/utils.h>
 #include <xre/structs.h>
+#include <xre/memory_allocator.h>
 #include <xre/buffer.h>
+#include <xre/uniform_arena.h>
+#include <xre/pipeline_cache.h>
+#include <xre/pipeline_registry.h>
+#include <xre/upload_manager.h>
+#include <xre/geometry_pool.h>
+#include <xre/render_queue.h>
+#include <xre/frustum.h>
+#include <xre/occlusion_culler.h>
+#include <xre/transient_attachments.h>
+#include <xre/gpu_profiler.h>
+#include <xre/cpu_profiler.h>
+#include <xre/descriptor_allocator.h>
+#include <xre/parallel_recorder.h>
+#include <xre/static_command_cache.h>
 
 // Other includes
 #include <vector>
@@ -23,13 +38,20 @@
 #include <string>
 #include <set>
 #include <functional>
+#include <array>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
 
 class VulkanHandler {
 public:
-  VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, const char *application_name);
+  VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, const char *application_name, bool request_multiview,
+                uint32_t recommended_sample_count, bool request_depth_store, uint32_t frames_in_flight);
+  ~VulkanHandler();
 
   void setupRenderer();
-  void renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuffer framebuf, VkExtent2D resolution,
+  void renderFrame(const std::vector<glm::mat4> &view_projections, const Frustum &frustum, const OcclusionCuller *occlusion_culler,
+                   const LodViews &lod_views, VkFramebuffer framebuf, VkExtent2D resolution, const char *profiler_scope,
                    std::function<void(RenderContext &)> draw_callback, std::function<void(RenderContext &)> draw_interactions_callback);
 
   VkInstance getInstance();
@@ -37,17 +59,120 @@ public:
   VkDevice getLogicalDevice();
   uint32_t getQueueFamilyIndex();
   VkRenderPass getRenderPass();
+  bool isMultiviewEnabled();
+  uint32_t getFramesInFlight();
+  VkSampleCountFlagBits getSampleCount();
+  bool isDepthStoreEnabled();
+  bool isGpuCullingEnabled();
+  bool isPushConstantsEnabled();
+  bool isBindlessEnabled();
+  bool isTextureCompressionBcEnabled();
+  bool isTextureCompressionAstcEnabled();
+  UploadManager *getUploadManager();
+  GeometryPool *getGeometryPool();
+  MemoryAllocator *getMemoryAllocator();
+  std::vector<MemoryHeapStatistics> getMemoryStatistics();
+  std::vector<DescriptorAllocatorStatistics> getDescriptorAllocatorStatistics();
+  StaticCommandCacheStatistics getStaticCommandCacheStatistics();
 
   static constexpr VkFormat USED_COLOR_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
-  static constexpr uint32_t MAX_MODELS_IN_SCENE = 256;
-  static constexpr uint32_t MAX_DESCRIPTORS = 20; // TODO: we might need to be able to handle more materials
+
+  // Number of material descriptor sets in the first pool of the scene and persistent allocators, and of the
+  // per-frame sets in the first pool of each frame. Further (larger) pools are chained once they run out.
+  static constexpr uint32_t DESCRIPTOR_SETS_PER_POOL = 20;
+  static constexpr uint32_t FRAME_DESCRIPTOR_SETS_PER_POOL = 16;
+
+  // Default number of frames the CPU may record ahead of the GPU, applications can pass their own to
+  // the constructor. Each frame in flight has its own command buffer, fence and uniform storage. Please
+  // note that in the per-eye path, each eye uses a frame.
+  static constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+
+  // Number of bytes of per-draw uniform data which can be allocated per frame. With the usual
+  // alignment of 256 bytes, this allows for 4096 draws per frame.
+  static constexpr VkDeviceSize UNIFORM_ARENA_FRAME_SIZE = 1024 * 1024;
+
+  // Render both eyes in a single render pass instance (VK_KHR_multiview) if possible. If disabled, or if
+  // the eyes can't share a swapchain, each eye is rendered in its own render pass instead.
+  static constexpr bool PREFER_MULTIVIEW = true;
+  static constexpr uint32_t MULTIVIEW_VIEW_COUNT = 2;
+
+  // Render with the sample count recommended by the runtime (at most MAX_MSAA_SAMPLES), and resolve into
+  // the swapchain images at the end of the render pass
+  static constexpr bool USE_MSAA = true;
+  static constexpr uint32_t MAX_MSAA_SAMPLES = 4;
+
+  // Size of the staging ring used to upload static data (meshes, textures) into device local memory
+  static constexpr VkDeviceSize UPLOAD_STAGING_SIZE = 32 * 1024 * 1024;
+
+  // Store the geometry of all meshes in a few large shared buffers instead of separate buffers per mesh
+  static constexpr bool USE_SHARED_GEOMETRY_BUFFERS = true;
+
+  // Hide nodes behind the occluders of the scene (see `SceneNode::setOccluder`), which are rasterized
+  // on the CPU. Only worth it for scenes where most of the geometry is hidden, e.g. indoor scenes. The
+  // meshes only keep a CPU copy of their geometry (to rasterize them as occluders) if this is enabled.
+  static constexpr bool USE_OCCLUSION_CULLING = false;
+
+  // Cull the draws on the GPU and draw them with indirect count draws, if the device supports it
+  static constexpr bool USE_GPU_CULLING = true;
+
+  // Also query the vertex and fragment shader invocations of the passes in the GPU profiler, if the
+  // device supports pipeline statistics queries. The GPU times are always measured.
+  static constexpr bool USE_PIPELINE_STATISTICS = false;
+
+  // Pass the per-draw data (world matrix and color) as push constants instead of through the uniform arena,
+  // which saves the uniform writes and descriptor set rebinds of each model. Descriptor set 1 then only
+  // holds material data. Needs the push constant variants of the vertex shaders.
+  static constexpr bool USE_PUSH_CONSTANTS = true;
+
+  // Keep all textures in one large array (set = 2), which is bound once per frame, if the device supports
+  // descriptor indexing. Materials then reference their texture by its slot and share a single descriptor
+  // set, which saves a descriptor set per material.
+  static constexpr bool USE_BINDLESS_TEXTURES = true;
+  static constexpr uint32_t MAX_BINDLESS_TEXTURES = 4096;
+
+  // Load the block-compressed variant of a texture (`name.bc7.ktx2` or `name.astc.ktx2` next to the image)
+  // if the device supports it, and generate the full mip chain of uncompressed textures with blits
+  static constexpr bool USE_COMPRESSED_TEXTURES = true;
+  static constexpr bool GENERATE_MIPMAPS = true;
+
+  // Record the draws of a frame into secondary command buffers on worker threads (one less than the
+  // number of cores, at most MAX_RECORDING_THREADS), if there are at least PARALLEL_RECORDING_MIN_DRAWS
+  static constexpr bool USE_PARALLEL_RECORDING = true;
+  static constexpr uint32_t MAX_RECORDING_THREADS = 4;
+  static constexpr uint32_t PARALLEL_RECORDING_MIN_DRAWS = 256;
+
+  // Draw static scene subtrees from command buffers recorded once, instead of recording them every frame.
+  // Needs push constants, as the uniform arena is rewritten each frame. Frames drawing static subtrees
+  // always record the remaining draws into secondary command buffers, as the render pass can't mix them
+  // with inline commands.
+  static constexpr bool USE_STATIC_COMMAND_CACHE = true;
+
+  // File the pipeline cache is stored in between runs (relative to the working directory)
+  static constexpr const char *PIPELINE_CACHE_FILE = "xre_pipeline_cache.bin";
 
   VkPipelineLayout createPipelineLayout();
-  VkPipeline createGraphicsPipeline(const std::string &vert_path, const std::string &frag_path);
-  void bindGraphicsPipeline(VkPipeline pipeline);
-  Buffer *createUniformBuffer();
-  VkDescriptorSet allocateDescriptorSet(Buffer *material_uniform_buffer, VkImageView texture_image_view, VkSampler texture_sampler, bool use_persistent_pool);
+  VkPipeline acquireGraphicsPipeline(const std::string &vert_path, const std::string &frag_path, const PipelineState &state);
+  void releaseGraphicsPipeline(VkPipeline pipeline);
+  void destroyUnusedPipelines();
+  PipelineRegistryStatistics getPipelineRegistryStatistics();
+  VkDescriptorSet allocateDescriptorSet(VkImageView texture_image_view, VkSampler texture_sampler, bool use_persistent_pool);
+  VkDescriptorSet getSharedDescriptorSet();
+  uint32_t acquireBindlessTexture(VkImageView texture_image_view, VkSampler texture_sampler);
+  void releaseBindlessTexture(VkImageView texture_image_view);
   void resetDescriptorPool();
+  void waitForFramesInFlight();
+  FrameStatistics getFrameStatistics();
+  bool isGpuTimingEnabled();
+  double takeCompletedGpuTime(uint32_t &submission_count);
+  std::vector<GpuScopeStatistics> getGpuProfilerStatistics();
+  RenderQueueStatistics getRenderQueueStatistics();
+  RenderQueueStatistics getLastFrameRenderQueueStatistics();
+  CullingStatistics getCullingStatistics();
+  CullingStatistics getLastFrameCullingStatistics();
+  void savePipelineCache();
+  PipelineCacheStatistics getPipelineCacheStatistics();
+  void printStatistics();
+  void stopRecordingThreads();
 
   VkCommandBuffer beginSingleTimeCommands();
   void endSingleTimeCommands(VkCommandBuffer commandBuffer);
@@ -56,7 +181,8 @@ private:
   // -------------------------------------------
   // Methods
   // -------------------------------------------
-  VkShaderModule createShaderModule(const std::vector<char> &code);
+  VkPipeline createGraphicsPipeline(VkShaderModule vertex_shader_module, VkShaderModule fragment_shader_module,
+                                    const PipelineState &state);
 
   // -------------------------------------------
   // Attributes
@@ -76,38 +202,106 @@ private:
   // Render pass for the graphics pipeline
   VkRenderPass m_render_pass = nullptr;
 
+  // Whether the render pass renders all views at once
+  bool m_multiview_enabled = false;
+
+  // Number of samples of the color and depth attachments, with more than one they are resolved into the swapchain
+  VkSampleCountFlagBits m_sample_count = VK_SAMPLE_COUNT_1_BIT;
+
+  // Whether the depth attachment is stored at the end of the render pass, i.e. submitted to the compositor
+  bool m_depth_store_enabled = false;
+
   // Graphics queue used for rendering
   VkQueue m_graphics_queue = nullptr;
 
-  // Uniform buffers
-  Buffer *m_uniform_buffer = nullptr;
-  Buffer *m_global_uniform_buffer = nullptr;
+  // Sub-allocates the device memory of all buffers and images
+  MemoryAllocator *m_memory_allocator = nullptr;
+
+  // Uploads static data into device local memory
+  UploadManager *m_upload_manager = nullptr;
+
+  // Shared vertex and index buffers for static geometry
+  GeometryPool *m_geometry_pool = nullptr;
+
+  // Cache shared by all pipeline creations, persisted on disk
+  PipelineCache *m_pipeline_cache = nullptr;
+
+  // Shared pipelines and shader modules
+  PipelineRegistry *m_pipeline_registry = nullptr;
+
+  // Sorts the draws of a frame to minimize state changes
+  RenderQueue m_render_queue;
 
-  // Vertex and index buffers
-  Buffer *m_vertex_buffer = nullptr;
-  Buffer *m_index_buffer = nullptr;
+  // Records the draws of the render queue on worker threads, only created if parallel recording or the static
+  // command cache is enabled
+  ParallelRecorder *m_parallel_recorder = nullptr;
+
+  // Command buffers of the static subtrees and the queue their draws are sorted in while recording them,
+  // only created if the static command cache is enabled
+  StaticCommandCache *m_static_command_cache = nullptr;
+  RenderQueue m_static_render_queue;
+
+  // Culls the draws of the render queue on the GPU, only created if GPU culling is enabled
+  GpuCuller *m_gpu_culler = nullptr;
+  bool m_gpu_culling_enabled = false;
+
+  // Whether the driver can report if a pipeline creation hit the cache (VK_EXT_pipeline_creation_feedback)
+  bool m_pipeline_creation_feedback_enabled = false;
+
+  // Persistently mapped storage for the per-draw uniform data of all frames in flight
+  UniformArena *m_uniform_arena = nullptr;
 
   // Specifies the types of resources that are going to be accessed by the pipeline
   VkDescriptorSetLayout m_descriptor_set_layout = nullptr;
-  VkDescriptorPool m_scene_descriptor_pool; // Pool used by a scene for materials, can be reset between scenes
-  VkDescriptorPool m_persistent_descriptor_pool; // Pool used by multiple scene, e.g. for controller materials, must not be reset
+  DescriptorAllocator *m_scene_descriptor_allocator = nullptr; // Used by a scene for materials, reset between scenes
+  DescriptorAllocator *m_persistent_descriptor_allocator = nullptr; // Used by multiple scenes, e.g. for controller materials, never reset
 
   VkDescriptorSetLayout m_global_descriptor_set_layout = nullptr;
-  VkDescriptorSet m_global_descriptor_set = nullptr;
+
+  // Bindless texture array (set = 2), only created if bindless textures are enabled. Slots are handed out
+  // per image view, and released slots are only reused once the frames which might still sample them are done.
+  struct BindlessTexture {
+    uint32_t slot;
+    uint32_t references;
+  };
+
+  bool m_bindless_enabled = false;
+  uint32_t m_bindless_capacity = 0u;
+  VkDescriptorSetLayout m_bindless_descriptor_set_layout = VK_NULL_HANDLE;
+  VkDescriptorPool m_bindless_descriptor_pool = VK_NULL_HANDLE;
+  VkDescriptorSet m_bindless_descriptor_set = VK_NULL_HANDLE;
+  VkDescriptorSet m_shared_descriptor_set = VK_NULL_HANDLE; // Set 1 of all materials in bindless mode
+  std::unordered_map<VkImageView, BindlessTexture> m_bindless_textures;
+  std::vector<std::pair<uint32_t, uint64_t>> m_released_bindless_slots; // Slot and the frame it was released in
+  uint32_t m_next_bindless_slot = 0u;
 
   // Layout of the graphics pipeline (holds `uniform` values in shaders)
   VkPipelineLayout m_pipeline_layout = nullptr;
 
-  // Command pool for our application (manage the memory that is used to store
+  // Command pool for one-off commands, e.g. uploads (manage the memory that is used to store
   // command buffers).
   VkCommandPool m_command_pool = nullptr;
 
-  // Command buffer for our application
-  VkCommandBuffer m_command_buffer = nullptr;
+  // Ring of per-frame resources, and the index of the frame we're currently recording
+  uint32_t m_frames_in_flight;
+  std::vector<FrameData> m_frames;
+  uint32_t m_current_frame = 0u;
+
+  // Tracks how often we had to wait for the GPU
+  FrameStatistics m_frame_statistics;
+
+  // Measures the GPU time of the frames and their passes (only created if the queue supports timestamps)
+  GpuProfiler *m_gpu_profiler = nullptr;
+  bool m_gpu_timing_enabled = false;
+  bool m_pipeline_statistics_enabled = false;
+  double m_timestamp_period = 0.0; // Nanoseconds per timestamp tick
+  uint64_t m_timestamp_mask = 0u;  // Valid bits of the timestamps
 
-  // Synchronization object
-  VkFence m_fence = nullptr;
+  // Whether block-compressed textures in the BC or ASTC LDR formats can be sampled
+  bool m_texture_compression_bc_enabled = false;
+  bool m_texture_compression_astc_enabled = false;
 
-  // Aligned size for the uniform buffer
-  VkDeviceSize m_aligned_size;
+  // Frustum culling counters, summed over all frames and of the last frame
+  CullingStatistics m_culling_statistics;
+  CullingStatistics m_last_frame_culling_statistics;
 };
@@ -22,4 +22,21 @@ inline static uint32_t findMemoryType(VkPhysicalDevice physical_device, uint32_t
   Utils::exitWithMessage("Failed to find suitable memory type!");
   return 0;
 }
+
+// Create a view of all layers of an image, which is a 2D array view if there is more than one layer
+inline static VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspect,
+                                          uint32_t layer_count) {
+  VkImageViewCreateInfo image_view_create_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  image_view_create_info.image = image;
+  image_view_create_info.format = format;
+  image_view_create_info.viewType = layer_count > 1u ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+  image_view_create_info.subresourceRange.aspectMask = aspect;
+  image_view_create_info.subresourceRange.levelCount = 1u;
+  image_view_create_info.subresourceRange.layerCount = layer_count;
+
+  VkImageView image_view;
+  VkResult result = vkCreateImageView(device, &image_view_create_info, nullptr, &image_view);
+  Utils::checkVkResult(result, "Failed to create image view");
+  return image_view;
+}
 } // namespace VulkanUtils
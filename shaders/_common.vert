@@ -1,18 +1,62 @@
+#extension GL_EXT_multiview : require
+
+// Holds one view projection matrix per eye. In multiview mode, gl_ViewIndex selects the matrix of the
+// eye we're currently rendering, otherwise gl_ViewIndex is always 0.
 layout(set = 0, binding = 0) uniform GlobalUniformBufferObject {
-  mat4 view_projection;
+  mat4 view_projection[2];
   vec3 light_vector;
   vec3 light_color;
   vec3 ambient_color;
 } globalUBO;
 
+#ifdef XRE_INDIRECT
+// GPU-driven draws read the data of the model from the object buffer of the frame instead, the culling
+// pass stores the index of the object in `firstInstance` of the indirect draw command.
+struct ObjectData {
+  mat4 world;
+  vec3 color;
+  uint texture_index;
+};
+
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+  ObjectData objects[];
+} objectBuffer;
+
+#define modelUBO objectBuffer.objects[gl_InstanceIndex]
+#elif defined(XRE_INSTANCED)
+// Instanced draws get the data of each instance as per-instance vertex attributes (binding 1), the
+// world matrix takes up locations 3 to 6.
+layout(location = 3) in mat4 inInstanceWorld;
+layout(location = 7) in vec3 inInstanceColor;
+layout(location = 8) in uint inInstanceTextureIndex;
+
+struct InstanceData {
+  mat4 world;
+  vec3 color;
+  uint texture_index;
+};
+
+#define modelUBO InstanceData(inInstanceWorld, inInstanceColor, inInstanceTextureIndex)
+#elif defined(XRE_PUSH_CONSTANTS)
+// Directly recorded draws get their data as push constants, such that set 1 only holds material data and
+// doesn't need to be bound again for each draw.
+layout(push_constant) uniform ModelPushConstants {
+  mat4 world;
+  vec3 color;
+  uint texture_index;
+} modelUBO;
+#else
 layout(set = 1, binding = 0) uniform ModelUniformBufferObject {
   mat4 world;
   vec3 color;
+  uint texture_index;
 } modelUBO;
+#endif
 
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec3 inNormal;
 layout(location = 2) in vec2 inTexCoord;
 
 layout(location = 0) out vec3 color;
-layout(location = 1) out vec2 fragTexCoord;
\ No newline at end of file
+layout(location = 1) out vec2 fragTexCoord;
+layout(location = 2) flat out uint fragTextureIndex; // Slot in the bindless texture array
\ No newline at end of file
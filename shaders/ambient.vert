@@ -6,7 +6,7 @@ void main() {
   vec4 pos = modelUBO.world * vec4(inPosition, 1.0);
 
   // Transform to clip space
-  gl_Position = globalUBO.view_projection * pos;
+  gl_Position = globalUBO.view_projection[gl_ViewIndex] * pos;
 
   // Extract rotation+scale, then fix for non-uniform scaling
   mat3 normalMatrix = transpose(inverse(mat3(modelUBO.world)));
@@ -6,11 +6,12 @@ void main() {
   vec4 pos = modelUBO.world * vec4(inPosition, 1.0);
 
   // Transform to clip space
-  gl_Position = globalUBO.view_projection * pos;
+  gl_Position = globalUBO.view_projection[gl_ViewIndex] * pos;
 
   // Set color to color of the model
   color = modelUBO.color;
 
   // Set fragment texture coordinates
   fragTexCoord = inTexCoord;
+  fragTextureIndex = modelUBO.texture_index;
 }
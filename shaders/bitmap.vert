@@ -15,4 +15,5 @@ void main() {
 
   // Set fragment texture coordinates
   fragTexCoord = inTexCoord;
+  fragTextureIndex = modelUBO.texture_index;
 }
@@ -2,5 +2,14 @@ glslc --target-env=vulkan1.3 -std=450core basic.vert -o basic.vert.spv
 glslc --target-env=vulkan1.3 -std=450core basic.frag -o basic.frag.spv
 glslc --target-env=vulkan1.3 -std=450core ambient.vert -o ambient.vert.spv
 glslc --target-env=vulkan1.3 -std=450core texture.frag -o texture.frag.spv
+glslc --target-env=vulkan1.3 -std=450core texture.bindless.frag -o texture.bindless.frag.spv
 glslc --target-env=vulkan1.3 -std=450core bitmap.vert -o bitmap.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_INDIRECT basic.vert -o basic.indirect.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_INDIRECT ambient.vert -o ambient.indirect.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_INSTANCED basic.vert -o basic.instanced.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_INSTANCED ambient.vert -o ambient.instanced.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_PUSH_CONSTANTS basic.vert -o basic.push.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_PUSH_CONSTANTS ambient.vert -o ambient.push.vert.spv
+glslc --target-env=vulkan1.3 -std=450core -DXRE_PUSH_CONSTANTS bitmap.vert -o bitmap.push.vert.spv
+glslc --target-env=vulkan1.3 -std=450core cull.comp -o cull.comp.spv
 pause
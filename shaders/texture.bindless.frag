@@ -0,0 +1,13 @@
+#version 450 core
+#extension GL_EXT_nonuniform_qualifier : require
+#include "_common.frag"
+
+// All textures of the scene, the vertex shader passes on the slot of the texture of the model
+layout(set = 2, binding = 0) uniform sampler2D textures[];
+
+layout(location = 2) flat in uint fragTextureIndex;
+
+void main() {
+  // Draws merged by the GPU-driven path may use different textures, so the index is not uniform
+  outColor = texture(textures[nonuniformEXT(fragTextureIndex)], fragmentCoordinate);
+}
@@ -1,8 +1,8 @@
 #include <xre/application.h>
 
-Application::Application(const char *application_name) {
+Application::Application(const char *application_name, uint32_t frames_in_flight) {
   // create the XR handler
-  m_open_xr_handler = std::make_unique<OpenXrHandler>(application_name);
+  m_open_xr_handler = std::make_unique<OpenXrHandler>(application_name, frames_in_flight);
 
   // Create the resource manager
   m_resource_manager = std::make_shared<ResourceManager>(m_open_xr_handler->m_vulkan_handler);
@@ -1,10 +1,12 @@
 #include <xre/buffer.h>
 
-Buffer::Buffer(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize size, VkBufferUsageFlags buffer_usage_flags) {
+Buffer::Buffer(MemoryAllocator *allocator, VkDeviceSize size, VkBufferUsageFlags buffer_usage_flags,
+               VkMemoryPropertyFlags memory_property_flags) {
   VkResult result;
 
   // Store inputs on object
-  m_device = device;
+  m_allocator = allocator;
+  m_device = allocator->getDevice();
   m_size = size;
 
   // Setup the create info struct to create the buffer, passing in the needed
@@ -13,30 +15,18 @@ Buffer::Buffer(VkDevice device, VkPhysicalDevice physical_device, VkDeviceSize s
   buffer_create_info.size = size;
   buffer_create_info.usage = buffer_usage_flags;
   buffer_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  result = vkCreateBuffer(device, &buffer_create_info, nullptr, &m_buffer);
+  result = vkCreateBuffer(m_device, &buffer_create_info, nullptr, &m_buffer);
   Utils::checkVkResult(result, "Failed to create buffer");
 
-  // Get the memory requirements and the memory proportions from the Vulkan runtime
+  // Get the memory requirements from the Vulkan runtime
   VkMemoryRequirements memory_requirements;
-  vkGetBufferMemoryRequirements(device, m_buffer, &memory_requirements);
+  vkGetBufferMemoryRequirements(m_device, m_buffer, &memory_requirements);
 
-  VkPhysicalDeviceMemoryProperties memory_properties;
-  vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
-
-  // Find the index of the memory type we requestes
-  const uint32_t properties = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
-  const VkMemoryPropertyFlags type_filter = memory_requirements.memoryTypeBits;
-  uint32_t memory_type_index = VulkanUtils::findMemoryType(physical_device, type_filter, properties);
-
-  // Allocate memory
-  VkMemoryAllocateInfo memory_allocate_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
-  memory_allocate_info.allocationSize = memory_requirements.size;
-  memory_allocate_info.memoryTypeIndex = memory_type_index;
-  result = vkAllocateMemory(device, &memory_allocate_info, nullptr, &m_device_memory);
-  Utils::checkVkResult(result, "Failed to allocate memory for buffer");
+  // Sub-allocate the memory from one of the blocks of the allocator
+  m_allocation = m_allocator->allocate(memory_requirements, memory_property_flags, AllocationKind::BUFFER);
 
   // And bind the buffer memory
-  result = vkBindBufferMemory(device, m_buffer, m_device_memory, 0u);
+  result = vkBindBufferMemory(m_device, m_buffer, m_allocation.memory, m_allocation.offset);
   Utils::checkVkResult(result, "Failed to allocate bind memory for buffer");
 }
 
@@ -45,7 +35,6 @@ void Buffer::loadData(std::vector<Vertex> input) {
   void *data = map();
   uint32_t size = sizeof(Vertex) * input.size();
   memcpy(data, input.data(), size);
-  unmap();
 }
 
 // Method to load indices into a buffer
@@ -53,43 +42,34 @@ void Buffer::loadData(std::vector<uint16_t> input) {
   void *data = map();
   uint32_t size = sizeof(uint16_t) * input.size();
   memcpy(data, input.data(), size);
-  unmap();
-}
-
-// Method to load data from a UBO for a Model into a buffer
-void Buffer::loadData(ModelUniformBufferObject input, VkDeviceSize offset) {
-  void *data = map();
-  // Copy at given offset
-  memcpy(static_cast<uint8_t *>(data) + offset, &input, sizeof(input));
-  unmap();
 }
 
 // Method to load data for the global UBO into a buffer
 void Buffer::loadData(GlobalUniformBufferObject input) {
   void *data = map();
   memcpy(data, &input, sizeof(input));
-  unmap();
 }
 
 void Buffer::loadData(stbi_uc *input) {
   void *data = map();
   memcpy(data, input, m_size);
-  unmap();
 }
 
+// Returns a pointer to the memory of the buffer, which stays valid until the buffer is destroyed
+void *Buffer::mapPersistently() { return map(); }
+
 void Buffer::destroy() {
   vkDestroyBuffer(m_device, m_buffer, nullptr);
-  vkFreeMemory(m_device, m_device_memory, nullptr);
+  m_allocator->free(m_allocation);
 }
 
+// Host visible memory is mapped by the allocator for its whole lifetime, so we only need to
+// return the pointer to our allocation.
 void *Buffer::map() {
-  void *data;
-  VkResult result = vkMapMemory(m_device, m_device_memory, 0u, m_size, 0, &data);
-  Utils::checkVkResult(result, "Failed to map memory for buffer");
+  // Device local buffers can't be mapped, their data needs to be uploaded by the `UploadManager`
+  Utils::checkBoolResult(m_allocation.mapped_data != nullptr, "Failed to map buffer, its memory is not host visible");
 
-  return data;
+  return m_allocation.mapped_data;
 }
 
-void Buffer::unmap() { vkUnmapMemory(m_device, m_device_memory); }
-
 VkBuffer Buffer::getBuffer() { return m_buffer; }
@@ -0,0 +1,92 @@
+#include <xre/cpu_profiler.h>
+
+#ifdef XRE_ENABLE_PROFILER
+
+// Other includes
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+uint64_t CpuProfiler::now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - s_start_time).count();
+}
+
+void CpuProfiler::record(const char *name, uint64_t start_ns, uint64_t end_ns) {
+  ThreadBuffer &buffer = threadBuffer();
+
+  // Only this thread writes the count, so a relaxed load is sufficient. The store publishes the event.
+  uint64_t count = buffer.count.load(std::memory_order_relaxed);
+  buffer.events[count % EVENTS_PER_THREAD] = {name, start_ns, end_ns};
+  buffer.count.store(count + 1u, std::memory_order_release);
+}
+
+void CpuProfiler::setThreadName(const char *name) { threadBuffer().thread_name = name; }
+
+//------------------------------------------------------------------------------------------------------
+// Write the events of all threads as complete ("X") events of the Chrome trace event format, with the
+// times in microseconds. Returns false if the file could not be written.
+//------------------------------------------------------------------------------------------------------
+bool CpuProfiler::writeChromeTrace(const std::string &path) {
+  std::ofstream file(path);
+  if (!file) {
+    std::cout << "Could not write the CPU trace to " << path << std::endl;
+    return false;
+  }
+
+  // The names are string literals chosen by us, so only quotes and backslashes need escaping
+  auto write_name = [&file](const char *name) {
+    file << '"';
+    for (const char *c = name; *c != '\0'; c++) {
+      if (*c == '"' || *c == '\\') {
+        file << '\\';
+      }
+      file << *c;
+    }
+    file << '"';
+  };
+
+  std::lock_guard<std::mutex> lock(s_buffers_mutex);
+
+  file << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+  bool first = true;
+  for (const ThreadBuffer *buffer : s_buffers) {
+    if (!buffer->thread_name.empty()) {
+      file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->thread_id
+           << ",\"args\":{\"name\":";
+      write_name(buffer->thread_name.c_str());
+      file << "}}";
+      first = false;
+    }
+
+    uint64_t count = buffer->count.load(std::memory_order_acquire);
+    for (uint64_t i = count - std::min<uint64_t>(count, EVENTS_PER_THREAD); i < count; i++) {
+      const Event &event = buffer->events[i % EVENTS_PER_THREAD];
+      file << (first ? "" : ",") << "\n{\"name\":";
+      write_name(event.name);
+      file << ",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->thread_id << ",\"ts\":" << event.start_ns / 1000.0
+           << ",\"dur\":" << (event.end_ns - event.start_ns) / 1000.0 << "}";
+      first = false;
+    }
+  }
+  file << "\n]}\n";
+
+  return static_cast<bool>(file);
+}
+
+// Returns the buffer of the calling thread, which is registered on first use
+CpuProfiler::ThreadBuffer &CpuProfiler::threadBuffer() {
+  thread_local ThreadBuffer *buffer = nullptr;
+
+  if (buffer == nullptr) {
+    buffer = new ThreadBuffer();
+
+    std::lock_guard<std::mutex> lock(s_buffers_mutex);
+    buffer->thread_id = static_cast<uint32_t>(s_buffers.size());
+    s_buffers.push_back(buffer);
+  }
+
+  return *buffer;
+}
+
+#endif
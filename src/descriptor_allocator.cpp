@@ -0,0 +1,123 @@
+#include <xre/descriptor_allocator.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the allocator, the first pool is only created on the first allocation.
+// Arguments:
+//  1) Device the descriptor sets are allocated for
+//  2) Name of the allocator, used in the statistics
+//  3) Number of descriptors of each type a single set needs at most
+//  4) Number of sets of the first pool, each further pool has twice as many (up to MAX_SETS_PER_POOL)
+//------------------------------------------------------------------------------------------------------
+DescriptorAllocator::DescriptorAllocator(VkDevice device, const char *name, const std::vector<VkDescriptorPoolSize> &set_sizes,
+                                         uint32_t sets_per_pool) {
+  m_device = device;
+  m_set_sizes = set_sizes;
+  m_sets_per_pool = std::min(sets_per_pool, MAX_SETS_PER_POOL);
+  m_statistics.name = name;
+}
+
+void DescriptorAllocator::destroy() {
+  reset();
+
+  for (VkDescriptorPool pool : m_free_pools) {
+    vkDestroyDescriptorPool(m_device, pool, nullptr);
+  }
+  m_free_pools.clear();
+}
+
+//------------------------------------------------------------------------------------------------------
+// Allocate a set with the given layout. If the current pool is out of memory (or too fragmented), the
+// allocation is retried once with the next pool.
+//------------------------------------------------------------------------------------------------------
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+  if (m_current_pool == VK_NULL_HANDLE) {
+    m_current_pool = acquirePool();
+  }
+
+  VkDescriptorSetAllocateInfo descriptor_set_allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  descriptor_set_allocate_info.descriptorPool = m_current_pool;
+  descriptor_set_allocate_info.descriptorSetCount = 1u;
+  descriptor_set_allocate_info.pSetLayouts = &layout;
+
+  VkDescriptorSet descriptor_set;
+  VkResult result = vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &descriptor_set);
+
+  if (result == VK_ERROR_OUT_OF_POOL_MEMORY || result == VK_ERROR_FRAGMENTED_POOL) {
+    m_used_pools.push_back(m_current_pool);
+    m_current_pool = acquirePool();
+
+    descriptor_set_allocate_info.descriptorPool = m_current_pool;
+    result = vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &descriptor_set);
+  }
+
+  Utils::checkVkResult(result, "Failed to allocate descriptor set from pool");
+
+  m_allocated_sets++;
+  m_statistics.allocations++;
+  m_statistics.peak_sets = std::max(m_statistics.peak_sets, m_allocated_sets);
+
+  return descriptor_set;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Free all sets of the allocator. The caller has to make sure that none of them is still in use by the
+// GPU. The pools are kept for the next allocations.
+//------------------------------------------------------------------------------------------------------
+void DescriptorAllocator::reset() {
+  if (m_current_pool != VK_NULL_HANDLE) {
+    m_used_pools.push_back(m_current_pool);
+    m_current_pool = VK_NULL_HANDLE;
+  }
+
+  for (VkDescriptorPool pool : m_used_pools) {
+    VkResult result = vkResetDescriptorPool(m_device, pool, 0);
+    Utils::checkVkResult(result, "Failed to reset descriptor pool");
+    m_free_pools.push_back(pool);
+  }
+  m_used_pools.clear();
+
+  m_allocated_sets = 0u;
+  m_statistics.resets++;
+}
+
+DescriptorAllocatorStatistics DescriptorAllocator::getStatistics() {
+  DescriptorAllocatorStatistics statistics = m_statistics;
+  statistics.pools = static_cast<uint32_t>(m_used_pools.size() + m_free_pools.size()) + (m_current_pool != VK_NULL_HANDLE ? 1u : 0u);
+  return statistics;
+}
+
+// Returns a pool with free sets, preferring the pools which were reset over creating a new one
+VkDescriptorPool DescriptorAllocator::acquirePool() {
+  if (!m_free_pools.empty()) {
+    VkDescriptorPool pool = m_free_pools.back();
+    m_free_pools.pop_back();
+    return pool;
+  }
+
+  return createPool();
+}
+
+VkDescriptorPool DescriptorAllocator::createPool() {
+  std::vector<VkDescriptorPoolSize> pool_sizes = m_set_sizes;
+  for (VkDescriptorPoolSize &pool_size : pool_sizes) {
+    pool_size.descriptorCount *= m_sets_per_pool;
+  }
+
+  VkDescriptorPoolCreateInfo descriptor_pool_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+  descriptor_pool_create_info.pPoolSizes = pool_sizes.data();
+  descriptor_pool_create_info.maxSets = m_sets_per_pool;
+
+  VkDescriptorPool pool;
+  VkResult result = vkCreateDescriptorPool(m_device, &descriptor_pool_create_info, nullptr, &pool);
+  Utils::checkVkResult(result, "Failed to create descriptor pool");
+
+  // Every pool after the first one means the allocator was sized too small for the content
+  if (m_statistics.created_pools > 0u) {
+    m_statistics.pool_growths++;
+  }
+  m_statistics.created_pools++;
+
+  m_sets_per_pool = std::min(m_sets_per_pool * 2u, MAX_SETS_PER_POOL);
+  return pool;
+}
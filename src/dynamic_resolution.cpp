@@ -0,0 +1,53 @@
+#include <xre/dynamic_resolution.h>
+
+// Other includes
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------------------
+// Create the controller, which starts at the maximum scale.
+// Arguments:
+//  1) Lowest scale the resolution may be reduced to
+//  2) Highest scale, usually 1 (i.e. the recommended resolution)
+//------------------------------------------------------------------------------------------------------
+DynamicResolution::DynamicResolution(float min_scale, float max_scale)
+    : m_min_scale(min_scale), m_max_scale(max_scale), m_scale(max_scale) {}
+
+void DynamicResolution::update(double gpu_time_ms, double frame_budget_ms) {
+  if (frame_budget_ms <= 0.0) {
+    return;
+  }
+
+  // Smooth the time, as the GPU time of single frames is noisy
+  if (m_smoothed_gpu_time_ms == 0.0) {
+    m_smoothed_gpu_time_ms = gpu_time_ms;
+  } else {
+    m_smoothed_gpu_time_ms += (gpu_time_ms - m_smoothed_gpu_time_ms) * SMOOTHING;
+  }
+
+  double load = m_smoothed_gpu_time_ms / frame_budget_ms;
+  m_frames_above = load > LOWER_THRESHOLD ? m_frames_above + 1u : 0u;
+  m_frames_below = load < RAISE_THRESHOLD ? m_frames_below + 1u : 0u;
+
+  // After a step, the counters and the smoothed time start over, such that the new scale is measured
+  // before the next step (the measurements lag behind by the frames in flight)
+  if (m_frames_above >= LOWER_FRAMES) {
+    m_scale = std::max(m_scale - SCALE_STEP, m_min_scale);
+    m_frames_above = 0u;
+    m_smoothed_gpu_time_ms = 0.0;
+  } else if (m_frames_below >= RAISE_FRAMES) {
+    m_scale = std::min(m_scale + SCALE_STEP, m_max_scale);
+    m_frames_below = 0u;
+    m_smoothed_gpu_time_ms = 0.0;
+  }
+}
+
+float DynamicResolution::getScale() const { return m_scale; }
+
+VkExtent2D DynamicResolution::scaleExtent(VkExtent2D extent) const {
+  auto scale = [this](uint32_t size) {
+    uint32_t scaled = static_cast<uint32_t>(size * m_scale) / EXTENT_ALIGNMENT * EXTENT_ALIGNMENT;
+    return std::clamp(scaled, std::min(EXTENT_ALIGNMENT, size), size);
+  };
+
+  return {scale(extent.width), scale(extent.height)};
+}
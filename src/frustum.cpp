@@ -0,0 +1,95 @@
+#include <xre/frustum.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the frustum of a single view.
+//------------------------------------------------------------------------------------------------------
+Frustum Frustum::fromView(const XrView &view, const glm::vec3 &current_origin, float far_clip) {
+  glm::vec3 position = glm::vec3(view.pose.position.x, view.pose.position.y, view.pose.position.z) + current_origin;
+  glm::quat orientation = glm::quat(view.pose.orientation.w, view.pose.orientation.x, view.pose.orientation.y, view.pose.orientation.z);
+
+  return Frustum(position, orientation, view.fov, far_clip);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Create a single frustum containing the frusta of both eyes. It uses the outermost angles of both
+// views, and its apex is moved back from the center between the eyes until its side planes pass through
+// the eyes, such that both frusta are inside. This assumes that the displays are (roughly) parallel.
+//------------------------------------------------------------------------------------------------------
+Frustum Frustum::fromStereoViews(const XrView &left_view, const XrView &right_view, const glm::vec3 &current_origin, float far_clip) {
+  glm::vec3 left_position = glm::vec3(left_view.pose.position.x, left_view.pose.position.y, left_view.pose.position.z);
+  glm::vec3 right_position = glm::vec3(right_view.pose.position.x, right_view.pose.position.y, right_view.pose.position.z);
+  glm::quat left_orientation =
+      glm::quat(left_view.pose.orientation.w, left_view.pose.orientation.x, left_view.pose.orientation.y, left_view.pose.orientation.z);
+  glm::quat right_orientation =
+      glm::quat(right_view.pose.orientation.w, right_view.pose.orientation.x, right_view.pose.orientation.y, right_view.pose.orientation.z);
+
+  XrFovf fov;
+  fov.angleLeft = std::min(left_view.fov.angleLeft, right_view.fov.angleLeft);
+  fov.angleRight = std::max(left_view.fov.angleRight, right_view.fov.angleRight);
+  fov.angleDown = std::min(left_view.fov.angleDown, right_view.fov.angleDown);
+  fov.angleUp = std::max(left_view.fov.angleUp, right_view.fov.angleUp);
+
+  // Distance the apex needs to be moved back such that the side planes pass through the eyes
+  float half_eye_distance = glm::length(right_position - left_position) * 0.5f;
+  float left_tangent = std::max(glm::tan(-fov.angleLeft), 0.001f);
+  float right_tangent = std::max(glm::tan(fov.angleRight), 0.001f);
+  float apex_offset = std::max(half_eye_distance / left_tangent, half_eye_distance / right_tangent);
+
+  // The views look along -Z, so moving back means moving along +Z
+  glm::quat orientation = glm::slerp(left_orientation, right_orientation, 0.5f);
+  glm::vec3 position = (left_position + right_position) * 0.5f + current_origin + orientation * glm::vec3(0.0f, 0.0f, apex_offset);
+
+  return Frustum(position, orientation, fov, far_clip + apex_offset);
+}
+
+Frustum::Frustum(const glm::vec3 &position, const glm::quat &orientation, const XrFovf &fov, float far_clip) {
+  // Normals of the planes in view space (looking along -Z), pointing inside. The side planes pass through
+  // the apex, the far plane is at the given distance.
+  std::array<glm::vec3, 5> normals = {
+      glm::vec3(glm::cos(fov.angleLeft), 0.0f, glm::sin(fov.angleLeft)),
+      glm::vec3(-glm::cos(fov.angleRight), 0.0f, -glm::sin(fov.angleRight)),
+      glm::vec3(0.0f, glm::cos(fov.angleDown), glm::sin(fov.angleDown)),
+      glm::vec3(0.0f, -glm::cos(fov.angleUp), -glm::sin(fov.angleUp)),
+      glm::vec3(0.0f, 0.0f, 1.0f),
+  };
+
+  // Transform the planes into world space
+  for (size_t i = 0; i < normals.size(); i++) {
+    glm::vec3 normal = orientation * normals[i];
+    m_planes[i] = glm::vec4(normal, -glm::dot(normal, position));
+  }
+  m_planes[4].w += far_clip;
+}
+
+bool Frustum::intersects(const AABB &box) const {
+  glm::vec3 center = (box.min + box.max) * 0.5f;
+  glm::vec3 half_extents = (box.max - box.min) * 0.5f;
+
+  for (const glm::vec4 &plane : m_planes) {
+    float radius = glm::dot(glm::abs(glm::vec3(plane)), half_extents);
+    if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool Frustum::intersects(OOBB box) const {
+  glm::vec3 center = box.getCenter();
+  glm::vec3 extents = box.getExtents();
+  glm::mat3 axes = box.getAxes();
+
+  for (const glm::vec4 &plane : m_planes) {
+    glm::vec3 normal = glm::vec3(plane);
+
+    // Project the box onto the normal of the plane
+    float radius = glm::abs(glm::dot(normal, axes[0])) * extents.x + glm::abs(glm::dot(normal, axes[1])) * extents.y +
+                   glm::abs(glm::dot(normal, axes[2])) * extents.z;
+    if (glm::dot(normal, center) + plane.w < -radius) {
+      return false;
+    }
+  }
+
+  return true;
+}
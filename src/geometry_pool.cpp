@@ -0,0 +1,167 @@
+#include <xre/geometry_pool.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the pool.
+// Arguments:
+//  1) Allocator to get the memory of the pages from
+//  2) Upload manager to copy the geometry into the pages
+//  3) Number of frames which can be in flight at the same time
+//------------------------------------------------------------------------------------------------------
+GeometryPool::GeometryPool(MemoryAllocator *allocator, UploadManager *upload_manager, uint32_t frame_count) {
+  m_allocator = allocator;
+  m_upload_manager = upload_manager;
+  m_frame_count = frame_count;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Allocate a range for the given geometry in one of the pages and upload the data into it. The range
+// has to be returned with `free()` once the geometry is not drawn anymore.
+//------------------------------------------------------------------------------------------------------
+GeometryRange GeometryPool::allocate(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices) {
+  uint32_t vertex_count = static_cast<uint32_t>(vertices.size());
+  uint32_t index_count = static_cast<uint32_t>(indices.size());
+
+  // Look for a page which still has enough space for both the vertices and the indices
+  Page *target_page = nullptr;
+  int32_t vertex_block = -1;
+  int32_t index_block = -1;
+  for (Page &page : m_pages) {
+    vertex_block = findBlock(page.free_vertices, vertex_count);
+    index_block = findBlock(page.free_indices, index_count);
+    if (vertex_block >= 0 && index_block >= 0) {
+      target_page = &page;
+      break;
+    }
+  }
+
+  // Otherwise create a new one, which is larger than usual if the geometry would not fit a regular page
+  if (target_page == nullptr) {
+    target_page = &createPage(std::max(vertex_count, PAGE_VERTEX_COUNT), std::max(index_count, PAGE_INDEX_COUNT));
+    vertex_block = 0;
+    index_block = 0;
+  }
+
+  uint32_t first_vertex = takeBlock(target_page->free_vertices, vertex_block, vertex_count);
+  uint32_t first_index = takeBlock(target_page->free_indices, index_block, index_count);
+
+  GeometryRange range{};
+  range.vertex_buffer = target_page->vertex_buffer->getBuffer();
+  range.index_buffer = target_page->index_buffer->getBuffer();
+  range.vertex_offset = static_cast<int32_t>(first_vertex);
+  range.first_index = first_index;
+  range.index_count = index_count;
+  range.vertex_count = vertex_count;
+
+  // Upload the data into the range of the page
+  m_upload_manager->uploadBuffer(target_page->vertex_buffer, vertices.data(), sizeof(Vertex) * vertex_count,
+                                 sizeof(Vertex) * first_vertex);
+  m_upload_manager->uploadBuffer(target_page->index_buffer, indices.data(), sizeof(uint16_t) * index_count,
+                                 sizeof(uint16_t) * first_index);
+
+  return range;
+}
+
+// Return a range allocated by `allocate()`. As frames in flight might still draw it, it is only reused
+// once these are done.
+void GeometryPool::free(const GeometryRange &range) {
+  for (Page &page : m_pages) {
+    if (page.vertex_buffer->getBuffer() == range.vertex_buffer) {
+      insertBlock(page.free_vertices, static_cast<uint32_t>(range.vertex_offset), range.vertex_count);
+      insertBlock(page.free_indices, range.first_index, range.index_count);
+      return;
+    }
+  }
+}
+
+// Called once the GPU is done with the oldest frame in flight, which makes the blocks it could still
+// draw available again
+void GeometryPool::beginFrame() { m_frame++; }
+
+void GeometryPool::destroy() {
+  for (Page &page : m_pages) {
+    page.vertex_buffer->destroy();
+    page.index_buffer->destroy();
+    delete page.vertex_buffer;
+    delete page.index_buffer;
+  }
+
+  m_pages.clear();
+}
+
+GeometryPool::Page &GeometryPool::createPage(uint32_t vertex_capacity, uint32_t index_capacity) {
+  Page page{};
+  page.vertex_buffer = new Buffer(m_allocator, sizeof(Vertex) * static_cast<VkDeviceSize>(vertex_capacity),
+                                  VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  page.index_buffer = new Buffer(m_allocator, sizeof(uint16_t) * static_cast<VkDeviceSize>(index_capacity),
+                                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  // The whole page is free, and was never drawn
+  page.free_vertices.push_back({0u, vertex_capacity, 0u});
+  page.free_indices.push_back({0u, index_capacity, 0u});
+
+  m_pages.push_back(page);
+  return m_pages.back();
+}
+
+// Returns the first block which can hold the given count and is not drawn by any frame in flight, or -1
+int32_t GeometryPool::findBlock(const std::vector<FreeBlock> &blocks, uint32_t count) {
+  for (size_t i = 0; i < blocks.size(); i++) {
+    if (blocks[i].count >= count && blocks[i].reusable_frame <= m_frame) {
+      return static_cast<int32_t>(i);
+    }
+  }
+
+  return -1;
+}
+
+// Take the given count from the start of a block, and return its offset
+uint32_t GeometryPool::takeBlock(std::vector<FreeBlock> &blocks, int32_t block, uint32_t count) {
+  FreeBlock &free_block = blocks[block];
+  uint32_t offset = free_block.offset;
+
+  free_block.offset += count;
+  free_block.count -= count;
+  if (free_block.count == 0u) {
+    blocks.erase(blocks.begin() + block);
+  }
+
+  return offset;
+}
+
+// Add a freed block, merging it with adjacent ones. Merged blocks can only be reused once all their parts can.
+void GeometryPool::insertBlock(std::vector<FreeBlock> &blocks, uint32_t offset, uint32_t count) {
+  if (count == 0u) {
+    return;
+  }
+
+  uint64_t reusable_frame = m_frame + m_frame_count;
+  auto next = std::lower_bound(blocks.begin(), blocks.end(), offset,
+                               [](const FreeBlock &block, uint32_t value) { return block.offset < value; });
+
+  // Merge with the previous block
+  if (next != blocks.begin()) {
+    auto previous = next - 1;
+    if (previous->offset + previous->count == offset) {
+      previous->count += count;
+      previous->reusable_frame = std::max(previous->reusable_frame, reusable_frame);
+
+      // The previous block might now reach the next one as well
+      if (next != blocks.end() && previous->offset + previous->count == next->offset) {
+        previous->count += next->count;
+        previous->reusable_frame = std::max(previous->reusable_frame, next->reusable_frame);
+        blocks.erase(next);
+      }
+      return;
+    }
+  }
+
+  // Merge with the next block
+  if (next != blocks.end() && offset + count == next->offset) {
+    next->offset = offset;
+    next->count += count;
+    next->reusable_frame = std::max(next->reusable_frame, reusable_frame);
+    return;
+  }
+
+  blocks.insert(next, {offset, count, reusable_frame});
+}
@@ -0,0 +1,282 @@
+#include <xre/gpu_culler.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the culler.
+// Arguments:
+//  1) Logical device
+//  2) Allocator to get the memory of the buffers from
+//  3) Pipeline cache to create the compute pipeline with
+//  4) Path of the compiled culling shader
+//  5) Number of frames which can be in flight at the same time
+//------------------------------------------------------------------------------------------------------
+GpuCuller::GpuCuller(VkDevice device, MemoryAllocator *allocator, VkPipelineCache pipeline_cache, const std::string &shader_path,
+                     uint32_t frame_count) {
+  VkResult result;
+  m_device = device;
+
+  //------------------------------------------------------------------------------------------------------
+  // Descriptor set layout
+  //------------------------------------------------------------------------------------------------------
+  // Objects, draws, commands and counts are storage buffers, the frustum is a uniform buffer
+  std::array<VkDescriptorSetLayoutBinding, 5> bindings{};
+  for (uint32_t i = 0; i < bindings.size(); i++) {
+    bindings[i].binding = i;
+    bindings[i].descriptorType = i == 4 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[i].descriptorCount = 1;
+    bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  }
+
+  VkDescriptorSetLayoutCreateInfo layout_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+  layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
+  layout_create_info.pBindings = bindings.data();
+
+  result = vkCreateDescriptorSetLayout(m_device, &layout_create_info, nullptr, &m_descriptor_set_layout);
+  Utils::checkVkResult(result, "Failed to create the culling descriptor set layout");
+
+  //------------------------------------------------------------------------------------------------------
+  // Descriptor pool
+  //------------------------------------------------------------------------------------------------------
+  std::array<VkDescriptorPoolSize, 2> pool_sizes{};
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[0].descriptorCount = 4 * frame_count;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_sizes[1].descriptorCount = frame_count;
+
+  VkDescriptorPoolCreateInfo pool_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+  pool_create_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+  pool_create_info.pPoolSizes = pool_sizes.data();
+  pool_create_info.maxSets = frame_count;
+
+  result = vkCreateDescriptorPool(m_device, &pool_create_info, nullptr, &m_descriptor_pool);
+  Utils::checkVkResult(result, "Failed to create the culling descriptor pool");
+
+  //------------------------------------------------------------------------------------------------------
+  // Pipeline and per-frame resources
+  //------------------------------------------------------------------------------------------------------
+  createPipeline(pipeline_cache, shader_path);
+
+  m_frames.resize(frame_count);
+  for (Frame &frame : m_frames) {
+    createFrame(frame, allocator);
+  }
+}
+
+void GpuCuller::destroy() {
+  for (Frame &frame : m_frames) {
+    for (Buffer *buffer : {frame.object_buffer, frame.draw_buffer, frame.frustum_buffer, frame.command_buffer, frame.count_buffer}) {
+      buffer->destroy();
+      delete buffer;
+    }
+  }
+  m_frames.clear();
+
+  vkDestroyPipeline(m_device, m_pipeline, nullptr);
+  vkDestroyPipelineLayout(m_device, m_pipeline_layout, nullptr);
+  vkDestroyDescriptorPool(m_device, m_descriptor_pool, nullptr);
+  vkDestroyDescriptorSetLayout(m_device, m_descriptor_set_layout, nullptr);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Start collecting the draws of the given frame, and store the frustum planes of its views. The caller
+// has to make sure that the GPU is done with the previous frame which used the same slot.
+//------------------------------------------------------------------------------------------------------
+void GpuCuller::beginFrame(uint32_t frame_index, const std::vector<glm::mat4> &view_projections) {
+  m_current_frame = frame_index;
+  m_draw_count = 0u;
+  m_batch_count = 0u;
+
+  GpuCullFrustum *frustum = m_frames[m_current_frame].frustum;
+  frustum->view_count = static_cast<uint32_t>(std::min<size_t>(view_projections.size(), 2u));
+
+  for (uint32_t view = 0; view < frustum->view_count; view++) {
+    // Extract the planes from the rows of the view projection matrix (glm is column major)
+    const glm::mat4 &m = view_projections[view];
+    glm::vec4 row_x = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row_y = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row_z = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row_w = glm::vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    std::array<glm::vec4, 5> planes = {row_w + row_x, row_w - row_x, row_w + row_y, row_w - row_y, row_w - row_z};
+    for (uint32_t i = 0; i < planes.size(); i++) {
+      frustum->planes[view * 5 + i] = planes[i] / glm::length(glm::vec3(planes[i]));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Add a draw to the given batch. Returns false if the buffers are full, in which case the caller has to
+// draw it without culling.
+//------------------------------------------------------------------------------------------------------
+bool GpuCuller::addDraw(const glm::mat4 &world, const glm::vec3 &color, uint32_t texture_index, const OOBB &bounds,
+                        const GeometryRange &geometry, uint32_t batch, uint32_t first_command) {
+  if (m_draw_count >= MAX_DRAWS || batch >= MAX_BATCHES) {
+    return false;
+  }
+
+  Frame &frame = m_frames[m_current_frame];
+
+  GpuObjectData &object = frame.objects[m_draw_count];
+  object.world = world;
+  object.color = color;
+  object.texture_index = texture_index;
+
+  // The getters of the bounding box are not const, so we work on a copy
+  OOBB box = bounds;
+  glm::mat3 axes = box.getAxes();
+
+  GpuDrawData &draw = frame.draws[m_draw_count];
+  draw.center = glm::vec4(box.getCenter(), 1.0f);
+  draw.extents = glm::vec4(box.getExtents(), 0.0f);
+  draw.axes[0] = glm::vec4(axes[0], 0.0f);
+  draw.axes[1] = glm::vec4(axes[1], 0.0f);
+  draw.axes[2] = glm::vec4(axes[2], 0.0f);
+  draw.index_count = geometry.index_count;
+  draw.first_index = geometry.first_index;
+  draw.vertex_offset = geometry.vertex_offset;
+  draw.object = m_draw_count;
+  draw.batch = batch;
+  draw.first_command = first_command;
+
+  m_draw_count++;
+  m_batch_count = std::max(m_batch_count, batch + 1u);
+  return true;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Record the culling pass. Has to be called outside of a render pass, before any of the batches is drawn.
+//------------------------------------------------------------------------------------------------------
+void GpuCuller::dispatch(VkCommandBuffer command_buffer) {
+  if (m_draw_count == 0u) {
+    return;
+  }
+
+  Frame &frame = m_frames[m_current_frame];
+
+  // Reset the counts of the batches
+  vkCmdFillBuffer(command_buffer, frame.count_buffer->getBuffer(), 0u, m_batch_count * sizeof(uint32_t), 0u);
+
+  VkMemoryBarrier fill_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  fill_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  fill_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1u, &fill_barrier, 0u,
+                       nullptr, 0u, nullptr);
+
+  // Cull all draws of the frame
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline_layout, 0u, 1u, &frame.descriptor_set, 0u, nullptr);
+  vkCmdPushConstants(command_buffer, m_pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0u, sizeof(uint32_t), &m_draw_count);
+  vkCmdDispatch(command_buffer, (m_draw_count + WORKGROUP_SIZE - 1u) / WORKGROUP_SIZE, 1u, 1u);
+
+  // Make the commands and counts visible to the indirect draws
+  VkMemoryBarrier cull_barrier{VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+  cull_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  cull_barrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0, 1u, &cull_barrier, 0u,
+                       nullptr, 0u, nullptr);
+}
+
+// Draw the visible draws of a batch. The pipeline, descriptor sets and geometry buffers of the batch
+// need to be bound already.
+void GpuCuller::drawBatch(VkCommandBuffer command_buffer, uint32_t batch, uint32_t first_command, uint32_t max_draw_count) {
+  Frame &frame = m_frames[m_current_frame];
+  vkCmdDrawIndexedIndirectCount(command_buffer, frame.command_buffer->getBuffer(), first_command * sizeof(VkDrawIndexedIndirectCommand),
+                                frame.count_buffer->getBuffer(), batch * sizeof(uint32_t), max_draw_count,
+                                sizeof(VkDrawIndexedIndirectCommand));
+}
+
+VkBuffer GpuCuller::getObjectBuffer(uint32_t frame_index) { return m_frames[frame_index].object_buffer->getBuffer(); }
+
+void GpuCuller::createPipeline(VkPipelineCache pipeline_cache, const std::string &shader_path) {
+  VkResult result;
+
+  // The number of draws is passed as push constant
+  VkPushConstantRange push_constant_range{};
+  push_constant_range.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constant_range.offset = 0u;
+  push_constant_range.size = sizeof(uint32_t);
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info{VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
+  pipeline_layout_info.setLayoutCount = 1u;
+  pipeline_layout_info.pSetLayouts = &m_descriptor_set_layout;
+  pipeline_layout_info.pushConstantRangeCount = 1u;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+
+  result = vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &m_pipeline_layout);
+  Utils::checkVkResult(result, "Failed to create the culling pipeline layout");
+
+  // Load the shader, which we only need while creating the pipeline
+  std::vector<char> code = Utils::readFile(shader_path);
+
+  VkShaderModuleCreateInfo shader_module_create_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  shader_module_create_info.codeSize = code.size();
+  shader_module_create_info.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  VkShaderModule shader_module;
+  result = vkCreateShaderModule(m_device, &shader_module_create_info, nullptr, &shader_module);
+  Utils::checkVkResult(result, "Failed to create the culling shader module");
+
+  VkComputePipelineCreateInfo pipeline_create_info{VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+  pipeline_create_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_create_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_create_info.stage.module = shader_module;
+  pipeline_create_info.stage.pName = "main";
+  pipeline_create_info.layout = m_pipeline_layout;
+
+  result = vkCreateComputePipelines(m_device, pipeline_cache, 1u, &pipeline_create_info, nullptr, &m_pipeline);
+  Utils::checkVkResult(result, "Failed to create the culling pipeline");
+
+  vkDestroyShaderModule(m_device, shader_module, nullptr);
+}
+
+void GpuCuller::createFrame(Frame &frame, MemoryAllocator *allocator) {
+  //------------------------------------------------------------------------------------------------------
+  // Buffers
+  //------------------------------------------------------------------------------------------------------
+  // The inputs are written by the CPU every frame, so we keep them mapped
+  frame.object_buffer = new Buffer(allocator, MAX_DRAWS * sizeof(GpuObjectData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  frame.objects = static_cast<GpuObjectData *>(frame.object_buffer->mapPersistently());
+
+  frame.draw_buffer = new Buffer(allocator, MAX_DRAWS * sizeof(GpuDrawData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+  frame.draws = static_cast<GpuDrawData *>(frame.draw_buffer->mapPersistently());
+
+  frame.frustum_buffer = new Buffer(allocator, sizeof(GpuCullFrustum), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  frame.frustum = static_cast<GpuCullFrustum *>(frame.frustum_buffer->mapPersistently());
+
+  // The outputs are only accessed by the GPU
+  frame.command_buffer = new Buffer(allocator, MAX_DRAWS * sizeof(VkDrawIndexedIndirectCommand),
+                                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+                                    VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  frame.count_buffer = new Buffer(allocator, MAX_BATCHES * sizeof(uint32_t),
+                                  VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                                  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+  //------------------------------------------------------------------------------------------------------
+  // Descriptor set
+  //------------------------------------------------------------------------------------------------------
+  VkDescriptorSetAllocateInfo allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+  allocate_info.descriptorPool = m_descriptor_pool;
+  allocate_info.descriptorSetCount = 1;
+  allocate_info.pSetLayouts = &m_descriptor_set_layout;
+
+  VkResult result = vkAllocateDescriptorSets(m_device, &allocate_info, &frame.descriptor_set);
+  Utils::checkVkResult(result, "Failed to allocate the culling descriptor set");
+
+  std::array<Buffer *, 5> buffers = {frame.object_buffer, frame.draw_buffer, frame.command_buffer, frame.count_buffer, frame.frustum_buffer};
+  std::array<VkDescriptorBufferInfo, 5> buffer_infos{};
+  std::array<VkWriteDescriptorSet, 5> writes{};
+  for (uint32_t i = 0; i < buffers.size(); i++) {
+    buffer_infos[i].buffer = buffers[i]->getBuffer();
+    buffer_infos[i].offset = 0;
+    buffer_infos[i].range = VK_WHOLE_SIZE;
+
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = frame.descriptor_set;
+    writes[i].dstBinding = i;
+    writes[i].dstArrayElement = 0;
+    writes[i].descriptorType = i == 4 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[i].descriptorCount = 1;
+    writes[i].pBufferInfo = &buffer_infos[i];
+  }
+
+  vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+}
@@ -0,0 +1,216 @@
+#include <xre/gpu_profiler.h>
+
+// Other includes
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------------------
+// Create the query pools of the profiler.
+// Arguments:
+//  1) Logical device
+//  2) Number of frames which can be in flight at the same time
+//  3) Nanoseconds per timestamp tick (`timestampPeriod` of the device limits)
+//  4) Mask of the valid bits of the timestamps (`timestampValidBits` of the queue family)
+//  5) Whether to query the vertex and fragment shader invocations (needs `pipelineStatisticsQuery`)
+//  6) Number of views of the render pass, i.e. queries used per query inside a multiview render pass
+//------------------------------------------------------------------------------------------------------
+GpuProfiler::GpuProfiler(VkDevice device, uint32_t frame_count, double timestamp_period, uint64_t timestamp_mask,
+                         bool pipeline_statistics, uint32_t view_count)
+    : m_device(device), m_timestamp_period(timestamp_period), m_timestamp_mask(timestamp_mask), m_view_count(view_count) {
+  VkResult result;
+
+  // Two timestamps per scope, each of which might use one query per view
+  VkQueryPoolCreateInfo timestamp_pool_create_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+  timestamp_pool_create_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  timestamp_pool_create_info.queryCount = frame_count * MAX_SCOPES_PER_FRAME * 2u * m_view_count;
+  result = vkCreateQueryPool(m_device, &timestamp_pool_create_info, nullptr, &m_timestamp_pool);
+  Utils::checkVkResult(result, "Failed to create the timestamp query pool");
+
+  if (pipeline_statistics) {
+    VkQueryPoolCreateInfo statistics_pool_create_info{VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    statistics_pool_create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+    statistics_pool_create_info.queryCount = frame_count * MAX_SCOPES_PER_FRAME * m_view_count;
+    statistics_pool_create_info.pipelineStatistics =
+        VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    result = vkCreateQueryPool(m_device, &statistics_pool_create_info, nullptr, &m_statistics_pool);
+    Utils::checkVkResult(result, "Failed to create the pipeline statistics query pool");
+  }
+
+  m_frames.resize(frame_count);
+}
+
+void GpuProfiler::destroy() {
+  vkDestroyQueryPool(m_device, m_timestamp_pool, nullptr);
+  if (m_statistics_pool != VK_NULL_HANDLE) {
+    vkDestroyQueryPool(m_device, m_statistics_pool, nullptr);
+  }
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer command_buffer, uint32_t frame_index) {
+  Frame &frame = m_frames[frame_index];
+  if (frame.recorded) {
+    readResults(frame_index);
+  }
+
+  frame.scopes.clear();
+  frame.open_scopes = 0u;
+  frame.recorded = true;
+  m_current_frame = frame_index;
+
+  vkCmdResetQueryPool(command_buffer, m_timestamp_pool, timestampQuery(frame_index, 0u, false), MAX_SCOPES_PER_FRAME * 2u * m_view_count);
+  if (m_statistics_pool != VK_NULL_HANDLE) {
+    vkCmdResetQueryPool(command_buffer, m_statistics_pool, statisticsQuery(frame_index, 0u), MAX_SCOPES_PER_FRAME * m_view_count);
+  }
+}
+
+uint32_t GpuProfiler::beginScope(VkCommandBuffer command_buffer, const char *name, bool inside_render_pass, bool pipeline_statistics) {
+  Frame &frame = m_frames[m_current_frame];
+  if (frame.scopes.size() >= MAX_SCOPES_PER_FRAME) {
+    return NO_SCOPE;
+  }
+
+  uint32_t scope = static_cast<uint32_t>(frame.scopes.size());
+  frame.scopes.push_back({name, frame.open_scopes, inside_render_pass ? m_view_count : 1u,
+                          pipeline_statistics && m_statistics_pool != VK_NULL_HANDLE});
+  frame.open_scopes++;
+
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_pool, timestampQuery(m_current_frame, scope, false));
+  if (frame.scopes[scope].pipeline_statistics) {
+    vkCmdBeginQuery(command_buffer, m_statistics_pool, statisticsQuery(m_current_frame, scope), 0);
+  }
+
+  return scope;
+}
+
+void GpuProfiler::endScope(VkCommandBuffer command_buffer, uint32_t scope) {
+  if (scope == NO_SCOPE) {
+    return;
+  }
+
+  Frame &frame = m_frames[m_current_frame];
+  if (frame.scopes[scope].pipeline_statistics) {
+    vkCmdEndQuery(command_buffer, m_statistics_pool, statisticsQuery(m_current_frame, scope));
+  }
+  vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestamp_pool, timestampQuery(m_current_frame, scope, true));
+  frame.open_scopes--;
+}
+
+// The scope is nested in the scopes which are currently open, but doesn't open one itself
+uint32_t GpuProfiler::reserveScope(const char *name, bool inside_render_pass) {
+  Frame &frame = m_frames[m_current_frame];
+  if (frame.scopes.size() >= MAX_SCOPES_PER_FRAME) {
+    return NO_SCOPE;
+  }
+
+  frame.scopes.push_back({name, frame.open_scopes, inside_render_pass ? m_view_count : 1u, false});
+  return static_cast<uint32_t>(frame.scopes.size() - 1);
+}
+
+void GpuProfiler::writeScopeTimestamp(VkCommandBuffer command_buffer, uint32_t scope, bool end) {
+  if (scope == NO_SCOPE) {
+    return;
+  }
+
+  vkCmdWriteTimestamp(command_buffer, end ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestamp_pool,
+                      timestampQuery(m_current_frame, scope, end));
+}
+
+std::vector<GpuScopeStatistics> GpuProfiler::getStatistics() {
+  std::vector<GpuScopeStatistics> statistics;
+  for (const auto &[name, window] : m_windows) {
+    GpuScopeStatistics scope_statistics;
+    scope_statistics.name = name;
+    scope_statistics.samples = window.count;
+
+    for (uint32_t i = 0; i < window.count; i++) {
+      scope_statistics.gpu_time_ms += window.samples[i].gpu_time_ms;
+      scope_statistics.vertex_invocations += static_cast<double>(window.samples[i].vertex_invocations);
+      scope_statistics.fragment_invocations += static_cast<double>(window.samples[i].fragment_invocations);
+    }
+
+    if (window.count > 0u) {
+      scope_statistics.gpu_time_ms /= window.count;
+      scope_statistics.vertex_invocations /= window.count;
+      scope_statistics.fragment_invocations /= window.count;
+    }
+    statistics.push_back(scope_statistics);
+  }
+
+  return statistics;
+}
+
+double GpuProfiler::takeCompletedFrameTime(uint32_t &frame_count) {
+  double frame_time_ms = m_completed_frame_time_ms;
+  frame_count = m_completed_frames;
+  m_completed_frame_time_ms = 0.0;
+  m_completed_frames = 0u;
+  return frame_time_ms;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Read the results of all scopes of a frame slot. The caller waited for the fence of the frame, so the
+// results are available and we don't need to wait for them. Scopes whose results are missing anyway
+// (e.g. if they were never ended) are skipped.
+//------------------------------------------------------------------------------------------------------
+void GpuProfiler::readResults(uint32_t frame_index) {
+  Frame &frame = m_frames[frame_index];
+  double frame_time_ms = 0.0;
+
+  for (uint32_t scope = 0; scope < frame.scopes.size(); scope++) {
+    const Scope &current = frame.scopes[scope];
+
+    // Only the first query of a timestamp holds the value, the others of a multiview render pass are zero
+    uint64_t begin, end;
+    VkResult result = vkGetQueryPoolResults(m_device, m_timestamp_pool, timestampQuery(frame_index, scope, false), 1u, sizeof(begin),
+                                            &begin, sizeof(begin), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+      continue;
+    }
+    result = vkGetQueryPoolResults(m_device, m_timestamp_pool, timestampQuery(frame_index, scope, true), 1u, sizeof(end), &end,
+                                   sizeof(end), VK_QUERY_RESULT_64_BIT);
+    if (result != VK_SUCCESS) {
+      continue;
+    }
+
+    Sample sample{};
+    sample.gpu_time_ms = ((end - begin) & m_timestamp_mask) * m_timestamp_period / 1000000.0;
+
+    // How the invocations are distributed among the queries of the views is implementation dependent,
+    // so we sum them up
+    if (current.pipeline_statistics) {
+      std::vector<uint64_t> invocations(2u * current.query_count);
+      result = vkGetQueryPoolResults(m_device, m_statistics_pool, statisticsQuery(frame_index, scope), current.query_count,
+                                     invocations.size() * sizeof(uint64_t), invocations.data(), 2u * sizeof(uint64_t),
+                                     VK_QUERY_RESULT_64_BIT);
+      if (result == VK_SUCCESS) {
+        for (uint32_t i = 0; i < current.query_count; i++) {
+          sample.vertex_invocations += invocations[2u * i];
+          sample.fragment_invocations += invocations[2u * i + 1u];
+        }
+      }
+    }
+
+    RollingWindow &window = m_windows[current.name];
+    window.samples[window.next] = sample;
+    window.next = (window.next + 1u) % ROLLING_WINDOW;
+    window.count = std::min(window.count + 1u, ROLLING_WINDOW);
+
+    if (current.depth == 0u) {
+      frame_time_ms += sample.gpu_time_ms;
+    }
+  }
+
+  if (!frame.scopes.empty()) {
+    m_completed_frame_time_ms += frame_time_ms;
+    m_completed_frames++;
+  }
+  frame.recorded = false;
+}
+
+// Each scope has a begin and an end timestamp, each of which reserves one query per view
+uint32_t GpuProfiler::timestampQuery(uint32_t frame_index, uint32_t scope, bool end) {
+  return ((frame_index * MAX_SCOPES_PER_FRAME + scope) * 2u + (end ? 1u : 0u)) * m_view_count;
+}
+
+uint32_t GpuProfiler::statisticsQuery(uint32_t frame_index, uint32_t scope) {
+  return (frame_index * MAX_SCOPES_PER_FRAME + scope) * m_view_count;
+}
@@ -2,16 +2,19 @@
 
 Hand::Hand(XrHandEXT hand_identifier, std::shared_ptr<Material> material, std::shared_ptr<VulkanHandler> vulkan_handler) {
   m_hand_identifier = hand_identifier;
-  m_hand_root_node = std::make_shared<SceneNode>();
 
-  // This could probably be replaced by instancing, where we only have one cube but draw it multiple
-  // times. For the first version we'll keep this approach though.
+  // All joints are drawn with a single instanced draw
+  m_joint_instances = ModelFactory::createInstancedCube(material, XR_HAND_JOINT_COUNT_EXT, vulkan_handler);
+  m_hand_root_node = std::make_shared<SceneNode>(m_joint_instances);
+
+  std::shared_ptr<Model> joint_model = ModelFactory::createCube({0.67f, 0.84f, 0.9}, material, vulkan_handler);
+
   for (int i = 0; i < XR_HAND_JOINT_COUNT_EXT; i++) {
-    std::shared_ptr<Model> joint_model = ModelFactory::createCube({0.67f, 0.84f, 0.9}, material, vulkan_handler);
-    std::shared_ptr<SceneNode> joint_node = std::make_unique<SceneNode>(joint_model);
+    std::shared_ptr<SceneNode> joint_node = std::make_shared<SceneNode>(joint_model);
     joint_node->setScale(0.005f, 0.005f, 0.005f);
-    m_hand_root_node->addChildNode(joint_node);
     m_joint_nodes.push_back(joint_node);
+
+    m_joint_instances->addInstance(glm::scale(glm::identity<glm::mat4>(), glm::vec3(0.005f)), {0.67f, 0.84f, 0.9});
   }
 }
 
@@ -103,6 +106,11 @@ void Hand::updatePosition(glm::vec3 current_origin) {
     current_node->setPosition(joint_position);
     current_node->setRotation(joint_orientation);
     current_node->setScale(joint_scale, joint_scale, joint_scale);
+    current_node->updateTransformation();
+
+    // And the instance which is drawn
+    glm::mat4 joint_transform = Geometry::composeWorldMatrix(joint_position, joint_orientation, glm::vec3(joint_scale));
+    m_joint_instances->setInstanceTransform(i, joint_transform);
   }
 
   m_hand_root_node->updateTransformation();
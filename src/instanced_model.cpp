@@ -0,0 +1,103 @@
+#include <xre/instanced_model.h>
+
+//------------------------------------------------------------------------------------------------------
+// Initialize the instanced model.
+// Arguments:
+//  1) Mesh which is drawn for each instance
+//  2) Material of all instances, its vertex shader needs an instanced variant
+//  3) Maximum number of instances
+//  4) Vulkan handler
+//------------------------------------------------------------------------------------------------------
+InstancedModel::InstancedModel(Mesh mesh, std::shared_ptr<Material> material, uint32_t max_instances,
+                               std::shared_ptr<VulkanHandler> vulkan_handler)
+    : m_mesh(mesh) {
+  m_material = material;
+  m_vulkan_handler = vulkan_handler;
+  m_max_instances = max_instances;
+  m_instances.reserve(max_instances);
+
+  // The instance data changes every frame, so we keep it in host visible memory, with one region per
+  // frame in flight
+  VkDeviceSize size = static_cast<VkDeviceSize>(max_instances) * sizeof(InstanceData) * m_vulkan_handler->getFramesInFlight();
+  m_instance_buffer = new Buffer(m_vulkan_handler->getMemoryAllocator(), size, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+  m_mapped_instance_data = static_cast<uint8_t *>(m_instance_buffer->mapPersistently());
+}
+
+InstancedModel::~InstancedModel() {
+  // The buffer might still be read by a frame in flight
+  m_vulkan_handler->waitForFramesInFlight();
+
+  m_instance_buffer->destroy();
+  delete m_instance_buffer;
+}
+
+uint32_t InstancedModel::addInstance(const glm::mat4 &transform, glm::vec3 color) {
+  if (m_instances.size() >= m_max_instances) {
+    Utils::exitWithMessage("Instanced model is full (" + std::to_string(m_max_instances) + " instances)");
+  }
+
+  InstanceData instance{};
+  instance.world = transform;
+  instance.color = color;
+  m_instances.push_back(instance);
+  m_generation++;
+
+  return static_cast<uint32_t>(m_instances.size() - 1);
+}
+
+void InstancedModel::setInstanceTransform(uint32_t index, const glm::mat4 &transform) {
+  m_instances[index].world = transform;
+  m_generation++;
+}
+
+void InstancedModel::setInstanceColor(uint32_t index, glm::vec3 color) {
+  m_instances[index].color = color;
+  m_generation++;
+}
+
+void InstancedModel::clearInstances() {
+  m_instances.clear();
+  m_generation++;
+}
+
+uint32_t InstancedModel::getInstanceCount() { return static_cast<uint32_t>(m_instances.size()); }
+
+uint64_t InstancedModel::getGeneration() { return m_generation; }
+
+void InstancedModel::render(RenderContext &ctx, glm::mat4 scene_node_transform) {
+  if (m_instances.empty()) {
+    return;
+  }
+
+  // Copy the instances into the region of the current frame, applying the transform of the scene node
+  VkDeviceSize region_offset = static_cast<VkDeviceSize>(ctx.frame_index) * m_max_instances * sizeof(InstanceData);
+  InstanceData *frame_instances = reinterpret_cast<InstanceData *>(m_mapped_instance_data + region_offset);
+
+  const uint32_t texture_index = m_material->getTextureIndex();
+  for (size_t i = 0; i < m_instances.size(); i++) {
+    frame_instances[i].world = scene_node_transform * m_instances[i].world;
+    frame_instances[i].color = m_instances[i].color;
+    frame_instances[i].texture_index = texture_index;
+  }
+
+  // Without push constants, the material descriptor set expects model uniform data as well, even though
+  // the instanced shaders don't read it
+  uint32_t offset = 0u;
+  if (!ctx.push_constants) {
+    ModelUniformBufferObject uniform_buffer_object{};
+    uniform_buffer_object.world = scene_node_transform;
+    offset = ctx.uniform_arena->push(uniform_buffer_object);
+  }
+
+  // Update context, which is used by the mesh to add its draw to the render queue
+  ctx.pipeline = m_material->getInstancedGraphicsPipeline();
+  ctx.indirect_pipeline = VK_NULL_HANDLE;
+  ctx.descriptor_set = m_material->getDescriptorset();
+  ctx.uniform_offset = offset;
+  ctx.world_transform = scene_node_transform;
+  ctx.color = glm::vec3(1.0f);
+  ctx.texture_index = texture_index;
+  ctx.translucent = m_material->isTranslucent();
+
+  m_mesh.renderInstanced(ctx, m_instance_buffer->getBuffer(), region_offset, static_cast<uint32_t>(m_instances.size()));
+}
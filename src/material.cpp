@@ -1,37 +1,140 @@
 #include <xre/material.h>
 
-Material::Material(const std::string &vert_path, const std::string &frag_path, bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler) {
+Material::Material(const std::string &vert_path, const std::string &frag_path, bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler,
+                   const PipelineState &pipeline_state) {
   // Bind the vulkan handler
   m_vulkan_handler = vulkan_handler;
 
-  // Create graphics pipeline
-  m_graphics_pipeline = m_vulkan_handler->createGraphicsPipeline(vert_path, frag_path);
+  // Get the graphics pipeline
+  m_vert_path = vert_path;
+  m_frag_path = frag_path;
+  m_translucent = pipeline_state.blend;
+  m_pipeline_state = pipeline_state;
+  m_graphics_pipeline = m_vulkan_handler->acquireGraphicsPipeline(getDirectVertexShaderPath(), frag_path, m_pipeline_state);
+  acquireIndirectGraphicsPipeline();
 
-  // Create uniform buffer
-  m_uniform_buffer = m_vulkan_handler->createUniformBuffer();
-
-  // Create descriptor set
-  m_descriptor_set = m_vulkan_handler->allocateDescriptorSet(m_uniform_buffer, NULL, NULL, persist_between_scenes);
+  // Create descriptor set, in bindless mode all materials share the same one
+  if (m_vulkan_handler->isBindlessEnabled()) {
+    m_descriptor_set = m_vulkan_handler->getSharedDescriptorSet();
+  } else {
+    m_descriptor_set = m_vulkan_handler->allocateDescriptorSet(NULL, NULL, persist_between_scenes);
+  }
 }
 
 Material::Material(const std::string &vert_path, const std::string &frag_path, std::shared_ptr<Texture> texture,
-                   bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler) {
+                   bool persist_between_scenes, std::shared_ptr<VulkanHandler> vulkan_handler, const PipelineState &pipeline_state) {
   // Bind the vulkan handler
   m_vulkan_handler = vulkan_handler;
 
-  // Create graphics pipeline
-  m_graphics_pipeline = m_vulkan_handler->createGraphicsPipeline(vert_path, frag_path);
-
-  // Create uniform buffer
-  m_uniform_buffer = m_vulkan_handler->createUniformBuffer();
+  // Get the graphics pipeline. In bindless mode, the texture is sampled by the bindless variant of the fragment
+  // shader, which reads it from the texture array.
+  m_vert_path = vert_path;
+  m_frag_path = frag_path;
+  if (m_vulkan_handler->isBindlessEnabled()) {
+    m_frag_path = getVariantShaderPath(frag_path, "bindless");
+    if (m_frag_path.empty() || !std::filesystem::exists(m_frag_path)) {
+      Utils::exitWithMessage("Fragment shader " + frag_path + " has no bindless variant");
+    }
+  }
+  // Textures with alpha make the material translucent, which decides both the blending and the sorting
+  m_translucent = pipeline_state.blend || texture->hasAlpha();
+  m_pipeline_state = pipeline_state;
+  m_pipeline_state.blend = m_translucent;
+  m_graphics_pipeline = m_vulkan_handler->acquireGraphicsPipeline(getDirectVertexShaderPath(), m_frag_path, m_pipeline_state);
+  acquireIndirectGraphicsPipeline();
 
-  // Create descriptor set
-  m_descriptor_set =
-      m_vulkan_handler->allocateDescriptorSet(m_uniform_buffer, texture->getTextureImageView(), texture->getTextureSampler(), persist_between_scenes);
+  // Create descriptor set, or reference the texture by its slot in bindless mode
+  m_texture = texture;
+  if (m_vulkan_handler->isBindlessEnabled()) {
+    m_descriptor_set = m_vulkan_handler->getSharedDescriptorSet();
+    m_texture_index = m_vulkan_handler->acquireBindlessTexture(texture->getTextureImageView(), texture->getTextureSampler());
+  } else {
+    m_descriptor_set =
+        m_vulkan_handler->allocateDescriptorSet(texture->getTextureImageView(), texture->getTextureSampler(), persist_between_scenes);
+  }
 }
 
-Buffer *Material::getUniformBuffer() { return m_uniform_buffer; }
+Material::~Material() {
+  // The pipeline is kept cached by the vulkan handler, as other materials might use it as well
+  m_vulkan_handler->releaseGraphicsPipeline(m_graphics_pipeline);
+
+  if (m_indirect_graphics_pipeline != VK_NULL_HANDLE) {
+    m_vulkan_handler->releaseGraphicsPipeline(m_indirect_graphics_pipeline);
+  }
+
+  if (m_instanced_graphics_pipeline != VK_NULL_HANDLE) {
+    m_vulkan_handler->releaseGraphicsPipeline(m_instanced_graphics_pipeline);
+  }
+
+  if (m_texture && m_vulkan_handler->isBindlessEnabled()) {
+    m_vulkan_handler->releaseBindlessTexture(m_texture->getTextureImageView());
+  }
+}
 
 VkDescriptorSet Material::getDescriptorset() { return m_descriptor_set; }
 
-void Material::bind() { m_vulkan_handler->bindGraphicsPipeline(m_graphics_pipeline); }
+uint32_t Material::getTextureIndex() { return m_texture_index; }
+
+VkPipeline Material::getGraphicsPipeline() { return m_graphics_pipeline; }
+
+bool Material::isTranslucent() { return m_translucent; }
+
+VkPipeline Material::getIndirectGraphicsPipeline() { return m_indirect_graphics_pipeline; }
+
+// Most materials are never used for instanced draws, so the variant is only created on first use
+VkPipeline Material::getInstancedGraphicsPipeline() {
+  if (m_instanced_graphics_pipeline == VK_NULL_HANDLE) {
+    std::string instanced_vert_path = getVariantShaderPath(m_vert_path, "instanced");
+    if (instanced_vert_path.empty() || !std::filesystem::exists(instanced_vert_path)) {
+      Utils::exitWithMessage("Vertex shader " + m_vert_path + " has no instanced variant");
+    }
+
+    PipelineState instanced_pipeline_state = m_pipeline_state;
+    instanced_pipeline_state.instanced = true;
+    m_instanced_graphics_pipeline = m_vulkan_handler->acquireGraphicsPipeline(instanced_vert_path, m_frag_path, instanced_pipeline_state);
+  }
+
+  return m_instanced_graphics_pipeline;
+}
+
+// Shaders without a GPU-driven variant (e.g. screen space ones, which must not be frustum culled) are
+// always drawn directly.
+void Material::acquireIndirectGraphicsPipeline() {
+  if (!m_vulkan_handler->isGpuCullingEnabled()) {
+    return;
+  }
+
+  std::string indirect_vert_path = getVariantShaderPath(m_vert_path, "indirect");
+  if (indirect_vert_path.empty() || !std::filesystem::exists(indirect_vert_path)) {
+    return;
+  }
+
+  m_indirect_graphics_pipeline = m_vulkan_handler->acquireGraphicsPipeline(indirect_vert_path, m_frag_path, m_pipeline_state);
+}
+
+// With push constants, directly recorded draws use the push constant variant of the vertex shader, as the
+// set of the material doesn't hold the per-draw data anymore
+std::string Material::getDirectVertexShaderPath() {
+  if (!m_vulkan_handler->isPushConstantsEnabled()) {
+    return m_vert_path;
+  }
+
+  std::string push_vert_path = getVariantShaderPath(m_vert_path, "push");
+  if (push_vert_path.empty() || !std::filesystem::exists(push_vert_path)) {
+    Utils::exitWithMessage("Vertex shader " + m_vert_path + " has no push constant variant");
+  }
+
+  return push_vert_path;
+}
+
+// Variants of a shader `name.<stage>.spv` are compiled to `name.<variant>.<stage>.spv`. Returns an empty
+// string if the shader doesn't follow this naming.
+std::string Material::getVariantShaderPath(const std::string &path, const std::string &variant) {
+  for (const std::string suffix : {".vert.spv", ".frag.spv"}) {
+    if (path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0) {
+      return path.substr(0, path.size() - suffix.size()) + "." + variant + suffix;
+    }
+  }
+
+  return "";
+}
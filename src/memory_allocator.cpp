@@ -0,0 +1,314 @@
+#include <xre/memory_allocator.h>
+
+//------------------------------------------------------------------------------------------------------
+// Allocator
+//------------------------------------------------------------------------------------------------------
+MemoryAllocator::MemoryAllocator(VkDevice device, VkPhysicalDevice physical_device) {
+  m_device = device;
+  m_physical_device = physical_device;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &m_memory_properties);
+}
+
+void MemoryAllocator::destroy() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (auto &[key, heap] : m_heaps) {
+    for (MemoryBlock *block : heap.blocks) {
+      vkFreeMemory(m_device, block->getMemory(), nullptr);
+      delete block;
+    }
+  }
+
+  m_heaps.clear();
+}
+
+//------------------------------------------------------------------------------------------------------
+// Allocate memory for a resource.
+// Arguments:
+//  1) Memory requirements of the resource
+//  2) Memory properties the memory needs to have
+//  3) Kind of the resource (buffer or image)
+//  4) Strategy used to place the allocation within a block
+//------------------------------------------------------------------------------------------------------
+MemoryAllocation MemoryAllocator::allocate(const VkMemoryRequirements &requirements, VkMemoryPropertyFlags memory_property_flags,
+                                           AllocationKind kind, AllocationStrategy strategy) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  uint32_t memory_type_index = VulkanUtils::findMemoryType(m_physical_device, requirements.memoryTypeBits, memory_property_flags);
+
+  MemoryAllocation allocation{};
+  allocation.size = requirements.size;
+  allocation.memory_type_index = memory_type_index;
+
+  // Large resources (e.g. render targets) get their own memory, they'd only fragment the blocks
+  if (requirements.size >= DEDICATED_ALLOCATION_THRESHOLD) {
+    allocation.memory = allocateDeviceMemory(requirements.size, memory_type_index, &allocation.mapped_data);
+    allocation.offset = 0u;
+
+    MemoryHeapStatistics &statistics = m_dedicated_statistics[memory_type_index];
+    statistics.memory_type_index = memory_type_index;
+    statistics.dedicated = true;
+    statistics.block_count++;
+    statistics.allocation_count++;
+    statistics.block_bytes += requirements.size;
+    statistics.used_bytes += requirements.size;
+
+    return allocation;
+  }
+
+  Heap &heap = m_heaps[{memory_type_index, kind, strategy}];
+
+  // Try to fit the allocation into one of the existing blocks
+  VkDeviceSize offset = 0u;
+  MemoryBlock *target_block = nullptr;
+  for (MemoryBlock *block : heap.blocks) {
+    if (block->allocate(requirements.size, requirements.alignment, offset)) {
+      target_block = block;
+      break;
+    }
+  }
+
+  // Otherwise, we need a new block
+  if (target_block == nullptr) {
+    void *mapped_data = nullptr;
+    VkDeviceMemory memory = allocateDeviceMemory(BLOCK_SIZE, memory_type_index, &mapped_data);
+    target_block = new MemoryBlock(memory, BLOCK_SIZE, mapped_data, strategy);
+    heap.blocks.push_back(target_block);
+
+    bool allocated = target_block->allocate(requirements.size, requirements.alignment, offset);
+    Utils::checkBoolResult(allocated, "Failed to sub-allocate memory from a new block");
+  }
+
+  allocation.memory = target_block->getMemory();
+  allocation.offset = offset;
+  allocation.block = target_block;
+  if (target_block->getMappedData() != nullptr) {
+    allocation.mapped_data = static_cast<uint8_t *>(target_block->getMappedData()) + offset;
+  }
+
+  return allocation;
+}
+
+bool MemoryAllocator::hasMemoryType(uint32_t memory_type_bits, VkMemoryPropertyFlags memory_property_flags) {
+  for (uint32_t i = 0; i < m_memory_properties.memoryTypeCount; i++) {
+    VkMemoryPropertyFlags property_flags = m_memory_properties.memoryTypes[i].propertyFlags;
+    if ((memory_type_bits & (1u << i)) && (property_flags & memory_property_flags) == memory_property_flags) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void MemoryAllocator::free(MemoryAllocation &allocation) {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  if (allocation.memory == VK_NULL_HANDLE) {
+    return;
+  }
+
+  // Dedicated allocations are simply freed
+  if (allocation.block == nullptr) {
+    vkFreeMemory(m_device, allocation.memory, nullptr);
+
+    MemoryHeapStatistics &statistics = m_dedicated_statistics[allocation.memory_type_index];
+    statistics.block_count--;
+    statistics.allocation_count--;
+    statistics.block_bytes -= allocation.size;
+    statistics.used_bytes -= allocation.size;
+  } else {
+    allocation.block->free(allocation.offset);
+
+    // Release empty blocks, but keep one block per heap around to avoid allocating it again right away
+    for (auto &[key, heap] : m_heaps) {
+      auto found_block = std::find(heap.blocks.begin(), heap.blocks.end(), allocation.block);
+      if (found_block == heap.blocks.end()) {
+        continue;
+      }
+
+      if (allocation.block->isEmpty() && heap.blocks.size() > 1) {
+        vkFreeMemory(m_device, allocation.block->getMemory(), nullptr);
+        delete allocation.block;
+        heap.blocks.erase(found_block);
+      }
+      break;
+    }
+  }
+
+  allocation = MemoryAllocation{};
+}
+
+std::vector<MemoryHeapStatistics> MemoryAllocator::getStatistics() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  std::vector<MemoryHeapStatistics> heap_statistics;
+  for (auto &[key, heap] : m_heaps) {
+    MemoryHeapStatistics statistics{};
+    statistics.memory_type_index = key.memory_type_index;
+    statistics.images = key.kind == AllocationKind::IMAGE;
+    statistics.linear = key.strategy == AllocationStrategy::LINEAR;
+
+    for (MemoryBlock *block : heap.blocks) {
+      statistics.block_count++;
+      statistics.block_bytes += block->getSize();
+      statistics.used_bytes += block->getUsedSize();
+      statistics.allocation_count += block->getAllocationCount();
+    }
+
+    heap_statistics.push_back(statistics);
+  }
+
+  for (auto &[memory_type_index, statistics] : m_dedicated_statistics) {
+    heap_statistics.push_back(statistics);
+  }
+
+  return heap_statistics;
+}
+
+VkDevice MemoryAllocator::getDevice() { return m_device; }
+
+VkPhysicalDevice MemoryAllocator::getPhysicalDevice() { return m_physical_device; }
+
+VkDeviceMemory MemoryAllocator::allocateDeviceMemory(VkDeviceSize size, uint32_t memory_type_index, void **mapped_data) {
+  VkMemoryAllocateInfo memory_allocate_info{VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO};
+  memory_allocate_info.allocationSize = size;
+  memory_allocate_info.memoryTypeIndex = memory_type_index;
+
+  VkDeviceMemory memory;
+  VkResult result = vkAllocateMemory(m_device, &memory_allocate_info, nullptr, &memory);
+  Utils::checkVkResult(result, "Failed to allocate device memory");
+
+  // Host visible memory is mapped once, as the same memory can't be mapped multiple times
+  *mapped_data = nullptr;
+  if (m_memory_properties.memoryTypes[memory_type_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    result = vkMapMemory(m_device, memory, 0u, VK_WHOLE_SIZE, 0, mapped_data);
+    Utils::checkVkResult(result, "Failed to map device memory");
+  }
+
+  return memory;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Block
+//------------------------------------------------------------------------------------------------------
+MemoryBlock::MemoryBlock(VkDeviceMemory memory, VkDeviceSize size, void *mapped_data, AllocationStrategy strategy) {
+  m_memory = memory;
+  m_size = size;
+  m_mapped_data = mapped_data;
+  m_strategy = strategy;
+
+  if (m_strategy == AllocationStrategy::BUDDY) {
+    // Initially, the whole block is one free chunk of the highest order
+    uint32_t max_order = 0u;
+    while ((MIN_BUDDY_SIZE << max_order) < m_size) {
+      max_order++;
+    }
+
+    m_free_lists.resize(max_order + 1u);
+    m_free_lists[max_order].insert(0u);
+  }
+}
+
+bool MemoryBlock::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+  if (m_strategy == AllocationStrategy::BUDDY) {
+    return allocateBuddy(size, alignment, offset);
+  } else {
+    return allocateLinear(size, alignment, offset);
+  }
+}
+
+void MemoryBlock::free(VkDeviceSize offset) {
+  auto found_allocation = m_allocations.find(offset);
+  assert(found_allocation != m_allocations.end());
+
+  if (m_strategy == AllocationStrategy::LINEAR) {
+    m_used_size -= found_allocation->second;
+    m_allocations.erase(found_allocation);
+
+    // Only once everything is freed, the block can be reused from the start
+    if (m_allocations.empty()) {
+      m_linear_offset = 0u;
+    }
+    return;
+  }
+
+  uint32_t order = static_cast<uint32_t>(found_allocation->second);
+  m_used_size -= MIN_BUDDY_SIZE << order;
+  m_allocations.erase(found_allocation);
+
+  // Merge the chunk with its buddy as long as the buddy is free as well
+  while (order + 1u < m_free_lists.size()) {
+    VkDeviceSize buddy_offset = offset ^ (MIN_BUDDY_SIZE << order);
+    auto found_buddy = m_free_lists[order].find(buddy_offset);
+    if (found_buddy == m_free_lists[order].end()) {
+      break;
+    }
+
+    m_free_lists[order].erase(found_buddy);
+    offset = std::min(offset, buddy_offset);
+    order++;
+  }
+
+  m_free_lists[order].insert(offset);
+}
+
+bool MemoryBlock::isEmpty() { return m_allocations.empty(); }
+
+VkDeviceMemory MemoryBlock::getMemory() { return m_memory; }
+
+void *MemoryBlock::getMappedData() { return m_mapped_data; }
+
+VkDeviceSize MemoryBlock::getSize() { return m_size; }
+
+VkDeviceSize MemoryBlock::getUsedSize() { return m_used_size; }
+
+uint32_t MemoryBlock::getAllocationCount() { return static_cast<uint32_t>(m_allocations.size()); }
+
+bool MemoryBlock::allocateBuddy(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+  // Chunks are aligned to their own size, so a chunk at least as large as the alignment is aligned as well
+  VkDeviceSize needed_size = std::max({size, alignment, MIN_BUDDY_SIZE});
+  uint32_t order = 0u;
+  while ((MIN_BUDDY_SIZE << order) < needed_size) {
+    order++;
+  }
+
+  if (order >= m_free_lists.size()) {
+    return false;
+  }
+
+  // Find the smallest free chunk which is large enough
+  uint32_t free_order = order;
+  while (free_order < m_free_lists.size() && m_free_lists[free_order].empty()) {
+    free_order++;
+  }
+
+  if (free_order == m_free_lists.size()) {
+    return false;
+  }
+
+  offset = *m_free_lists[free_order].begin();
+  m_free_lists[free_order].erase(m_free_lists[free_order].begin());
+
+  // Split it until it has the requested order, returning the upper halves to the free lists
+  while (free_order > order) {
+    free_order--;
+    m_free_lists[free_order].insert(offset + (MIN_BUDDY_SIZE << free_order));
+  }
+
+  m_allocations[offset] = order;
+  m_used_size += MIN_BUDDY_SIZE << order;
+  return true;
+}
+
+bool MemoryBlock::allocateLinear(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize &offset) {
+  VkDeviceSize aligned_offset = (m_linear_offset + alignment - 1) / alignment * alignment;
+  if (aligned_offset + size > m_size) {
+    return false;
+  }
+
+  offset = aligned_offset;
+  m_linear_offset = aligned_offset + size;
+  m_allocations[offset] = size;
+  m_used_size += size;
+  return true;
+}
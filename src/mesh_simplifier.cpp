@@ -0,0 +1,332 @@
+#include <xre/mesh_simplifier.h>
+
+// Other includes
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+namespace {
+// Key to weld vertices with exactly the same position
+struct PositionKey {
+  uint32_t bits[3];
+
+  bool operator==(const PositionKey &other) const = default;
+};
+
+struct PositionKeyHash {
+  size_t operator()(const PositionKey &key) const {
+    size_t hash = key.bits[0];
+    hash = hash * 73856093u ^ key.bits[1];
+    hash = hash * 19349663u ^ key.bits[2];
+    return hash;
+  }
+};
+
+// Key to weld vertices with exactly the same position, normal and texture coordinate
+struct VertexKey {
+  uint32_t bits[8];
+
+  bool operator==(const VertexKey &other) const = default;
+};
+static_assert(sizeof(Vertex) == sizeof(VertexKey::bits), "Vertex must not contain padding");
+
+struct VertexKeyHash {
+  size_t operator()(const VertexKey &key) const {
+    size_t hash = 0u;
+    for (uint32_t bits : key.bits) {
+      hash = hash * 73856093u ^ bits;
+    }
+    return hash;
+  }
+};
+
+uint64_t edgeKey(uint32_t a, uint32_t b) { return (static_cast<uint64_t>(std::min(a, b)) << 32) | std::max(a, b); }
+} // namespace
+
+void MeshSimplifier::Quadric::addPlane(const glm::dvec4 &plane, double weight) {
+  a[0] += weight * plane.x * plane.x;
+  a[1] += weight * plane.x * plane.y;
+  a[2] += weight * plane.x * plane.z;
+  a[3] += weight * plane.x * plane.w;
+  a[4] += weight * plane.y * plane.y;
+  a[5] += weight * plane.y * plane.z;
+  a[6] += weight * plane.y * plane.w;
+  a[7] += weight * plane.z * plane.z;
+  a[8] += weight * plane.z * plane.w;
+  a[9] += weight * plane.w * plane.w;
+}
+
+void MeshSimplifier::Quadric::add(const Quadric &other) {
+  for (uint32_t i = 0; i < 10; i++) {
+    a[i] += other.a[i];
+  }
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::dvec3 &p) const {
+  return a[0] * p.x * p.x + 2.0 * a[1] * p.x * p.y + 2.0 * a[2] * p.x * p.z + 2.0 * a[3] * p.x + a[4] * p.y * p.y + 2.0 * a[5] * p.y * p.z +
+         2.0 * a[6] * p.y + a[7] * p.z * p.z + 2.0 * a[8] * p.z + a[9];
+}
+
+//------------------------------------------------------------------------------------------------------
+// Simplify a mesh
+// Arguments:
+//  1) Vertices of the mesh
+//  2) Indices of the mesh (triangle list)
+//  3) Number of indices the simplified mesh should have at most
+//  4) Vertices of the simplified mesh (output)
+//  5) Indices of the simplified mesh (output)
+//------------------------------------------------------------------------------------------------------
+float MeshSimplifier::simplify(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices, size_t target_index_count,
+                               std::vector<Vertex> &out_vertices, std::vector<uint16_t> &out_indices) {
+  //------------------------------------------------------------------------------------------------------
+  // Weld the vertices
+  //------------------------------------------------------------------------------------------------------
+  // The collapses work on the positions, while the output keeps the full vertices (with their normal and
+  // texture coordinate) of each corner
+  std::unordered_map<PositionKey, uint32_t, PositionKeyHash> welded_positions;
+  std::unordered_map<VertexKey, uint32_t, VertexKeyHash> welded_indices;
+  std::vector<uint32_t> position_remap(vertices.size());
+  std::vector<uint32_t> vertex_remap(vertices.size());
+  std::vector<glm::vec3> positions;
+  std::vector<Vertex> welded_vertices;
+  std::vector<uint32_t> welded_vertex_positions; // Position of each welded vertex
+  std::vector<uint32_t> position_vertices;       // First welded vertex of each position
+  std::vector<bool> seams;                       // Whether multiple welded vertices share the position
+
+  for (size_t i = 0; i < vertices.size(); i++) {
+    PositionKey position_key;
+    std::memcpy(position_key.bits, &vertices[i].position, sizeof(position_key.bits));
+
+    auto [position_it, new_position] = welded_positions.try_emplace(position_key, static_cast<uint32_t>(positions.size()));
+    if (new_position) {
+      positions.push_back(vertices[i].position);
+      position_vertices.push_back(static_cast<uint32_t>(welded_vertices.size()));
+      seams.push_back(false);
+    }
+    position_remap[i] = position_it->second;
+
+    VertexKey vertex_key;
+    std::memcpy(vertex_key.bits, &vertices[i], sizeof(vertex_key.bits));
+
+    auto [vertex_it, new_vertex] = welded_indices.try_emplace(vertex_key, static_cast<uint32_t>(welded_vertices.size()));
+    if (new_vertex) {
+      welded_vertices.push_back(vertices[i]);
+      welded_vertex_positions.push_back(position_it->second);
+      seams[position_it->second] = !new_position;
+    }
+    vertex_remap[i] = vertex_it->second;
+  }
+
+  // Three positions per triangle, and the welded vertex of each corner. Degenerate triangles are dropped.
+  std::vector<uint32_t> triangles;
+  std::vector<uint32_t> corners;
+  triangles.reserve(indices.size());
+  corners.reserve(indices.size());
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    uint32_t a = position_remap[indices[i]], b = position_remap[indices[i + 1]], c = position_remap[indices[i + 2]];
+    if (a != b && b != c && c != a) {
+      triangles.insert(triangles.end(), {a, b, c});
+      corners.insert(corners.end(), {vertex_remap[indices[i]], vertex_remap[indices[i + 1]], vertex_remap[indices[i + 2]]});
+    }
+  }
+
+  //------------------------------------------------------------------------------------------------------
+  // Setup the quadrics and lock the vertices on the border
+  //------------------------------------------------------------------------------------------------------
+  std::vector<Quadric> quadrics(positions.size());
+  std::unordered_map<uint64_t, uint32_t> edge_use_counts;
+
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    glm::dvec3 p0 = positions[triangles[i]], p1 = positions[triangles[i + 1]], p2 = positions[triangles[i + 2]];
+    glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+    double length = glm::length(normal);
+    if (length > 0.0) {
+      normal /= length;
+      glm::dvec4 plane(normal, -glm::dot(normal, p0));
+
+      // Weight by area, such that small triangles don't dominate
+      for (uint32_t j = 0; j < 3; j++) {
+        quadrics[triangles[i + j]].addPlane(plane, length * 0.5);
+      }
+    }
+
+    for (uint32_t j = 0; j < 3; j++) {
+      edge_use_counts[edgeKey(triangles[i + j], triangles[i + (j + 1) % 3])]++;
+    }
+  }
+
+  // Seams are locked as well, as their corners would otherwise need to pick one of the different normals
+  // or texture coordinates
+  std::vector<bool> locked = seams;
+  for (const auto &[edge, count] : edge_use_counts) {
+    if (count == 1) {
+      locked[edge >> 32] = true;
+      locked[edge & 0xffffffffu] = true;
+    }
+  }
+
+  //------------------------------------------------------------------------------------------------------
+  // Collapse edges in passes, cheapest first, until the target is reached
+  //------------------------------------------------------------------------------------------------------
+  double max_error = 0.0;
+
+  while (triangles.size() > target_index_count) {
+    // Collect the unique edges of the current triangles (sorted, such that the result is deterministic)
+    std::vector<uint64_t> edges;
+    edges.reserve(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      for (uint32_t j = 0; j < 3; j++) {
+        edges.push_back(edgeKey(triangles[i + j], triangles[i + (j + 1) % 3]));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+    // Compute the cost of each collapse, trying both end points and the midpoint
+    std::vector<Collapse> collapses;
+    for (uint64_t edge : edges) {
+      uint32_t a = static_cast<uint32_t>(edge >> 32);
+      uint32_t b = static_cast<uint32_t>(edge & 0xffffffffu);
+      if (locked[a] || locked[b]) {
+        continue;
+      }
+
+      Quadric quadric = quadrics[a];
+      quadric.add(quadrics[b]);
+
+      Collapse collapse{quadric.evaluate(positions[a]), b, a, positions[a]};
+      double error = quadric.evaluate(positions[b]);
+      if (error < collapse.error) {
+        collapse = {error, a, b, positions[b]};
+      }
+      glm::vec3 midpoint = (positions[a] + positions[b]) * 0.5f;
+      error = quadric.evaluate(midpoint);
+      if (error < collapse.error) {
+        collapse = {error, b, a, midpoint};
+      }
+
+      collapses.push_back(collapse);
+    }
+
+    std::stable_sort(collapses.begin(), collapses.end(), [](const Collapse &a, const Collapse &b) { return a.error < b.error; });
+
+    // Triangles around each vertex, to check for flips
+    std::vector<std::vector<uint32_t>> vertex_triangles(positions.size());
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      for (uint32_t j = 0; j < 3; j++) {
+        vertex_triangles[triangles[i + j]].push_back(static_cast<uint32_t>(i / 3));
+      }
+    }
+
+    // Each collapse removes two triangles, and vertices around a collapse may not be collapsed again in
+    // the same pass, as the flip check would not be valid anymore.
+    size_t remaining_collapses = (triangles.size() - target_index_count) / 6 + 1;
+    std::vector<bool> touched(positions.size(), false);
+    std::vector<uint32_t> collapse_targets(positions.size());
+    for (uint32_t i = 0; i < collapse_targets.size(); i++) {
+      collapse_targets[i] = i;
+    }
+
+    size_t collapse_count = 0;
+    for (const Collapse &collapse : collapses) {
+      if (collapse_count >= remaining_collapses) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to]) {
+        continue;
+      }
+
+      // Reject the collapse if any of the remaining triangles would flip
+      bool flips = false;
+      for (uint32_t vertex : {collapse.from, collapse.to}) {
+        for (uint32_t triangle : vertex_triangles[vertex]) {
+          flips = flips || flipsTriangle(positions, triangles, triangle, collapse);
+        }
+      }
+      if (flips) {
+        continue;
+      }
+
+      // Apply the collapse
+      collapse_targets[collapse.from] = collapse.to;
+      positions[collapse.to] = collapse.position;
+      quadrics[collapse.to].add(quadrics[collapse.from]);
+      max_error = std::max(max_error, collapse.error);
+      collapse_count++;
+
+      for (uint32_t vertex : {collapse.from, collapse.to}) {
+        for (uint32_t triangle : vertex_triangles[vertex]) {
+          for (uint32_t j = 0; j < 3; j++) {
+            touched[triangles[triangle * 3 + j]] = true;
+          }
+        }
+      }
+    }
+
+    if (collapse_count == 0) {
+      break;
+    }
+
+    // Remap the triangles and drop the ones which collapsed. Collapsed vertices are never on a seam, so
+    // their corners simply take the vertex of the position they moved to.
+    std::vector<uint32_t> remaining_triangles;
+    std::vector<uint32_t> remaining_corners;
+    remaining_triangles.reserve(triangles.size());
+    remaining_corners.reserve(corners.size());
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      uint32_t a = collapse_targets[triangles[i]], b = collapse_targets[triangles[i + 1]], c = collapse_targets[triangles[i + 2]];
+      if (a != b && b != c && c != a) {
+        remaining_triangles.insert(remaining_triangles.end(), {a, b, c});
+        for (uint32_t j = 0; j < 3; j++) {
+          uint32_t position = remaining_triangles[remaining_triangles.size() - 3 + j];
+          remaining_corners.push_back(position == triangles[i + j] ? corners[i + j] : position_vertices[position]);
+        }
+      }
+    }
+    triangles = std::move(remaining_triangles);
+    corners = std::move(remaining_corners);
+  }
+
+  //------------------------------------------------------------------------------------------------------
+  // Compact the vertices which are still used
+  //------------------------------------------------------------------------------------------------------
+  std::vector<uint32_t> compacted_indices(welded_vertices.size(), UINT32_MAX);
+  out_vertices.clear();
+  out_indices.clear();
+  out_indices.reserve(corners.size());
+
+  for (uint32_t vertex : corners) {
+    if (compacted_indices[vertex] == UINT32_MAX) {
+      compacted_indices[vertex] = static_cast<uint32_t>(out_vertices.size());
+
+      Vertex compacted_vertex = welded_vertices[vertex];
+      compacted_vertex.position = positions[welded_vertex_positions[vertex]];
+      out_vertices.push_back(compacted_vertex);
+    }
+    out_indices.push_back(static_cast<uint16_t>(compacted_indices[vertex]));
+  }
+
+  return static_cast<float>(max_error);
+}
+
+// Whether a collapse flips the normal of a triangle around the edge. Triangles which contain both vertices
+// of the edge are removed by the collapse anyway, and always pass.
+bool MeshSimplifier::flipsTriangle(const std::vector<glm::vec3> &positions, const std::vector<uint32_t> &triangles, uint32_t triangle,
+                                   const Collapse &collapse) {
+  glm::vec3 before[3], after[3];
+  for (uint32_t j = 0; j < 3; j++) {
+    uint32_t current = triangles[triangle * 3 + j];
+    before[j] = positions[current];
+    after[j] = current == collapse.from || current == collapse.to ? collapse.position : positions[current];
+  }
+
+  glm::vec3 normal_before = glm::cross(before[1] - before[0], before[2] - before[0]);
+  glm::vec3 normal_after = glm::cross(after[1] - after[0], after[2] - after[0]);
+
+  // Collapsed triangles have a zero normal after the move
+  if (glm::dot(normal_after, normal_after) == 0.0f) {
+    return false;
+  }
+
+  return glm::dot(normal_before, normal_after) <= 0.0f;
+}
@@ -13,8 +13,6 @@ Model::Model(std::vector<Mesh> meshes, glm::vec3 color, std::shared_ptr<Material
   m_meshes = meshes;
   m_original_model_color = color;
   m_model_color = color;
-  // TODO: check that we haven't reached the max number of models
-  m_model_index = s_model_index++;
   m_material = material;
 }
 
@@ -22,51 +20,148 @@ Model::Model(const char *model_path, glm::vec3 color, std::shared_ptr<Material>
   loadObj(model_path, vulkan_handler);
   m_model_color = color;
   m_original_model_color = color;
-  m_model_index = s_model_index++;
   m_material = material;
 }
 
-void Model::render(RenderContext &ctx, glm::mat4 scene_node_transform) {
+void Model::render(RenderContext &ctx, glm::mat4 scene_node_transform, uint32_t lod_level) {
+  std::vector<Mesh> &meshes = lod_level == 0 ? m_meshes : m_lod_meshes[lod_level - 1];
+
+  // Reject the meshes which are outside of the frustum, using their world space bounding boxes
+  m_visible_meshes.clear();
+  for (Mesh &mesh : meshes) {
+    if (ctx.frustum && mesh.hasBoundingBox() &&
+        !ctx.frustum->intersects(mesh.getObjectOrientedBoundingBox().transformed(scene_node_transform))) {
+      ctx.culling_statistics.culled_draws++;
+    } else if (ctx.occlusion_culler && mesh.hasBoundingBox() &&
+               ctx.occlusion_culler->isOccluded(mesh.getObjectOrientedBoundingBox().transformed(scene_node_transform))) {
+      ctx.culling_statistics.occluded_draws++;
+    } else {
+      m_visible_meshes.push_back(&mesh);
+    }
+  }
+
+  // Nothing to render, so we don't need the uniform data either
+  if (m_visible_meshes.empty()) {
+    return;
+  }
+
   // Prepare model uniform buffer
   ModelUniformBufferObject uniform_buffer_object{};
   uniform_buffer_object.world = scene_node_transform;
   uniform_buffer_object.color = m_model_color;
+  uniform_buffer_object.texture_index = m_material->getTextureIndex();
 
   // Render a different color if the model is interacted with.
   if (m_interacted) {
     uniform_buffer_object.color = ColorUtils::lighten(m_model_color, 0.5f);
   }
 
-  // Update context
+  // Allocate a slot for the uniform data in the arena of the current frame, with push constants the
+  // render queue pushes the data with each draw instead
+  const uint32_t offset = ctx.push_constants ? 0u : ctx.uniform_arena->push(uniform_buffer_object);
+
+  // Update context, which is used by the meshes to add their draws to the render queue
+  ctx.pipeline = m_material->getGraphicsPipeline();
+  ctx.indirect_pipeline = m_material->getIndirectGraphicsPipeline();
   ctx.descriptor_set = m_material->getDescriptorset();
-  ctx.model_uniform_buffer = m_material->getUniformBuffer();
+  ctx.uniform_offset = offset;
+  ctx.world_transform = uniform_buffer_object.world;
+  ctx.color = uniform_buffer_object.color;
+  ctx.texture_index = uniform_buffer_object.texture_index;
+  ctx.translucent = m_material->isTranslucent();
 
-  // Update uniform buffer
-  const uint32_t offset = m_model_index * ctx.aligned_size;
-  ctx.model_uniform_buffer->loadData(uniform_buffer_object, offset);
+  // Render meshes of this model
+  for (Mesh *mesh : m_visible_meshes) {
+    mesh->render(ctx);
 
-  // Bind descriptor set
-  vkCmdBindDescriptorSets(ctx.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipeline_layout, 1u, 1u, &ctx.descriptor_set, 1,
-                          &offset);
+    if (m_render_bounding_boxes) {
+      mesh->renderBoundingBox(ctx);
+    }
+  }
+}
 
-  // Bind the graphics pipeline of the material
-  m_material->bind();
+// Add the meshes to the occluders rasterized by the occlusion culler
+void Model::addOccluders(OcclusionCuller &occlusion_culler, const glm::mat4 &scene_node_transform) {
+  for (Mesh &mesh : m_meshes) {
+    occlusion_culler.addOccluder(mesh.getVertexPositions(), mesh.getIndices(), scene_node_transform);
+  }
+}
 
-  // Render meshes of this model
-  for (Mesh mesh : m_meshes) {
-    mesh.render(ctx);
+//------------------------------------------------------------------------------------------------------
+// Compute the world space bounds of all meshes, used for the bounds of the scene node subtrees.
+//------------------------------------------------------------------------------------------------------
+AABB Model::computeBounds(const glm::mat4 &scene_node_transform) {
+  AABB bounds;
 
-    if (m_render_bounding_boxes) {
-      mesh.renderBoundingBox(ctx);
+  for (Mesh &mesh : m_meshes) {
+    if (!mesh.hasBoundingBox()) {
+      continue;
+    }
+
+    for (const glm::vec3 &corner : mesh.getObjectOrientedBoundingBox().transformed(scene_node_transform).getCorners()) {
+      bounds.extend(corner);
     }
   }
+
+  return bounds;
 }
 
-void Model::toggleRenderBoundingBoxes() { m_render_bounding_boxes = !m_render_bounding_boxes; }
+uint32_t Model::getLodLevelCount() { return 1u + static_cast<uint32_t>(m_lod_meshes.size()); }
+
+//------------------------------------------------------------------------------------------------------
+// Select the level of detail from the projected size of the bounds, for the eye in which the model
+// appears largest. Each level is used for half the size of the previous one, and the level only
+// changes once the size passes the threshold by a fraction of a level, to avoid popping back and forth.
+//------------------------------------------------------------------------------------------------------
+uint32_t Model::selectLodLevel(const LodViews &lod_views, const AABB &bounds, uint32_t current_level) {
+  if (m_lod_meshes.empty() || bounds.isEmpty()) {
+    return 0u;
+  }
 
-void Model::setColor(glm::vec3 color) { m_model_color = color; }
+  glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+  float radius = glm::length(bounds.max - bounds.min) * 0.5f;
 
-void Model::resetColor() { m_model_color = m_original_model_color; }
+  float projected_size = 0.0f;
+  for (uint32_t i = 0; i < lod_views.count; i++) {
+    float distance = glm::length(center - lod_views.positions[i]);
+
+    // Always use the full detail when we're inside the bounds
+    if (distance <= radius) {
+      return 0u;
+    }
+
+    projected_size = std::max(projected_size, 2.0f * radius * lod_views.pixels_per_unit / distance);
+  }
+
+  // Continuous level, e.g. 1.5 is halfway between the thresholds of level 1 and 2
+  float level = std::log2(LOD_FULL_DETAIL_PIXELS / projected_size) + 1.0f + s_lod_bias;
+
+  uint32_t selected_level = current_level;
+  if (level < static_cast<float>(current_level) - LOD_HYSTERESIS || level >= static_cast<float>(current_level) + 1.0f + LOD_HYSTERESIS) {
+    selected_level = static_cast<uint32_t>(std::max(level, 0.0f));
+  }
+
+  return std::min(selected_level, getLodLevelCount() - 1u);
+}
+
+void Model::setLodBias(float lod_bias) { s_lod_bias = lod_bias; }
+
+float Model::getLodBias() { return s_lod_bias; }
+
+void Model::toggleRenderBoundingBoxes() {
+  m_render_bounding_boxes = !m_render_bounding_boxes;
+  m_generation++;
+}
+
+// Scenes often set the color every frame, so only actual changes count
+void Model::setColor(glm::vec3 color) {
+  if (color != m_model_color) {
+    m_model_color = color;
+    m_generation++;
+  }
+}
+
+void Model::resetColor() { setColor(m_original_model_color); }
 
 glm::vec3 Model::getColor() { return m_model_color; }
 
@@ -81,6 +176,9 @@ void Model::loadObj(const char *model_path, std::shared_ptr<VulkanHandler> vulka
   bool result = tinyobj::LoadObj(&attrib, &shapes, &materials, NULL, &error_output, model_path, NULL, true);
   Utils::checkBoolResult(result, error_output.c_str());
 
+  // Levels of detail of each mesh
+  std::vector<std::vector<Mesh>> mesh_lods;
+
   // Loop over the shapes (i.e. meshes) of the loaded model
   for (tinyobj::shape_t shape : shapes) {
     std::vector<Vertex> mesh_vertices;
@@ -138,7 +236,57 @@ void Model::loadObj(const char *model_path, std::shared_ptr<VulkanHandler> vulka
 
     Mesh mesh = Mesh(mesh_vertices, mesh_indices, vulkan_handler);
     m_meshes.push_back(mesh);
+
+    if (GENERATE_LODS) {
+      mesh_lods.push_back(generateLods(mesh_vertices, mesh_indices, vulkan_handler));
+    }
   };
+
+  // Store the levels of detail, meshes which have fewer levels than others use their coarsest level
+  size_t lod_level_count = 0;
+  for (const std::vector<Mesh> &lods : mesh_lods) {
+    lod_level_count = std::max(lod_level_count, lods.size());
+  }
+
+  m_lod_meshes.resize(lod_level_count);
+  for (size_t level = 0; level < lod_level_count; level++) {
+    for (size_t i = 0; i < mesh_lods.size(); i++) {
+      if (mesh_lods[i].empty()) {
+        m_lod_meshes[level].push_back(m_meshes[i]);
+      } else {
+        m_lod_meshes[level].push_back(mesh_lods[i][std::min(level, mesh_lods[i].size() - 1)]);
+      }
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Generate the simplified levels of a mesh, each with a fraction of the triangles of the previous one.
+// Stops early if the mesh is small or can't be simplified any further.
+//------------------------------------------------------------------------------------------------------
+std::vector<Mesh> Model::generateLods(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices,
+                                      std::shared_ptr<VulkanHandler> vulkan_handler) {
+  std::vector<Mesh> lods;
+  std::vector<Vertex> lod_vertices = vertices;
+  std::vector<uint16_t> lod_indices = indices;
+
+  while (lods.size() + 1 < MAX_LOD_LEVELS && lod_indices.size() / 3 >= LOD_MIN_TRIANGLES) {
+    std::vector<Vertex> simplified_vertices;
+    std::vector<uint16_t> simplified_indices;
+    size_t target_index_count = static_cast<size_t>(lod_indices.size() / 3 * LOD_TRIANGLE_RATIO) * 3;
+    MeshSimplifier::simplify(lod_vertices, lod_indices, target_index_count, simplified_vertices, simplified_indices);
+
+    // Not worth another level if the simplification got stuck
+    if (simplified_indices.empty() || simplified_indices.size() > lod_indices.size() * 0.9f) {
+      break;
+    }
+
+    lod_vertices = std::move(simplified_vertices);
+    lod_indices = std::move(simplified_indices);
+    lods.push_back(Mesh(lod_vertices, lod_indices, vulkan_handler));
+  }
+
+  return lods;
 }
 
 // TODO: Build "outer" bounding box containing all meshes such that we first only
@@ -176,4 +324,11 @@ void Model::printBouindingBoxes() {
   }
 }
 
-void Model::setInteractedState(bool interacted) { m_interacted = interacted; }
+void Model::setInteractedState(bool interacted) {
+  if (interacted != m_interacted) {
+    m_interacted = interacted;
+    m_generation++;
+  }
+}
+
+uint64_t Model::getGeneration() { return m_generation; }
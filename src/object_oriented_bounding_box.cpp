@@ -183,24 +183,22 @@ OOBB OOBB::transformed(const glm::mat4 &model) const {
   return transformed_bounding_box;
 }
 
-std::vector<glm::vec3> OOBB::getCorners() const {
-  std::vector<glm::vec3> vertices;
-  vertices.reserve(8);
-
+// Returned by value without allocating, as it is used by the culling tests of every frame
+std::array<glm::vec3, 8> OOBB::getCorners() const {
   glm::vec3 ex = m_axes[0] * m_extents.x;
   glm::vec3 ey = m_axes[1] * m_extents.y;
   glm::vec3 ez = m_axes[2] * m_extents.z;
 
-  vertices.push_back(m_center + ex + ey + ez); // 0
-  vertices.push_back(m_center + ex + ey - ez); // 1
-  vertices.push_back(m_center + ex - ey + ez); // 2
-  vertices.push_back(m_center + ex - ey - ez); // 3
-  vertices.push_back(m_center - ex + ey + ez); // 4
-  vertices.push_back(m_center - ex + ey - ez); // 5
-  vertices.push_back(m_center - ex - ey + ez); // 6
-  vertices.push_back(m_center - ex - ey - ez); // 7
-
-  return vertices;
+  return {
+      m_center + ex + ey + ez, // 0
+      m_center + ex + ey - ez, // 1
+      m_center + ex - ey + ez, // 2
+      m_center + ex - ey - ez, // 3
+      m_center - ex + ey + ez, // 4
+      m_center - ex + ey - ez, // 5
+      m_center - ex - ey + ez, // 6
+      m_center - ex - ey - ez, // 7
+  };
 }
 
 std::vector<uint16_t> OOBB::getLineIndices() const {
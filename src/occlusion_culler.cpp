@@ -0,0 +1,312 @@
+#include <xre/occlusion_culler.h>
+
+// SSE includes
+#include <emmintrin.h>
+
+// XRe includes
+#include <xre/cpu_profiler.h>
+
+// Other includes
+#include <algorithm>
+#include <cmath>
+
+OcclusionCuller::OcclusionCuller() { m_worker = std::thread(&OcclusionCuller::workerLoop, this); }
+
+OcclusionCuller::~OcclusionCuller() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+  m_worker.join();
+}
+
+//------------------------------------------------------------------------------------------------------
+// Collect the occluders of a frame
+//------------------------------------------------------------------------------------------------------
+void OcclusionCuller::beginFrame(const std::vector<glm::mat4> &view_projections) {
+  // The worker might still be reading the data of the previous frame
+  wait();
+
+  m_views.resize(view_projections.size());
+  for (size_t i = 0; i < view_projections.size(); i++) {
+    m_views[i].view_projection = view_projections[i];
+  }
+
+  m_triangles.clear();
+}
+
+void OcclusionCuller::addOccluder(const std::vector<glm::vec3> &positions, const std::vector<uint16_t> &indices, const glm::mat4 &world) {
+  // Copy the triangles, such that the worker does not depend on the occluder staying alive
+  for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+    for (size_t j = 0; j < 3; j++) {
+      m_triangles.push_back(glm::vec3(world * glm::vec4(positions[indices[i + j]], 1.0f)));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Rasterize the occluders
+//------------------------------------------------------------------------------------------------------
+void OcclusionCuller::rasterizeAsync() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_job_pending = true;
+  }
+  m_condition.notify_all();
+}
+
+void OcclusionCuller::rasterize() {
+  XRE_PROFILE_SCOPE("Rasterize occluders");
+  for (ViewBuffer &view : m_views) {
+    rasterizeView(view);
+  }
+}
+
+void OcclusionCuller::wait() {
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_condition.wait(lock, [this] { return !m_job_pending; });
+}
+
+void OcclusionCuller::workerLoop() {
+  XRE_PROFILE_THREAD("Occlusion culler");
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    m_condition.wait(lock, [this] { return m_job_pending || m_stop; });
+    if (m_stop) {
+      return;
+    }
+
+    // The main thread does not touch the inputs until the job is done, so we don't need to hold the lock
+    lock.unlock();
+    rasterize();
+    lock.lock();
+
+    m_job_pending = false;
+    m_condition.notify_all();
+  }
+}
+
+void OcclusionCuller::rasterizeView(ViewBuffer &view) {
+  view.depth.assign(WIDTH * HEIGHT, 0.0f);
+  view.tile_depth.assign(TILES_X * TILES_Y, 0.0f);
+
+  for (size_t i = 0; i < m_triangles.size(); i += 3) {
+    rasterizeTriangle(view, view.view_projection * glm::vec4(m_triangles[i], 1.0f),
+                      view.view_projection * glm::vec4(m_triangles[i + 1], 1.0f),
+                      view.view_projection * glm::vec4(m_triangles[i + 2], 1.0f));
+  }
+
+  // Store the farthest depth of each tile, which is used to reject boxes without looking at the pixels
+  for (uint32_t tile_y = 0; tile_y < TILES_Y; tile_y++) {
+    for (uint32_t tile_x = 0; tile_x < TILES_X; tile_x++) {
+      __m128 farthest = _mm_set1_ps(std::numeric_limits<float>::max());
+
+      for (uint32_t y = tile_y * TILE_SIZE; y < (tile_y + 1) * TILE_SIZE; y++) {
+        for (uint32_t x = tile_x * TILE_SIZE; x < (tile_x + 1) * TILE_SIZE; x += 4) {
+          farthest = _mm_min_ps(farthest, _mm_loadu_ps(&view.depth[y * WIDTH + x]));
+        }
+      }
+
+      alignas(16) float lanes[4];
+      _mm_store_ps(lanes, farthest);
+      view.tile_depth[tile_y * TILES_X + tile_x] = std::min(std::min(lanes[0], lanes[1]), std::min(lanes[2], lanes[3]));
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Rasterize a single triangle (in clip space), four pixels at a time. Pixels are covered if their
+// center is inside the triangle, and keep the closest depth.
+//------------------------------------------------------------------------------------------------------
+void OcclusionCuller::rasterizeTriangle(ViewBuffer &view, const glm::vec4 &v0, const glm::vec4 &v1, const glm::vec4 &v2) {
+  // Triangles crossing the near plane are skipped instead of clipped, which is still conservative
+  if (v0.w < NEAR_W || v1.w < NEAR_W || v2.w < NEAR_W) {
+    return;
+  }
+
+  // Project into screen space
+  std::array<glm::vec3, 3> vertices;
+  const glm::vec4 *clip_vertices[3] = {&v0, &v1, &v2};
+  for (uint32_t i = 0; i < 3; i++) {
+    float inverse_w = 1.0f / clip_vertices[i]->w;
+    vertices[i] = glm::vec3((clip_vertices[i]->x * inverse_w * 0.5f + 0.5f) * WIDTH,
+                            (clip_vertices[i]->y * inverse_w * 0.5f + 0.5f) * HEIGHT, inverse_w);
+  }
+
+  // Make sure the triangle is counter-clockwise, such that the inside has positive edge functions.
+  // Occluders are rasterized from both sides.
+  float area = (vertices[1].x - vertices[0].x) * (vertices[2].y - vertices[0].y) -
+               (vertices[2].x - vertices[0].x) * (vertices[1].y - vertices[0].y);
+  if (area < 0.0f) {
+    std::swap(vertices[1], vertices[2]);
+    area = -area;
+  }
+  if (area < 1e-6f) {
+    return;
+  }
+
+  // Bounds of the triangle, clamped to the screen
+  float min_x = std::min({vertices[0].x, vertices[1].x, vertices[2].x});
+  float max_x = std::max({vertices[0].x, vertices[1].x, vertices[2].x});
+  float min_y = std::min({vertices[0].y, vertices[1].y, vertices[2].y});
+  float max_y = std::max({vertices[0].y, vertices[1].y, vertices[2].y});
+  int32_t start_x = std::max(static_cast<int32_t>(std::floor(min_x)), 0);
+  int32_t end_x = std::min(static_cast<int32_t>(std::ceil(max_x)), static_cast<int32_t>(WIDTH) - 1);
+  int32_t start_y = std::max(static_cast<int32_t>(std::floor(min_y)), 0);
+  int32_t end_y = std::min(static_cast<int32_t>(std::ceil(max_y)), static_cast<int32_t>(HEIGHT) - 1);
+  if (start_x > end_x || start_y > end_y) {
+    return;
+  }
+
+  // Start at a multiple of four, pixels outside of the triangle are masked by the edge functions
+  start_x &= ~3;
+
+  // Edge functions E(x, y) = a * x + b * y + c, the edge opposite of vertex i is used as its
+  // barycentric weight for interpolating the depth
+  float edge_a[3], edge_b[3], edge_c[3];
+  for (uint32_t i = 0; i < 3; i++) {
+    const glm::vec3 &from = vertices[(i + 1) % 3];
+    const glm::vec3 &to = vertices[(i + 2) % 3];
+    edge_a[i] = from.y - to.y;
+    edge_b[i] = to.x - from.x;
+    edge_c[i] = -(edge_a[i] * from.x + edge_b[i] * from.y);
+  }
+
+  // Depth is linear in screen space as well
+  float inverse_area = 1.0f / area;
+  float depth_a = (edge_a[0] * vertices[0].z + edge_a[1] * vertices[1].z + edge_a[2] * vertices[2].z) * inverse_area;
+  float depth_b = (edge_b[0] * vertices[0].z + edge_b[1] * vertices[1].z + edge_b[2] * vertices[2].z) * inverse_area;
+  float depth_c = (edge_c[0] * vertices[0].z + edge_c[1] * vertices[1].z + edge_c[2] * vertices[2].z) * inverse_area;
+
+  const __m128 lane_offsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+  const __m128 zero = _mm_setzero_ps();
+
+  for (int32_t y = start_y; y <= end_y; y++) {
+    float center_y = static_cast<float>(y) + 0.5f;
+
+    __m128 row_edge[3];
+    __m128 step_edge[3];
+    for (uint32_t i = 0; i < 3; i++) {
+      row_edge[i] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(edge_a[i]), _mm_add_ps(_mm_set1_ps(static_cast<float>(start_x)), lane_offsets)),
+                               _mm_set1_ps(edge_b[i] * center_y + edge_c[i]));
+      step_edge[i] = _mm_set1_ps(edge_a[i] * 4.0f);
+    }
+    __m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(depth_a), _mm_add_ps(_mm_set1_ps(static_cast<float>(start_x)), lane_offsets)),
+                              _mm_set1_ps(depth_b * center_y + depth_c));
+    __m128 step_depth = _mm_set1_ps(depth_a * 4.0f);
+
+    float *row = &view.depth[y * WIDTH];
+    for (int32_t x = start_x; x <= end_x; x += 4) {
+      __m128 inside =
+          _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(row_edge[0], zero), _mm_cmpge_ps(row_edge[1], zero)), _mm_cmpge_ps(row_edge[2], zero));
+
+      if (_mm_movemask_ps(inside) != 0) {
+        __m128 previous = _mm_loadu_ps(row + x);
+        __m128 closest = _mm_max_ps(previous, depth);
+        _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closest), _mm_andnot_ps(inside, previous)));
+      }
+
+      for (uint32_t i = 0; i < 3; i++) {
+        row_edge[i] = _mm_add_ps(row_edge[i], step_edge[i]);
+      }
+      depth = _mm_add_ps(depth, step_depth);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Test boxes against the depth buffers
+//------------------------------------------------------------------------------------------------------
+bool OcclusionCuller::isOccluded(const OOBB &box) const {
+  std::array<glm::vec3, 8> corners = box.getCorners();
+  return isOccluded(corners.data());
+}
+
+bool OcclusionCuller::isOccluded(const AABB &box) const {
+  glm::vec3 corners[8];
+  for (uint32_t i = 0; i < 8; i++) {
+    corners[i] = glm::vec3(i & 1 ? box.max.x : box.min.x, i & 2 ? box.max.y : box.min.y, i & 4 ? box.max.z : box.min.z);
+  }
+
+  return isOccluded(corners);
+}
+
+// A box is only occluded if it is hidden in all views
+bool OcclusionCuller::isOccluded(const glm::vec3 *corners) const {
+  if (m_views.empty()) {
+    return false;
+  }
+
+  for (const ViewBuffer &view : m_views) {
+    if (!isOccludedInView(view, corners)) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool OcclusionCuller::isOccludedInView(const ViewBuffer &view, const glm::vec3 *corners) const {
+  // Screen space rectangle and closest depth of the box
+  float min_x = std::numeric_limits<float>::max();
+  float max_x = std::numeric_limits<float>::lowest();
+  float min_y = std::numeric_limits<float>::max();
+  float max_y = std::numeric_limits<float>::lowest();
+  float closest_depth = 0.0f;
+
+  for (uint32_t i = 0; i < 8; i++) {
+    glm::vec4 corner = view.view_projection * glm::vec4(corners[i], 1.0f);
+
+    // Boxes reaching behind the near plane are never culled
+    if (corner.w < NEAR_W) {
+      return false;
+    }
+
+    float inverse_w = 1.0f / corner.w;
+    float x = (corner.x * inverse_w * 0.5f + 0.5f) * WIDTH;
+    float y = (corner.y * inverse_w * 0.5f + 0.5f) * HEIGHT;
+    min_x = std::min(min_x, x);
+    max_x = std::max(max_x, x);
+    min_y = std::min(min_y, y);
+    max_y = std::max(max_y, y);
+    closest_depth = std::max(closest_depth, inverse_w);
+  }
+  closest_depth *= DEPTH_BIAS;
+
+  // Boxes outside of the screen are not visible in this view anyway
+  if (max_x < 0.0f || max_y < 0.0f || min_x >= WIDTH || min_y >= HEIGHT) {
+    return true;
+  }
+
+  uint32_t start_x = static_cast<uint32_t>(std::max(min_x, 0.0f));
+  uint32_t end_x = std::min(static_cast<uint32_t>(max_x), WIDTH - 1);
+  uint32_t start_y = static_cast<uint32_t>(std::max(min_y, 0.0f));
+  uint32_t end_y = std::min(static_cast<uint32_t>(max_y), HEIGHT - 1);
+
+  for (uint32_t tile_y = start_y / TILE_SIZE; tile_y <= end_y / TILE_SIZE; tile_y++) {
+    for (uint32_t tile_x = start_x / TILE_SIZE; tile_x <= end_x / TILE_SIZE; tile_x++) {
+      // The whole tile is in front of the box
+      if (view.tile_depth[tile_y * TILES_X + tile_x] > closest_depth) {
+        continue;
+      }
+
+      // Otherwise, check the pixels of the tile covered by the box
+      uint32_t tile_start_x = std::max(start_x, tile_x * TILE_SIZE);
+      uint32_t tile_end_x = std::min(end_x, (tile_x + 1) * TILE_SIZE - 1);
+      uint32_t tile_start_y = std::max(start_y, tile_y * TILE_SIZE);
+      uint32_t tile_end_y = std::min(end_y, (tile_y + 1) * TILE_SIZE - 1);
+
+      for (uint32_t y = tile_start_y; y <= tile_end_y; y++) {
+        for (uint32_t x = tile_start_x; x <= tile_end_x; x++) {
+          if (view.depth[y * WIDTH + x] <= closest_depth) {
+            return false;
+          }
+        }
+      }
+    }
+  }
+
+  return true;
+}
@@ -3,8 +3,10 @@
 //------------------------------------------------------------------------------------------------------
 // Constructor
 //------------------------------------------------------------------------------------------------------
-OpenXrHandler::OpenXrHandler(const char *application_name) {
+OpenXrHandler::OpenXrHandler(const char *application_name, uint32_t frames_in_flight) {
   m_application_name = application_name;
+  m_frames_in_flight = frames_in_flight;
+  XRE_PROFILE_THREAD("Main");
 
   bool result;
 
@@ -17,6 +19,11 @@ OpenXrHandler::OpenXrHandler(const char *application_name) {
   // Setup the vulkan renderer
   m_vulkan_handler->setupRenderer();
 
+  // The occlusion culler is optional, as it only pays off in scenes with a lot of hidden geometry
+  if (VulkanHandler::USE_OCCLUSION_CULLING) {
+    m_occlusion_culler = new OcclusionCuller();
+  }
+
   // Create the material for the controllers and hands
   m_interactions_material =
       std::make_shared<Material>(SHADERS_FOLDER "ambient.vert.spv", SHADERS_FOLDER "basic.frag.spv", true, m_vulkan_handler);
@@ -32,7 +39,23 @@ OpenXrHandler::OpenXrHandler(const char *application_name) {
 //------------------------------------------------------------------------------------------------------
 // Destructor
 //------------------------------------------------------------------------------------------------------
-OpenXrHandler::~OpenXrHandler() {}
+OpenXrHandler::~OpenXrHandler() {
+  // Stops the worker thread of the occlusion culler
+  delete m_occlusion_culler;
+
+  // Construction might have failed before the renderer was created
+  if (m_vulkan_handler) {
+    m_vulkan_handler->stopRecordingThreads();
+
+    // Persist the pipeline cache for the next start
+    m_vulkan_handler->savePipelineCache();
+    m_vulkan_handler->printStatistics();
+  }
+
+  // Dump the CPU profiler scopes (only if the profiler is compiled in). All profiled threads are joined
+  // by now, so none of them is still writing into its event buffer.
+  XRE_PROFILE_WRITE_TRACE(CPU_TRACE_FILE);
+}
 
 //------------------------------------------------------------------------------------------------------
 // Initialize the general OpenXR stuff
@@ -91,6 +114,17 @@ bool OpenXrHandler::initializeOpenxr() {
     }
   }
 
+  // Submitting the depth is optional, so we only enable the extension if the runtime has it
+  if (USE_DEPTH_LAYER) {
+    for (XrExtensionProperties extension_property : extension_properties) {
+      if (strcmp(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME, extension_property.extensionName) == 0) {
+        requested_extensions.push_back(XR_KHR_COMPOSITION_LAYER_DEPTH_EXTENSION_NAME);
+        m_depth_layer_enabled = true;
+        break;
+      }
+    }
+  }
+
   //------------------------------------------------------------------------------------------------------
   // OpenXR Instance
   //------------------------------------------------------------------------------------------------------
@@ -133,10 +167,61 @@ bool OpenXrHandler::initializeOpenxr() {
                                             &m_openxr_blend_mode);
   Utils::checkXrResult(result, "Failed to enumerate the OpenXR environment blend modes!");
 
+  //------------------------------------------------------------------------------------------------------
+  // View ports
+  //------------------------------------------------------------------------------------------------------
+  // Devices running OpenXR code can have multiple viewports (views we need to render). For a stereo
+  // headset (XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO), this is usually 2, one for each eye. If it's
+  // an AR application running on e.g. a phone, this would be 1, and for other constellations, such as
+  // a cave-like system where on each wall an image is projected, this can even be 6 (or any other number).
+
+  // As such, we first need to find out how many views we need to support. If we set the 4th param of
+  // the xrEnumerateViewConfigurationViews function call to zero, it will retrieve the required
+  // number of viewports and store it in the 5th param
+  result = xrEnumerateViewConfigurationViews(m_openxr_instance, m_openxr_system_id, m_application_view_type, 0, &m_view_count, NULL);
+  if (XR_FAILED(result) || m_view_count == 0u) {
+    return false;
+  }
+
+  // Now that we know how many views we need to render, resize the vector that contains the view
+  // configurations (each XrViewConfigurationView specifies properties related to rendering an
+  // individual view) and the vector containing the views (each XrView specifies the pose and
+  // the fov of the view. Basically, a XrView is a view matrix in "traditional" rendering).
+  m_openxr_view_configuration_views.resize(m_view_count, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
+  m_openxr_views.resize(m_view_count, {XR_TYPE_VIEW});
+
+  // Now we again call xrEnumerateViewConfigurationViews, this time we set the 4th param
+  // to the number of our viewports, such that the method fills the xr_view_configurations
+  // vector with the actual view configurations
+  result = xrEnumerateViewConfigurationViews(m_openxr_instance, m_openxr_system_id, m_application_view_type, m_view_count, &m_view_count,
+                                             m_openxr_view_configuration_views.data());
+  if (XR_FAILED(result)) {
+    return false;
+  }
+
   //------------------------------------------------------------------------------------------------------
   // Vulkan handler
   //------------------------------------------------------------------------------------------------------
-  m_vulkan_handler = std::make_shared<VulkanHandler>(m_openxr_instance, m_openxr_system_id, m_application_name);
+  // Both eyes can only be rendered in a single pass into a layered swapchain if they have the same
+  // resolution, otherwise we fall back to rendering each eye on its own.
+  bool request_multiview = VulkanHandler::PREFER_MULTIVIEW && m_view_count == VulkanHandler::MULTIVIEW_VIEW_COUNT;
+  for (uint32_t i = 1u; i < m_view_count; i++) {
+    VkExtent2D first_resolution = getEyeResolution(0);
+    VkExtent2D resolution = getEyeResolution(i);
+    request_multiview = request_multiview && resolution.width == first_resolution.width && resolution.height == first_resolution.height;
+  }
+
+  // Use the sample count the runtime recommends for MSAA (the Vulkan handler clamps it to what the device supports)
+  uint32_t recommended_sample_count = m_openxr_view_configuration_views[0].recommendedSwapchainSampleCount;
+
+  m_vulkan_handler = std::make_shared<VulkanHandler>(m_openxr_instance, m_openxr_system_id, m_application_name, request_multiview,
+                                                     recommended_sample_count, m_depth_layer_enabled, m_frames_in_flight);
+  m_multiview = m_vulkan_handler->isMultiviewEnabled();
+
+  if (m_depth_layer_enabled && !m_vulkan_handler->isDepthStoreEnabled()) {
+    std::cout << "Depth is not submitted to the compositor, as it's not supported with MSAA" << std::endl;
+    m_depth_layer_enabled = false;
+  }
 
   //------------------------------------------------------------------------------------------------------
   // OpenXR Session
@@ -204,38 +289,6 @@ bool OpenXrHandler::initializeOpenxr() {
     return false;
   }
 
-  //------------------------------------------------------------------------------------------------------
-  // View ports
-  //------------------------------------------------------------------------------------------------------
-  // Devices running OpenXR code can have multiple viewports (views we need to render). For a stereo
-  // headset (XR_VIEW_CONFIGURATION_TYPE_PRIMARY_STEREO), this is usually 2, one for each eye. If it's
-  // an AR application running on e.g. a phone, this would be 1, and for other constellations, such as
-  // a cave-like system where on each wall an image is projected, this can even be 6 (or any other number).
-
-  // As such, we first need to find out how many views we need to support. If we set the 4th param of
-  // the xrEnumerateViewConfigurationViews function call to zero, it will retrieve the required
-  // number of viewports and store it in the 5th param
-  result = xrEnumerateViewConfigurationViews(m_openxr_instance, m_openxr_system_id, m_application_view_type, 0, &m_view_count, NULL);
-  if (XR_FAILED(result) || m_view_count == 0u) {
-    return false;
-  }
-
-  // Now that we know how many views we need to render, resize the vector that contains the view
-  // configurations (each XrViewConfigurationView specifies properties related to rendering an
-  // individual view) and the vector containing the views (each XrView specifies the pose and
-  // the fov of the view. Basically, a XrView is a view matrix in "traditional" rendering).
-  m_openxr_view_configuration_views.resize(m_view_count, {XR_TYPE_VIEW_CONFIGURATION_VIEW});
-  m_openxr_views.resize(m_view_count, {XR_TYPE_VIEW});
-
-  // Now we again call xrEnumerateViewConfigurationViews, this time we set the 4th param
-  // to the number of our viewports, such that the method fills the xr_view_configurations
-  // vector with the actual view configurations
-  result = xrEnumerateViewConfigurationViews(m_openxr_instance, m_openxr_system_id, m_application_view_type, m_view_count, &m_view_count,
-                                             m_openxr_view_configuration_views.data());
-  if (XR_FAILED(result)) {
-    return false;
-  }
-
   //------------------------------------------------------------------------------------------------------
   // Swapchains
   //------------------------------------------------------------------------------------------------------
@@ -263,11 +316,30 @@ bool OpenXrHandler::initializeOpenxr() {
 
   Utils::checkBoolResult(format_found, "Required OpenXR swapchain format not supported");
 
-  // Create swapchain and render targets
-  m_swapchains.resize(m_view_count);
-  m_render_targets.resize(m_view_count);
+  // The depth swapchains need a format matching our depth attachment, otherwise we keep the depth transient
+  if (m_depth_layer_enabled) {
+    bool depth_format_found = false;
+    for (const auto &available_format : swapchain_formats) {
+      depth_format_found = depth_format_found || available_format == TransientAttachments::DEPTH_FORMAT;
+    }
 
-  for (uint32_t i = 0; i < m_view_count; i++) {
+    if (!depth_format_found) {
+      std::cout << "Depth swapchain format not supported, depth is not submitted to the compositor" << std::endl;
+      m_depth_layer_enabled = false;
+    }
+  }
+
+  // Create swapchain and render targets. In multiview mode, we only need a single swapchain, where
+  // each view renders into its own layer of the swapchain images.
+  const uint32_t swapchain_count = m_multiview ? 1u : m_view_count;
+  const uint32_t swapchain_layer_count = m_multiview ? m_view_count : 1u;
+  m_swapchains.resize(swapchain_count);
+  m_render_targets.resize(swapchain_count);
+  m_transient_attachments.resize(swapchain_count);
+  m_depth_swapchains.resize(m_depth_layer_enabled ? swapchain_count : 0u);
+  m_depth_image_views.resize(swapchain_count);
+
+  for (uint32_t i = 0; i < swapchain_count; i++) {
     // Get the current view configuration we're interested in
     XrViewConfigurationView &current_view_configuration = m_openxr_view_configuration_views[i];
 
@@ -277,7 +349,7 @@ bool OpenXrHandler::initializeOpenxr() {
     // Create a create info struct to create the swapchain
     XrSwapchainCreateInfo swapchain_create_info = {};
     swapchain_create_info.type = {XR_TYPE_SWAPCHAIN_CREATE_INFO};
-    swapchain_create_info.arraySize = 1; // Number of array layers
+    swapchain_create_info.arraySize = swapchain_layer_count; // Number of array layers
     swapchain_create_info.mipCount = 1;  // Only use one mipmap level, bigger numbers would only be useful for textures
     swapchain_create_info.faceCount = 1; // Number of faces to render, 1 should be used, other option would be 6 for cubemaps
     swapchain_create_info.format = VulkanHandler::USED_COLOR_FORMAT;
@@ -285,8 +357,7 @@ bool OpenXrHandler::initializeOpenxr() {
         current_view_configuration.recommendedImageRectWidth; // Just use the recommended width that the runtime gave us
     swapchain_create_info.height =
         current_view_configuration.recommendedImageRectHeight; // Just use the recommended height that the runtime gave us
-    swapchain_create_info.sampleCount =
-        current_view_configuration.recommendedSwapchainSampleCount; // Just use the recommended sample count that the runtime gave us
+    swapchain_create_info.sampleCount = 1; // With MSAA, the multisampled attachment is resolved into the swapchain images
     swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_SAMPLED_BIT | XR_SWAPCHAIN_USAGE_COLOR_ATTACHMENT_BIT;
 
     // Create the OpenXR swapchain
@@ -314,6 +385,36 @@ bool OpenXrHandler::initializeOpenxr() {
                                         (XrSwapchainImageBaseHeader *)swapchain_images.data());
     Utils::checkXrResult(result, "Failed to enumerate the swapchain images");
 
+    // If the depth is submitted to the compositor, we render it into a depth swapchain of the same size
+    if (m_depth_layer_enabled) {
+      XrSwapchainCreateInfo depth_swapchain_create_info = swapchain_create_info;
+      depth_swapchain_create_info.format = TransientAttachments::DEPTH_FORMAT;
+      depth_swapchain_create_info.usageFlags = XR_SWAPCHAIN_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+      result = xrCreateSwapchain(m_openxr_session, &depth_swapchain_create_info, &m_depth_swapchains[i]);
+      Utils::checkXrResult(result, "Failed to create a depth swapchain");
+
+      uint32_t depth_image_count = 0;
+      result = xrEnumerateSwapchainImages(m_depth_swapchains[i], 0, &depth_image_count, NULL);
+      Utils::checkXrResult(result, "Failed to enumerate the depth swapchain images");
+
+      std::vector<XrSwapchainImageVulkanKHR> depth_images(depth_image_count, {XR_TYPE_SWAPCHAIN_IMAGE_VULKAN_KHR});
+      result = xrEnumerateSwapchainImages(m_depth_swapchains[i], depth_image_count, &depth_image_count,
+                                          (XrSwapchainImageBaseHeader *)depth_images.data());
+      Utils::checkXrResult(result, "Failed to enumerate the depth swapchain images");
+
+      for (const XrSwapchainImageVulkanKHR &depth_image : depth_images) {
+        m_depth_image_views[i].push_back(VulkanUtils::createImageView(m_vulkan_handler->getLogicalDevice(), depth_image.image,
+                                                                      TransientAttachments::DEPTH_FORMAT, VK_IMAGE_ASPECT_DEPTH_BIT,
+                                                                      swapchain_layer_count));
+      }
+    }
+
+    // The depth and MSAA color attachments are only used within the render pass, so all images of the
+    // swapchain can share them
+    m_transient_attachments[i] = new TransientAttachments(m_vulkan_handler->getMemoryAllocator(), getEyeResolution(i),
+                                                          VulkanHandler::USED_COLOR_FORMAT, m_vulkan_handler->getSampleCount(),
+                                                          !m_depth_layer_enabled, swapchain_layer_count);
+
     // For each swapchain image, call the function to create a render target using that swapchain image.
     std::vector<RenderTarget *> &swapchain_render_targets = m_render_targets[i];
     swapchain_render_targets.resize(swapchain_images.size());
@@ -322,8 +423,9 @@ bool OpenXrHandler::initializeOpenxr() {
       RenderTarget *&render_target = swapchain_render_targets[j];
 
       VkImage image = swapchain_images[j].image;
-      render_target = new RenderTarget(m_vulkan_handler->getLogicalDevice(), m_vulkan_handler->getPhysicalDevice(), image,
-                                       getEyeResolution(i), VulkanHandler::USED_COLOR_FORMAT, m_vulkan_handler->getRenderPass());
+      render_target = new RenderTarget(m_vulkan_handler->getLogicalDevice(), image, getEyeResolution(i), VulkanHandler::USED_COLOR_FORMAT,
+                                       m_vulkan_handler->getRenderPass(), m_transient_attachments[i], swapchain_layer_count,
+                                       m_depth_image_views[i]);
     }
   }
 
@@ -331,6 +433,7 @@ bool OpenXrHandler::initializeOpenxr() {
   // Projection views
   //------------------------------------------------------------------------------------------------------
   m_projection_views.resize(m_view_count);
+  m_depth_infos.resize(m_view_count, {XR_TYPE_COMPOSITION_LAYER_DEPTH_INFO_KHR});
 
   for (uint32_t i = 0u; i < m_view_count; i++) {
     XrCompositionLayerProjectionView &projection_view = m_projection_views[i];
@@ -340,13 +443,27 @@ bool OpenXrHandler::initializeOpenxr() {
     projection_view.type = XR_TYPE_COMPOSITION_LAYER_PROJECTION_VIEW;
     projection_view.next = nullptr;
 
-    // Associate this view with its corresponding swapchain
-    projection_view.subImage.swapchain = m_swapchains.at(i);
-    projection_view.subImage.imageArrayIndex = 0u;
+    // Associate this view with its corresponding swapchain (or the layer of the shared swapchain in
+    // multiview mode)
+    projection_view.subImage.swapchain = m_multiview ? m_swapchains.at(0) : m_swapchains.at(i);
+    projection_view.subImage.imageArrayIndex = m_multiview ? i : 0u;
     projection_view.subImage.imageRect.offset.x = 0;
     projection_view.subImage.imageRect.offset.y = 0;
     projection_view.subImage.imageRect.extent.width = view_configuration.recommendedImageRectWidth;
     projection_view.subImage.imageRect.extent.height = view_configuration.recommendedImageRectHeight;
+
+    // The depth covers the same region of the depth swapchain. Its range needs to match the projection
+    // matrices (see `Geometry::createProjectionMatrix`).
+    if (m_depth_layer_enabled) {
+      XrCompositionLayerDepthInfoKHR &depth_info = m_depth_infos[i];
+      depth_info.subImage = projection_view.subImage;
+      depth_info.subImage.swapchain = m_multiview ? m_depth_swapchains.at(0) : m_depth_swapchains.at(i);
+      depth_info.minDepth = 0.0f;
+      depth_info.maxDepth = 1.0f;
+      depth_info.nearZ = NEAR_CLIP;
+      depth_info.farZ = FAR_CLIP;
+      projection_view.next = &depth_info;
+    }
   }
 
   // Allocate view and projection matrices
@@ -361,6 +478,15 @@ VkExtent2D OpenXrHandler::getEyeResolution(size_t eyeIndex) const {
   return {eye_info.recommendedImageRectWidth, eye_info.recommendedImageRectHeight};
 }
 
+// Resolution which is actually rendered, i.e. the part of the swapchain images which is used
+VkExtent2D OpenXrHandler::getRenderResolution(size_t eyeIndex) const {
+  if (USE_DYNAMIC_RESOLUTION) {
+    return m_dynamic_resolution.scaleExtent(getEyeResolution(eyeIndex));
+  }
+
+  return getEyeResolution(eyeIndex);
+}
+
 //------------------------------------------------------------------------------------------------------
 // Initialize the OpenXR actions
 //------------------------------------------------------------------------------------------------------
@@ -622,6 +748,7 @@ void OpenXrHandler::pollOpenxrEvents(bool &loop_running, bool &xr_running) {
 // Poll the OpenXR actions
 //------------------------------------------------------------------------------------------------------
 void OpenXrHandler::pollOpenxrActions(XrTime predicted_time) {
+  XRE_PROFILE_SCOPE("Poll actions");
   XrResult result;
 
   // Sync active action set, currently we only have one action set, so we
@@ -766,6 +893,7 @@ void OpenXrHandler::updateHandTrackingStates(Hand *hand, XrTime predicted_time)
 //------------------------------------------------------------------------------------------------------
 void OpenXrHandler::renderFrame(std::function<void(RenderContext &)> draw_callback,
                                 std::function<void(XrTime)> update_simulation_callback) {
+  XRE_PROFILE_SCOPE("Frame");
   XrResult result;
 
   //------------------------------------------------------------------------------------------------------
@@ -778,16 +906,36 @@ void OpenXrHandler::renderFrame(std::function<void(RenderContext &)> draw_callba
   XrFrameState xr_frame_state = {};
   xr_frame_state.type = XR_TYPE_FRAME_STATE;
   XrFrameWaitInfo frame_wait_info{XR_TYPE_FRAME_WAIT_INFO};
-  result = xrWaitFrame(m_openxr_session, &frame_wait_info, &xr_frame_state);
+  {
+    XRE_PROFILE_SCOPE("xrWaitFrame");
+    result = xrWaitFrame(m_openxr_session, &frame_wait_info, &xr_frame_state);
+  }
   Utils::checkXrResult(result, "Failed to wait for frame");
 
+  // The display period is the time we have to render a frame (in nanoseconds)
+  m_frame_budget_ms = xr_frame_state.predictedDisplayPeriod / 1000000.0;
+
   //------------------------------------------------------------------------------------------------------
   // Begin the frame
   //------------------------------------------------------------------------------------------------------
   XrFrameBeginInfo frame_begin_info{XR_TYPE_FRAME_BEGIN_INFO};
-  result = xrBeginFrame(m_openxr_session, &frame_begin_info);
+  {
+    XRE_PROFILE_SCOPE("xrBeginFrame");
+    result = xrBeginFrame(m_openxr_session, &frame_begin_info);
+  }
   Utils::checkXrResult(result, "Failed to begin frame");
 
+  //------------------------------------------------------------------------------------------------------
+  // Locate the views and start the occlusion culling
+  //------------------------------------------------------------------------------------------------------
+  // The views are located this early such that the occluders can be rasterized on the worker thread
+  // while the actions are polled and the simulation is updated.
+  locateViews(xr_frame_state.predictedDisplayTime);
+
+  if (m_occlusion_culler && xr_frame_state.shouldRender) {
+    startOcclusionCulling();
+  }
+
   //------------------------------------------------------------------------------------------------------
   // Poll the openxr actions for this frame
   //------------------------------------------------------------------------------------------------------
@@ -796,49 +944,57 @@ void OpenXrHandler::renderFrame(std::function<void(RenderContext &)> draw_callba
   //------------------------------------------------------------------------------------------------------
   // Update the interactions of the controllers and hands with the scene
   //------------------------------------------------------------------------------------------------------
-  std::optional<glm::vec3> teleport_location_left, teleport_location_right;
-  teleport_location_left = m_left_controller->updateIntersectionSphereAndComputePossibleTeleport();
-  teleport_location_right = m_right_controller->updateIntersectionSphereAndComputePossibleTeleport();
-
-  // Reset the interaction tracking booleans on the grabbable SceneNodes
-  SceneManager::instance().resetInteractionStates();
-  SceneManager::instance().resetButtonInteractions();
-
-  // As both might have a value, we arbitrarily decide to give the right controller
-  // precedende. Later, we might map the teleport action to a single controller anyway,
-  // so maybe this will not be needed anymore.
-  if (teleport_location_right.has_value()) {
-    updateCurrentOriginForTeleport(teleport_location_right.value());
-    // TODO: update position of grabbed model if we're currently grabbing something with either hand
-  } else if (teleport_location_left.has_value()) {
-    updateCurrentOriginForTeleport(teleport_location_left.value());
-    // TODO: update position of grabbed model if we're currently grabbing something with either hand
-  } else {
-    // If not teleporting, we can update the position of the controller, as well as their interactions
-    // with the scene
-    m_left_controller->updatePosition(m_current_origin);
-    m_right_controller->updatePosition(m_current_origin);
-
-    m_left_controller->computeSceneInteractions();
-    m_right_controller->computeSceneInteractions();
-
-    // Update the interactions with the scene and the hands, but only if the hands are enabled.
-    if (m_left_hand != nullptr && m_right_hand != nullptr) {
-      m_left_hand->updatePosition(m_current_origin);
-      m_right_hand->updatePosition(m_current_origin);
-
-      m_left_hand->computeSceneInteractions();
-      m_right_hand->computeSceneInteractions();
+  {
+    XRE_PROFILE_SCOPE("Interactions");
+
+    std::optional<glm::vec3> teleport_location_left, teleport_location_right;
+    teleport_location_left = m_left_controller->updateIntersectionSphereAndComputePossibleTeleport();
+    teleport_location_right = m_right_controller->updateIntersectionSphereAndComputePossibleTeleport();
+
+    // Reset the interaction tracking booleans on the grabbable SceneNodes
+    SceneManager::instance().resetInteractionStates();
+    SceneManager::instance().resetButtonInteractions();
+
+    // As both might have a value, we arbitrarily decide to give the right controller
+    // precedende. Later, we might map the teleport action to a single controller anyway,
+    // so maybe this will not be needed anymore.
+    if (teleport_location_right.has_value()) {
+      updateCurrentOriginForTeleport(teleport_location_right.value());
+      // TODO: update position of grabbed model if we're currently grabbing something with either hand
+    } else if (teleport_location_left.has_value()) {
+      updateCurrentOriginForTeleport(teleport_location_left.value());
+      // TODO: update position of grabbed model if we're currently grabbing something with either hand
+    } else {
+      // If not teleporting, we can update the position of the controller, as well as their interactions
+      // with the scene
+      m_left_controller->updatePosition(m_current_origin);
+      m_right_controller->updatePosition(m_current_origin);
+
+      m_left_controller->computeSceneInteractions();
+      m_right_controller->computeSceneInteractions();
+
+      // Update the interactions with the scene and the hands, but only if the hands are enabled.
+      if (m_left_hand != nullptr && m_right_hand != nullptr) {
+        XRE_PROFILE_SCOPE("Hand interactions");
+        m_left_hand->updatePosition(m_current_origin);
+        m_right_hand->updatePosition(m_current_origin);
+
+        m_left_hand->computeSceneInteractions();
+        m_right_hand->computeSceneInteractions();
+      }
     }
-  }
 
-  // Process button triggers
-  SceneManager::instance().processButtonInteractions();
+    // Process button triggers
+    SceneManager::instance().processButtonInteractions();
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Update simulation
   //------------------------------------------------------------------------------------------------------
-  update_simulation_callback(xr_frame_state.predictedDisplayTime);
+  {
+    XRE_PROFILE_SCOPE("Update simulation");
+    update_simulation_callback(xr_frame_state.predictedDisplayTime);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Render the layer
@@ -853,7 +1009,7 @@ void OpenXrHandler::renderFrame(std::function<void(RenderContext &)> draw_callba
   // we need to keep the application (and the simulation) running, but there is no point in rendering
   // anything.
   if (xr_frame_state.shouldRender) {
-    renderLayer(xr_frame_state.predictedDisplayTime, layer_projection, draw_callback);
+    renderLayer(layer_projection, draw_callback);
     layers.push_back((XrCompositionLayerBaseHeader *)&layer_projection);
   }
 
@@ -866,15 +1022,18 @@ void OpenXrHandler::renderFrame(std::function<void(RenderContext &)> draw_callba
   frame_end_info.environmentBlendMode = XR_ENVIRONMENT_BLEND_MODE_OPAQUE;
   frame_end_info.layerCount = layers.size();
   frame_end_info.layers = layers.data();
-  result = xrEndFrame(m_openxr_session, &frame_end_info);
+  {
+    XRE_PROFILE_SCOPE("xrEndFrame");
+    result = xrEndFrame(m_openxr_session, &frame_end_info);
+  }
   Utils::checkXrResult(result, "Failed to end OpenXR frame");
 }
 
 //------------------------------------------------------------------------------------------------------
-// Renders an OpenXR layer
+// Locates the views for the predicted display time
 //------------------------------------------------------------------------------------------------------
-void OpenXrHandler::renderLayer(XrTime predicted_time, XrCompositionLayerProjection &layer_projection,
-                                std::function<void(RenderContext &)> draw_callback) {
+void OpenXrHandler::locateViews(XrTime predicted_time) {
+  XRE_PROFILE_SCOPE("Locate views");
   XrResult result;
 
   uint32_t view_count = 0;
@@ -905,6 +1064,51 @@ void OpenXrHandler::renderLayer(XrTime predicted_time, XrCompositionLayerProject
   if (view_count != m_view_count) {
     Utils::exitWithMessage("Number of views does not match number of eyes");
   }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Collects the occluders of the scene and starts rasterizing them on the worker thread
+//------------------------------------------------------------------------------------------------------
+void OpenXrHandler::startOcclusionCulling() {
+  XRE_PROFILE_SCOPE("Start occlusion culling");
+  std::vector<glm::mat4> view_projections(m_view_count);
+  for (uint32_t i = 0; i < m_view_count; i++) {
+    view_projections[i] = Geometry::createProjectionMatrix(m_openxr_views[i].fov, NEAR_CLIP, FAR_CLIP) *
+                          Geometry::poseToMatrix(m_openxr_views[i].pose, m_current_origin);
+  }
+  m_occlusion_origin = m_current_origin;
+
+  // The occluders are copied with the transforms of the last simulation update, as the simulation
+  // is updated while they are rasterized.
+  m_occlusion_culler->beginFrame(view_projections);
+  for (SceneNode *node : SceneManager::instance().getOccluderInstances()) {
+    node->addOccluders(*m_occlusion_culler);
+  }
+
+  m_occlusion_culler->rasterizeAsync();
+}
+
+//------------------------------------------------------------------------------------------------------
+// Renders an OpenXR layer
+//------------------------------------------------------------------------------------------------------
+void OpenXrHandler::renderLayer(XrCompositionLayerProjection &layer_projection, std::function<void(RenderContext &)> draw_callback) {
+  XRE_PROFILE_SCOPE("Render layer");
+  uint32_t view_count = m_view_count;
+
+  //------------------------------------------------------------------------------------------------------
+  // Update the resolution scale
+  //------------------------------------------------------------------------------------------------------
+  // Feed the GPU time of the frames which finished since the last frame into the controller. In the
+  // per-eye path, each eye is a submission of its own, so the time is scaled to a whole frame.
+  if (USE_DYNAMIC_RESOLUTION && m_vulkan_handler->isGpuTimingEnabled()) {
+    uint32_t submission_count = 0u;
+    double gpu_time_ms = m_vulkan_handler->takeCompletedGpuTime(submission_count);
+
+    if (submission_count > 0u) {
+      uint32_t submissions_per_frame = m_multiview ? 1u : view_count;
+      m_dynamic_resolution.update(gpu_time_ms / submission_count * submissions_per_frame, m_frame_budget_ms);
+    }
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Update view render informations as well as the matrices
@@ -914,50 +1118,84 @@ void OpenXrHandler::renderLayer(XrTime predicted_time, XrCompositionLayerProject
     m_projection_views[i].pose = m_openxr_views[i].pose;
     m_projection_views[i].fov = m_openxr_views[i].fov;
 
+    // Only the scaled region of the swapchain image is rendered and shown
+    m_projection_views[i].subImage.imageRect.extent = {static_cast<int32_t>(getRenderResolution(i).width),
+                                                       static_cast<int32_t>(getRenderResolution(i).height)};
+    m_depth_infos[i].subImage.imageRect = m_projection_views[i].subImage.imageRect;
+
     // Update view matrix
     m_view_matrices[i] = Geometry::poseToMatrix(m_projection_views[i].pose, m_current_origin);
 
     // Update projection matrix
-    m_projection_matrices[i] = Geometry::createProjectionMatrix(m_projection_views[i].fov, 0.1f, 250.0f);
+    m_projection_matrices[i] = Geometry::createProjectionMatrix(m_projection_views[i].fov, NEAR_CLIP, FAR_CLIP);
+  }
+
+  // Eyes the levels of detail are selected for, which is done for both eyes at once
+  LodViews lod_views{};
+  lod_views.count = std::min(view_count, 2u);
+  for (uint32_t i = 0; i < lod_views.count; i++) {
+    const XrVector3f &position = m_openxr_views[i].pose.position;
+    lod_views.positions[i] = glm::vec3(position.x, position.y, position.z) + m_current_origin;
+
+    const XrFovf &fov = m_openxr_views[i].fov;
+    float pixels_per_unit = getRenderResolution(i).height / (glm::tan(fov.angleUp) - glm::tan(fov.angleDown));
+    lod_views.pixels_per_unit = std::max(lod_views.pixels_per_unit, pixels_per_unit);
+  }
+
+  // Wait for the occluders to be rasterized. If the origin changed in the meantime (i.e. we teleported),
+  // the depth buffers don't match the views anymore and can't be used for this frame.
+  const OcclusionCuller *occlusion_culler = nullptr;
+  if (m_occlusion_culler) {
+    XRE_PROFILE_SCOPE("Wait for occlusion culling");
+    m_occlusion_culler->wait();
+
+    if (m_occlusion_origin == m_current_origin) {
+      occlusion_culler = m_occlusion_culler;
+    }
   }
 
   //------------------------------------------------------------------------------------------------------
   // Render the layer for each view
   //------------------------------------------------------------------------------------------------------
-  for (uint32_t i = 0; i < view_count; i++) {
-    // First, we need to acquire a swapchain image, as we need a render target to render the data to.
-    // As we don't pass a swapchain_image_id into the xrAcquireSwapchainImage call, the runtime decides
-    // which swapchain image we'll get
-    uint32_t swapchain_image_id;
-    XrSwapchainImageAcquireInfo swapchain_acquire_info = {};
-    swapchain_acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
-    result = xrAcquireSwapchainImage(m_swapchains[i], &swapchain_acquire_info, &swapchain_image_id);
-    Utils::checkXrResult(result, "Could not acquire swapchain image");
-
-    // We need to wait until the swapchain image is available for writing, as the compositor
-    // could still be reading from it (writing while the compositor is still reading could
-    // result in tearing or otherwise badly rendered frames).
-    // For now, we set the timeout to infinite, but one could also set another timeout
-    // by passing in an xrDuration
-    XrSwapchainImageWaitInfo swapchain_wait_info = {};
-    swapchain_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
-    swapchain_wait_info.timeout = XR_INFINITE_DURATION;
-    result = xrWaitSwapchainImage(m_swapchains[i], &swapchain_wait_info);
-    Utils::checkXrResult(result, "Could not wait for the swapchain image");
-
-    // Render the content to the swapchain, which is done by the Vulkan handler
-    m_vulkan_handler->renderFrame(m_view_matrices[i], m_projection_matrices[i], m_render_targets[i][swapchain_image_id]->getFramebuffer(),
-                                  getEyeResolution(i), draw_callback,
-                                  std::bind(&OpenXrHandler::renderInteractions, this, std::placeholders::_1));
-
-    // We're done rendering for the current view, so we can release the swapchain image (i.e. tell
-    // the OpenXR runtime that we're done with this swapchain image).
-    // We have to pass in a XrSwapchainImageReleaseInfo, but at the moment, this struct doesn't
-    // do anything special.
-    XrSwapchainImageReleaseInfo swapchain_release_info = {};
-    swapchain_release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
-    result = xrReleaseSwapchainImage(m_swapchains[i], &swapchain_release_info);
-    Utils::checkXrResult(result, "Could not release the swapchain image");
+  if (m_multiview) {
+    XRE_PROFILE_SCOPE("Both eyes");
+
+    // Render all views at once into the layers of the shared swapchain
+    std::vector<glm::mat4> view_projections(view_count);
+    for (uint32_t i = 0; i < view_count; i++) {
+      view_projections[i] = m_projection_matrices[i] * m_view_matrices[i];
+    }
+
+    // Cull against a single frustum containing both views
+    Frustum frustum = Frustum::fromStereoViews(m_openxr_views[0], m_openxr_views[1], m_current_origin, FAR_CLIP);
+
+    uint32_t swapchain_image_id = acquireSwapchainImage(m_swapchains[0]);
+    uint32_t depth_image_id = m_depth_layer_enabled ? acquireSwapchainImage(m_depth_swapchains[0]) : 0u;
+    m_vulkan_handler->renderFrame(view_projections, frustum, occlusion_culler, lod_views,
+                                  m_render_targets[0][swapchain_image_id]->getFramebuffer(depth_image_id), getRenderResolution(0),
+                                  "Both eyes", draw_callback, std::bind(&OpenXrHandler::renderInteractions, this, std::placeholders::_1));
+    releaseSwapchainImage(m_swapchains[0]);
+    if (m_depth_layer_enabled) {
+      releaseSwapchainImage(m_depth_swapchains[0]);
+    }
+  } else {
+    for (uint32_t i = 0; i < view_count; i++) {
+      XRE_PROFILE_SCOPE(i == 0u ? "Left eye" : "Right eye");
+      uint32_t swapchain_image_id = acquireSwapchainImage(m_swapchains[i]);
+      uint32_t depth_image_id = m_depth_layer_enabled ? acquireSwapchainImage(m_depth_swapchains[i]) : 0u;
+
+      // Render the content to the swapchain, which is done by the Vulkan handler
+      Frustum frustum = Frustum::fromView(m_openxr_views[i], m_current_origin, FAR_CLIP);
+      m_vulkan_handler->renderFrame({m_projection_matrices[i] * m_view_matrices[i]}, frustum, occlusion_culler, lod_views,
+                                    m_render_targets[i][swapchain_image_id]->getFramebuffer(depth_image_id), getRenderResolution(i),
+                                    i == 0u ? "Left eye" : "Right eye", draw_callback,
+                                    std::bind(&OpenXrHandler::renderInteractions, this, std::placeholders::_1));
+
+      releaseSwapchainImage(m_swapchains[i]);
+      if (m_depth_layer_enabled) {
+        releaseSwapchainImage(m_depth_swapchains[i]);
+      }
+    }
   }
 
   //------------------------------------------------------------------------------------------------------
@@ -970,6 +1208,50 @@ void OpenXrHandler::renderLayer(XrTime predicted_time, XrCompositionLayerProject
   layer_projection.views = m_projection_views.data();
 }
 
+uint32_t OpenXrHandler::acquireSwapchainImage(XrSwapchain swapchain) {
+  XrResult result;
+
+  // First, we need to acquire a swapchain image, as we need a render target to render the data to.
+  // As we don't pass a swapchain_image_id into the xrAcquireSwapchainImage call, the runtime decides
+  // which swapchain image we'll get
+  uint32_t swapchain_image_id;
+  XrSwapchainImageAcquireInfo swapchain_acquire_info = {};
+  swapchain_acquire_info.type = XR_TYPE_SWAPCHAIN_IMAGE_ACQUIRE_INFO;
+  {
+    XRE_PROFILE_SCOPE("xrAcquireSwapchainImage");
+    result = xrAcquireSwapchainImage(swapchain, &swapchain_acquire_info, &swapchain_image_id);
+  }
+  Utils::checkXrResult(result, "Could not acquire swapchain image");
+
+  // We need to wait until the swapchain image is available for writing, as the compositor
+  // could still be reading from it (writing while the compositor is still reading could
+  // result in tearing or otherwise badly rendered frames).
+  // For now, we set the timeout to infinite, but one could also set another timeout
+  // by passing in an xrDuration
+  XrSwapchainImageWaitInfo swapchain_wait_info = {};
+  swapchain_wait_info.type = XR_TYPE_SWAPCHAIN_IMAGE_WAIT_INFO;
+  swapchain_wait_info.timeout = XR_INFINITE_DURATION;
+  {
+    XRE_PROFILE_SCOPE("xrWaitSwapchainImage");
+    result = xrWaitSwapchainImage(swapchain, &swapchain_wait_info);
+  }
+  Utils::checkXrResult(result, "Could not wait for the swapchain image");
+
+  return swapchain_image_id;
+}
+
+void OpenXrHandler::releaseSwapchainImage(XrSwapchain swapchain) {
+  XRE_PROFILE_SCOPE("xrReleaseSwapchainImage");
+  // We're done rendering for the current view, so we can release the swapchain image (i.e. tell
+  // the OpenXR runtime that we're done with this swapchain image).
+  // We have to pass in a XrSwapchainImageReleaseInfo, but at the moment, this struct doesn't
+  // do anything special.
+  XrSwapchainImageReleaseInfo swapchain_release_info = {};
+  swapchain_release_info.type = XR_TYPE_SWAPCHAIN_IMAGE_RELEASE_INFO;
+  XrResult result = xrReleaseSwapchainImage(swapchain, &swapchain_release_info);
+  Utils::checkXrResult(result, "Could not release the swapchain image");
+}
+
 void OpenXrHandler::renderInteractions(RenderContext &ctx) {
   // Render the controllers
   m_left_controller->render(ctx);
@@ -0,0 +1,158 @@
+#include <xre/parallel_recorder.h>
+
+// XRe includes
+#include <xre/cpu_profiler.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the command pools and start the worker threads.
+// Arguments:
+//  1) Device the command buffers are recorded for
+//  2) Queue family the primary command buffers are submitted to
+//  3) Number of worker threads
+//  4) Number of frames which can be in flight at the same time
+//------------------------------------------------------------------------------------------------------
+ParallelRecorder::ParallelRecorder(VkDevice device, uint32_t queue_family_index, uint32_t thread_count, uint32_t frame_count) {
+  m_device = device;
+
+  // The workers keep pointers into the vector, so it must not be resized once the threads are running
+  m_workers.resize(thread_count);
+  for (uint32_t i = 0; i < thread_count; i++) {
+    Worker &worker = m_workers[i];
+    worker.name = "Command recorder " + std::to_string(i);
+    worker.command_pools.resize(frame_count);
+    worker.command_buffers.resize(frame_count);
+
+    for (VkCommandPool &command_pool : worker.command_pools) {
+      VkCommandPoolCreateInfo pool_create_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+      pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      pool_create_info.queueFamilyIndex = queue_family_index;
+
+      VkResult result = vkCreateCommandPool(m_device, &pool_create_info, nullptr, &command_pool);
+      Utils::checkVkResult(result, "Failed to create the command pool of a recording thread");
+    }
+  }
+
+  for (uint32_t i = 0; i < thread_count; i++) {
+    m_workers[i].thread = std::thread(&ParallelRecorder::workerLoop, this, i);
+  }
+}
+
+ParallelRecorder::~ParallelRecorder() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+  m_condition.notify_all();
+
+  for (Worker &worker : m_workers) {
+    worker.thread.join();
+
+    for (VkCommandPool command_pool : worker.command_pools) {
+      vkDestroyCommandPool(m_device, command_pool, nullptr);
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Start recording the given frame. The caller has to make sure that the GPU is done with the previous
+// frame which used the same slot (i.e. waited on its fence), as all of its buffers are reset.
+//------------------------------------------------------------------------------------------------------
+void ParallelRecorder::beginFrame(uint32_t frame_index) {
+  m_current_frame = frame_index;
+
+  for (Worker &worker : m_workers) {
+    VkResult result = vkResetCommandPool(m_device, worker.command_pools[frame_index], 0);
+    Utils::checkVkResult(result, "Failed to reset the command pool of a recording thread");
+    worker.used_command_buffers = 0u;
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Record the given number of chunks into secondary command buffers, which continue the render pass of
+// the inheritance info. The chunks are spread over the workers, and the callback is called on the worker
+// threads, so it must not touch any shared state. Blocks until all chunks are recorded, and returns the
+// buffers in the order of the chunks.
+//------------------------------------------------------------------------------------------------------
+std::vector<VkCommandBuffer> ParallelRecorder::record(uint32_t chunk_count, const VkCommandBufferInheritanceInfo &inheritance_info,
+                                                      const std::function<void(uint32_t, VkCommandBuffer)> &record_chunk) {
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  m_chunk_count = chunk_count;
+  m_inheritance_info = &inheritance_info;
+  m_record_chunk = &record_chunk;
+  m_recorded_buffers.assign(chunk_count, VK_NULL_HANDLE);
+
+  m_busy_workers = static_cast<uint32_t>(m_workers.size());
+  m_job++;
+  m_condition.notify_all();
+
+  m_condition.wait(lock, [this] { return m_busy_workers == 0u; });
+
+  return m_recorded_buffers;
+}
+
+uint32_t ParallelRecorder::getThreadCount() { return static_cast<uint32_t>(m_workers.size()); }
+
+void ParallelRecorder::workerLoop(uint32_t worker_index) {
+  Worker &worker = m_workers[worker_index];
+  XRE_PROFILE_THREAD(worker.name.c_str());
+
+  uint64_t last_job = 0u;
+  std::unique_lock<std::mutex> lock(m_mutex);
+
+  while (true) {
+    m_condition.wait(lock, [this, last_job] { return m_job != last_job || m_stop; });
+    if (m_stop) {
+      return;
+    }
+    last_job = m_job;
+
+    // The calling thread waits until all workers are done, so the job doesn't change while we record
+    lock.unlock();
+
+    const uint32_t worker_count = static_cast<uint32_t>(m_workers.size());
+    for (uint32_t chunk = worker_index; chunk < m_chunk_count; chunk += worker_count) {
+      XRE_PROFILE_SCOPE("Record chunk");
+      VkCommandBuffer command_buffer = acquireCommandBuffer(worker);
+
+      VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      begin_info.pInheritanceInfo = m_inheritance_info;
+
+      VkResult result = vkBeginCommandBuffer(command_buffer, &begin_info);
+      Utils::checkVkResult(result, "Failed to begin recording a secondary command buffer");
+
+      (*m_record_chunk)(chunk, command_buffer);
+
+      result = vkEndCommandBuffer(command_buffer);
+      Utils::checkVkResult(result, "Failed to record a secondary command buffer");
+
+      // Each chunk is only written by a single worker
+      m_recorded_buffers[chunk] = command_buffer;
+    }
+
+    lock.lock();
+    if (--m_busy_workers == 0u) {
+      m_condition.notify_all();
+    }
+  }
+}
+
+// Returns the next unused secondary command buffer of the worker in the current frame, allocating more as needed
+VkCommandBuffer ParallelRecorder::acquireCommandBuffer(Worker &worker) {
+  std::vector<VkCommandBuffer> &command_buffers = worker.command_buffers[m_current_frame];
+
+  if (worker.used_command_buffers == command_buffers.size()) {
+    VkCommandBufferAllocateInfo buffer_allocate_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    buffer_allocate_info.commandPool = worker.command_pools[m_current_frame];
+    buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    buffer_allocate_info.commandBufferCount = 1u;
+
+    VkCommandBuffer command_buffer;
+    VkResult result = vkAllocateCommandBuffers(m_device, &buffer_allocate_info, &command_buffer);
+    Utils::checkVkResult(result, "Failed to allocate a secondary command buffer");
+    command_buffers.push_back(command_buffer);
+  }
+
+  return command_buffers[worker.used_command_buffers++];
+}
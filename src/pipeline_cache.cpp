@@ -0,0 +1,143 @@
+#include <xre/pipeline_cache.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the pipeline cache, using the data stored on disk from a previous run if it is valid
+// for the current device and driver.
+//------------------------------------------------------------------------------------------------------
+PipelineCache::PipelineCache(VkDevice device, VkPhysicalDevice physical_device, const std::string &path) {
+  m_device = device;
+  m_path = path;
+  vkGetPhysicalDeviceProperties(physical_device, &m_device_properties);
+
+  std::vector<char> initial_data = loadValidatedData();
+  m_statistics.loaded_from_disk = !initial_data.empty();
+
+  VkPipelineCacheCreateInfo pipeline_cache_create_info{VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+  pipeline_cache_create_info.initialDataSize = initial_data.size();
+  pipeline_cache_create_info.pInitialData = initial_data.empty() ? nullptr : initial_data.data();
+
+  VkResult result = vkCreatePipelineCache(m_device, &pipeline_cache_create_info, nullptr, &m_pipeline_cache);
+
+  // If the driver still rejects the data, start with an empty cache instead
+  if (result != VK_SUCCESS && !initial_data.empty()) {
+    std::cout << "Pipeline cache data was rejected by the driver, starting with an empty cache" << std::endl;
+    m_statistics.loaded_from_disk = false;
+    pipeline_cache_create_info.initialDataSize = 0u;
+    pipeline_cache_create_info.pInitialData = nullptr;
+    result = vkCreatePipelineCache(m_device, &pipeline_cache_create_info, nullptr, &m_pipeline_cache);
+  }
+
+  Utils::checkVkResult(result, "Failed to create pipeline cache");
+}
+
+//------------------------------------------------------------------------------------------------------
+// Write the cache back to disk. We first write to a temporary file and then rename it, such that
+// a crash while writing never leaves a truncated cache file behind.
+//------------------------------------------------------------------------------------------------------
+void PipelineCache::save() {
+  size_t data_size = 0u;
+  VkResult result = vkGetPipelineCacheData(m_device, m_pipeline_cache, &data_size, nullptr);
+  Utils::checkVkResult(result, "Failed to get pipeline cache data size");
+
+  std::vector<char> data(data_size);
+  result = vkGetPipelineCacheData(m_device, m_pipeline_cache, &data_size, data.data());
+  Utils::checkVkResult(result, "Failed to get pipeline cache data");
+
+  FileHeader header{};
+  header.magic = FILE_MAGIC;
+  header.header_version = FILE_HEADER_VERSION;
+  header.vendor_id = m_device_properties.vendorID;
+  header.device_id = m_device_properties.deviceID;
+  header.driver_version = m_device_properties.driverVersion;
+  memcpy(header.pipeline_cache_uuid, m_device_properties.pipelineCacheUUID, VK_UUID_SIZE);
+  header.data_size = data_size;
+
+  std::string temporary_path = m_path + ".tmp";
+  {
+    std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+      std::cout << "Failed to open " << temporary_path << " for writing, pipeline cache is not saved" << std::endl;
+      return;
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(data.data(), data_size);
+
+    if (!file.good()) {
+      std::cout << "Failed to write pipeline cache to " << temporary_path << std::endl;
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(temporary_path, m_path, error);
+  if (error) {
+    std::cout << "Failed to move pipeline cache to " << m_path << ": " << error.message() << std::endl;
+  }
+}
+
+void PipelineCache::destroy() { vkDestroyPipelineCache(m_device, m_pipeline_cache, nullptr); }
+
+VkPipelineCache PipelineCache::getCache() { return m_pipeline_cache; }
+
+//------------------------------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------------------------------
+// Record a pipeline creation for which the driver reported whether the cache was hit
+void PipelineCache::recordPipelineCreation(const VkPipelineCreationFeedbackEXT &feedback) {
+  if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+    recordPipelineCreation();
+    return;
+  }
+
+  if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+    m_statistics.hits++;
+  } else {
+    m_statistics.misses++;
+  }
+}
+
+// Record a pipeline creation for which we don't know if the cache was hit
+void PipelineCache::recordPipelineCreation() { m_statistics.unknown++; }
+
+PipelineCacheStatistics PipelineCache::getStatistics() { return m_statistics; }
+
+//------------------------------------------------------------------------------------------------------
+// Loading
+//------------------------------------------------------------------------------------------------------
+// Returns the cache data stored on disk, or an empty vector if there is no (valid) data
+std::vector<char> PipelineCache::loadValidatedData() {
+  std::ifstream file(m_path, std::ios::binary | std::ios::ate);
+  if (!file.is_open()) {
+    return {};
+  }
+
+  size_t file_size = static_cast<size_t>(file.tellg());
+  if (file_size < sizeof(FileHeader)) {
+    return {};
+  }
+
+  FileHeader header{};
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+  if (!headerMatchesDevice(header) || header.data_size != file_size - sizeof(FileHeader)) {
+    std::cout << "Pipeline cache on disk does not match the current device or driver, ignoring it" << std::endl;
+    return {};
+  }
+
+  std::vector<char> data(header.data_size);
+  file.read(data.data(), header.data_size);
+  if (!file.good()) {
+    return {};
+  }
+
+  return data;
+}
+
+bool PipelineCache::headerMatchesDevice(const FileHeader &header) {
+  return header.magic == FILE_MAGIC && header.header_version == FILE_HEADER_VERSION &&
+         header.vendor_id == m_device_properties.vendorID && header.device_id == m_device_properties.deviceID &&
+         header.driver_version == m_device_properties.driverVersion &&
+         memcmp(header.pipeline_cache_uuid, m_device_properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
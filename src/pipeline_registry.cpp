@@ -0,0 +1,143 @@
+#include <xre/pipeline_registry.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the registry.
+// Arguments:
+//  1) Logical device
+//  2) Function which creates a pipeline from a vertex and fragment shader module and the state
+//------------------------------------------------------------------------------------------------------
+PipelineRegistry::PipelineRegistry(VkDevice device, PipelineFactory pipeline_factory) {
+  m_device = device;
+  m_pipeline_factory = pipeline_factory;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Returns the pipeline for the given shaders and state, creating it if it does not exist yet. Each
+// call needs to be matched by a call to `release` once the pipeline is no longer used.
+//------------------------------------------------------------------------------------------------------
+VkPipeline PipelineRegistry::acquire(const std::string &vert_path, const std::string &frag_path, const PipelineState &state) {
+  m_statistics.requests++;
+
+  PipelineKey key{vert_path, frag_path, state};
+  auto found_pipeline = m_pipelines.find(key);
+  if (found_pipeline != m_pipelines.end()) {
+    found_pipeline->second.reference_count++;
+    return found_pipeline->second.pipeline;
+  }
+
+  // Not created yet, so we need the shader modules (which might be shared with other pipelines)
+  VkShaderModule vertex_shader_module = acquireShaderModule(vert_path);
+  VkShaderModule fragment_shader_module = acquireShaderModule(frag_path);
+
+  VkPipeline pipeline = m_pipeline_factory(vertex_shader_module, fragment_shader_module, state);
+  m_pipelines[key] = {pipeline, 1u};
+  m_statistics.created_pipelines++;
+
+  return pipeline;
+}
+
+void PipelineRegistry::release(VkPipeline pipeline) {
+  for (auto &[key, entry] : m_pipelines) {
+    if (entry.pipeline == pipeline) {
+      assert(entry.reference_count > 0);
+      entry.reference_count--;
+      return;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Destroys all pipelines (and their shader modules) which are no longer used. The caller needs to
+// make sure that no frame in flight still uses any of them.
+//------------------------------------------------------------------------------------------------------
+void PipelineRegistry::destroyUnused() {
+  for (auto it = m_pipelines.begin(); it != m_pipelines.end();) {
+    if (it->second.reference_count == 0) {
+      vkDestroyPipeline(m_device, it->second.pipeline, nullptr);
+      releaseShaderModule(it->first.vert_path);
+      releaseShaderModule(it->first.frag_path);
+      it = m_pipelines.erase(it);
+    } else {
+      it++;
+    }
+  }
+}
+
+void PipelineRegistry::destroy() {
+  for (auto &[key, entry] : m_pipelines) {
+    vkDestroyPipeline(m_device, entry.pipeline, nullptr);
+  }
+
+  for (auto &[path, entry] : m_shader_modules) {
+    vkDestroyShaderModule(m_device, entry.shader_module, nullptr);
+  }
+
+  m_pipelines.clear();
+  m_shader_modules.clear();
+}
+
+PipelineRegistryStatistics PipelineRegistry::getStatistics() {
+  PipelineRegistryStatistics statistics = m_statistics;
+  statistics.cached_pipelines = m_pipelines.size();
+  statistics.cached_shader_modules = m_shader_modules.size();
+  return statistics;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Shader modules
+//------------------------------------------------------------------------------------------------------
+VkShaderModule PipelineRegistry::acquireShaderModule(const std::string &path) {
+  auto found_shader_module = m_shader_modules.find(path);
+  if (found_shader_module != m_shader_modules.end()) {
+    found_shader_module->second.reference_count++;
+    return found_shader_module->second.shader_module;
+  }
+
+  // Load shader bytecode
+  std::vector<char> code = Utils::readFile(path);
+
+  // Setup the create info for the shader module
+  VkShaderModuleCreateInfo shader_module_create_info{VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO};
+  shader_module_create_info.codeSize = code.size();
+  shader_module_create_info.pCode = reinterpret_cast<const uint32_t *>(code.data());
+
+  // And create the shader module itself
+  VkShaderModule shader_module;
+  VkResult result = vkCreateShaderModule(m_device, &shader_module_create_info, nullptr, &shader_module);
+  Utils::checkVkResult(result, "Failed to create shader module");
+
+  m_shader_modules[path] = {shader_module, 1u};
+  return shader_module;
+}
+
+void PipelineRegistry::releaseShaderModule(const std::string &path) {
+  auto found_shader_module = m_shader_modules.find(path);
+  if (found_shader_module == m_shader_modules.end()) {
+    return;
+  }
+
+  found_shader_module->second.reference_count--;
+  if (found_shader_module->second.reference_count == 0) {
+    vkDestroyShaderModule(m_device, found_shader_module->second.shader_module, nullptr);
+    m_shader_modules.erase(found_shader_module);
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Hashing
+//------------------------------------------------------------------------------------------------------
+size_t PipelineRegistry::PipelineKeyHash::operator()(const PipelineKey &key) const {
+  size_t hash = std::hash<std::string>{}(key.vert_path);
+
+  // Combine the hashes of all members (same approach as boost::hash_combine)
+  auto combine = [&hash](size_t value) { hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2); };
+  combine(std::hash<std::string>{}(key.frag_path));
+  combine(std::hash<uint32_t>{}(key.state.topology));
+  combine(std::hash<uint32_t>{}(key.state.cull_mode));
+  combine(std::hash<bool>{}(key.state.depth_test));
+  combine(std::hash<bool>{}(key.state.depth_write));
+  combine(std::hash<bool>{}(key.state.blend));
+  combine(std::hash<bool>{}(key.state.instanced));
+
+  return hash;
+}
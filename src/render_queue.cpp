@@ -0,0 +1,421 @@
+#include <xre/render_queue.h>
+
+// Other includes
+#include <algorithm>
+
+//------------------------------------------------------------------------------------------------------
+// Start collecting the draws of a new frame. The view projection is used to compute the depth of the
+// draws, in multiview mode the one of the first view is good enough for sorting.
+//------------------------------------------------------------------------------------------------------
+void RenderQueue::begin(const glm::mat4 &view_projection) {
+  m_packets.clear();
+  m_sorted_packets.clear();
+  m_culler = nullptr;
+  m_pipeline_ids.clear();
+  m_descriptor_set_ids.clear();
+  m_geometry_ids.clear();
+
+  m_view_projection = view_projection;
+  m_pass = PASS_SCENE;
+}
+
+void RenderQueue::setPass(Pass pass) { m_pass = pass; }
+
+RenderQueue::Pass RenderQueue::getPass() { return m_pass; }
+
+//------------------------------------------------------------------------------------------------------
+// Add a draw of the given geometry, using the pipeline, descriptor set and uniform data which the
+// model stored in the render context. Only draws with bounds can be culled on the GPU.
+//------------------------------------------------------------------------------------------------------
+void RenderQueue::push(const RenderContext &ctx, const GeometryRange &geometry, const OOBB *bounds) {
+  // Quantize the view space depth, such that opaque draws are sorted front to back within the same state,
+  // which helps the early depth test.
+  float depth = (m_view_projection * ctx.world_transform[3]).w;
+  uint64_t quantized_depth = static_cast<uint64_t>(std::clamp(depth / MAX_SORT_DEPTH, 0.0f, 1.0f) * 0xFFFF);
+
+  uint64_t state = 0u;
+  state |= static_cast<uint64_t>(lookupId(m_pipeline_ids, (uint64_t)ctx.pipeline, 0x7FF)) << 32;
+  state |= static_cast<uint64_t>(lookupId(m_descriptor_set_ids, (uint64_t)ctx.descriptor_set, 0xFFFF)) << 16;
+  state |= static_cast<uint64_t>(lookupId(m_geometry_ids, (uint64_t)geometry.vertex_buffer, 0xFFFF));
+
+  // Blended draws come after the opaque ones, and have to be drawn back to front to blend correctly, so
+  // their depth is more important than the state
+  uint64_t key = static_cast<uint64_t>(m_pass & 0xF) << 60;
+  if (ctx.translucent) {
+    key |= 1ull << 59;
+    key |= (0xFFFFull - quantized_depth) << 43;
+    key |= state;
+  } else {
+    key |= state << 16;
+    key |= quantized_depth;
+  }
+
+  DrawPacket packet;
+  packet.key = key;
+  packet.pipeline = ctx.pipeline;
+  packet.indirect_pipeline = ctx.indirect_pipeline;
+  packet.descriptor_set = ctx.descriptor_set;
+  packet.uniform_offset = ctx.uniform_offset;
+  packet.geometry = geometry;
+  packet.instance_buffer = VK_NULL_HANDLE;
+  packet.instance_offset = 0u;
+  packet.instance_count = 1u;
+  packet.has_bounds = bounds != nullptr;
+  if (bounds) {
+    packet.bounds = *bounds;
+  }
+  packet.world_transform = ctx.world_transform;
+  packet.color = ctx.color;
+  packet.texture_index = ctx.texture_index;
+  packet.batch = -1;
+  packet.first_command = 0u;
+  packet.batch_size = 0u;
+  m_packets.push_back(std::move(packet));
+}
+
+// Add an instanced draw, which is always recorded directly (i.e. not culled on the GPU)
+void RenderQueue::pushInstanced(const RenderContext &ctx, const GeometryRange &geometry, VkBuffer instance_buffer,
+                                VkDeviceSize instance_offset, uint32_t instance_count) {
+  push(ctx, geometry, nullptr);
+
+  DrawPacket &packet = m_packets.back();
+  packet.indirect_pipeline = VK_NULL_HANDLE;
+  packet.instance_buffer = instance_buffer;
+  packet.instance_offset = instance_offset;
+  packet.instance_count = instance_count;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Sort the collected draws, and hand the ones which can be culled on the GPU to the culler (if given).
+// Has to be called outside of a render pass, as it records the culling pass.
+//------------------------------------------------------------------------------------------------------
+void RenderQueue::cull(VkCommandBuffer command_buffer, GpuCuller *culler, uint32_t frame_index,
+                       const std::vector<glm::mat4> &view_projections) {
+  sort();
+
+  m_culler = culler;
+  if (!m_culler) {
+    return;
+  }
+
+  m_culler->beginFrame(frame_index, view_projections);
+
+  // Consecutive draws sharing the same state form a batch, which gets a contiguous range of commands
+  uint32_t batch_count = 0u;
+  uint32_t command_count = 0u;
+  DrawPacket *batch_start = nullptr;
+
+  for (uint32_t index : m_sorted_packets) {
+    DrawPacket &packet = m_packets[index];
+
+    if (!packet.has_bounds || packet.indirect_pipeline == VK_NULL_HANDLE) {
+      batch_start = nullptr;
+      continue;
+    }
+
+    bool new_batch = !batch_start || !sameBatch(*batch_start, packet);
+    uint32_t batch = new_batch ? batch_count : static_cast<uint32_t>(batch_start->batch);
+    uint32_t first_command = new_batch ? command_count : batch_start->first_command;
+
+    // If the culler is full, the draw is recorded directly instead
+    if (!m_culler->addDraw(packet.world_transform, packet.color, packet.texture_index, packet.bounds, packet.geometry, batch,
+                           first_command)) {
+      batch_start = nullptr;
+      continue;
+    }
+
+    if (new_batch) {
+      batch_start = &packet;
+      batch_count++;
+    }
+
+    packet.batch = static_cast<int32_t>(batch);
+    packet.first_command = first_command;
+    batch_start->batch_size++;
+    command_count++;
+  }
+
+  m_culler->dispatch(command_buffer);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Sort the collected draws and record them into the command buffer of the context, skipping all binds
+// of state which is already bound.
+//------------------------------------------------------------------------------------------------------
+void RenderQueue::submit(RenderContext &ctx) {
+  if (m_sorted_packets.size() != m_packets.size()) {
+    sort();
+  }
+
+  RenderQueueStatistics frame_statistics{};
+  frame_statistics.frames = 1u;
+
+  record(ctx, 0u, m_sorted_packets.size(), frame_statistics);
+
+  m_packets.clear();
+  m_sorted_packets.clear();
+  addStatistics(frame_statistics);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Sort the collected draws and record them in chunks into secondary command buffers on the worker threads
+// of the recorder. Each chunk starts without any bound state, so `begin_chunk` has to record the state
+// shared by all draws (e.g. viewport and global descriptor sets). Returns the buffers in the order they
+// have to be executed in. Each chunk only holds draws of a single pass, and the profiler scope of a pass
+// is written into the first and last chunk of the pass.
+//------------------------------------------------------------------------------------------------------
+std::vector<VkCommandBuffer> RenderQueue::submitParallel(const RenderContext &ctx, ParallelRecorder *recorder,
+                                                         const VkCommandBufferInheritanceInfo &inheritance_info,
+                                                         const std::function<void(VkCommandBuffer)> &begin_chunk) {
+  if (m_sorted_packets.size() != m_packets.size()) {
+    sort();
+  }
+
+  std::vector<size_t> chunk_starts = splitIntoChunks(recorder->getThreadCount());
+  uint32_t chunk_count = static_cast<uint32_t>(chunk_starts.size() - 1);
+  std::vector<RenderQueueStatistics> chunk_statistics(chunk_count);
+
+  // The profiler scopes are reserved here, as the worker threads may only write their timestamps
+  std::vector<uint32_t> chunk_passes(chunk_count);
+  std::vector<uint32_t> pass_scopes(chunk_count, GpuProfiler::NO_SCOPE);
+  for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+    chunk_passes[chunk] = static_cast<uint32_t>(m_packets[m_sorted_packets[chunk_starts[chunk]]].key >> 60);
+
+    if (ctx.gpu_profiler) {
+      bool first_of_pass = chunk == 0u || chunk_passes[chunk] != chunk_passes[chunk - 1];
+      pass_scopes[chunk] = first_of_pass ? ctx.gpu_profiler->reserveScope(PASS_NAMES[chunk_passes[chunk]], true) : pass_scopes[chunk - 1];
+    }
+  }
+
+  std::vector<VkCommandBuffer> command_buffers =
+      recorder->record(chunk_count, inheritance_info, [&](uint32_t chunk, VkCommandBuffer command_buffer) {
+        RenderContext chunk_ctx = ctx;
+        chunk_ctx.command_buffer = command_buffer;
+        chunk_ctx.gpu_profiler = nullptr;
+        chunk_ctx.bound_pipeline = VK_NULL_HANDLE;
+        chunk_ctx.bound_descriptor_set = VK_NULL_HANDLE;
+        chunk_ctx.bound_vertex_buffer = VK_NULL_HANDLE;
+        chunk_ctx.bound_index_buffer = VK_NULL_HANDLE;
+
+        bool first_of_pass = chunk == 0u || chunk_passes[chunk] != chunk_passes[chunk - 1];
+        bool last_of_pass = chunk + 1u == chunk_count || chunk_passes[chunk] != chunk_passes[chunk + 1];
+
+        begin_chunk(command_buffer);
+        if (ctx.gpu_profiler && first_of_pass) {
+          ctx.gpu_profiler->writeScopeTimestamp(command_buffer, pass_scopes[chunk], false);
+        }
+        record(chunk_ctx, chunk_starts[chunk], chunk_starts[chunk + 1], chunk_statistics[chunk]);
+        if (ctx.gpu_profiler && last_of_pass) {
+          ctx.gpu_profiler->writeScopeTimestamp(command_buffer, pass_scopes[chunk], true);
+        }
+      });
+
+  RenderQueueStatistics frame_statistics{};
+  for (const RenderQueueStatistics &statistics : chunk_statistics) {
+    accumulateStatistics(frame_statistics, statistics);
+  }
+  frame_statistics.frames = 1u;
+  frame_statistics.parallel_chunks = chunk_count;
+
+  m_packets.clear();
+  m_sorted_packets.clear();
+  addStatistics(frame_statistics);
+
+  return command_buffers;
+}
+
+size_t RenderQueue::getDrawCount() { return m_packets.size(); }
+
+//------------------------------------------------------------------------------------------------------
+// Record the given range of the sorted draws. Only reads the queue, such that multiple ranges can be
+// recorded at the same time into different command buffers.
+//------------------------------------------------------------------------------------------------------
+void RenderQueue::record(RenderContext &ctx, size_t begin, size_t end, RenderQueueStatistics &frame_statistics) const {
+  int32_t last_batch = -1;
+
+  // Each pass is measured in a profiler scope of its own
+  int32_t current_pass = -1;
+  uint32_t pass_scope = GpuProfiler::NO_SCOPE;
+
+  for (size_t i = begin; i < end; i++) {
+    const DrawPacket &packet = m_packets[m_sorted_packets[i]];
+
+    int32_t pass = static_cast<int32_t>(packet.key >> 60);
+    if (ctx.gpu_profiler && pass != current_pass) {
+      ctx.gpu_profiler->endScope(ctx.command_buffer, pass_scope);
+      pass_scope = ctx.gpu_profiler->beginScope(ctx.command_buffer, PASS_NAMES[pass], true, true);
+      current_pass = pass;
+    }
+
+    // The draws of a batch are all drawn together with the first one
+    bool indirect = packet.batch >= 0;
+    if (indirect && packet.batch == last_batch) {
+      continue;
+    }
+
+    // Bind the pipeline
+    VkPipeline pipeline = indirect ? packet.indirect_pipeline : packet.pipeline;
+    if (ctx.bound_pipeline != pipeline) {
+      vkCmdBindPipeline(ctx.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+      ctx.bound_pipeline = pipeline;
+      frame_statistics.pipeline_binds++;
+    } else {
+      frame_statistics.skipped_pipeline_binds++;
+    }
+
+    // Bind the descriptor set of the material. If the uniform data is addressed with a dynamic offset,
+    // the set has to be bound again whenever the offset changes, i.e. for each model. With push constants,
+    // it only changes with the material.
+    if (ctx.bound_descriptor_set != packet.descriptor_set || (!ctx.push_constants && ctx.bound_uniform_offset != packet.uniform_offset)) {
+      vkCmdBindDescriptorSets(ctx.command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, ctx.pipeline_layout, 1u, 1u, &packet.descriptor_set,
+                              ctx.push_constants ? 0u : 1u, &packet.uniform_offset);
+      ctx.bound_descriptor_set = packet.descriptor_set;
+      ctx.bound_uniform_offset = packet.uniform_offset;
+      frame_statistics.descriptor_set_binds++;
+    } else {
+      frame_statistics.skipped_descriptor_set_binds++;
+    }
+
+    // Bind the geometry buffers, with shared geometry buffers most draws use the ones already bound
+    if (ctx.bound_vertex_buffer != packet.geometry.vertex_buffer) {
+      const VkDeviceSize offset = 0u;
+      vkCmdBindVertexBuffers(ctx.command_buffer, 0u, 1u, &packet.geometry.vertex_buffer, &offset);
+      ctx.bound_vertex_buffer = packet.geometry.vertex_buffer;
+      frame_statistics.vertex_buffer_binds++;
+    } else {
+      frame_statistics.skipped_vertex_buffer_binds++;
+    }
+
+    if (ctx.bound_index_buffer != packet.geometry.index_buffer) {
+      vkCmdBindIndexBuffer(ctx.command_buffer, packet.geometry.index_buffer, 0, VK_INDEX_TYPE_UINT16);
+      ctx.bound_index_buffer = packet.geometry.index_buffer;
+      frame_statistics.index_buffer_binds++;
+    } else {
+      frame_statistics.skipped_index_buffer_binds++;
+    }
+
+    if (indirect) {
+      // Draw the visible draws of the batch, as written by the culling pass
+      m_culler->drawBatch(ctx.command_buffer, static_cast<uint32_t>(packet.batch), packet.first_command, packet.batch_size);
+      last_batch = packet.batch;
+      frame_statistics.indirect_batches++;
+      frame_statistics.indirect_draws += packet.batch_size;
+    } else if (packet.instance_buffer != VK_NULL_HANDLE) {
+      // Draw all instances at once, with the per-instance data in the second vertex buffer binding
+      vkCmdBindVertexBuffers(ctx.command_buffer, 1u, 1u, &packet.instance_buffer, &packet.instance_offset);
+      vkCmdDrawIndexed(ctx.command_buffer, packet.geometry.index_count, packet.instance_count, packet.geometry.first_index,
+                       packet.geometry.vertex_offset, 0u);
+      frame_statistics.instanced_draws++;
+      frame_statistics.instances += packet.instance_count;
+    } else {
+      if (ctx.push_constants) {
+        ModelPushConstants push_constants{packet.world_transform, packet.color, packet.texture_index};
+        vkCmdPushConstants(ctx.command_buffer, ctx.pipeline_layout, VK_SHADER_STAGE_VERTEX_BIT, 0u, sizeof(ModelPushConstants),
+                           &push_constants);
+        frame_statistics.push_constant_updates++;
+      }
+
+      // Draw using indices, offset into the (possibly shared) buffers
+      vkCmdDrawIndexed(ctx.command_buffer, packet.geometry.index_count, 1u, packet.geometry.first_index, packet.geometry.vertex_offset, 0u);
+      frame_statistics.draws++;
+    }
+  }
+
+  if (ctx.gpu_profiler) {
+    ctx.gpu_profiler->endScope(ctx.command_buffer, pass_scope);
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Split the sorted draws into chunks of about the same size, and return the start of each chunk followed
+// by the end of the last one. Each pass starts a new chunk, such that it can be measured by the GPU
+// profiler, so there might be a few more chunks than asked for. A batch of indirect draws is never split,
+// as the whole batch is drawn with its first draw.
+//------------------------------------------------------------------------------------------------------
+std::vector<size_t> RenderQueue::splitIntoChunks(uint32_t max_chunk_count) const {
+  const size_t draw_count = m_sorted_packets.size();
+  const size_t chunk_count = std::clamp<size_t>(draw_count / MIN_DRAWS_PER_CHUNK, 1u, max_chunk_count);
+
+  std::vector<size_t> chunk_starts = {0u};
+  for (size_t chunk = 1; chunk < chunk_count; chunk++) {
+    size_t start = std::max(draw_count * chunk / chunk_count, chunk_starts.back());
+    while (start > 0u && start < draw_count && m_packets[m_sorted_packets[start]].batch >= 0 &&
+           m_packets[m_sorted_packets[start]].batch == m_packets[m_sorted_packets[start - 1]].batch) {
+      start++;
+    }
+    chunk_starts.push_back(start);
+  }
+
+  for (size_t i = 1; i < draw_count; i++) {
+    if ((m_packets[m_sorted_packets[i]].key >> 60) != (m_packets[m_sorted_packets[i - 1]].key >> 60)) {
+      chunk_starts.push_back(i);
+    }
+  }
+  chunk_starts.push_back(draw_count);
+
+  // Drop the empty chunks, without any draws there are no chunks at all
+  std::sort(chunk_starts.begin(), chunk_starts.end());
+  chunk_starts.erase(std::unique(chunk_starts.begin(), chunk_starts.end()), chunk_starts.end());
+
+  return chunk_starts;
+}
+
+// Sort the indices of the packets by key. Stable, such that draws with equal keys keep the order in
+// which they were added.
+void RenderQueue::sort() {
+  m_sorted_packets.resize(m_packets.size());
+  for (uint32_t i = 0; i < m_sorted_packets.size(); i++) {
+    m_sorted_packets[i] = i;
+  }
+
+  std::stable_sort(m_sorted_packets.begin(), m_sorted_packets.end(),
+                   [this](uint32_t a, uint32_t b) { return m_packets[a].key < m_packets[b].key; });
+}
+
+// Whether two draws can be drawn with the same indirect count draw. Batches never span passes, as each
+// pass is measured on its own.
+bool RenderQueue::sameBatch(const DrawPacket &a, const DrawPacket &b) {
+  return (a.key >> 60) == (b.key >> 60) && a.indirect_pipeline == b.indirect_pipeline && a.descriptor_set == b.descriptor_set &&
+         a.geometry.vertex_buffer == b.geometry.vertex_buffer && a.geometry.index_buffer == b.geometry.index_buffer;
+}
+
+RenderQueueStatistics RenderQueue::getStatistics() { return m_statistics; }
+
+RenderQueueStatistics RenderQueue::getLastFrameStatistics() { return m_last_frame_statistics; }
+
+// Returns the id of the handle in the current frame, handing out the next one for new handles. If we run
+// out of ids, the remaining handles share the last one, which only makes the sorting less effective.
+uint32_t RenderQueue::lookupId(std::unordered_map<uint64_t, uint32_t> &ids, uint64_t handle, uint32_t max_id) {
+  auto it = ids.find(handle);
+  if (it != ids.end()) {
+    return it->second;
+  }
+
+  uint32_t id = std::min(static_cast<uint32_t>(ids.size()), max_id);
+  ids.emplace(handle, id);
+  return id;
+}
+
+void RenderQueue::addStatistics(const RenderQueueStatistics &frame_statistics) {
+  m_last_frame_statistics = frame_statistics;
+  accumulateStatistics(m_statistics, frame_statistics);
+}
+
+void RenderQueue::accumulateStatistics(RenderQueueStatistics &total, const RenderQueueStatistics &statistics) {
+  total.frames += statistics.frames;
+  total.draws += statistics.draws;
+  total.pipeline_binds += statistics.pipeline_binds;
+  total.skipped_pipeline_binds += statistics.skipped_pipeline_binds;
+  total.descriptor_set_binds += statistics.descriptor_set_binds;
+  total.skipped_descriptor_set_binds += statistics.skipped_descriptor_set_binds;
+  total.vertex_buffer_binds += statistics.vertex_buffer_binds;
+  total.skipped_vertex_buffer_binds += statistics.skipped_vertex_buffer_binds;
+  total.index_buffer_binds += statistics.index_buffer_binds;
+  total.skipped_index_buffer_binds += statistics.skipped_index_buffer_binds;
+  total.indirect_draws += statistics.indirect_draws;
+  total.indirect_batches += statistics.indirect_batches;
+  total.instanced_draws += statistics.instanced_draws;
+  total.instances += statistics.instances;
+  total.push_constant_updates += statistics.push_constant_updates;
+  total.parallel_chunks += statistics.parallel_chunks;
+}
@@ -1,35 +1,26 @@
 #include <xre/renderable.h>
+#include <xre/render_queue.h>
 
 // Function to initialize the "common" data of a mesh, to avoid code-duplication
 void Renderable::initialize(std::vector<Vertex> vertices, std::vector<uint16_t> indices, std::shared_ptr<VulkanHandler> vulkan_handler) {
   // Store vulkan handler
   m_vulkan_handler = vulkan_handler;
 
-  auto device = m_vulkan_handler->getLogicalDevice();
-  auto physical_device = m_vulkan_handler->getPhysicalDevice();
-
   // Store number of vertices and indices
   m_vertex_count = vertices.size();
   m_index_count = indices.size();
 
-  // Create vertex buffer
-  size_t size = sizeof(Vertex) * vertices.size();
-  m_vertex_buffer = new Buffer(device, physical_device, static_cast<VkDeviceSize>(size), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-  m_vertex_buffer->loadData(vertices);
+  // Create the vertex and index buffers (or the range in the shared buffers)
+  m_geometry = createGeometry(vertices, indices, m_vertex_buffer, m_index_buffer);
 
-  // Create index buffer
-  size_t index_size = sizeof(uint16_t) * indices.size();
-  m_index_buffer = new Buffer(device, physical_device, static_cast<VkDeviceSize>(index_size), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-  m_index_buffer->loadData(indices);
+  // The positions are needed for the bounding box
+  std::vector<glm::vec3> vertex_positions;
+  vertex_positions.reserve(m_vertex_count);
+  for (int i = 0; i < m_vertex_count; i++) {
+    vertex_positions.push_back(vertices[i].position);
+  }
 
   if (hasBoundingBox()) {
-    // Store vertex positions temporary
-    std::vector<glm::vec3> vertex_positions;
-
-    for (int i = 0; i < m_vertex_count; i++) {
-      vertex_positions.push_back(vertices[i].position);
-    }
-
     // Create the bounding box for this mesh
     m_bounding_box = OOBB(vertex_positions);
 
@@ -44,56 +35,73 @@ void Renderable::initialize(std::vector<Vertex> vertices, std::vector<uint16_t>
       bbox_vertices.push_back(vert);
     }
 
-    // Create vertex buffer for object oriented bounding boxes.
-    size_t size = sizeof(Vertex) * bbox_vertices.size();
-    m_bounding_box_vertex_buffer = new Buffer(device, physical_device, static_cast<VkDeviceSize>(size), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    m_bounding_box_vertex_buffer->loadData(bbox_vertices);
+    // Create vertex and index buffer for object oriented bounding boxes.
     m_bbox_index_count = m_bounding_box.getLineIndices().size();
+    m_bounding_box_geometry =
+        createGeometry(bbox_vertices, m_bounding_box.getLineIndices(), m_bounding_box_vertex_buffer, m_bounding_box_index_buffer);
+  }
 
-    // Create index buffer for object oriented bounding boxes.
-    size_t index_size = sizeof(uint16_t) * m_bbox_index_count;
-    m_bounding_box_index_buffer =
-        new Buffer(device, physical_device, static_cast<VkDeviceSize>(index_size), VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    m_bounding_box_index_buffer->loadData(m_bounding_box.getLineIndices());
+  // Only keep the geometry on the CPU if it might be rasterized as an occluder
+  if (VulkanHandler::USE_OCCLUSION_CULLING) {
+    m_vertex_positions = std::move(vertex_positions);
+    m_indices = indices;
   }
 }
 
-void Renderable::render(RenderContext &ctx) {
-  //------------------------------------------------------------------------------------------------------
-  // Bind buffers
-  //------------------------------------------------------------------------------------------------------
-  const VkDeviceSize offset = 0u;
-  const VkBuffer vertex_buffer = m_vertex_buffer->getBuffer();
-  vkCmdBindVertexBuffers(ctx.command_buffer, 0u, 1u, &vertex_buffer, &offset);
-
-  // Bind the index buffer
-  const VkBuffer index_buffer = m_index_buffer->getBuffer(); // Your new index buffer
-  vkCmdBindIndexBuffer(ctx.command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT16);
-
-  //------------------------------------------------------------------------------------------------------
-  // Draw
-  //------------------------------------------------------------------------------------------------------
-  // Draw using indices
-  vkCmdDrawIndexed(ctx.command_buffer, m_index_count, 1u, 0u, 0u, 0u);
+// Creates the buffers for the given geometry. If shared geometry buffers are used, we only get a range in
+// the buffers of the geometry pool, and the buffer pointers are left untouched.
+GeometryRange Renderable::createGeometry(const std::vector<Vertex> &vertices, const std::vector<uint16_t> &indices, Buffer *&vertex_buffer,
+                                         Buffer *&index_buffer) {
+  if (VulkanHandler::USE_SHARED_GEOMETRY_BUFFERS) {
+    GeometryPool *geometry_pool = m_vulkan_handler->getGeometryPool();
+    GeometryRange range = geometry_pool->allocate(vertices, indices);
+
+    // Renderables are copied by value, so the range is returned to the pool once the last copy is gone
+    m_pool_allocations.emplace_back(new GeometryRange(range), [geometry_pool](GeometryRange *allocation) {
+      geometry_pool->free(*allocation);
+      delete allocation;
+    });
+    return range;
+  }
+
+  // The geometry is static, so we keep it in device local memory and upload it through the staging ring
+  MemoryAllocator *allocator = m_vulkan_handler->getMemoryAllocator();
+  UploadManager *upload_manager = m_vulkan_handler->getUploadManager();
+
+  // Create vertex buffer
+  size_t size = sizeof(Vertex) * vertices.size();
+  vertex_buffer = new Buffer(allocator, static_cast<VkDeviceSize>(size), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                             VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  upload_manager->uploadBuffer(vertex_buffer, vertices.data(), size);
+
+  // Create index buffer
+  size_t index_size = sizeof(uint16_t) * indices.size();
+  index_buffer = new Buffer(allocator, static_cast<VkDeviceSize>(index_size), VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  upload_manager->uploadBuffer(index_buffer, indices.data(), index_size);
+
+  GeometryRange range{};
+  range.vertex_buffer = vertex_buffer->getBuffer();
+  range.index_buffer = index_buffer->getBuffer();
+  range.vertex_offset = 0;
+  range.first_index = 0u;
+  range.index_count = static_cast<uint32_t>(indices.size());
+  range.vertex_count = static_cast<uint32_t>(vertices.size());
+  return range;
 }
 
-void Renderable::renderBoundingBox(RenderContext &ctx) {
-  //------------------------------------------------------------------------------------------------------
-  // Bind buffers for bounding boxes
-  //------------------------------------------------------------------------------------------------------
-  const VkDeviceSize offset = 0u;
-  const VkBuffer bbox_vertex_buffer = m_bounding_box_vertex_buffer->getBuffer();
-  vkCmdBindVertexBuffers(ctx.command_buffer, 0u, 1u, &bbox_vertex_buffer, &offset);
-
-  // Bind the index buffer
-  const VkBuffer bbox_index_buffer = m_bounding_box_index_buffer->getBuffer(); // Your new index buffer
-  vkCmdBindIndexBuffer(ctx.command_buffer, bbox_index_buffer, 0, VK_INDEX_TYPE_UINT16);
-
-  //------------------------------------------------------------------------------------------------------
-  // Draw
-  //------------------------------------------------------------------------------------------------------
-  // Draw using indices
-  vkCmdDrawIndexed(ctx.command_buffer, m_bbox_index_count, 1u, 0u, 0u, 0u);
+// Add the draw to the render queue, using the state the model stored in the render context
+void Renderable::render(RenderContext &ctx) { ctx.render_queue->push(ctx, m_geometry, hasBoundingBox() ? &m_bounding_box : nullptr); }
+
+void Renderable::renderBoundingBox(RenderContext &ctx) { ctx.render_queue->push(ctx, m_bounding_box_geometry, &m_bounding_box); }
+
+// Add a single draw of all instances, whose data is read from the given buffer
+void Renderable::renderInstanced(RenderContext &ctx, VkBuffer instance_buffer, VkDeviceSize instance_offset, uint32_t instance_count) {
+  ctx.render_queue->pushInstanced(ctx, m_geometry, instance_buffer, instance_offset, instance_count);
 }
 
 OOBB Renderable::getObjectOrientedBoundingBox() { return m_bounding_box; }
+
+const std::vector<glm::vec3> &Renderable::getVertexPositions() { return m_vertex_positions; }
+
+const std::vector<uint16_t> &Renderable::getIndices() { return m_indices; }
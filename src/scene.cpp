@@ -54,6 +54,26 @@ std::unordered_set<SceneNode *> Scene::getTerrainNodeInstances() {
   return result;
 }
 
+void Scene::setNodeOccluder(SceneNode *node, bool occluder) {
+  if (occluder) {
+    m_occluder_scene_nodes.insert(node);
+  } else {
+    m_occluder_scene_nodes.erase(node);
+  }
+}
+
+std::unordered_set<SceneNode *> Scene::getOccluderNodeInstances() {
+  std::unordered_set<SceneNode *> result;
+
+  for (SceneNode *current_node : m_occluder_scene_nodes) {
+    if (current_node->isActive()) {
+      result.insert(current_node);
+    }
+  }
+
+  return result;
+}
+
 void Scene::resetInteractionStates() {
   for (SceneNode *current_node : m_grabbable_scene_nodes) {
     current_node->m_intersected_in_current_frame = false;
@@ -35,22 +35,35 @@ void SceneManager::setActive(const std::string& name) {
 
   // Deactivate old scene safely
   if (old_scene) {
+    XRE_PROFILE_SCOPE("Scene::onDeactivate");
     old_scene->onDeactivate();
     m_vulkan_handler->resetDescriptorPool();
   }
 
   // Activate new scene
-  m_active_scene->onActivate();
+  {
+    XRE_PROFILE_SCOPE("Scene::onActivate");
+    m_active_scene->onActivate();
+  }
+
+  // Destroy the old scene only now, such that pipelines shared with the new scene are kept. Afterwards the
+  // pipelines only the old scene used are unreferenced, and can be destroyed once no frame uses them.
+  if (old_scene) {
+    old_scene.reset();
+    m_vulkan_handler->destroyUnusedPipelines();
+  }
 }
 
 void SceneManager::updateSimulation(XrTime predicted_time) {
   if (m_active_scene) {
+    XRE_PROFILE_SCOPE("Scene::updateSimulation");
     m_active_scene->updateSimulation(predicted_time);
   }
 }
 
 void SceneManager::draw(RenderContext& ctx) {
   if (m_active_scene) {
+    XRE_PROFILE_SCOPE("Scene::draw");
     m_active_scene->draw(ctx);
   }
 }
@@ -77,6 +90,14 @@ std::unordered_set<SceneNode *> SceneManager::getTerrainInstances() {
   }
 }
 
+std::unordered_set<SceneNode *> SceneManager::getOccluderInstances() {
+  if (m_active_scene) {
+    return m_active_scene->getOccluderNodeInstances();
+  } else {
+    return {};
+  }
+}
+
 void SceneManager::processButtonInteractions() {
   if (m_active_scene) {
     m_active_scene->processButtonInteractions();
@@ -3,6 +3,8 @@
 #include <xre/line.h>
 #include <xre/text.h>
 #include <xre/button.h>
+#include <xre/static_command_cache.h>
+#include <xre/render_queue.h>
 
 SceneNode::SceneNode() {
   m_parent = NULL;
@@ -16,11 +18,19 @@ SceneNode::SceneNode(std::shared_ptr<Model> model) {
   m_scene = NULL;
 }
 
+SceneNode::SceneNode(std::shared_ptr<InstancedModel> instanced_model) {
+  m_instanced_model = instanced_model;
+  m_model = NULL;
+  m_parent = NULL;
+  m_scene = NULL;
+}
+
 SceneNode::~SceneNode() { m_children.clear(); }
 
 void SceneNode::addChildNode(std::shared_ptr<SceneNode> child) {
   m_children.push_back(child);
   child->m_parent = this;
+  invalidateBounds();
 }
 
 void SceneNode::addChildNode(std::shared_ptr<Line> child) {
@@ -40,17 +50,69 @@ void SceneNode::render(RenderContext &ctx) {
     return;
   }
 
+  // Reject the whole subtree if its bounds are outside of the frustum. Subtrees without any
+  // models don't need to be visited at all. Bounds which were not computed yet can't be used.
+  if (ctx.frustum && m_subtree_bounded && !m_bounds_need_update) {
+    if (m_subtree_bounds.isEmpty()) {
+      return;
+    }
+
+    if (!ctx.frustum->intersects(m_subtree_bounds)) {
+      ctx.culling_statistics.culled_nodes++;
+      return;
+    }
+
+    if (ctx.occlusion_culler && ctx.occlusion_culler->isOccluded(m_subtree_bounds)) {
+      ctx.culling_statistics.occluded_nodes++;
+      return;
+    }
+  }
+  ctx.culling_statistics.visited_nodes++;
+
+  // Static subtrees are drawn from their cached command buffers, which are only recorded again once
+  // something in the subtree changed
+  if (m_static && ctx.static_cache && ctx.render_queue->getPass() == RenderQueue::PASS_SCENE) {
+    if (updateStaticSubtree(ctx)) {
+      invalidateStaticContent();
+    }
+    ctx.static_cache->addSubtree(this, m_static_generation);
+    return;
+  }
+
+  // Disable the culling of the meshes as well, until the subtree is done
+  const Frustum *frustum = ctx.frustum;
+  const OcclusionCuller *occlusion_culler = ctx.occlusion_culler;
+  if (!m_culling_enabled) {
+    ctx.frustum = nullptr;
+    ctx.occlusion_culler = nullptr;
+  }
+
   if (m_model) {
     // Keep track if there is an interaction with the model
     m_model->setInteractedState(m_intersected_in_current_frame);
 
     // And render the model
-    m_model->render(ctx, m_world_transform);
+    // Select the level of detail, starting from the one of the last frame
+    if (ctx.lod_views) {
+      m_lod_level = m_model->selectLodLevel(*ctx.lod_views, m_model_bounds, m_lod_level);
+    }
+
+    // Blended models of static subtrees are drawn with the rest of the frame instead
+    if (!ctx.static_recording || !m_model->m_material->isTranslucent()) {
+      m_model->render(ctx, m_world_transform, m_lod_level);
+    }
+  }
+
+  if (m_instanced_model && (!ctx.static_recording || !m_instanced_model->m_material->isTranslucent())) {
+    m_instanced_model->render(ctx, m_world_transform);
   }
 
   for (std::shared_ptr<SceneNode> child : m_children) {
     child->render(ctx);
   }
+
+  ctx.frustum = frustum;
+  ctx.occlusion_culler = occlusion_culler;
 }
 
 void SceneNode::updateTransformation() {
@@ -62,6 +124,8 @@ void SceneNode::updateTransformation() {
   // We only need to update the transform for the current element
   // if its `m_transform_needs_update` flag or the one of its parent is set to `true`
   if (m_transform_needs_update) {
+    invalidateStaticContent();
+
     // Update the local transform
     glm::mat4 m_local_transform = Geometry::composeWorldMatrix(m_translation, m_rotation, m_scaling);
 
@@ -78,9 +142,25 @@ void SceneNode::updateTransformation() {
   }
 
   // Update the transforms of all the children.
+  bool bounds_changed = m_transform_needs_update || m_bounds_need_update;
   for (std::shared_ptr<SceneNode> child : m_children) {
     child->updateTransformation();
+    bounds_changed = bounds_changed || child->m_subtree_bounds_changed;
+  }
+
+  // Recompute the bounds of the subtree if the node or any of its children changed
+  if (bounds_changed) {
+    m_model_bounds = m_model ? m_model->computeBounds(m_world_transform) : AABB();
+    m_subtree_bounds = m_model_bounds;
+    m_subtree_bounded = m_culling_enabled && !m_instanced_model;
+
+    for (std::shared_ptr<SceneNode> child : m_children) {
+      m_subtree_bounded = m_subtree_bounded && child->m_subtree_bounded;
+      m_subtree_bounds.extend(child->m_subtree_bounds);
+    }
   }
+  m_subtree_bounds_changed = bounds_changed;
+  m_bounds_need_update = false;
 
   // And then reset the `m_transform_needs_update` flag
   m_transform_needs_update = false;
@@ -163,10 +243,111 @@ void SceneNode::setIsTerrain(bool is_terrain) {
   }
 }
 
-void SceneNode::setActive(bool is_active) { m_is_active = is_active; }
+void SceneNode::setOccluder(bool occluder) {
+  if (m_scene) {
+    m_scene->setNodeOccluder(this, occluder);
+  }
+}
+
+void SceneNode::addOccluders(OcclusionCuller &occlusion_culler) {
+  if (m_model) {
+    m_model->addOccluders(occlusion_culler, m_world_transform);
+  }
+}
+
+void SceneNode::setActive(bool is_active) {
+  if (is_active != m_is_active) {
+    invalidateStaticContent();
+  }
+  m_is_active = is_active;
+}
 
 bool SceneNode::isActive() { return m_is_active; }
 
+void SceneNode::setCullingEnabled(bool culling_enabled) {
+  m_culling_enabled = culling_enabled;
+  invalidateBounds();
+}
+
+void SceneNode::setStatic(bool is_static) {
+  m_static = is_static;
+  invalidateStaticContent();
+}
+
+bool SceneNode::isStatic() { return m_static; }
+
+// Outdate the cached command buffers of all static subtrees containing the node
+void SceneNode::invalidateStaticContent() {
+  for (SceneNode *node = this; node; node = node->m_parent) {
+    if (node->m_static) {
+      node->m_static_generation = ++s_static_generations;
+    }
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Update the state of the models in a subtree whose opaque draws come from the static command cache,
+// i.e. whether they are interacted with and their level of detail, and draw its blended models. Returns
+// whether the cached draws of the subtree are outdated.
+//------------------------------------------------------------------------------------------------------
+bool SceneNode::updateStaticSubtree(RenderContext &ctx) {
+  if (!m_is_active) {
+    return false;
+  }
+
+  const Frustum *frustum = ctx.frustum;
+  const OcclusionCuller *occlusion_culler = ctx.occlusion_culler;
+  if (!m_culling_enabled) {
+    ctx.frustum = nullptr;
+    ctx.occlusion_culler = nullptr;
+  }
+
+  bool changed = false;
+  if (m_model) {
+    m_model->setInteractedState(m_intersected_in_current_frame);
+
+    uint32_t lod_level = ctx.lod_views ? m_model->selectLodLevel(*ctx.lod_views, m_model_bounds, m_lod_level) : m_lod_level;
+    if (m_model->m_material->isTranslucent()) {
+      m_lod_level = lod_level;
+      m_model->render(ctx, m_world_transform, m_lod_level);
+    } else {
+      uint64_t generation = m_model->getGeneration();
+      changed = changed || generation != m_model_generation || lod_level != m_lod_level;
+      m_model_generation = generation;
+      m_lod_level = lod_level;
+    }
+  }
+
+  if (m_instanced_model) {
+    if (m_instanced_model->m_material->isTranslucent()) {
+      m_instanced_model->render(ctx, m_world_transform);
+    } else {
+      uint64_t generation = m_instanced_model->getGeneration();
+      changed = changed || generation != m_instanced_model_generation;
+      m_instanced_model_generation = generation;
+    }
+  }
+
+  for (std::shared_ptr<SceneNode> child : m_children) {
+    changed = child->updateStaticSubtree(ctx) || changed;
+  }
+
+  ctx.frustum = frustum;
+  ctx.occlusion_culler = occlusion_culler;
+  return changed;
+}
+
+// Mark the bounds of the node and all its ancestors as outdated, such that they are not used until
+// they are recomputed by the next call to `updateTransformation()`.
+void SceneNode::invalidateBounds() {
+  for (SceneNode *node = this; node; node = node->m_parent) {
+    node->m_bounds_need_update = true;
+  }
+
+  // The structure of the subtree changed as well
+  invalidateStaticContent();
+}
+
 bool SceneNode::intersects(std::shared_ptr<SceneNode> other) {
   return m_model->intersects(other->m_model, other->m_world_transform, m_world_transform);
 }
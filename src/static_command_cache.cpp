@@ -0,0 +1,129 @@
+#include <xre/static_command_cache.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the cache.
+// Arguments:
+//  1) Device the command buffers are recorded for
+//  2) Queue family the primary command buffers are submitted to
+//  3) Number of frames which can be in flight at the same time
+//------------------------------------------------------------------------------------------------------
+StaticCommandCache::StaticCommandCache(VkDevice device, uint32_t queue_family_index, uint32_t frame_count) {
+  m_device = device;
+  m_frame_count = frame_count;
+
+  // The buffers are long-lived and re-recorded individually
+  VkCommandPoolCreateInfo pool_create_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_create_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_create_info.queueFamilyIndex = queue_family_index;
+
+  VkResult result = vkCreateCommandPool(m_device, &pool_create_info, nullptr, &m_command_pool);
+  Utils::checkVkResult(result, "Failed to create the command pool of the static command cache");
+}
+
+StaticCommandCache::~StaticCommandCache() {
+  // Frees all command buffers of the pool as well
+  vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Start collecting the static subtrees of a frame. The caller has to make sure that the GPU is done with
+// the previous frame which used the same slot, as its buffers might be recorded again.
+//------------------------------------------------------------------------------------------------------
+void StaticCommandCache::beginFrame(uint32_t frame_index) {
+  m_current_frame = frame_index;
+  m_frame++;
+  m_current_subtrees.clear();
+
+  // Drop the subtrees which were not drawn by any frame which might still be in flight
+  for (auto it = m_entries.begin(); it != m_entries.end();) {
+    if (it->second.last_used_frame + m_frame_count < m_frame) {
+      for (VkCommandBuffer command_buffer : it->second.command_buffers) {
+        if (command_buffer != VK_NULL_HANDLE) {
+          vkFreeCommandBuffers(m_device, m_command_pool, 1u, &command_buffer);
+        }
+      }
+
+      m_statistics.evicted_subtrees++;
+      it = m_entries.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+// Draw the given subtree from its cached buffer in the current frame
+void StaticCommandCache::addSubtree(SceneNode *node, uint64_t generation) {
+  m_current_subtrees.emplace_back(node, generation);
+
+  Entry &entry = m_entries[node];
+  if (entry.command_buffers.empty()) {
+    entry.command_buffers.assign(m_frame_count, VK_NULL_HANDLE);
+    entry.generations.assign(m_frame_count, 0u);
+    entry.extents.assign(m_frame_count, VkExtent2D{0u, 0u});
+  }
+  entry.last_used_frame = m_frame;
+}
+
+size_t StaticCommandCache::getSubtreeCount() { return m_current_subtrees.size(); }
+
+//------------------------------------------------------------------------------------------------------
+// Returns the buffers of all subtrees drawn in the current frame, recording the ones which are outdated
+// (or were never recorded for the current frame slot) with the given callback first.
+//------------------------------------------------------------------------------------------------------
+std::vector<VkCommandBuffer> StaticCommandCache::record(const VkCommandBufferInheritanceInfo &inheritance_info, VkExtent2D extent,
+                                                        const std::function<void(SceneNode *, VkCommandBuffer)> &record_subtree) {
+  std::vector<VkCommandBuffer> command_buffers;
+  command_buffers.reserve(m_current_subtrees.size());
+
+  for (const auto &[node, generation] : m_current_subtrees) {
+    Entry &entry = m_entries[node];
+    VkExtent2D &recorded_extent = entry.extents[m_current_frame];
+
+    if (entry.command_buffers[m_current_frame] == VK_NULL_HANDLE || entry.generations[m_current_frame] != generation ||
+        recorded_extent.width != extent.width || recorded_extent.height != extent.height) {
+      recordEntry(node, entry, inheritance_info, record_subtree);
+      entry.generations[m_current_frame] = generation;
+      recorded_extent = extent;
+      m_statistics.recorded_subtrees++;
+    } else {
+      m_statistics.replayed_subtrees++;
+    }
+
+    command_buffers.push_back(entry.command_buffers[m_current_frame]);
+  }
+
+  m_statistics.frames++;
+  return command_buffers;
+}
+
+StaticCommandCacheStatistics StaticCommandCache::getStatistics() { return m_statistics; }
+
+void StaticCommandCache::recordEntry(SceneNode *node, Entry &entry, const VkCommandBufferInheritanceInfo &inheritance_info,
+                                     const std::function<void(SceneNode *, VkCommandBuffer)> &record_subtree) {
+  VkCommandBuffer &command_buffer = entry.command_buffers[m_current_frame];
+  VkResult result;
+
+  if (command_buffer == VK_NULL_HANDLE) {
+    VkCommandBufferAllocateInfo buffer_allocate_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    buffer_allocate_info.commandPool = m_command_pool;
+    buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    buffer_allocate_info.commandBufferCount = 1u;
+
+    result = vkAllocateCommandBuffers(m_device, &buffer_allocate_info, &command_buffer);
+    Utils::checkVkResult(result, "Failed to allocate a static command buffer");
+  }
+
+  // Begin implicitly resets the buffer. It is replayed by multiple frames, but never by two at once, as
+  // each frame slot has its own buffer.
+  VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  begin_info.pInheritanceInfo = &inheritance_info;
+
+  result = vkBeginCommandBuffer(command_buffer, &begin_info);
+  Utils::checkVkResult(result, "Failed to begin recording a static command buffer");
+
+  record_subtree(node, command_buffer);
+
+  result = vkEndCommandBuffer(command_buffer);
+  Utils::checkVkResult(result, "Failed to record a static command buffer");
+}
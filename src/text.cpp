@@ -10,6 +10,11 @@ Text::Text(const std::string sentence, std::shared_ptr<VulkanHandler> vulkan_han
 
   // Setup the scene node
   m_scene_node = std::make_shared<SceneNode>(m_model);
+
+  // Text on the HUD is placed in screen space, so its world space bounds are meaningless
+  if (m_stick_to_hud) {
+    m_scene_node->setCullingEnabled(false);
+  }
 }
 
 TextChar Text::computeTextureOffsets(int letter) {
@@ -90,8 +95,12 @@ void Text::buildMeshesFromSentence(const std::string sentence) {
     vertex_shader = SHADERS_FOLDER "basic.vert.spv";
   }
 
+  // The glyphs are cut out of the quads by the alpha of the font texture
+  PipelineState pipeline_state{};
+  pipeline_state.blend = true;
+
   std::shared_ptr<Material> material =
-      std::make_shared<Material>(vertex_shader, SHADERS_FOLDER "texture.frag.spv", texture, false, m_vulkan_handler);
+      std::make_shared<Material>(vertex_shader, SHADERS_FOLDER "texture.frag.spv", texture, false, m_vulkan_handler, pipeline_state);
 
   // Create the model
   m_model = std::make_shared<Model>(meshes, glm::vec3(1.0f, 0.0f, 0.0f), material);
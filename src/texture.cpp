@@ -4,15 +4,139 @@
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+// Other includes
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+
+namespace {
+
+// Header of a KTX2 file, which is followed by the level index (one entry per mip level)
+struct Ktx2Header {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+static_assert(sizeof(Ktx2Header) == 80, "KTX2 header must not be padded");
+
+struct Ktx2LevelIndex {
+  uint64_t byte_offset; // Relative to the start of the file
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A};
+
+// Extent and size of a texel block of the formats which KTX2 textures may use, uncompressed formats have
+// blocks of a single texel. Returns false for other formats.
+bool getFormatBlock(VkFormat format, uint32_t &block_width, uint32_t &block_height, uint32_t &block_bytes) {
+  // Extents of the ASTC formats, each of which has a UNORM and an SRGB variant
+  constexpr uint32_t ASTC_BLOCK_EXTENTS[14][2] = {{4, 4},  {5, 4},  {5, 5},  {6, 5},   {6, 6},   {8, 5},   {8, 6},
+                                                  {8, 8},  {10, 5}, {10, 6}, {10, 8},  {10, 10}, {12, 10}, {12, 12}};
+
+  block_width = 1u;
+  block_height = 1u;
+  switch (format) {
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    block_bytes = 4u;
+    return true;
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+  case VK_FORMAT_BC4_SNORM_BLOCK:
+    block_width = 4u;
+    block_height = 4u;
+    block_bytes = 8u;
+    return true;
+  case VK_FORMAT_BC2_UNORM_BLOCK:
+  case VK_FORMAT_BC2_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+  case VK_FORMAT_BC5_SNORM_BLOCK:
+  case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+  case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    block_width = 4u;
+    block_height = 4u;
+    block_bytes = 16u;
+    return true;
+  default:
+    break;
+  }
+
+  if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+    const uint32_t *extent = ASTC_BLOCK_EXTENTS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+    block_width = extent[0];
+    block_height = extent[1];
+    block_bytes = 16u;
+    return true;
+  }
+
+  return false;
+}
+
+// Path of a compressed variant of an image, e.g. `Tiles012.bc7.ktx2` for `Tiles012.png`
+std::string getCompressedVariantPath(const std::string &path, const std::string &variant) {
+  std::filesystem::path variant_path(path);
+  variant_path.replace_extension(variant + ".ktx2");
+  return variant_path.string();
+}
+
+} // namespace
+
 Texture::Texture(const std::string &path, std::shared_ptr<VulkanHandler> vulkan_handler) : m_vulkan_handler(vulkan_handler) {
-  VkImage texture_image = createTextureImage(path);
+  std::string compressed_path = findCompressedVariant(path);
+  VkImage texture_image = compressed_path.empty() ? createTextureImage(path) : createCompressedTextureImage(compressed_path);
   createTextureImageView(texture_image);
   createTextureSampler();
 }
 
-VkImage Texture::createTextureImage(const std::string &path) {
-  VkResult result;
+// Returns the KTX2 file to load instead of the image, or an empty string if there is none the device supports
+std::string Texture::findCompressedVariant(const std::string &path) {
+  if (std::filesystem::path(path).extension() == ".ktx2") {
+    return path;
+  }
+
+  // BC7 is supported on desktop GPUs, ASTC on mobile ones (e.g. standalone headsets)
+  if (m_vulkan_handler->isTextureCompressionBcEnabled()) {
+    std::string bc7_path = getCompressedVariantPath(path, "bc7");
+    if (std::filesystem::exists(bc7_path)) {
+      return bc7_path;
+    }
+  }
+
+  if (m_vulkan_handler->isTextureCompressionAstcEnabled()) {
+    std::string astc_path = getCompressedVariantPath(path, "astc");
+    if (std::filesystem::exists(astc_path)) {
+      return astc_path;
+    }
+  }
 
+  return "";
+}
+
+VkImage Texture::createTextureImage(const std::string &path) {
   // Load the image with the STB image library
   int texture_width, texture_height, texture_channels;
   stbi_uc *pixels = stbi_load(path.c_str(), &texture_width, &texture_height, &texture_channels, STBI_rgb_alpha);
@@ -22,29 +146,147 @@ VkImage Texture::createTextureImage(const std::string &path) {
     Utils::exitWithMessage("failed to load texture image!");
   }
 
-  // Create our staging buffer
-  Buffer staging_buffer =
-      Buffer(m_vulkan_handler->getLogicalDevice(), m_vulkan_handler->getPhysicalDevice(), image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  // Images with an alpha channel often have it fully opaque anyway, which doesn't need blending
+  if (texture_channels == 2 || texture_channels == 4) {
+    for (VkDeviceSize i = 3u; i < image_size && !m_has_alpha; i += 4u) {
+      m_has_alpha = pixels[i] < 255u;
+    }
+  }
+
+  uint32_t width = static_cast<uint32_t>(texture_width);
+  uint32_t height = static_cast<uint32_t>(texture_height);
+
+  // Generate the full mip chain with linear filtered blits, if the format supports them
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(m_vulkan_handler->getPhysicalDevice(), m_format, &format_properties);
+  const VkFormatFeatureFlags blit_features =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  if (VulkanHandler::GENERATE_MIPMAPS && (format_properties.optimalTilingFeatures & blit_features) == blit_features) {
+    m_mip_levels = std::bit_width(std::max(width, height));
+  }
+
+  // The mip levels are blitted from the previous level
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  if (m_mip_levels > 1u) {
+    usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  VkImage texture_image = createImage(width, height, usage);
 
-  // Load pixels into buffer
-  staging_buffer.loadData(pixels);
+  // Upload the pixels through the staging ring. This transitions the image layout to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+  // copies the pixels, generates the mip levels and then transitions the image to the final layout
+  // VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL. The upload is submitted together with the other uploads before the next frame.
+  m_vulkan_handler->getUploadManager()->uploadImage(texture_image, width, height, pixels, image_size, m_mip_levels);
 
-  // Clean up the original pixel array
+  // Clean up the original pixel array, which has been copied into the staging ring
   stbi_image_free(pixels);
 
+  return texture_image;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Load a KTX2 file with pre-compressed data (e.g. BC7 or ASTC) and all its mip levels. Only 2D textures
+// without supercompression are supported, so the levels can be copied as they are.
+//------------------------------------------------------------------------------------------------------
+VkImage Texture::createCompressedTextureImage(const std::string &path) {
+  std::vector<char> file = Utils::readFile(path);
+
+  Ktx2Header header;
+  if (file.size() < sizeof(header) || std::memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+    Utils::exitWithMessage("Texture " + path + " is not a KTX2 file");
+  }
+  std::memcpy(&header, file.data(), sizeof(header));
+
+  if (header.supercompression_scheme != 0u) {
+    Utils::exitWithMessage("Texture " + path + " uses supercompression, which is not supported");
+  }
+
+  // The image can't have more levels than the full mip chain of its extent
+  if (header.pixel_width == 0u || header.pixel_height == 0u || header.pixel_depth > 0u || header.layer_count > 1u ||
+      header.face_count != 1u || header.level_count == 0u ||
+      header.level_count > static_cast<uint32_t>(std::bit_width(std::max(header.pixel_width, header.pixel_height)))) {
+    Utils::exitWithMessage("Texture " + path + " is not a 2D texture with baked mip levels");
+  }
+
+  // The format has to be known, and sampleable with linear filtering
+  m_format = static_cast<VkFormat>(header.vk_format);
+  m_mip_levels = header.level_count;
+
+  uint32_t block_width, block_height, block_bytes;
+  if (!getFormatBlock(m_format, block_width, block_height, block_bytes)) {
+    Utils::exitWithMessage("Format of texture " + path + " is not supported by the device");
+  }
+
+  // The compressed texels are not inspected, so all formats which can store alpha are assumed to use it
+  m_has_alpha = m_format != VK_FORMAT_BC1_RGB_UNORM_BLOCK && m_format != VK_FORMAT_BC1_RGB_SRGB_BLOCK &&
+                !(m_format >= VK_FORMAT_BC4_UNORM_BLOCK && m_format <= VK_FORMAT_BC6H_SFLOAT_BLOCK);
+
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(m_vulkan_handler->getPhysicalDevice(), m_format, &format_properties);
+  const VkFormatFeatureFlags sample_features = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  if (m_format == VK_FORMAT_UNDEFINED || (format_properties.optimalTilingFeatures & sample_features) != sample_features) {
+    Utils::exitWithMessage("Format of texture " + path + " is not supported by the device");
+  }
+
+  // Block-compressed formats also need their device feature to be enabled, which the format properties
+  // don't reflect. This matters for KTX2 files loaded directly, which skip the checks of the variants.
+  const bool bc_format = m_format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && m_format <= VK_FORMAT_BC7_SRGB_BLOCK;
+  const bool astc_format = m_format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && m_format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK;
+  if ((bc_format && !m_vulkan_handler->isTextureCompressionBcEnabled()) ||
+      (astc_format && !m_vulkan_handler->isTextureCompressionAstcEnabled())) {
+    Utils::exitWithMessage("Texture " + path + " uses a compressed format whose device feature is not enabled");
+  }
+
+  // The level index directly follows the header. Its size is checked before allocating it, as the level
+  // count comes straight from the file.
+  if ((file.size() - sizeof(header)) / sizeof(Ktx2LevelIndex) < header.level_count) {
+    Utils::exitWithMessage("Texture " + path + " is truncated");
+  }
+  std::vector<Ktx2LevelIndex> levels(header.level_count);
+  std::memcpy(levels.data(), file.data() + sizeof(header), levels.size() * sizeof(Ktx2LevelIndex));
+
+  // Each level has to hold all blocks the copy reads, partial blocks at the edges are stored in full
+  std::vector<VkDeviceSize> level_offsets;
+  for (uint32_t i = 0u; i < header.level_count; i++) {
+    const Ktx2LevelIndex &level = levels[i];
+    uint64_t level_width = std::max(header.pixel_width >> i, 1u);
+    uint64_t level_height = std::max(header.pixel_height >> i, 1u);
+    uint64_t level_blocks = ((level_width + block_width - 1u) / block_width) * ((level_height + block_height - 1u) / block_height);
+    uint64_t level_size = level_blocks * block_bytes;
+
+    if (level.byte_offset > file.size() || level.byte_length > file.size() - level.byte_offset || level.byte_length < level_size ||
+        level.byte_offset % block_bytes != 0u) {
+      Utils::exitWithMessage("Texture " + path + " is truncated");
+    }
+    level_offsets.push_back(level.byte_offset);
+  }
+
+  VkImage texture_image =
+      createImage(header.pixel_width, header.pixel_height, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+  // The whole file is staged, the level offsets are relative to its start
+  m_vulkan_handler->getUploadManager()->uploadImageLevels(texture_image, header.pixel_width, header.pixel_height, file.data(),
+                                                          file.size(), level_offsets);
+
+  return texture_image;
+}
+
+// Create the image with the format and number of mip levels of the texture, and bind its memory
+VkImage Texture::createImage(uint32_t width, uint32_t height, VkImageUsageFlags usage) {
+  VkResult result;
+
   // Setup the struct to create the image in Vulkan
   VkImageCreateInfo image_create_info{};
   image_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
   image_create_info.imageType = VK_IMAGE_TYPE_2D;
-  image_create_info.extent.width = static_cast<uint32_t>(texture_width);
-  image_create_info.extent.height = static_cast<uint32_t>(texture_height);
+  image_create_info.extent.width = width;
+  image_create_info.extent.height = height;
   image_create_info.extent.depth = 1;
-  image_create_info.mipLevels = 1;
+  image_create_info.mipLevels = m_mip_levels;
   image_create_info.arrayLayers = 1;
-  image_create_info.format = VK_FORMAT_R8G8B8A8_SRGB;
+  image_create_info.format = m_format;
   image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
   image_create_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  image_create_info.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+  image_create_info.usage = usage;
   image_create_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
   image_create_info.samples = VK_SAMPLE_COUNT_1_BIT;
   image_create_info.flags = 0; // Optional
@@ -58,94 +300,17 @@ VkImage Texture::createTextureImage(const std::string &path) {
   VkMemoryRequirements memory_requirements;
   vkGetImageMemoryRequirements(m_vulkan_handler->getLogicalDevice(), texture_image, &memory_requirements);
 
-  // Setup the info struct to allocate memory
-  VkMemoryAllocateInfo allocate_info{};
-  allocate_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  allocate_info.allocationSize = memory_requirements.size;
-  allocate_info.memoryTypeIndex = VulkanUtils::findMemoryType(m_vulkan_handler->getPhysicalDevice(), memory_requirements.memoryTypeBits,
-                                                              VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-  // Allocate and bind the image memory
-  VkDeviceMemory texture_image_memory;
-  result = vkAllocateMemory(m_vulkan_handler->getLogicalDevice(), &allocate_info, nullptr, &texture_image_memory);
-  Utils::checkVkResult(result, "failed to allocate image memory!");
+  // Sub-allocate the image memory from the allocator and bind it
+  MemoryAllocator *allocator = m_vulkan_handler->getMemoryAllocator();
+  m_texture_image_allocation = allocator->allocate(memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, AllocationKind::IMAGE);
 
-  result = vkBindImageMemory(m_vulkan_handler->getLogicalDevice(), texture_image, texture_image_memory, 0);
+  result = vkBindImageMemory(m_vulkan_handler->getLogicalDevice(), texture_image, m_texture_image_allocation.memory,
+                             m_texture_image_allocation.offset);
   Utils::checkVkResult(result, "failed to bing image memory!");
 
-  // Transition the image layout to the correct layout VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, then copy
-  // the buffer to the image, and then transition the image to the final layout VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
-  transitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-  copyBufferToImage(staging_buffer.getBuffer(), texture_image, static_cast<uint32_t>(texture_width), static_cast<uint32_t>(texture_height));
-  transitionImageLayout(texture_image, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
-
-  // Cleanup
-  staging_buffer.destroy();
-
   return texture_image;
 }
 
-void Texture::transitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout, VkImageLayout new_layout) {
-  VkCommandBuffer command_buffer = m_vulkan_handler->beginSingleTimeCommands();
-
-  VkPipelineStageFlags source_stage;
-  VkPipelineStageFlags destination_stage;
-
-  // Setup the barrier which we'll use to transition the image layout
-  VkImageMemoryBarrier barrier{};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.oldLayout = old_layout;
-  barrier.newLayout = new_layout;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.image = image;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = 1;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED && new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL && new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-
-    source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  } else {
-    Utils::exitWithMessage("unsupported layout transition!");
-  }
-
-  vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-  m_vulkan_handler->endSingleTimeCommands(command_buffer);
-}
-
-void Texture::copyBufferToImage(VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-  VkCommandBuffer command_buffer = m_vulkan_handler->beginSingleTimeCommands();
-
-  VkBufferImageCopy region{};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
-  region.imageOffset = {0, 0, 0};
-  region.imageExtent = {width, height, 1};
-
-  vkCmdCopyBufferToImage(command_buffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-  m_vulkan_handler->endSingleTimeCommands(command_buffer);
-}
-
 void Texture::createTextureImageView(VkImage image) {
   VkResult result;
 
@@ -153,10 +318,10 @@ void Texture::createTextureImageView(VkImage image) {
   image_view_create_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
   image_view_create_info.image = image;
   image_view_create_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  image_view_create_info.format = VK_FORMAT_R8G8B8A8_SRGB;
+  image_view_create_info.format = m_format;
   image_view_create_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
   image_view_create_info.subresourceRange.baseMipLevel = 0;
-  image_view_create_info.subresourceRange.levelCount = 1;
+  image_view_create_info.subresourceRange.levelCount = m_mip_levels;
   image_view_create_info.subresourceRange.baseArrayLayer = 0;
   image_view_create_info.subresourceRange.layerCount = 1;
 
@@ -182,7 +347,7 @@ void Texture::createTextureSampler() {
   sampler_create_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
   sampler_create_info.mipLodBias = 0.0f;
   sampler_create_info.minLod = 0.0f;
-  sampler_create_info.maxLod = 0.0f;
+  sampler_create_info.maxLod = static_cast<float>(m_mip_levels); // Allow sampling all mip levels
 
   // Check the max level of anisotropic filtering that the physical device supports
   VkPhysicalDeviceProperties properties{};
@@ -196,3 +361,5 @@ void Texture::createTextureSampler() {
 VkImageView Texture::getTextureImageView() { return m_texture_image_view; }
 
 VkSampler Texture::getTextureSampler() { return m_texture_sampler; }
+
+bool Texture::hasAlpha() { return m_has_alpha; }
@@ -0,0 +1,96 @@
+#include <xre/transient_attachments.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the attachments.
+// Arguments:
+//  1) Allocator for the memory of the attachments
+//  2) Size of the attachments (i.e. of the swapchain images)
+//  3) Format of the swapchain images
+//  4) Number of samples per pixel, the color attachment is only created if larger than 1
+//  5) Whether to create the depth attachment, i.e. the depth is not rendered into a depth swapchain
+//  6) Number of layers (one per view for multiview rendering)
+//------------------------------------------------------------------------------------------------------
+TransientAttachments::TransientAttachments(MemoryAllocator *allocator, VkExtent2D size, VkFormat color_format,
+                                           VkSampleCountFlagBits sample_count, bool transient_depth, uint32_t layer_count)
+    : m_device(allocator->getDevice()), m_allocator(allocator) {
+  if (transient_depth) {
+    m_depth = createAttachment(size, DEPTH_FORMAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_ASPECT_DEPTH_BIT, sample_count,
+                               layer_count);
+  }
+
+  if (sample_count != VK_SAMPLE_COUNT_1_BIT) {
+    m_color =
+        createAttachment(size, color_format, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, VK_IMAGE_ASPECT_COLOR_BIT, sample_count, layer_count);
+  }
+}
+
+void TransientAttachments::destroy() {
+  destroyAttachment(m_depth);
+  destroyAttachment(m_color);
+}
+
+VkImageView TransientAttachments::getDepthImageView() { return m_depth.image_view; }
+
+VkImageView TransientAttachments::getColorImageView() { return m_color.image_view; }
+
+bool TransientAttachments::isLazilyAllocated() { return m_lazily_allocated; }
+
+TransientAttachments::Attachment TransientAttachments::createAttachment(VkExtent2D size, VkFormat format, VkImageUsageFlags usage,
+                                                                        VkImageAspectFlags aspect, VkSampleCountFlagBits sample_count,
+                                                                        uint32_t layer_count) {
+  VkResult result;
+  Attachment attachment;
+
+  // Create the image, which is only ever used as an attachment
+  VkImageCreateInfo image_create_info{VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+  image_create_info.imageType = VK_IMAGE_TYPE_2D;
+  image_create_info.extent = {size.width, size.height, 1};
+  image_create_info.mipLevels = 1;
+  image_create_info.arrayLayers = layer_count;
+  image_create_info.format = format;
+  image_create_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_create_info.usage = usage | VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  image_create_info.samples = sample_count;
+  result = vkCreateImage(m_device, &image_create_info, nullptr, &attachment.image);
+  Utils::checkVkResult(result, "Failed to create transient attachment image");
+
+  // Prefer lazily allocated memory, which might never be backed by actual memory as the contents stay
+  // in the tile memory. Attachments are created once and live as long as the session, so the linear
+  // strategy is sufficient.
+  VkMemoryRequirements memory_requirements;
+  vkGetImageMemoryRequirements(m_device, attachment.image, &memory_requirements);
+
+  VkMemoryPropertyFlags memory_properties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+  if (m_allocator->hasMemoryType(memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+    memory_properties |= VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT;
+    m_lazily_allocated = true;
+  }
+
+  attachment.allocation = m_allocator->allocate(memory_requirements, memory_properties, AllocationKind::IMAGE, AllocationStrategy::LINEAR);
+  result = vkBindImageMemory(m_device, attachment.image, attachment.allocation.memory, attachment.allocation.offset);
+  Utils::checkVkResult(result, "Failed to bind memory of transient attachment");
+
+  // With multiple layers (multiview rendering), each layer of the image is rendered by one view
+  VkImageViewCreateInfo image_view_create_info{VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+  image_view_create_info.image = attachment.image;
+  image_view_create_info.format = format;
+  image_view_create_info.viewType = layer_count > 1u ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D;
+  image_view_create_info.subresourceRange.aspectMask = aspect;
+  image_view_create_info.subresourceRange.levelCount = 1;
+  image_view_create_info.subresourceRange.layerCount = layer_count;
+  result = vkCreateImageView(m_device, &image_view_create_info, nullptr, &attachment.image_view);
+  Utils::checkVkResult(result, "Failed to create image view for transient attachment");
+
+  return attachment;
+}
+
+void TransientAttachments::destroyAttachment(Attachment &attachment) {
+  if (attachment.image == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vkDestroyImageView(m_device, attachment.image_view, nullptr);
+  vkDestroyImage(m_device, attachment.image, nullptr);
+  m_allocator->free(attachment.allocation);
+  attachment = {};
+}
@@ -0,0 +1,67 @@
+#include <xre/uniform_arena.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the arena.
+// Arguments:
+//  1) Allocator to get the memory from
+//  2) Number of bytes available per frame
+//  3) Number of frames which can be in flight at the same time
+//------------------------------------------------------------------------------------------------------
+UniformArena::UniformArena(MemoryAllocator *allocator, VkDeviceSize frame_region_size, uint32_t frame_count) {
+  // All offsets we hand out are used as dynamic uniform buffer offsets, so they need to respect
+  // minUniformBufferOffsetAlignment (which is guaranteed to be a power of two).
+  VkPhysicalDeviceProperties properties{};
+  vkGetPhysicalDeviceProperties(allocator->getPhysicalDevice(), &properties);
+  m_alignment = properties.limits.minUniformBufferOffsetAlignment;
+
+  m_frame_region_size = (frame_region_size + m_alignment - 1) & ~(m_alignment - 1);
+  m_frame_count = frame_count;
+
+  // Create the buffer and keep it mapped for its whole lifetime. The memory is host coherent, so
+  // we don't need to flush the writes.
+  m_buffer = new Buffer(allocator, m_frame_region_size * frame_count, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  m_mapped_data = static_cast<uint8_t *>(m_buffer->mapPersistently());
+}
+
+void UniformArena::destroy() {
+  m_buffer->destroy();
+  delete m_buffer;
+  m_buffer = nullptr;
+  m_mapped_data = nullptr;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Start recording into the region of the given frame. The caller has to make sure that the GPU
+// is done with the previous frame which used the same region (i.e. waited on its fence).
+//------------------------------------------------------------------------------------------------------
+void UniformArena::beginFrame(uint32_t frame_index) {
+  assert(frame_index < m_frame_count);
+
+  m_region_start = frame_index * m_frame_region_size;
+  m_region_offset = 0u;
+}
+
+uint32_t UniformArena::push(const void *data, VkDeviceSize size) {
+  VkDeviceSize aligned_size = (size + m_alignment - 1) & ~(m_alignment - 1);
+
+  if (m_region_offset + aligned_size > m_frame_region_size) {
+    Utils::exitWithMessage("Uniform arena is full, increase VulkanHandler::UNIFORM_ARENA_FRAME_SIZE (currently " +
+                           std::to_string(m_frame_region_size) + " bytes per frame)");
+  }
+
+  VkDeviceSize offset = m_region_start + m_region_offset;
+  memcpy(m_mapped_data + offset, data, size);
+
+  m_region_offset += aligned_size;
+  m_high_watermark = std::max(m_high_watermark, m_region_offset);
+
+  return static_cast<uint32_t>(offset);
+}
+
+VkBuffer UniformArena::getBuffer() { return m_buffer->getBuffer(); }
+
+VkDeviceSize UniformArena::getAlignment() { return m_alignment; }
+
+VkDeviceSize UniformArena::getFrameRegionSize() { return m_frame_region_size; }
+
+VkDeviceSize UniformArena::getHighWatermark() { return m_high_watermark; }
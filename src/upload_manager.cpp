@@ -0,0 +1,422 @@
+#include <xre/upload_manager.h>
+
+//------------------------------------------------------------------------------------------------------
+// Create the upload manager.
+// Arguments:
+//  1) Allocator to get the staging memory from
+//  2) Queue to submit the uploads to (the graphics queue, such that no ownership transfer is needed)
+//  3) Index of the queue family of the queue
+//  4) Size of the staging ring in bytes
+//------------------------------------------------------------------------------------------------------
+UploadManager::UploadManager(MemoryAllocator *allocator, VkQueue queue, uint32_t queue_family_index, VkDeviceSize staging_size) {
+  VkResult result;
+
+  m_device = allocator->getDevice();
+  m_allocator = allocator;
+  m_queue = queue;
+  m_staging_size = staging_size;
+
+  // Command pool for the batches. Command buffers are freed individually once their batch is done.
+  VkCommandPoolCreateInfo pool_create_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+  pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+  pool_create_info.queueFamilyIndex = queue_family_index;
+  result = vkCreateCommandPool(m_device, &pool_create_info, nullptr, &m_command_pool);
+  Utils::checkVkResult(result, "Failed to create the upload command pool");
+
+  // Timeline semaphore, which is signalled with an increasing value for each submitted batch
+  VkSemaphoreTypeCreateInfo semaphore_type_create_info{VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+  semaphore_type_create_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+  semaphore_type_create_info.initialValue = 0u;
+
+  VkSemaphoreCreateInfo semaphore_create_info{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+  semaphore_create_info.pNext = &semaphore_type_create_info;
+  result = vkCreateSemaphore(m_device, &semaphore_create_info, nullptr, &m_timeline_semaphore);
+  Utils::checkVkResult(result, "Failed to create the upload timeline semaphore");
+
+  // Staging ring, which stays mapped for the whole lifetime of the manager
+  m_staging_buffer = new Buffer(m_allocator, m_staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+  m_staging_data = static_cast<uint8_t *>(m_staging_buffer->mapPersistently());
+}
+
+void UploadManager::destroy() {
+  flush();
+  wait(m_last_submitted_value);
+  reclaimCompletedBatches();
+
+  m_staging_buffer->destroy();
+  delete m_staging_buffer;
+
+  vkDestroySemaphore(m_device, m_timeline_semaphore, nullptr);
+  vkDestroyCommandPool(m_device, m_command_pool, nullptr);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Uploads
+//------------------------------------------------------------------------------------------------------
+// Copy data into a (device local) buffer, which needs to have been created with VK_BUFFER_USAGE_TRANSFER_DST_BIT
+void UploadManager::uploadBuffer(Buffer *destination, const void *data, VkDeviceSize size, VkDeviceSize destination_offset) {
+  if (size == 0u) {
+    return;
+  }
+
+  VkDeviceSize staging_offset;
+  VkBuffer staging_buffer = stage(data, size, staging_offset);
+
+  VkBufferCopy copy_region{};
+  copy_region.srcOffset = staging_offset;
+  copy_region.dstOffset = destination_offset;
+  copy_region.size = size;
+
+  vkCmdCopyBuffer(getCommandBuffer(), staging_buffer, destination->getBuffer(), 1u, &copy_region);
+}
+
+// Copy pixel data into the first mip level of a color image which is in VK_IMAGE_LAYOUT_UNDEFINED, and
+// generate the remaining levels by blitting each level into the next one (which needs a format supporting
+// linear filtered blits). The image is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+void UploadManager::uploadImage(VkImage destination, uint32_t width, uint32_t height, const void *data, VkDeviceSize size,
+                                uint32_t mip_levels) {
+  VkDeviceSize staging_offset;
+  VkBuffer staging_buffer = stage(data, size, staging_offset);
+  VkCommandBuffer command_buffer = getCommandBuffer();
+
+  // Transition the image layout to VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, such that we can copy into it
+  VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = destination;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+
+  // Copy the pixels
+  VkBufferImageCopy region{};
+  region.bufferOffset = staging_offset;
+  region.bufferRowLength = 0;
+  region.bufferImageHeight = 0;
+  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  region.imageSubresource.mipLevel = 0;
+  region.imageSubresource.baseArrayLayer = 0;
+  region.imageSubresource.layerCount = 1;
+  region.imageOffset = {0, 0, 0};
+  region.imageExtent = {width, height, 1};
+
+  vkCmdCopyBufferToImage(command_buffer, staging_buffer, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+  if (mip_levels > 1u) {
+    generateMipmaps(command_buffer, destination, width, height, mip_levels);
+    return;
+  }
+
+  // And transition the image to the layout in which it is sampled
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+}
+
+// Copy all mip levels of an image which is in VK_IMAGE_LAYOUT_UNDEFINED, e.g. block-compressed data which
+// can't be blitted. The level offsets are relative to the data, and need to be aligned to the texel block
+// size of the format. The caller has to make sure that each level holds all of its blocks, as the copy
+// reads them unchecked. The image is left in VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+void UploadManager::uploadImageLevels(VkImage destination, uint32_t width, uint32_t height, const void *data, VkDeviceSize size,
+                                      const std::vector<VkDeviceSize> &level_offsets) {
+  VkDeviceSize staging_offset;
+  VkBuffer staging_buffer = stage(data, size, staging_offset);
+  VkCommandBuffer command_buffer = getCommandBuffer();
+
+  const uint32_t mip_levels = static_cast<uint32_t>(level_offsets.size());
+
+  VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = destination;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.srcAccessMask = 0;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+
+  // One copy per level, the extents of the smaller levels don't need to be a multiple of the block size
+  std::vector<VkBufferImageCopy> regions(mip_levels);
+  for (uint32_t level = 0u; level < mip_levels; level++) {
+    VkBufferImageCopy &region = regions[level];
+    region.bufferOffset = staging_offset + level_offsets[level];
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = level;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {std::max(width >> level, 1u), std::max(height >> level, 1u), 1};
+  }
+
+  vkCmdCopyBufferToImage(command_buffer, staging_buffer, destination, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels, regions.data());
+
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+}
+
+// Fill the mip levels of an image from its first level, which all need to be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL.
+// Each level is read once it has been written, and then transitioned to VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL.
+void UploadManager::generateMipmaps(VkCommandBuffer command_buffer, VkImage image, uint32_t width, uint32_t height, uint32_t mip_levels) {
+  VkImageMemoryBarrier barrier{VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.levelCount = 1;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  int32_t level_width = static_cast<int32_t>(width);
+  int32_t level_height = static_cast<int32_t>(height);
+
+  for (uint32_t level = 1u; level < mip_levels; level++) {
+    // The previous level has been written, and is the source of the blit now
+    barrier.subresourceRange.baseMipLevel = level - 1u;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                         &barrier);
+
+    int32_t next_width = std::max(level_width / 2, 1);
+    int32_t next_height = std::max(level_height / 2, 1);
+
+    VkImageBlit blit{};
+    blit.srcOffsets[0] = {0, 0, 0};
+    blit.srcOffsets[1] = {level_width, level_height, 1};
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = level - 1u;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+    blit.dstOffsets[0] = {0, 0, 0};
+    blit.dstOffsets[1] = {next_width, next_height, 1};
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = level;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    // The previous level is done
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr,
+                         1, &barrier);
+
+    level_width = next_width;
+    level_height = next_height;
+  }
+
+  // The last level is only written
+  barrier.subresourceRange.baseMipLevel = mip_levels - 1u;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                       &barrier);
+}
+
+//------------------------------------------------------------------------------------------------------
+// Submission
+//------------------------------------------------------------------------------------------------------
+// Submit all uploads recorded so far as a single batch. Returns the timeline value which is signalled
+// once the batch is done (which is the last submitted value if there was nothing to submit).
+uint64_t UploadManager::flush() {
+  reclaimCompletedBatches();
+
+  if (m_command_buffer == VK_NULL_HANDLE) {
+    return m_last_submitted_value;
+  }
+
+  VkResult result = vkEndCommandBuffer(m_command_buffer);
+  Utils::checkVkResult(result, "Failed to record upload command buffer");
+
+  Batch batch{};
+  batch.command_buffer = m_command_buffer;
+  batch.timeline_value = submit(m_command_buffer);
+  batch.staging_end = m_head;
+  batch.own_buffers = std::move(m_own_buffers);
+  m_pending_batches.push_back(std::move(batch));
+
+  m_command_buffer = VK_NULL_HANDLE;
+  m_own_buffers.clear();
+
+  return m_last_submitted_value;
+}
+
+// Submit a recorded command buffer, signalling the next value of the timeline semaphore
+uint64_t UploadManager::submit(VkCommandBuffer command_buffer) {
+  uint64_t signal_value = m_last_submitted_value + 1u;
+
+  VkTimelineSemaphoreSubmitInfo timeline_submit_info{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+  timeline_submit_info.signalSemaphoreValueCount = 1u;
+  timeline_submit_info.pSignalSemaphoreValues = &signal_value;
+
+  VkSubmitInfo submit_info{VK_STRUCTURE_TYPE_SUBMIT_INFO};
+  submit_info.pNext = &timeline_submit_info;
+  submit_info.commandBufferCount = 1u;
+  submit_info.pCommandBuffers = &command_buffer;
+  submit_info.signalSemaphoreCount = 1u;
+  submit_info.pSignalSemaphores = &m_timeline_semaphore;
+
+  VkResult result = vkQueueSubmit(m_queue, 1u, &submit_info, VK_NULL_HANDLE);
+  Utils::checkVkResult(result, "Failed to submit uploads");
+
+  m_last_submitted_value = signal_value;
+  return signal_value;
+}
+
+// Block until the timeline semaphore reached the given value
+void UploadManager::wait(uint64_t value) {
+  VkSemaphoreWaitInfo wait_info{VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+  wait_info.semaphoreCount = 1u;
+  wait_info.pSemaphores = &m_timeline_semaphore;
+  wait_info.pValues = &value;
+
+  VkResult result = vkWaitSemaphores(m_device, &wait_info, UINT64_MAX);
+  Utils::checkVkResult(result, "Failed to wait for uploads");
+}
+
+VkSemaphore UploadManager::getTimelineSemaphore() { return m_timeline_semaphore; }
+
+uint64_t UploadManager::getLastSubmittedValue() { return m_last_submitted_value; }
+
+//------------------------------------------------------------------------------------------------------
+// Internals
+//------------------------------------------------------------------------------------------------------
+// Returns the command buffer of the current batch, beginning a new batch if needed
+VkCommandBuffer UploadManager::getCommandBuffer() {
+  if (m_command_buffer != VK_NULL_HANDLE) {
+    return m_command_buffer;
+  }
+
+  VkCommandBufferAllocateInfo allocate_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+  allocate_info.commandPool = m_command_pool;
+  allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocate_info.commandBufferCount = 1u;
+
+  VkResult result = vkAllocateCommandBuffers(m_device, &allocate_info, &m_command_buffer);
+  Utils::checkVkResult(result, "Failed to allocate upload command buffer");
+
+  VkCommandBufferBeginInfo begin_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  result = vkBeginCommandBuffer(m_command_buffer, &begin_info);
+  Utils::checkVkResult(result, "Failed to begin upload command buffer");
+
+  return m_command_buffer;
+}
+
+// Copy the data into staging memory, and return the staging buffer and the offset of the data in it
+VkBuffer UploadManager::stage(const void *data, VkDeviceSize size, VkDeviceSize &offset) {
+  // Data which would not even fit into an empty ring gets its own staging buffer
+  if (size > m_staging_size) {
+    Buffer *own_buffer = new Buffer(m_allocator, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    memcpy(own_buffer->mapPersistently(), data, size);
+    m_own_buffers.push_back(own_buffer);
+
+    // Make sure the batch exists, such that the buffer is freed with it
+    getCommandBuffer();
+
+    offset = 0u;
+    return own_buffer->getBuffer();
+  }
+
+  // If the ring is full, submit what we have and wait for the oldest batches to free up space
+  while (!allocateStaging(size, offset)) {
+    flush();
+    assert(!m_pending_batches.empty());
+    wait(m_pending_batches.front().timeline_value);
+    reclaimCompletedBatches();
+  }
+
+  memcpy(m_staging_data + offset, data, size);
+  return m_staging_buffer->getBuffer();
+}
+
+bool UploadManager::allocateStaging(VkDeviceSize size, VkDeviceSize &offset) {
+  VkDeviceSize aligned_size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+  if (m_ring_empty) {
+    m_head = 0u;
+    m_tail = 0u;
+  }
+
+  if (m_ring_empty || m_head > m_tail) {
+    // Free space is at the end of the ring and, after wrapping around, in front of the tail
+    if (m_staging_size - m_head >= aligned_size) {
+      offset = m_head;
+    } else if (m_tail >= aligned_size) {
+      offset = 0u;
+    } else {
+      return false;
+    }
+  } else if (m_head < m_tail && m_tail - m_head >= aligned_size) {
+    // Free space is between the head and the tail
+    offset = m_head;
+  } else {
+    return false;
+  }
+
+  m_head = offset + aligned_size;
+  m_ring_empty = false;
+  return true;
+}
+
+// Release the resources of all batches the GPU is done with
+void UploadManager::reclaimCompletedBatches() {
+  uint64_t completed_value;
+  VkResult result = vkGetSemaphoreCounterValue(m_device, m_timeline_semaphore, &completed_value);
+  Utils::checkVkResult(result, "Failed to get the upload timeline semaphore value");
+
+  while (!m_pending_batches.empty() && m_pending_batches.front().timeline_value <= completed_value) {
+    Batch &batch = m_pending_batches.front();
+
+    vkFreeCommandBuffers(m_device, m_command_pool, 1u, &batch.command_buffer);
+    for (Buffer *own_buffer : batch.own_buffers) {
+      own_buffer->destroy();
+      delete own_buffer;
+    }
+
+    m_tail = batch.staging_end;
+    m_pending_batches.pop_front();
+  }
+
+  // Everything is free if no batch (submitted or currently recorded) uses the ring anymore
+  if (m_pending_batches.empty() && m_command_buffer == VK_NULL_HANDLE) {
+    m_ring_empty = true;
+  }
+}
@@ -1,9 +1,16 @@
 #include <xre/vulkan_handler.h>
+#include <xre/scene_node.h>
 
-VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, const char *application_name) {
+VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, const char *application_name, bool request_multiview,
+                             uint32_t recommended_sample_count, bool request_depth_store, uint32_t frames_in_flight) {
   VkResult result;
   XrResult xr_result;
 
+  // All per-frame resources are sized by the number of frames in flight
+  Utils::checkBoolResult(frames_in_flight > 0u, "At least one frame has to be in flight");
+  m_frames_in_flight = frames_in_flight;
+  m_frames.resize(m_frames_in_flight);
+
   //------------------------------------------------------------------------------------------------------
   // Retrieve the needed extensions
   //------------------------------------------------------------------------------------------------------
@@ -65,7 +72,7 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   vulkan_app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
   vulkan_app_info.pEngineName = "XRe";
   vulkan_app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  vulkan_app_info.apiVersion = VK_API_VERSION_1_0;
+  vulkan_app_info.apiVersion = VK_API_VERSION_1_2; // Multiview is core since Vulkan 1.1, timeline semaphores since 1.2
 
   // Next, setup the info struct to create the vulkan instance. First,
   // add some basic data.
@@ -122,6 +129,11 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
 
   Utils::checkBoolResult(queue_family_index_found, "Failed to find graphics queue for physical device!");
 
+  // Timestamps are needed to measure the GPU time of the frames, which not all queues support
+  uint32_t timestamp_valid_bits = queue_families[m_queue_family_index].timestampValidBits;
+  m_gpu_timing_enabled = timestamp_valid_bits > 0u;
+  m_timestamp_mask = timestamp_valid_bits >= 64u ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1ull;
+
   PFN_xrGetVulkanDeviceExtensionsKHR ext_xrGetVulkanDeviceExtensionsKHR;
   xr_result =
       xrGetInstanceProcAddr(xr_instance, "xrGetVulkanDeviceExtensionsKHR", (PFN_xrVoidFunction *)(&ext_xrGetVulkanDeviceExtensionsKHR));
@@ -167,6 +179,15 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
     Utils::checkBoolResult(extensionSupported, "Required Vulkan device extensions not supported");
   }
 
+  // Optionally enable pipeline creation feedback, which we use to count pipeline cache hits
+  for (const VkExtensionProperties &supportedExtension : supportedVulkanDeviceExtensions) {
+    if (strcmp(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME, supportedExtension.extensionName) == 0) {
+      vulkanDeviceExtensions.push_back(VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME);
+      m_pipeline_creation_feedback_enabled = true;
+      break;
+    }
+  }
+
   // Create device
   float queue_priority = 1.0f;
 
@@ -194,9 +215,103 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
     Utils::exitWithMessage("Required Vulkan physical device feature \"samplerAnisotropy\" not supported");
   }
 
+  VkPhysicalDeviceProperties device_properties;
+  vkGetPhysicalDeviceProperties(m_physical_device, &device_properties);
+  if (device_properties.apiVersion < VK_API_VERSION_1_2) {
+    Utils::exitWithMessage("Vulkan 1.2 is required but not supported by the physical device");
+  }
+
+  m_timestamp_period = device_properties.limits.timestampPeriod;
+
+  // Use the highest sample count up to the recommended one which the device supports for both color and depth
+  VkSampleCountFlags supported_sample_counts =
+      device_properties.limits.framebufferColorSampleCounts & device_properties.limits.framebufferDepthSampleCounts;
+  uint32_t requested_sample_count = USE_MSAA ? std::min(recommended_sample_count, MAX_MSAA_SAMPLES) : 1u;
+  for (uint32_t sample_count = requested_sample_count; sample_count > 1u; sample_count--) {
+    if ((sample_count & (sample_count - 1u)) == 0u && (supported_sample_counts & sample_count)) {
+      m_sample_count = static_cast<VkSampleCountFlagBits>(sample_count);
+      break;
+    }
+  }
+
+  // The depth can only be submitted to the compositor without MSAA, as it would need to be resolved otherwise
+  m_depth_store_enabled = request_depth_store && m_sample_count == VK_SAMPLE_COUNT_1_BIT;
+
+  VkPhysicalDeviceVulkan11Features supported_vulkan_11_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+  VkPhysicalDeviceVulkan12Features supported_vulkan_12_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  supported_vulkan_11_features.pNext = &supported_vulkan_12_features;
+  VkPhysicalDeviceFeatures2 supported_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+  supported_features.pNext = &supported_vulkan_11_features;
+  vkGetPhysicalDeviceFeatures2(m_physical_device, &supported_features);
+
+  // The shaders use `gl_ViewIndex` to select the view projection matrix, which needs the multiview feature
+  // enabled on the device, even if we then end up rendering each eye in a separate render pass.
+  if (!supported_vulkan_11_features.multiview) {
+    Utils::exitWithMessage("Required Vulkan physical device feature \"multiview\" not supported");
+  }
+
+  // Uploads signal their completion with a timeline semaphore
+  if (!supported_vulkan_12_features.timelineSemaphore) {
+    Utils::exitWithMessage("Required Vulkan physical device feature \"timelineSemaphore\" not supported");
+  }
+
+  // GPU culling writes the draws into indirect buffers, with the index of the object as first instance and
+  // the number of visible draws in a count buffer. Without these features, all draws are recorded directly.
+  m_gpu_culling_enabled = USE_GPU_CULLING && supported_vulkan_12_features.drawIndirectCount && features.multiDrawIndirect &&
+                          features.drawIndirectFirstInstance;
+  device_features.multiDrawIndirect = m_gpu_culling_enabled ? VK_TRUE : VK_FALSE;
+  device_features.drawIndirectFirstInstance = m_gpu_culling_enabled ? VK_TRUE : VK_FALSE;
+
+  // Pipeline statistics are optional, and only used by the GPU profiler
+  m_pipeline_statistics_enabled = USE_PIPELINE_STATISTICS && m_gpu_timing_enabled && features.pipelineStatisticsQuery;
+  device_features.pipelineStatisticsQuery = m_pipeline_statistics_enabled ? VK_TRUE : VK_FALSE;
+
+  // Compressed textures are optional, the textures fall back to their uncompressed images
+  m_texture_compression_bc_enabled = USE_COMPRESSED_TEXTURES && features.textureCompressionBC;
+  m_texture_compression_astc_enabled = USE_COMPRESSED_TEXTURES && features.textureCompressionASTC_LDR;
+  device_features.textureCompressionBC = m_texture_compression_bc_enabled ? VK_TRUE : VK_FALSE;
+  device_features.textureCompressionASTC_LDR = m_texture_compression_astc_enabled ? VK_TRUE : VK_FALSE;
+
+  // Bindless textures are sampled from a partially bound, update-after-bind array, with an index which is
+  // only uniform per draw (and not even that for merged indirect draws)
+  m_bindless_enabled = USE_BINDLESS_TEXTURES && supported_vulkan_12_features.runtimeDescriptorArray &&
+                       supported_vulkan_12_features.descriptorBindingPartiallyBound &&
+                       supported_vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind &&
+                       supported_vulkan_12_features.descriptorBindingUpdateUnusedWhilePending &&
+                       supported_vulkan_12_features.shaderSampledImageArrayNonUniformIndexing;
+
+  VkPhysicalDeviceVulkan12Features vulkan_12_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+  vulkan_12_features.timelineSemaphore = VK_TRUE;
+  vulkan_12_features.drawIndirectCount = m_gpu_culling_enabled ? VK_TRUE : VK_FALSE;
+  vulkan_12_features.runtimeDescriptorArray = m_bindless_enabled ? VK_TRUE : VK_FALSE;
+  vulkan_12_features.descriptorBindingPartiallyBound = m_bindless_enabled ? VK_TRUE : VK_FALSE;
+  vulkan_12_features.descriptorBindingSampledImageUpdateAfterBind = m_bindless_enabled ? VK_TRUE : VK_FALSE;
+  vulkan_12_features.descriptorBindingUpdateUnusedWhilePending = m_bindless_enabled ? VK_TRUE : VK_FALSE;
+  vulkan_12_features.shaderSampledImageArrayNonUniformIndexing = m_bindless_enabled ? VK_TRUE : VK_FALSE;
+
+  VkPhysicalDeviceVulkan11Features vulkan_11_features{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+  vulkan_11_features.multiview = VK_TRUE;
+  vulkan_11_features.pNext = &vulkan_12_features;
+
+  // Only render both eyes in a single pass if the caller asked for it and the device supports
+  // enough views in a single render pass instance.
+  VkPhysicalDeviceMultiviewProperties multiview_properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MULTIVIEW_PROPERTIES};
+  VkPhysicalDeviceVulkan12Properties vulkan_12_properties{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+  multiview_properties.pNext = &vulkan_12_properties;
+  VkPhysicalDeviceProperties2 device_properties_2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+  device_properties_2.pNext = &multiview_properties;
+  vkGetPhysicalDeviceProperties2(m_physical_device, &device_properties_2);
+  m_multiview_enabled = request_multiview && multiview_properties.maxMultiviewViewCount >= MULTIVIEW_VIEW_COUNT;
+
+  // The texture array is limited by the number of update-after-bind samplers and sampled images per stage
+  m_bindless_capacity = std::min({MAX_BINDLESS_TEXTURES, vulkan_12_properties.maxPerStageDescriptorUpdateAfterBindSamplers,
+                                  vulkan_12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                                  vulkan_12_properties.maxDescriptorSetUpdateAfterBindSampledImages});
+
   // Create the logical device
   VkDeviceCreateInfo device_create_info{};
   device_create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  device_create_info.pNext = &vulkan_11_features;
 
   // add infos about the device queues we want to create
   device_create_info.queueCreateInfoCount = 1;
@@ -213,6 +328,9 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   result = vkCreateDevice(m_physical_device, &device_create_info, nullptr, &m_device);
   Utils::checkVkResult(result, "failed to create logical device!");
 
+  // All device memory is allocated through the memory allocator
+  m_memory_allocator = new MemoryAllocator(m_device, m_physical_device);
+
   // Check graphics requirements for Vulkan
   PFN_xrGetVulkanGraphicsRequirementsKHR getVulkanGraphicsRequirementsKHR = nullptr;
   xr_result = xrGetInstanceProcAddr(xr_instance, "xrGetVulkanGraphicsRequirementsKHR",
@@ -230,15 +348,19 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   //------------------------------------------------------------------------------------------------------
   // Render pass
   //------------------------------------------------------------------------------------------------------
-  // We only have a single color buffer attachment (represented by one of the images from the swapchain)
+  // Without MSAA, we render directly into the color buffer attachment (represented by one of the images from
+  // the swapchain). With MSAA, we render into a multisampled transient attachment, which is never stored but
+  // resolved into the swapchain image at the end of the subpass.
+  const bool msaa_enabled = m_sample_count != VK_SAMPLE_COUNT_1_BIT;
+
   VkAttachmentDescription color_attachment{};
   color_attachment.format = USED_COLOR_FORMAT;
-  color_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  color_attachment.samples = m_sample_count;
   color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color_attachment.storeOp = msaa_enabled ? VK_ATTACHMENT_STORE_OP_DONT_CARE : VK_ATTACHMENT_STORE_OP_STORE;
   color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  color_attachment.initialLayout = msaa_enabled ? VK_IMAGE_LAYOUT_UNDEFINED : VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
   color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
   // Setup a reference to the color attachment we created beforehand
@@ -246,12 +368,12 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   color_attachment_reference.attachment = 0;
   color_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
 
-  // And we have a single depth buffer attachment
+  // And we have a single depth buffer attachment, which is only stored if it's submitted to the compositor
   VkAttachmentDescription depth_attachment{};
-  depth_attachment.format = VK_FORMAT_D32_SFLOAT;
-  depth_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  depth_attachment.format = TransientAttachments::DEPTH_FORMAT;
+  depth_attachment.samples = m_sample_count;
   depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depth_attachment.storeOp = m_depth_store_enabled ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -262,24 +384,46 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   depth_attachment_reference.attachment = 1;
   depth_attachment_reference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
 
+  // With MSAA, the swapchain image is the resolve attachment. Its previous contents are overwritten
+  // completely by the resolve, so they don't need to be loaded.
+  VkAttachmentDescription resolve_attachment{};
+  resolve_attachment.format = USED_COLOR_FORMAT;
+  resolve_attachment.samples = VK_SAMPLE_COUNT_1_BIT;
+  resolve_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  resolve_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  resolve_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  resolve_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  resolve_attachment.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  resolve_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference resolve_attachment_reference{};
+  resolve_attachment_reference.attachment = 2;
+  resolve_attachment_reference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
   // We're only using a single render pass
   VkSubpassDescription subpass_description{};
   subpass_description.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
   subpass_description.colorAttachmentCount = 1;
   subpass_description.pColorAttachments = &color_attachment_reference;
   subpass_description.pDepthStencilAttachment = &depth_attachment_reference;
+  subpass_description.pResolveAttachments = msaa_enabled ? &resolve_attachment_reference : nullptr;
 
-  // Create render subpass dependency
+  // Create render subpass dependency. The transient attachments are shared by all swapchain images, so
+  // the writes of the previous frame need to be done before we clear them again.
   VkSubpassDependency dependency{};
   dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
   dependency.dstSubpass = 0;
   dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-  dependency.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
   dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
   dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
   // Create the render pass
-  std::array<VkAttachmentDescription, 2> attachments = {color_attachment, depth_attachment};
+  std::vector<VkAttachmentDescription> attachments = {color_attachment, depth_attachment};
+  if (msaa_enabled) {
+    attachments.push_back(resolve_attachment);
+  }
+
   VkRenderPassCreateInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
   renderPassInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
@@ -289,28 +433,85 @@ VulkanHandler::VulkanHandler(XrInstance xr_instance, XrSystemId xr_system_id, co
   renderPassInfo.dependencyCount = 1;
   renderPassInfo.pDependencies = &dependency;
 
+  // In multiview mode, the subpass is broadcast to all views (i.e. all layers of the attachments), and
+  // the views are correlated as they're rendered from almost the same position.
+  const uint32_t view_mask = (1u << MULTIVIEW_VIEW_COUNT) - 1u;
+  VkRenderPassMultiviewCreateInfo render_pass_multiview_info{VK_STRUCTURE_TYPE_RENDER_PASS_MULTIVIEW_CREATE_INFO};
+  render_pass_multiview_info.subpassCount = 1;
+  render_pass_multiview_info.pViewMasks = &view_mask;
+  render_pass_multiview_info.correlationMaskCount = 1;
+  render_pass_multiview_info.pCorrelationMasks = &view_mask;
+
+  if (m_multiview_enabled) {
+    renderPassInfo.pNext = &render_pass_multiview_info;
+  }
+
   result = vkCreateRenderPass(m_device, &renderPassInfo, nullptr, &m_render_pass);
   Utils::checkVkResult(result, "Failed to create render pass");
 }
 
+VulkanHandler::~VulkanHandler() {
+  // Stops the recording threads, which are otherwise waiting for work forever
+  stopRecordingThreads();
+  delete m_static_command_cache;
+}
+
+//------------------------------------------------------------------------------------------------------
+// Join the recording threads, e.g. before the CPU profiler trace is written. No frame can be rendered
+// with parallel recording afterwards.
+//------------------------------------------------------------------------------------------------------
+void VulkanHandler::stopRecordingThreads() {
+  if (!m_parallel_recorder) {
+    return;
+  }
+
+  // The command pools of the threads are destroyed, so the frames in flight have to finish first
+  vkDeviceWaitIdle(m_device);
+
+  delete m_parallel_recorder;
+  m_parallel_recorder = nullptr;
+}
+
 void VulkanHandler::setupRenderer() {
   VkResult result;
 
-  // Round up to minUniformBufferOffsetAlignment
-  VkDeviceSize model_uniform_buffer_object_size = sizeof(ModelUniformBufferObject);
-  VkPhysicalDeviceProperties properties{};
-  vkGetPhysicalDeviceProperties(m_physical_device, &properties);
-  VkDeviceSize min_alignment = properties.limits.minUniformBufferOffsetAlignment;
-  m_aligned_size = (model_uniform_buffer_object_size + min_alignment - 1) & ~(min_alignment - 1);
+  //------------------------------------------------------------------------------------------------------
+  // Pipeline cache
+  //------------------------------------------------------------------------------------------------------
+  // Load the pipeline cache before any material creates its pipeline
+  m_pipeline_cache = new PipelineCache(m_device, m_physical_device, PIPELINE_CACHE_FILE);
+
+  //------------------------------------------------------------------------------------------------------
+  // Uploads
+  //------------------------------------------------------------------------------------------------------
+  m_upload_manager = new UploadManager(m_memory_allocator, m_graphics_queue, m_queue_family_index, UPLOAD_STAGING_SIZE);
+  m_geometry_pool = new GeometryPool(m_memory_allocator, m_upload_manager, m_frames_in_flight);
+
+  // All materials get their pipelines through the registry, which creates them using the cache
+  m_pipeline_registry = new PipelineRegistry(
+      m_device, [this](VkShaderModule vertex_shader_module, VkShaderModule fragment_shader_module, const PipelineState &state) {
+        return createGraphicsPipeline(vertex_shader_module, fragment_shader_module, state);
+      });
+
+  //------------------------------------------------------------------------------------------------------
+  // GPU culling
+  //------------------------------------------------------------------------------------------------------
+  if (m_gpu_culling_enabled) {
+    m_gpu_culler = new GpuCuller(m_device, m_memory_allocator, m_pipeline_cache->getCache(), SHADERS_FOLDER "cull.comp.spv",
+                                 m_frames_in_flight);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Uniform buffer
   //------------------------------------------------------------------------------------------------------
-  // Create uniform buffer
-  m_uniform_buffer = createUniformBuffer();
+  // Create the arena for the per-draw uniform data, with a separate region for each frame in flight
+  m_uniform_arena = new UniformArena(m_memory_allocator, UNIFORM_ARENA_FRAME_SIZE, m_frames_in_flight);
 
-  // Create global uniform buffer
-  m_global_uniform_buffer = new Buffer(m_device, m_physical_device, sizeof(GlobalUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  // Create one global uniform buffer per frame in flight
+  for (FrameData &frame : m_frames) {
+    frame.global_uniform_buffer =
+        new Buffer(m_memory_allocator, sizeof(GlobalUniformBufferObject), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Descriptor set layouts
@@ -322,10 +523,18 @@ void VulkanHandler::setupRenderer() {
   global_ubo_layout_binding.descriptorCount = 1;
   global_ubo_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
 
+  // Object buffer of the GPU-driven path (set = 0), only used by the indirect shader variants
+  VkDescriptorSetLayoutBinding global_object_layout_binding{};
+  global_object_layout_binding.binding = 1;
+  global_object_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  global_object_layout_binding.descriptorCount = 1;
+  global_object_layout_binding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+
+  std::array<VkDescriptorSetLayoutBinding, 2> global_bindings = {global_ubo_layout_binding, global_object_layout_binding};
   VkDescriptorSetLayoutCreateInfo global_layout_create_info{};
   global_layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  global_layout_create_info.bindingCount = 1;
-  global_layout_create_info.pBindings = &global_ubo_layout_binding;
+  global_layout_create_info.bindingCount = static_cast<uint32_t>(global_bindings.size());
+  global_layout_create_info.pBindings = global_bindings.data();
 
   result = vkCreateDescriptorSetLayout(m_device, &global_layout_create_info, nullptr, &m_global_descriptor_set_layout);
   Utils::checkVkResult(result, "Failed to create global descriptor set layout");
@@ -345,7 +554,12 @@ void VulkanHandler::setupRenderer() {
   sampler_layout_binding.pImmutableSamplers = nullptr;
   sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-  std::array<VkDescriptorSetLayoutBinding, 2> bindings = {ubo_layout_binding, sampler_layout_binding};
+  // With push constants, the set only holds material data
+  std::vector<VkDescriptorSetLayoutBinding> bindings = {sampler_layout_binding};
+  if (!USE_PUSH_CONSTANTS) {
+    bindings.push_back(ubo_layout_binding);
+  }
+
   VkDescriptorSetLayoutCreateInfo layout_create_info{};
   layout_create_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
   layout_create_info.bindingCount = static_cast<uint32_t>(bindings.size());
@@ -354,68 +568,145 @@ void VulkanHandler::setupRenderer() {
   result = vkCreateDescriptorSetLayout(m_device, &layout_create_info, nullptr, &m_descriptor_set_layout);
   Utils::checkVkResult(result, "Failed to create the descriptor set layout");
 
+  // Bindless texture array (set = 2). Only the slots in use are written, and slots can be written while
+  // frames using other slots are still in flight.
+  if (m_bindless_enabled) {
+    VkDescriptorSetLayoutBinding bindless_layout_binding{};
+    bindless_layout_binding.binding = 0;
+    bindless_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindless_layout_binding.descriptorCount = m_bindless_capacity;
+    bindless_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+    VkDescriptorBindingFlags bindless_binding_flags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+                                                      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+                                                      VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo bindless_binding_flags_info{
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO};
+    bindless_binding_flags_info.bindingCount = 1u;
+    bindless_binding_flags_info.pBindingFlags = &bindless_binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo bindless_layout_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO};
+    bindless_layout_create_info.pNext = &bindless_binding_flags_info;
+    bindless_layout_create_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    bindless_layout_create_info.bindingCount = 1u;
+    bindless_layout_create_info.pBindings = &bindless_layout_binding;
+
+    result = vkCreateDescriptorSetLayout(m_device, &bindless_layout_create_info, nullptr, &m_bindless_descriptor_set_layout);
+    Utils::checkVkResult(result, "Failed to create the bindless descriptor set layout");
+  }
+
   //------------------------------------------------------------------------------------------------------
   // Descriptor pool
   //------------------------------------------------------------------------------------------------------
   // Create global descriptor pool
-  VkDescriptorPoolSize global_descriptor_pool_size{};
-  global_descriptor_pool_size.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  global_descriptor_pool_size.descriptorCount = 1;
+  std::array<VkDescriptorPoolSize, 2> global_descriptor_pool_sizes{};
+  global_descriptor_pool_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  global_descriptor_pool_sizes[0].descriptorCount = m_frames_in_flight;
+  global_descriptor_pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  global_descriptor_pool_sizes[1].descriptorCount = m_frames_in_flight;
 
   VkDescriptorPoolCreateInfo global_descriptor_pool_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-  global_descriptor_pool_create_info.poolSizeCount = 1;
-  global_descriptor_pool_create_info.pPoolSizes = &global_descriptor_pool_size;
-  global_descriptor_pool_create_info.maxSets = 1;
+  global_descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(global_descriptor_pool_sizes.size());
+  global_descriptor_pool_create_info.pPoolSizes = global_descriptor_pool_sizes.data();
+  global_descriptor_pool_create_info.maxSets = m_frames_in_flight;
 
   VkDescriptorPool global_descriptor_pool;
   result = vkCreateDescriptorPool(m_device, &global_descriptor_pool_create_info, nullptr, &global_descriptor_pool);
   Utils::checkVkResult(result, "Failed to create global descriptor pool");
 
-  // Create scene descriptor pool
-  std::array<VkDescriptorPoolSize, 2> poolSizes{};
-  poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-  poolSizes[0].descriptorCount = MAX_DESCRIPTORS;
-  poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  poolSizes[1].descriptorCount = MAX_DESCRIPTORS;
+  // Create the allocators of the material descriptor sets (set = 1), which chain more pools as needed
+  std::vector<VkDescriptorPoolSize> set_sizes(2);
+  set_sizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+  set_sizes[0].descriptorCount = 1u;
+  set_sizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  set_sizes[1].descriptorCount = 1u;
+
+  m_scene_descriptor_allocator = new DescriptorAllocator(m_device, "Scene", set_sizes, DESCRIPTOR_SETS_PER_POOL);
+  m_persistent_descriptor_allocator = new DescriptorAllocator(m_device, "Persistent", set_sizes, DESCRIPTOR_SETS_PER_POOL);
 
-  VkDescriptorPoolCreateInfo descriptor_pool_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
-  descriptor_pool_create_info.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
-  descriptor_pool_create_info.pPoolSizes = poolSizes.data();
-  descriptor_pool_create_info.maxSets = MAX_DESCRIPTORS;
+  // Each frame gets an allocator for transient sets, which is reset together with the rest of the frame
+  for (FrameData &frame : m_frames) {
+    frame.descriptor_allocator = new DescriptorAllocator(m_device, "Per-frame", set_sizes, FRAME_DESCRIPTOR_SETS_PER_POOL);
+  }
+
+  // Create the pool of the bindless texture array, which only ever holds that one set
+  if (m_bindless_enabled) {
+    VkDescriptorPoolSize bindless_pool_size{};
+    bindless_pool_size.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindless_pool_size.descriptorCount = m_bindless_capacity;
 
-  result = vkCreateDescriptorPool(m_device, &descriptor_pool_create_info, nullptr, &m_scene_descriptor_pool);
-  Utils::checkVkResult(result, "Failed to create scene descriptor pool");
+    VkDescriptorPoolCreateInfo bindless_pool_create_info{VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO};
+    bindless_pool_create_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    bindless_pool_create_info.poolSizeCount = 1u;
+    bindless_pool_create_info.pPoolSizes = &bindless_pool_size;
+    bindless_pool_create_info.maxSets = 1u;
 
-  // Create persistent descriptor pool
-  result = vkCreateDescriptorPool(m_device, &descriptor_pool_create_info, nullptr, &m_persistent_descriptor_pool);
-  Utils::checkVkResult(result, "Failed to create persistent descriptor pool");
+    result = vkCreateDescriptorPool(m_device, &bindless_pool_create_info, nullptr, &m_bindless_descriptor_pool);
+    Utils::checkVkResult(result, "Failed to create bindless descriptor pool");
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Descriptor set
   //------------------------------------------------------------------------------------------------------
-  // Allocate global descriptor set
-  VkDescriptorSetAllocateInfo global_descriptor_set_allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-  global_descriptor_set_allocate_info.descriptorPool = global_descriptor_pool;
-  global_descriptor_set_allocate_info.descriptorSetCount = 1;
-  global_descriptor_set_allocate_info.pSetLayouts = &m_global_descriptor_set_layout;
-
-  result = vkAllocateDescriptorSets(m_device, &global_descriptor_set_allocate_info, &m_global_descriptor_set);
-  Utils::checkVkResult(result, "Failed to allocate global descriptor set from pool");
+  // Allocate one global descriptor set per frame in flight
+  for (FrameData &frame : m_frames) {
+    VkDescriptorSetAllocateInfo global_descriptor_set_allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    global_descriptor_set_allocate_info.descriptorPool = global_descriptor_pool;
+    global_descriptor_set_allocate_info.descriptorSetCount = 1;
+    global_descriptor_set_allocate_info.pSetLayouts = &m_global_descriptor_set_layout;
+
+    result = vkAllocateDescriptorSets(m_device, &global_descriptor_set_allocate_info, &frame.global_descriptor_set);
+    Utils::checkVkResult(result, "Failed to allocate global descriptor set from pool");
+
+    VkDescriptorBufferInfo global_descriptor_buffer_info{};
+    global_descriptor_buffer_info.buffer = frame.global_uniform_buffer->getBuffer();
+    global_descriptor_buffer_info.offset = 0;
+    global_descriptor_buffer_info.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet global_write_descriptor_set{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    global_write_descriptor_set.dstSet = frame.global_descriptor_set;
+    global_write_descriptor_set.pBufferInfo = &global_descriptor_buffer_info;
+    global_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    global_write_descriptor_set.descriptorCount = 1;
+    global_write_descriptor_set.dstBinding = 0;
+    global_write_descriptor_set.dstArrayElement = 0;
+
+    vkUpdateDescriptorSets(m_device, 1, &global_write_descriptor_set, 0, nullptr);
+
+    // The object buffer is only needed (and only exists) if GPU culling is enabled
+    if (m_gpu_culler) {
+      uint32_t frame_index = static_cast<uint32_t>(&frame - m_frames.data());
+
+      VkDescriptorBufferInfo object_descriptor_buffer_info{};
+      object_descriptor_buffer_info.buffer = m_gpu_culler->getObjectBuffer(frame_index);
+      object_descriptor_buffer_info.offset = 0;
+      object_descriptor_buffer_info.range = VK_WHOLE_SIZE;
+
+      VkWriteDescriptorSet object_write_descriptor_set{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+      object_write_descriptor_set.dstSet = frame.global_descriptor_set;
+      object_write_descriptor_set.pBufferInfo = &object_descriptor_buffer_info;
+      object_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+      object_write_descriptor_set.descriptorCount = 1;
+      object_write_descriptor_set.dstBinding = 1;
+      object_write_descriptor_set.dstArrayElement = 0;
+
+      vkUpdateDescriptorSets(m_device, 1, &object_write_descriptor_set, 0, nullptr);
+    }
+  }
 
-  VkDescriptorBufferInfo global_descriptor_buffer_info{};
-  global_descriptor_buffer_info.buffer = m_global_uniform_buffer->getBuffer();
-  global_descriptor_buffer_info.offset = 0;
-  global_descriptor_buffer_info.range = VK_WHOLE_SIZE;
+  // In bindless mode, all materials share set 1, as it only holds the per-draw uniform data (if any)
+  if (m_bindless_enabled) {
+    VkDescriptorSetAllocateInfo bindless_descriptor_set_allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    bindless_descriptor_set_allocate_info.descriptorPool = m_bindless_descriptor_pool;
+    bindless_descriptor_set_allocate_info.descriptorSetCount = 1u;
+    bindless_descriptor_set_allocate_info.pSetLayouts = &m_bindless_descriptor_set_layout;
 
-  VkWriteDescriptorSet global_write_descriptor_set{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
-  global_write_descriptor_set.dstSet = m_global_descriptor_set;
-  global_write_descriptor_set.pBufferInfo = &global_descriptor_buffer_info;
-  global_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  global_write_descriptor_set.descriptorCount = 1;
-  global_write_descriptor_set.dstBinding = 0;
-  global_write_descriptor_set.dstArrayElement = 0;
+    result = vkAllocateDescriptorSets(m_device, &bindless_descriptor_set_allocate_info, &m_bindless_descriptor_set);
+    Utils::checkVkResult(result, "Failed to allocate bindless descriptor set from pool");
 
-  vkUpdateDescriptorSets(m_device, 1, &global_write_descriptor_set, 0, nullptr);
+    m_shared_descriptor_set = allocateDescriptorSet(VK_NULL_HANDLE, VK_NULL_HANDLE, true);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Pipeline layout
@@ -434,56 +725,80 @@ void VulkanHandler::setupRenderer() {
   Utils::checkVkResult(result, "Failed to create the command pool");
 
   //------------------------------------------------------------------------------------------------------
-  // Command buffer
+  // Per-frame command pools, command buffers and sync objects
   //------------------------------------------------------------------------------------------------------
-  VkCommandBufferAllocateInfo buffer_allocate_info{};
-  buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  buffer_allocate_info.commandPool = m_command_pool;
-  buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  buffer_allocate_info.commandBufferCount = 1u;
+  for (FrameData &frame : m_frames) {
+    // Each frame gets its own pool, such that the whole pool can be reset once the frame is done. The
+    // buffers of a pool are short-lived as they're re-recorded every frame.
+    VkCommandPoolCreateInfo frame_pool_create_info{VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    frame_pool_create_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    frame_pool_create_info.queueFamilyIndex = m_queue_family_index;
 
-  result = vkAllocateCommandBuffers(m_device, &buffer_allocate_info, &m_command_buffer);
-  Utils::checkVkResult(result, "Failed to allocate command buffers");
+    result = vkCreateCommandPool(m_device, &frame_pool_create_info, nullptr, &frame.command_pool);
+    Utils::checkVkResult(result, "Failed to create the per-frame command pool");
+
+    VkCommandBufferAllocateInfo buffer_allocate_info{};
+    buffer_allocate_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    buffer_allocate_info.commandPool = frame.command_pool;
+    buffer_allocate_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    buffer_allocate_info.commandBufferCount = 1u;
+
+    result = vkAllocateCommandBuffers(m_device, &buffer_allocate_info, &frame.command_buffer);
+    Utils::checkVkResult(result, "Failed to allocate command buffers");
+
+    // Create memory fence
+    VkFenceCreateInfo fence_create_info{};
+    fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    // Create the fence in the signalled state such that the first `vkWaitForFences` call
+    // does not block indefinitely.
+    fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+    result = vkCreateFence(m_device, &fence_create_info, nullptr, &frame.fence);
+    Utils::checkVkResult(result, "Failed to create fence");
+  }
 
   //------------------------------------------------------------------------------------------------------
-  // Sync objects
+  // Parallel command recording
   //------------------------------------------------------------------------------------------------------
-  // Create memory fence
-  VkFenceCreateInfo fence_create_info{};
-  fence_create_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  // Create the fence in the signalled state such that the first `vkWaitForFences` call
-  // does not block indefinitely.
-  fence_create_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-  result = vkCreateFence(m_device, &fence_create_info, nullptr, &m_fence);
-  Utils::checkVkResult(result, "Failed to create fence");
-}
-
-Buffer *VulkanHandler::createUniformBuffer() {
-  // Create uniform buffer
-  return new Buffer(m_device, m_physical_device, m_aligned_size * MAX_MODELS_IN_SCENE, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-}
+  // The main thread only waits while the workers record, so leave one core for the rest of the application
+  uint32_t recording_thread_count = std::min(std::thread::hardware_concurrency(), MAX_RECORDING_THREADS + 1u);
+  if (USE_PARALLEL_RECORDING && recording_thread_count > 2u) {
+    m_parallel_recorder = new ParallelRecorder(m_device, m_queue_family_index, recording_thread_count - 1u, m_frames_in_flight);
+  }
 
-VkDescriptorSet VulkanHandler::allocateDescriptorSet(Buffer *material_uniform_buffer, VkImageView texture_image_view,
-                                                     VkSampler texture_sampler, bool use_persistent_pool) {
-  VkDescriptorSetAllocateInfo descriptor_set_allocate_info{VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
-  descriptor_set_allocate_info.descriptorSetCount = 1u;
-  descriptor_set_allocate_info.pSetLayouts = &m_descriptor_set_layout;
+  //------------------------------------------------------------------------------------------------------
+  // Static command cache
+  //------------------------------------------------------------------------------------------------------
+  if (USE_STATIC_COMMAND_CACHE && USE_PUSH_CONSTANTS) {
+    m_static_command_cache = new StaticCommandCache(m_device, m_queue_family_index, m_frames_in_flight);
 
-  if (use_persistent_pool) {
-    descriptor_set_allocate_info.descriptorPool = m_persistent_descriptor_pool;
+    // The dynamic draws of frames with static subtrees have to be recorded into secondary command buffers
+    // as well, which needs at least a single worker thread
+    if (!m_parallel_recorder) {
+      m_parallel_recorder = new ParallelRecorder(m_device, m_queue_family_index, 1u, m_frames_in_flight);
+    }
   }
-  else {
-    descriptor_set_allocate_info.descriptorPool = m_scene_descriptor_pool;
+
+  //------------------------------------------------------------------------------------------------------
+  // GPU profiler
+  //------------------------------------------------------------------------------------------------------
+  // Queries of scopes inside a multiview render pass are broadcast to all views
+  if (m_gpu_timing_enabled) {
+    m_gpu_profiler = new GpuProfiler(m_device, m_frames_in_flight, m_timestamp_period, m_timestamp_mask, m_pipeline_statistics_enabled,
+                                     m_multiview_enabled ? MULTIVIEW_VIEW_COUNT : 1u);
   }
+}
 
-  VkDescriptorSet descriptor_set;
-  VkResult result = vkAllocateDescriptorSets(m_device, &descriptor_set_allocate_info, &descriptor_set);
-  Utils::checkVkResult(result, "Failed to allocate descriptor set from pool");
+VkDescriptorSet VulkanHandler::allocateDescriptorSet(VkImageView texture_image_view, VkSampler texture_sampler, bool use_persistent_pool) {
+  DescriptorAllocator *allocator = use_persistent_pool ? m_persistent_descriptor_allocator : m_scene_descriptor_allocator;
+  VkDescriptorSet descriptor_set = allocator->allocate(m_descriptor_set_layout);
 
+  std::vector<VkWriteDescriptorSet> descriptor_writes;
+
+  // Per-draw data is addressed with a dynamic offset, unless it's passed as push constants
   VkDescriptorBufferInfo descriptor_buffer_info;
-  descriptor_buffer_info.buffer = material_uniform_buffer->getBuffer();
+  descriptor_buffer_info.buffer = m_uniform_arena->getBuffer();
   descriptor_buffer_info.offset = 0u;
-  descriptor_buffer_info.range = VK_WHOLE_SIZE;
+  descriptor_buffer_info.range = sizeof(ModelUniformBufferObject); // The dynamic offset selects the slot in the arena
 
   VkDescriptorImageInfo imageInfo{};
   imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
@@ -498,40 +813,114 @@ VkDescriptorSet VulkanHandler::allocateDescriptorSet(Buffer *material_uniform_bu
   write_descriptor_set.dstBinding = 0u;
   write_descriptor_set.dstArrayElement = 0u;
 
-  if (texture_image_view == NULL) {
-    vkUpdateDescriptorSets(m_device, 1u, &write_descriptor_set, 0u, nullptr);
-  } else {
+  if (!USE_PUSH_CONSTANTS) {
+    descriptor_writes.push_back(write_descriptor_set);
+  }
+
+  if (texture_image_view != NULL) {
     assert(texture_sampler != VK_NULL_HANDLE);
     assert(texture_image_view != VK_NULL_HANDLE);
-    std::array<VkWriteDescriptorSet, 2> descriptorWrites{};
-    descriptorWrites[0] = write_descriptor_set;
-
-    descriptorWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptorWrites[1].dstSet = descriptor_set;
-    descriptorWrites[1].dstBinding = 1;
-    descriptorWrites[1].dstArrayElement = 0;
-    descriptorWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptorWrites[1].descriptorCount = 1;
-    descriptorWrites[1].pImageInfo = &imageInfo;
+    VkWriteDescriptorSet image_write_descriptor_set{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    image_write_descriptor_set.dstSet = descriptor_set;
+    image_write_descriptor_set.dstBinding = 1;
+    image_write_descriptor_set.dstArrayElement = 0;
+    image_write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    image_write_descriptor_set.descriptorCount = 1;
+    image_write_descriptor_set.pImageInfo = &imageInfo;
+    descriptor_writes.push_back(image_write_descriptor_set);
+  }
 
-    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
+  if (!descriptor_writes.empty()) {
+    vkUpdateDescriptorSets(m_device, static_cast<uint32_t>(descriptor_writes.size()), descriptor_writes.data(), 0, nullptr);
   }
 
   return descriptor_set;
 }
 
-VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, const std::string &frag_path) {
+VkDescriptorSet VulkanHandler::getSharedDescriptorSet() { return m_shared_descriptor_set; }
+
+//------------------------------------------------------------------------------------------------------
+// Returns the slot of the texture in the bindless texture array, writing it into a free slot if it's not
+// in the array yet. Each call has to be matched by a `releaseBindlessTexture` call.
+//------------------------------------------------------------------------------------------------------
+uint32_t VulkanHandler::acquireBindlessTexture(VkImageView texture_image_view, VkSampler texture_sampler) {
+  auto it = m_bindless_textures.find(texture_image_view);
+  if (it != m_bindless_textures.end()) {
+    it->second.references++;
+    return it->second.slot;
+  }
+
+  // Prefer a new slot, and only reuse released ones once no frame in flight can sample them anymore
+  uint32_t slot;
+  if (m_next_bindless_slot < m_bindless_capacity) {
+    slot = m_next_bindless_slot++;
+  } else {
+    auto released = std::find_if(m_released_bindless_slots.begin(), m_released_bindless_slots.end(),
+                                 [this](const std::pair<uint32_t, uint64_t> &released_slot) {
+                                   return m_frame_statistics.submitted_frames >= released_slot.second + m_frames_in_flight;
+                                 });
+    if (released == m_released_bindless_slots.end()) {
+      Utils::exitWithMessage("Out of bindless texture slots");
+    }
+
+    slot = released->first;
+    m_released_bindless_slots.erase(released);
+  }
+
+  VkDescriptorImageInfo image_info{};
+  image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  image_info.imageView = texture_image_view;
+  image_info.sampler = texture_sampler;
+
+  VkWriteDescriptorSet write_descriptor_set{VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+  write_descriptor_set.dstSet = m_bindless_descriptor_set;
+  write_descriptor_set.dstBinding = 0u;
+  write_descriptor_set.dstArrayElement = slot;
+  write_descriptor_set.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write_descriptor_set.descriptorCount = 1u;
+  write_descriptor_set.pImageInfo = &image_info;
+
+  vkUpdateDescriptorSets(m_device, 1u, &write_descriptor_set, 0u, nullptr);
+
+  m_bindless_textures.emplace(texture_image_view, BindlessTexture{slot, 1u});
+  return slot;
+}
+
+void VulkanHandler::releaseBindlessTexture(VkImageView texture_image_view) {
+  auto it = m_bindless_textures.find(texture_image_view);
+  if (it == m_bindless_textures.end()) {
+    return;
+  }
+
+  if (--it->second.references == 0u) {
+    m_released_bindless_slots.emplace_back(it->second.slot, m_frame_statistics.submitted_frames);
+    m_bindless_textures.erase(it);
+  }
+}
+
+//------------------------------------------------------------------------------------------------------
+// Returns a (possibly shared) pipeline for the given shaders and state. Release it with
+// `releaseGraphicsPipeline` once it's no longer used.
+//------------------------------------------------------------------------------------------------------
+VkPipeline VulkanHandler::acquireGraphicsPipeline(const std::string &vert_path, const std::string &frag_path, const PipelineState &state) {
+  return m_pipeline_registry->acquire(vert_path, frag_path, state);
+}
+
+void VulkanHandler::releaseGraphicsPipeline(VkPipeline pipeline) { m_pipeline_registry->release(pipeline); }
+
+// Destroys all pipelines which are no longer used by any material
+void VulkanHandler::destroyUnusedPipelines() {
+  waitForFramesInFlight();
+  m_pipeline_registry->destroyUnused();
+}
+
+PipelineRegistryStatistics VulkanHandler::getPipelineRegistryStatistics() { return m_pipeline_registry->getStatistics(); }
+
+VkPipeline VulkanHandler::createGraphicsPipeline(VkShaderModule vertex_shader_module, VkShaderModule fragment_shader_module,
+                                                 const PipelineState &state) {
   //------------------------------------------------------------------------------------------------------
   // Shader modules
   //------------------------------------------------------------------------------------------------------
-  // Load shader bytecodes
-  std::vector<char> vertex_shader_code = Utils::readFile(vert_path);
-  std::vector<char> fragment_shader_code = Utils::readFile(frag_path);
-
-  // Create shader modules for both of the shaders
-  VkShaderModule vertex_shader_module = createShaderModule(vertex_shader_code);
-  VkShaderModule fragment_shader_module = createShaderModule(fragment_shader_code);
-
   // We need to assign the shaders to specific pipeline stages, start with the vertext shader
   VkPipelineShaderStageCreateInfo vertex_shader_stage_create_info{};
   vertex_shader_stage_create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -561,13 +950,24 @@ VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, c
   //------------------------------------------------------------------------------------------------------
   // Vertex input
   //------------------------------------------------------------------------------------------------------
-  auto vertex_binding_description = Vertex::getBindingDescription();
-  auto vertex_attribute_descriptions = Vertex::getAttributeDescriptions();
+  std::vector<VkVertexInputBindingDescription> vertex_binding_descriptions = {Vertex::getBindingDescription()};
+  auto per_vertex_attribute_descriptions = Vertex::getAttributeDescriptions();
+  std::vector<VkVertexInputAttributeDescription> vertex_attribute_descriptions(per_vertex_attribute_descriptions.begin(),
+                                                                               per_vertex_attribute_descriptions.end());
+
+  // Instanced pipelines additionally read the per-instance data from a second binding
+  if (state.instanced) {
+    vertex_binding_descriptions.push_back(InstanceData::getBindingDescription());
+    auto per_instance_attribute_descriptions = InstanceData::getAttributeDescriptions();
+    vertex_attribute_descriptions.insert(vertex_attribute_descriptions.end(), per_instance_attribute_descriptions.begin(),
+                                         per_instance_attribute_descriptions.end());
+  }
+
   VkPipelineVertexInputStateCreateInfo vertex_input_info{};
   vertex_input_info.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
+  vertex_input_info.vertexBindingDescriptionCount = static_cast<uint32_t>(vertex_binding_descriptions.size());
   vertex_input_info.vertexAttributeDescriptionCount = static_cast<uint32_t>(vertex_attribute_descriptions.size());
-  vertex_input_info.pVertexBindingDescriptions = &vertex_binding_description;
+  vertex_input_info.pVertexBindingDescriptions = vertex_binding_descriptions.data();
   vertex_input_info.pVertexAttributeDescriptions = vertex_attribute_descriptions.data();
 
   //------------------------------------------------------------------------------------------------------
@@ -576,7 +976,7 @@ VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, c
   // Describe the input topology and if primitive restart is enabled
   VkPipelineInputAssemblyStateCreateInfo input_assembly_info{};
   input_assembly_info.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  input_assembly_info.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  input_assembly_info.topology = state.topology;
   input_assembly_info.primitiveRestartEnable = VK_FALSE;
 
   //------------------------------------------------------------------------------------------------------
@@ -598,26 +998,26 @@ VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, c
   rasterizer.rasterizerDiscardEnable = VK_FALSE;
   rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
   rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+  rasterizer.cullMode = state.cull_mode;
   rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
   rasterizer.depthBiasEnable = VK_FALSE;
 
   //------------------------------------------------------------------------------------------------------
   // Multisampling
   //------------------------------------------------------------------------------------------------------
-  // Keep multisampling disabled for now
+  // Rasterize with the sample count of the render pass, without per-sample shading
   VkPipelineMultisampleStateCreateInfo multisampling_info{};
   multisampling_info.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
   multisampling_info.sampleShadingEnable = VK_FALSE;
-  multisampling_info.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+  multisampling_info.rasterizationSamples = m_sample_count;
 
   //------------------------------------------------------------------------------------------------------
   // Depth buffer and stencil
   //------------------------------------------------------------------------------------------------------
   VkPipelineDepthStencilStateCreateInfo depth_stencil_info{};
   depth_stencil_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-  depth_stencil_info.depthTestEnable = VK_TRUE;
-  depth_stencil_info.depthWriteEnable = VK_TRUE;
+  depth_stencil_info.depthTestEnable = state.depth_test ? VK_TRUE : VK_FALSE;
+  depth_stencil_info.depthWriteEnable = state.depth_write ? VK_TRUE : VK_FALSE;
   depth_stencil_info.depthCompareOp = VK_COMPARE_OP_LESS;
   depth_stencil_info.depthBoundsTestEnable = VK_FALSE;
   depth_stencil_info.stencilTestEnable = VK_FALSE;
@@ -628,7 +1028,7 @@ VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, c
   VkPipelineColorBlendAttachmentState color_blend_attachment_state{};
   color_blend_attachment_state.colorWriteMask =
       VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  color_blend_attachment_state.blendEnable = VK_TRUE;
+  color_blend_attachment_state.blendEnable = state.blend ? VK_TRUE : VK_FALSE;
   color_blend_attachment_state.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
   color_blend_attachment_state.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
   color_blend_attachment_state.colorBlendOp = VK_BLEND_OP_ADD;
@@ -663,28 +1063,56 @@ VkPipeline VulkanHandler::createGraphicsPipeline(const std::string &vert_path, c
   pipeline_create_info.renderPass = m_render_pass;
   pipeline_create_info.subpass = 0;
 
+  // Ask the driver to report whether the pipeline was found in the cache
+  VkPipelineCreationFeedbackEXT pipeline_creation_feedback{};
+  VkPipelineCreationFeedbackCreateInfoEXT pipeline_creation_feedback_info{VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT};
+  pipeline_creation_feedback_info.pPipelineCreationFeedback = &pipeline_creation_feedback;
+
+  if (m_pipeline_creation_feedback_enabled) {
+    pipeline_create_info.pNext = &pipeline_creation_feedback_info;
+  }
+
   VkPipeline graphics_pipeline;
-  VkResult result = vkCreateGraphicsPipelines(m_device, VK_NULL_HANDLE, 1, &pipeline_create_info, nullptr, &graphics_pipeline);
+  VkResult result =
+      vkCreateGraphicsPipelines(m_device, m_pipeline_cache->getCache(), 1, &pipeline_create_info, nullptr, &graphics_pipeline);
   Utils::checkVkResult(result, "Failed to create the graphics pipeline");
 
-  // Make sure to cleanup the shader modules
-  vkDestroyShaderModule(m_device, fragment_shader_module, nullptr);
-  vkDestroyShaderModule(m_device, vertex_shader_module, nullptr);
+  if (m_pipeline_creation_feedback_enabled) {
+    m_pipeline_cache->recordPipelineCreation(pipeline_creation_feedback);
+  } else {
+    m_pipeline_cache->recordPipelineCreation();
+  }
 
   return graphics_pipeline;
 }
 
 VkPipelineLayout VulkanHandler::createPipelineLayout() {
-  std::array<VkDescriptorSetLayout, 2> set_layouts = {
+  std::vector<VkDescriptorSetLayout> set_layouts = {
       m_global_descriptor_set_layout, // set = 0
-      m_descriptor_set_layout         // set = 1 (local UBO)
+      m_descriptor_set_layout         // set = 1 (local UBO, or only material data with push constants)
   };
 
+  if (m_bindless_enabled) {
+    set_layouts.push_back(m_bindless_descriptor_set_layout); // set = 2 (bindless textures)
+  }
+
+  // Per-draw data of the push constant variants of the vertex shaders. The other variants (indirect,
+  // instanced) simply don't read it, so all pipelines can share the layout.
+  VkPushConstantRange push_constant_range{};
+  push_constant_range.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  push_constant_range.offset = 0u;
+  push_constant_range.size = sizeof(ModelPushConstants);
+
   VkPipelineLayoutCreateInfo pipeline_layout_info{};
   pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
   pipeline_layout_info.setLayoutCount = static_cast<uint32_t>(set_layouts.size());
   pipeline_layout_info.pSetLayouts = set_layouts.data();
 
+  if (USE_PUSH_CONSTANTS) {
+    pipeline_layout_info.pushConstantRangeCount = 1u;
+    pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  }
+
   VkPipelineLayout pipeline_layout;
 
   VkResult result = vkCreatePipelineLayout(m_device, &pipeline_layout_info, nullptr, &pipeline_layout);
@@ -693,62 +1121,213 @@ VkPipelineLayout VulkanHandler::createPipelineLayout() {
   return pipeline_layout;
 }
 
-VkShaderModule VulkanHandler::createShaderModule(const std::vector<char> &code) {
-  // Setup the create info for the shader module
-  VkShaderModuleCreateInfo shader_module_create_info{};
-  shader_module_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  shader_module_create_info.codeSize = code.size();
-  shader_module_create_info.pCode = reinterpret_cast<const uint32_t *>(code.data());
-
-  // And create the shader module itself
-  VkShaderModule shader_module;
-  VkResult result = vkCreateShaderModule(m_device, &shader_module_create_info, nullptr, &shader_module);
-  Utils::checkVkResult(result, "Failed to create shader module");
-
-  return shader_module;
-}
-
 void VulkanHandler::resetDescriptorPool() {
-  VkResult result;
-
   //------------------------------------------------------------------------------------------------------
-  // Wait for the previous frame
+  // Wait for the previous frames
   //------------------------------------------------------------------------------------------------------
-  // Wait for the previous frame to be finished (by waiting for the fence
-  // to be signalled)
-  result = vkWaitForFences(m_device, 1u, &m_fence, VK_TRUE, UINT64_MAX);
-  Utils::checkVkResult(result, "Failed to wait for memory fence");
+  // The descriptor sets might still be used by any frame in flight
+  waitForFramesInFlight();
 
   //------------------------------------------------------------------------------------------------------
   // Reset descriptor pool
   //------------------------------------------------------------------------------------------------------
-  result = vkResetDescriptorPool(m_device, m_scene_descriptor_pool, 0);
-  Utils::checkVkResult(result, "Failed to reset descriptor pool");
+  // All pools of the scene are kept for the next one
+  m_scene_descriptor_allocator->reset();
+}
+
+void VulkanHandler::waitForFramesInFlight() {
+  std::vector<VkFence> fences(m_frames_in_flight);
+  for (uint32_t i = 0; i < m_frames_in_flight; i++) {
+    fences[i] = m_frames[i].fence;
+  }
+
+  VkResult result = vkWaitForFences(m_device, m_frames_in_flight, fences.data(), VK_TRUE, UINT64_MAX);
+  Utils::checkVkResult(result, "Failed to wait for memory fences");
+}
+
+FrameStatistics VulkanHandler::getFrameStatistics() { return m_frame_statistics; }
+
+// Returns the statistics of the scene and persistent allocators, and those of all frames combined
+std::vector<DescriptorAllocatorStatistics> VulkanHandler::getDescriptorAllocatorStatistics() {
+  DescriptorAllocatorStatistics frame_statistics = m_frames[0].descriptor_allocator->getStatistics();
+  for (uint32_t i = 1u; i < m_frames_in_flight; i++) {
+    DescriptorAllocatorStatistics statistics = m_frames[i].descriptor_allocator->getStatistics();
+    frame_statistics.allocations += statistics.allocations;
+    frame_statistics.resets += statistics.resets;
+    frame_statistics.created_pools += statistics.created_pools;
+    frame_statistics.pool_growths += statistics.pool_growths;
+    frame_statistics.peak_sets = std::max(frame_statistics.peak_sets, statistics.peak_sets);
+    frame_statistics.pools += statistics.pools;
+  }
+
+  return {m_scene_descriptor_allocator->getStatistics(), m_persistent_descriptor_allocator->getStatistics(), frame_statistics};
+}
+
+StaticCommandCacheStatistics VulkanHandler::getStaticCommandCacheStatistics() {
+  return m_static_command_cache ? m_static_command_cache->getStatistics() : StaticCommandCacheStatistics{};
+}
+
+//------------------------------------------------------------------------------------------------------
+// Print the statistics of all parts of the renderer, usually once on shutdown
+//------------------------------------------------------------------------------------------------------
+void VulkanHandler::printStatistics() {
+  // Report how often the CPU had to wait for the GPU to finish a frame in flight
+  FrameStatistics statistics = getFrameStatistics();
+  std::cout << "Submitted " << statistics.submitted_frames << " frames, CPU blocked on a fence " << statistics.fence_blocks
+            << " times (" << statistics.fence_block_time_ms << " ms in total)" << std::endl;
+
+  // Report how many binds the render queue could skip by sorting the draws
+  RenderQueueStatistics render_queue_statistics = getRenderQueueStatistics();
+  if (render_queue_statistics.frames > 0u) {
+    std::cout << "Render queue, per frame: " << render_queue_statistics.draws / render_queue_statistics.frames << " draws, "
+              << render_queue_statistics.skipped_pipeline_binds / render_queue_statistics.frames << " pipeline, "
+              << render_queue_statistics.skipped_descriptor_set_binds / render_queue_statistics.frames << " descriptor set and "
+              << (render_queue_statistics.skipped_vertex_buffer_binds + render_queue_statistics.skipped_index_buffer_binds) /
+                     render_queue_statistics.frames
+              << " buffer binds skipped, " << render_queue_statistics.indirect_draws / render_queue_statistics.frames
+              << " draws culled on the GPU in " << render_queue_statistics.indirect_batches / render_queue_statistics.frames << " batches, "
+              << render_queue_statistics.instances / render_queue_statistics.frames << " instances in "
+              << render_queue_statistics.instanced_draws / render_queue_statistics.frames << " instanced draws, "
+              << render_queue_statistics.push_constant_updates / render_queue_statistics.frames << " push constant updates, "
+              << render_queue_statistics.parallel_chunks / render_queue_statistics.frames << " chunks recorded in parallel" << std::endl;
+  }
+
+  // Report how much the frustum culling rejected
+  CullingStatistics culling_statistics = getCullingStatistics();
+  if (culling_statistics.frames > 0u) {
+    std::cout << "Frustum culling, per frame: " << culling_statistics.visited_nodes / culling_statistics.frames << " nodes visited, "
+              << culling_statistics.culled_nodes / culling_statistics.frames << " subtrees and "
+              << culling_statistics.culled_draws / culling_statistics.frames << " meshes culled, "
+              << culling_statistics.occluded_nodes / culling_statistics.frames << " subtrees and "
+              << culling_statistics.occluded_draws / culling_statistics.frames << " meshes occluded" << std::endl;
+  }
+
+  // Report the GPU time of the profiled scopes, averaged over the last frames
+  for (const GpuScopeStatistics &scope : getGpuProfilerStatistics()) {
+    std::cout << "GPU scope \"" << scope.name << "\": " << scope.gpu_time_ms << " ms";
+    if (scope.vertex_invocations > 0.0 || scope.fragment_invocations > 0.0) {
+      std::cout << ", " << scope.vertex_invocations << " vertex and " << scope.fragment_invocations << " fragment invocations";
+    }
+    std::cout << " (average of the last " << scope.samples << " frames)" << std::endl;
+  }
+
+  // Report how useful the pipeline cache was for this start
+  PipelineCacheStatistics pipeline_cache_statistics = getPipelineCacheStatistics();
+  std::cout << "Pipeline cache " << (pipeline_cache_statistics.loaded_from_disk ? "(warm)" : "(cold)") << ": "
+            << pipeline_cache_statistics.hits << " hits, " << pipeline_cache_statistics.misses << " misses, "
+            << pipeline_cache_statistics.unknown << " unknown" << std::endl;
+
+  PipelineRegistryStatistics pipeline_registry_statistics = getPipelineRegistryStatistics();
+  std::cout << "Pipeline registry: " << pipeline_registry_statistics.requests << " requests, "
+            << pipeline_registry_statistics.created_pipelines << " pipelines created" << std::endl;
+
+  // Report how the descriptor pools were sized, growths mean the first pool was too small for the content
+  for (const DescriptorAllocatorStatistics &allocator : getDescriptorAllocatorStatistics()) {
+    std::cout << "Descriptor allocator \"" << allocator.name << "\": " << allocator.allocations << " sets allocated (at most "
+              << allocator.peak_sets << " at once), " << allocator.pools << " pools, " << allocator.pool_growths << " growths" << std::endl;
+  }
+
+  // Report how much of the per-frame uniform storage was used at most, to size UNIFORM_ARENA_FRAME_SIZE
+  if (m_uniform_arena) {
+    std::cout << "Uniform arena: " << m_uniform_arena->getHighWatermark() << " / " << m_uniform_arena->getFrameRegionSize()
+              << " bytes per frame used at most" << std::endl;
+  }
+
+  // Report how often the static subtrees could be replayed without recording them again
+  StaticCommandCacheStatistics static_cache_statistics = getStaticCommandCacheStatistics();
+  if (static_cache_statistics.frames > 0) {
+    std::cout << "Static command cache: " << static_cache_statistics.replayed_subtrees << " subtrees replayed, "
+              << static_cache_statistics.recorded_subtrees << " recorded, " << static_cache_statistics.evicted_subtrees << " evicted"
+              << std::endl;
+  }
+
+  // Report the memory used per memory type
+  for (const MemoryHeapStatistics &heap : getMemoryStatistics()) {
+    std::cout << "Memory type " << heap.memory_type_index << (heap.dedicated ? " (dedicated)" : heap.images ? " (images)" : " (buffers)")
+              << ": " << heap.allocation_count << " allocations, " << heap.used_bytes << " / " << heap.block_bytes << " bytes in "
+              << heap.block_count << " blocks" << std::endl;
+  }
 }
 
-void VulkanHandler::renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuffer framebuf, VkExtent2D resolution,
-                                std::function<void(RenderContext &)> draw_callback,
+bool VulkanHandler::isGpuTimingEnabled() { return m_gpu_timing_enabled; }
+
+//------------------------------------------------------------------------------------------------------
+// Returns the GPU time (in milliseconds) of all submissions which finished since the last call, along
+// with the number of these submissions. The results are only read once a frame slot is reused, so they
+// lag the number of frames in flight behind.
+//------------------------------------------------------------------------------------------------------
+double VulkanHandler::takeCompletedGpuTime(uint32_t &submission_count) {
+  submission_count = 0u;
+  return m_gpu_profiler ? m_gpu_profiler->takeCompletedFrameTime(submission_count) : 0.0;
+}
+
+std::vector<GpuScopeStatistics> VulkanHandler::getGpuProfilerStatistics() {
+  return m_gpu_profiler ? m_gpu_profiler->getStatistics() : std::vector<GpuScopeStatistics>();
+}
+
+RenderQueueStatistics VulkanHandler::getRenderQueueStatistics() { return m_render_queue.getStatistics(); }
+
+RenderQueueStatistics VulkanHandler::getLastFrameRenderQueueStatistics() { return m_render_queue.getLastFrameStatistics(); }
+
+CullingStatistics VulkanHandler::getCullingStatistics() { return m_culling_statistics; }
+
+CullingStatistics VulkanHandler::getLastFrameCullingStatistics() { return m_last_frame_culling_statistics; }
+
+// Write the pipeline cache to disk, such that the next start can skip compiling the pipelines
+void VulkanHandler::savePipelineCache() { m_pipeline_cache->save(); }
+
+PipelineCacheStatistics VulkanHandler::getPipelineCacheStatistics() { return m_pipeline_cache->getStatistics(); }
+
+void VulkanHandler::renderFrame(const std::vector<glm::mat4> &view_projections, const Frustum &frustum,
+                                const OcclusionCuller *occlusion_culler, const LodViews &lod_views, VkFramebuffer framebuf,
+                                VkExtent2D resolution, const char *profiler_scope, std::function<void(RenderContext &)> draw_callback,
                                 std::function<void(RenderContext &)> draw_interactions_callback) {
+  XRE_PROFILE_SCOPE("Record frame");
   VkResult result;
 
+  // Advance to the next frame in the ring
+  m_current_frame = (m_current_frame + 1u) % m_frames_in_flight;
+  FrameData &frame = m_frames[m_current_frame];
+  VkCommandBuffer command_buffer = frame.command_buffer;
+
   //------------------------------------------------------------------------------------------------------
-  // Wait for the previous frame
+  // Wait for the frame which previously used this slot
   //------------------------------------------------------------------------------------------------------
-  // Wait for the previous frame to be finished (by waiting for the fence
-  // to be signalled)
-  result = vkWaitForFences(m_device, 1u, &m_fence, VK_TRUE, UINT64_MAX);
-  Utils::checkVkResult(result, "Failed to wait for memory fence");
+  // Wait for the frame which used the slot m_frames_in_flight submissions ago to be finished (by waiting for the fence
+  // to be signalled). Keep track of how often (and how long) we actually have to block here.
+  if (vkGetFenceStatus(m_device, frame.fence) == VK_NOT_READY) {
+    XRE_PROFILE_SCOPE("Wait for frame fence");
+    auto wait_start = std::chrono::steady_clock::now();
+
+    result = vkWaitForFences(m_device, 1u, &frame.fence, VK_TRUE, UINT64_MAX);
+    Utils::checkVkResult(result, "Failed to wait for memory fence");
+
+    std::chrono::duration<double, std::milli> wait_duration = std::chrono::steady_clock::now() - wait_start;
+    m_frame_statistics.fence_blocks++;
+    m_frame_statistics.fence_block_time_ms += wait_duration.count();
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Reset sync objects
   //------------------------------------------------------------------------------------------------------
   // Reset the fence to the unsignalled state
-  result = vkResetFences(m_device, 1u, &m_fence);
+  result = vkResetFences(m_device, 1u, &frame.fence);
   Utils::checkVkResult(result, "Failed to reset fence to unsignalled state!");
 
-  // Reset the command buffer such that we can record into it
-  result = vkResetCommandBuffer(m_command_buffer, 0);
-  Utils::checkVkResult(result, "failed to reset command buffer!");
+  // Reset the command pool of the frame such that we can record into its command buffer again
+  result = vkResetCommandPool(m_device, frame.command_pool, 0);
+  Utils::checkVkResult(result, "failed to reset command pool!");
+
+  // The GPU is done with the uniform data and the transient descriptor sets of the frame, so we can reuse them
+  m_uniform_arena->beginFrame(m_current_frame);
+  m_geometry_pool->beginFrame();
+  frame.descriptor_allocator->reset();
+  if (m_parallel_recorder) {
+    m_parallel_recorder->beginFrame(m_current_frame);
+  }
+  if (m_static_command_cache) {
+    m_static_command_cache->beginFrame(m_current_frame);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // Begin recording the command buffer
@@ -756,9 +1335,91 @@ void VulkanHandler::renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuf
   VkCommandBufferBeginInfo begin_info{};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
 
-  result = vkBeginCommandBuffer(m_command_buffer, &begin_info);
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  result = vkBeginCommandBuffer(command_buffer, &begin_info);
   Utils::checkVkResult(result, "failed to begin recording command buffer!");
 
+  // The frame which previously used this slot is done, so the profiler can read back its results. The
+  // whole command buffer is the outermost scope of the frame.
+  uint32_t frame_scope = GpuProfiler::NO_SCOPE;
+  if (m_gpu_profiler) {
+    m_gpu_profiler->beginFrame(command_buffer, m_current_frame);
+    frame_scope = m_gpu_profiler->beginScope(command_buffer, profiler_scope);
+  }
+
+  //------------------------------------------------------------------------------------------------------
+  // Collect the draws
+  //------------------------------------------------------------------------------------------------------
+  // The draws are only collected here and recorded once the render pass is started, which allows
+  // sorting and culling them first. Prepare the render context
+  RenderContext ctx{};
+  ctx.command_buffer = command_buffer;
+  ctx.pipeline_layout = m_pipeline_layout;
+  ctx.uniform_arena = m_uniform_arena;
+  ctx.frame_index = m_current_frame;
+  ctx.render_queue = &m_render_queue;
+  ctx.frustum = &frustum;
+  ctx.occlusion_culler = occlusion_culler;
+  ctx.lod_views = &lod_views;
+  ctx.gpu_profiler = m_gpu_profiler;
+  ctx.descriptor_allocator = frame.descriptor_allocator;
+  ctx.push_constants = USE_PUSH_CONSTANTS;
+  ctx.static_cache = m_static_command_cache;
+  ctx.bound_pipeline = VK_NULL_HANDLE;
+  ctx.bound_descriptor_set = VK_NULL_HANDLE;
+  ctx.bound_vertex_buffer = VK_NULL_HANDLE;
+  ctx.bound_index_buffer = VK_NULL_HANDLE;
+
+  // Update global buffer. In multiview mode, the shaders pick the matrix of the view they're rendering
+  // with `gl_ViewIndex`, otherwise we only get a single matrix which is stored at index 0.
+  GlobalUniformBufferObject global_uniform_buffer_object{};
+  for (size_t i = 0; i < view_projections.size() && i < MULTIVIEW_VIEW_COUNT; i++) {
+    global_uniform_buffer_object.view_projection[i] = view_projections[i];
+  }
+  global_uniform_buffer_object.light_vector = glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f));
+  global_uniform_buffer_object.light_color = glm::vec3(0.5f, 0.5f, 0.5f);
+  global_uniform_buffer_object.ambient_color = glm::vec3(0.2f, 0.2f, 0.2f);
+
+  frame.global_uniform_buffer->loadData(global_uniform_buffer_object);
+
+  // Collect the draws of the scene
+  m_render_queue.begin(global_uniform_buffer_object.view_projection[0]);
+  {
+    XRE_PROFILE_SCOPE("Collect scene draws");
+    draw_callback(ctx);
+  }
+
+  // Collect the draws of the interactions (e.g. controllers, hands etc.), which are kept after the scene
+  m_render_queue.setPass(RenderQueue::PASS_INTERACTIONS);
+  {
+    XRE_PROFILE_SCOPE("Collect interaction draws");
+    draw_interactions_callback(ctx);
+  }
+
+  // Keep track of how much the frustum culling rejected
+  ctx.culling_statistics.frames = 1u;
+  m_last_frame_culling_statistics = ctx.culling_statistics;
+  m_culling_statistics.frames++;
+  m_culling_statistics.visited_nodes += ctx.culling_statistics.visited_nodes;
+  m_culling_statistics.culled_nodes += ctx.culling_statistics.culled_nodes;
+  m_culling_statistics.culled_draws += ctx.culling_statistics.culled_draws;
+  m_culling_statistics.occluded_nodes += ctx.culling_statistics.occluded_nodes;
+  m_culling_statistics.occluded_draws += ctx.culling_statistics.occluded_draws;
+
+  // Cull the draws on the GPU where possible. This records a compute pass, so it needs to happen
+  // before the render pass is started.
+  uint32_t culling_scope = GpuProfiler::NO_SCOPE;
+  if (m_gpu_profiler && m_gpu_culler) {
+    culling_scope = m_gpu_profiler->beginScope(command_buffer, "GPU culling");
+  }
+
+  m_render_queue.cull(command_buffer, m_gpu_culler, m_current_frame, view_projections);
+
+  if (m_gpu_profiler) {
+    m_gpu_profiler->endScope(command_buffer, culling_scope);
+  }
+
   //------------------------------------------------------------------------------------------------------
   // Setup render pass
   //------------------------------------------------------------------------------------------------------
@@ -776,7 +1437,14 @@ void VulkanHandler::renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuf
   render_pass_info.renderArea.extent = resolution;
   render_pass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
   render_pass_info.pClearValues = clear_values.data();
-  vkCmdBeginRenderPass(m_command_buffer, &render_pass_info, VK_SUBPASS_CONTENTS_INLINE);
+  // With enough draws, they are recorded in parallel into secondary command buffers, which the render pass
+  // then only executes. The same applies if cached buffers of static subtrees are executed.
+  const bool static_subtrees = m_static_command_cache && m_static_command_cache->getSubtreeCount() > 0u;
+  const bool parallel_recording =
+      m_parallel_recorder &&
+      (static_subtrees || (USE_PARALLEL_RECORDING && m_render_queue.getDrawCount() >= PARALLEL_RECORDING_MIN_DRAWS));
+  vkCmdBeginRenderPass(command_buffer, &render_pass_info,
+                       parallel_recording ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE);
 
   //------------------------------------------------------------------------------------------------------
   // Set viewport
@@ -788,7 +1456,6 @@ void VulkanHandler::renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuf
   viewport.height = static_cast<float>(render_pass_info.renderArea.extent.height);
   viewport.minDepth = 0.0f;
   viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(m_command_buffer, 0u, 1u, &viewport);
 
   //------------------------------------------------------------------------------------------------------
   // Set scissor
@@ -796,66 +1463,125 @@ void VulkanHandler::renderFrame(glm::mat4 view, glm::mat4 projection, VkFramebuf
   VkRect2D scissor;
   scissor.offset = render_pass_info.renderArea.offset;
   scissor.extent = render_pass_info.renderArea.extent;
-  vkCmdSetScissor(m_command_buffer, 0u, 1u, &scissor);
-
-  //------------------------------------------------------------------------------------------------------
-  // Draw the scene
-  //------------------------------------------------------------------------------------------------------
-  // Prepare the render context
-  RenderContext ctx{};
-  ctx.command_buffer = m_command_buffer;
-  ctx.pipeline_layout = m_pipeline_layout;
-  ctx.aligned_size = m_aligned_size;
 
-  // Update global buffer
-  GlobalUniformBufferObject global_uniform_buffer_object{};
-  global_uniform_buffer_object.view_projection = projection * view;
-  global_uniform_buffer_object.light_vector = glm::normalize(glm::vec3(1.0f, 1.0f, 1.0f));
-  global_uniform_buffer_object.light_color = glm::vec3(0.5f, 0.5f, 0.5f);
-  global_uniform_buffer_object.ambient_color = glm::vec3(0.2f, 0.2f, 0.2f);
+  // State shared by all draws, which has to be recorded into each secondary command buffer as well
+  auto record_frame_state = [&](VkCommandBuffer state_command_buffer) {
+    vkCmdSetViewport(state_command_buffer, 0u, 1u, &viewport);
+    vkCmdSetScissor(state_command_buffer, 0u, 1u, &scissor);
 
-  m_global_uniform_buffer->loadData(global_uniform_buffer_object);
+    // Bind global descriptor set (camera)
+    vkCmdBindDescriptorSets(state_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, // set = 0
+                            &frame.global_descriptor_set, 0, nullptr);
 
-  // Bind global descriptor set (camera)
-  vkCmdBindDescriptorSets(m_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 0, 1, &m_global_descriptor_set, // set = 0
-                          0, nullptr);
+    // Bind the texture array, which stays bound for all draws of the frame
+    if (m_bindless_enabled) {
+      vkCmdBindDescriptorSets(state_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, m_pipeline_layout, 2, 1, // set = 2
+                              &m_bindless_descriptor_set, 0, nullptr);
+    }
+  };
 
-  // Draw scene
-  draw_callback(ctx);
+  //------------------------------------------------------------------------------------------------------
+  // Draw the scene
+  //------------------------------------------------------------------------------------------------------
+  // Record all collected draws, sorted to skip redundant binds
+  if (parallel_recording) {
+    XRE_PROFILE_SCOPE("Record draws in parallel");
+
+    VkCommandBufferInheritanceInfo inheritance_info{VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritance_info.renderPass = m_render_pass;
+    inheritance_info.subpass = 0u;
+    inheritance_info.framebuffer = framebuf;
+
+    // The static subtrees come first, the buffers which are outdated are recorded again on this thread. They
+    // are replayed with other framebuffers as well, so the framebuffer is left unspecified.
+    std::vector<VkCommandBuffer> secondary_command_buffers;
+    if (static_subtrees) {
+      XRE_PROFILE_SCOPE("Record static subtrees");
+
+      VkCommandBufferInheritanceInfo static_inheritance_info = inheritance_info;
+      static_inheritance_info.framebuffer = VK_NULL_HANDLE;
+
+      secondary_command_buffers = m_static_command_cache->record(
+          static_inheritance_info, resolution, [&](SceneNode *node, VkCommandBuffer static_command_buffer) {
+            record_frame_state(static_command_buffer);
+
+            // Draw the subtree without any culling, and without redirecting it to the cache again
+            RenderContext static_ctx = ctx;
+            static_ctx.command_buffer = static_command_buffer;
+            static_ctx.render_queue = &m_static_render_queue;
+            static_ctx.frustum = nullptr;
+            static_ctx.occlusion_culler = nullptr;
+            static_ctx.lod_views = nullptr;
+            static_ctx.gpu_profiler = nullptr;
+            static_ctx.static_cache = nullptr;
+            static_ctx.static_recording = true;
+            static_ctx.culling_statistics = {};
+
+            m_static_render_queue.begin(global_uniform_buffer_object.view_projection[0]);
+            node->render(static_ctx);
+            m_static_render_queue.submit(static_ctx);
+          });
+    }
 
-  // Draw the interactions (e.g. controllers, hands etc.)
-  draw_interactions_callback(ctx);
+    std::vector<VkCommandBuffer> dynamic_command_buffers =
+        m_render_queue.submitParallel(ctx, m_parallel_recorder, inheritance_info, record_frame_state);
+    secondary_command_buffers.insert(secondary_command_buffers.end(), dynamic_command_buffers.begin(), dynamic_command_buffers.end());
+    vkCmdExecuteCommands(command_buffer, static_cast<uint32_t>(secondary_command_buffers.size()), secondary_command_buffers.data());
+  } else {
+    XRE_PROFILE_SCOPE("Record draws");
+    record_frame_state(command_buffer);
+    m_render_queue.submit(ctx);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // End the render pass
   //------------------------------------------------------------------------------------------------------
-  vkCmdEndRenderPass(m_command_buffer);
+  vkCmdEndRenderPass(command_buffer);
+
+  if (m_gpu_profiler) {
+    m_gpu_profiler->endScope(command_buffer, frame_scope);
+  }
 
   //------------------------------------------------------------------------------------------------------
   // End recording the command buffer
   //------------------------------------------------------------------------------------------------------
-  result = vkEndCommandBuffer(m_command_buffer);
+  result = vkEndCommandBuffer(command_buffer);
   Utils::checkVkResult(result, "failed to record command buffer!");
 
   //------------------------------------------------------------------------------------------------------
   // Submit the command buffer
   //------------------------------------------------------------------------------------------------------
+  // Submit the uploads recorded since the last frame, and let the frame wait on the GPU until
+  // they're done (instead of waiting on the CPU).
+  uint64_t upload_value = m_upload_manager->flush();
+  VkSemaphore upload_semaphore = m_upload_manager->getTimelineSemaphore();
+  VkPipelineStageFlags upload_wait_stage = VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+  VkTimelineSemaphoreSubmitInfo timeline_submit_info{VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+  timeline_submit_info.waitSemaphoreValueCount = 1u;
+  timeline_submit_info.pWaitSemaphoreValues = &upload_value;
+
   VkSubmitInfo submit_info{};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.pNext = &timeline_submit_info;
   submit_info.commandBufferCount = 1u;
-  submit_info.pCommandBuffers = &m_command_buffer;
+  submit_info.pCommandBuffers = &command_buffer;
+  submit_info.waitSemaphoreCount = 1u;
+  submit_info.pWaitSemaphores = &upload_semaphore;
+  submit_info.pWaitDstStageMask = &upload_wait_stage;
 
   //------------------------------------------------------------------------------------------------------
   // Submit the queue
   //------------------------------------------------------------------------------------------------------
-  // Actually submit the queue, which will also signal the `inFlightFence` on successful
-  // completion.
-  result = vkQueueSubmit(m_graphics_queue, 1, &submit_info, m_fence);
+  // Actually submit the queue, which will also signal the fence of the frame on successful
+  // completion. We don't wait for it here, such that the CPU can continue with the next frame.
+  {
+    XRE_PROFILE_SCOPE("vkQueueSubmit");
+    result = vkQueueSubmit(m_graphics_queue, 1, &submit_info, frame.fence);
+  }
   Utils::checkVkResult(result, "failed to submit draw command buffer!");
-}
 
-void VulkanHandler::bindGraphicsPipeline(VkPipeline pipeline) {
-  vkCmdBindPipeline(m_command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  m_frame_statistics.submitted_frames++;
 }
 
 VkInstance VulkanHandler::getInstance() { return m_vk_instance; }
@@ -868,6 +1594,32 @@ uint32_t VulkanHandler::getQueueFamilyIndex() { return m_queue_family_index; }
 
 VkRenderPass VulkanHandler::getRenderPass() { return m_render_pass; }
 
+bool VulkanHandler::isMultiviewEnabled() { return m_multiview_enabled; }
+
+uint32_t VulkanHandler::getFramesInFlight() { return m_frames_in_flight; }
+
+VkSampleCountFlagBits VulkanHandler::getSampleCount() { return m_sample_count; }
+
+bool VulkanHandler::isDepthStoreEnabled() { return m_depth_store_enabled; }
+
+bool VulkanHandler::isGpuCullingEnabled() { return m_gpu_culling_enabled; }
+
+bool VulkanHandler::isPushConstantsEnabled() { return USE_PUSH_CONSTANTS; }
+
+bool VulkanHandler::isBindlessEnabled() { return m_bindless_enabled; }
+
+bool VulkanHandler::isTextureCompressionBcEnabled() { return m_texture_compression_bc_enabled; }
+
+bool VulkanHandler::isTextureCompressionAstcEnabled() { return m_texture_compression_astc_enabled; }
+
+UploadManager *VulkanHandler::getUploadManager() { return m_upload_manager; }
+
+GeometryPool *VulkanHandler::getGeometryPool() { return m_geometry_pool; }
+
+MemoryAllocator *VulkanHandler::getMemoryAllocator() { return m_memory_allocator; }
+
+std::vector<MemoryHeapStatistics> VulkanHandler::getMemoryStatistics() { return m_memory_allocator->getStatistics(); }
+
 VkCommandBuffer VulkanHandler::beginSingleTimeCommands() {
   VkCommandBufferAllocateInfo allocInfo{};
   allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
@@ -890,13 +1642,10 @@ VkCommandBuffer VulkanHandler::beginSingleTimeCommands() {
 void VulkanHandler::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
   vkEndCommandBuffer(commandBuffer);
 
-  VkSubmitInfo submitInfo{};
-  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &commandBuffer;
-
-  vkQueueSubmit(m_graphics_queue, 1, &submitInfo, VK_NULL_HANDLE);
-  vkQueueWaitIdle(m_graphics_queue);
+  // Submit through the upload manager, such that we only wait for this command buffer instead of
+  // waiting for the whole queue to be idle.
+  uint64_t value = m_upload_manager->submit(commandBuffer);
+  m_upload_manager->wait(value);
 
   vkFreeCommandBuffers(m_device, m_command_pool, 1, &commandBuffer);
 }
@@ -0,0 +1,101 @@
+// XRe includes
+#include <xre/occlusion_culler.h>
+
+// GLM includes
+#include <glm/glm/gtc/matrix_transform.hpp>
+
+// Other includes
+#include <iostream>
+#include <vector>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const char *message) {
+  if (!condition) {
+    std::cerr << "FAILED: " << message << std::endl;
+    failures++;
+  }
+}
+
+AABB makeBox(const glm::vec3 &min, const glm::vec3 &max) {
+  AABB box;
+  box.extend(min);
+  box.extend(max);
+  return box;
+}
+
+// A single view at the origin, looking down -z
+glm::mat4 makeViewProjection() {
+  glm::mat4 projection = glm::perspective(glm::radians(90.0f), 1.0f, 0.1f, 100.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+  return projection * view;
+}
+
+// Rasterize a 4 x 4 quad facing the view at a distance of 5, and test a grid of boxes against it
+std::vector<bool> runCuller(bool asynchronous) {
+  const std::vector<glm::vec3> quad_positions = {{-2.0f, -2.0f, 0.0f}, {2.0f, -2.0f, 0.0f}, {2.0f, 2.0f, 0.0f}, {-2.0f, 2.0f, 0.0f}};
+  const std::vector<uint16_t> quad_indices = {0, 1, 2, 2, 3, 0};
+
+  OcclusionCuller culler;
+  culler.beginFrame({makeViewProjection()});
+  culler.addOccluder(quad_positions, quad_indices, glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -5.0f)));
+  if (asynchronous) {
+    culler.rasterizeAsync();
+  } else {
+    culler.rasterize();
+  }
+  culler.wait();
+
+  // Boxes fully behind the quad
+  std::vector<bool> results;
+  results.push_back(culler.isOccluded(makeBox({-0.5f, -0.5f, -10.0f}, {0.5f, 0.5f, -9.0f})));
+  results.push_back(culler.isOccluded(makeBox({-3.0f, -3.0f, -30.0f}, {3.0f, 3.0f, -20.0f})));
+
+  // Boxes in front of the quad
+  results.push_back(culler.isOccluded(makeBox({-0.5f, -0.5f, -3.0f}, {0.5f, 0.5f, -2.0f})));
+  results.push_back(culler.isOccluded(makeBox({-1.0f, -1.0f, -6.0f}, {1.0f, 1.0f, -4.0f})));
+
+  // Boxes beside the quad
+  results.push_back(culler.isOccluded(makeBox({5.0f, -0.5f, -10.0f}, {6.0f, 0.5f, -9.0f})));
+  results.push_back(culler.isOccluded(makeBox({-0.5f, 5.0f, -10.0f}, {0.5f, 6.0f, -9.0f})));
+
+  // Sweep a small box across the edge of the quad, which also exercises the per-pixel tests
+  for (int i = -20; i <= 20; i++) {
+    float x = static_cast<float>(i) * 0.25f;
+    results.push_back(culler.isOccluded(makeBox({x - 0.1f, -0.1f, -8.1f}, {x + 0.1f, 0.1f, -7.9f})));
+  }
+
+  return results;
+}
+
+} // namespace
+
+int main() {
+  std::vector<bool> results = runCuller(false);
+
+  check(results[0], "box behind the occluder is occluded");
+  check(results[1], "large box far behind the occluder is occluded");
+  check(!results[2], "box in front of the occluder is visible");
+  check(!results[3], "box intersecting the occluder is visible");
+  check(!results[4], "box beside the occluder (x) is visible");
+  check(!results[5], "box beside the occluder (y) is visible");
+
+  // The sweep covers boxes fully behind the quad as well as boxes next to it
+  check(!results[6], "box far left of the occluder in the sweep is visible");
+  check(results[6 + 20], "box in the center of the sweep is occluded");
+
+  // The result only depends on the inputs, no matter on which thread the occluders are rasterized
+  for (int run = 0; run < 4; run++) {
+    check(runCuller(run % 2 == 1) == results, "repeated runs give identical results");
+  }
+
+  if (failures > 0) {
+    std::cerr << failures << " checks failed" << std::endl;
+    return 1;
+  }
+
+  std::cout << "All checks passed" << std::endl;
+  return 0;
+}